@@ -122,12 +122,16 @@ const IntLiteral* resolve_to_int_literal(const Node* node);
 int64_t get_int_literal_value(IntLiteral, bool sign_extend);
 const FloatLiteral* resolve_to_float_literal(const Node* node);
 double get_float_literal_value(FloatLiteral);
+/// Whether @p node is itself a scalar literal, without looking through definitions like the resolve_ functions do
+bool is_literal(const Node* node);
 const char* get_string_literal(IrArena*, const Node*);
 
 String get_address_space_name(AddressSpace);
 /// Returns false iff pointers in that address space can contain different data at the same address
 /// (amongst threads in the same subgroup)
 bool is_addr_space_uniform(IrArena*, AddressSpace);
+/// Returns true for address spaces the shader can only read from, so their contents don't change during its execution
+bool is_addr_space_read_only(AddressSpace);
 
 const Node* lookup_annotation(const Node* decl, const char* name);
 const Node* lookup_annotation_list(Nodes, const char* name);
@@ -268,9 +272,28 @@ struct CompilerConfig_ {
     struct {
         bool emulate_subgroup_ops;
         bool emulate_subgroup_ops_extended_types;
+        /// Emulates subgroup shuffles by exchanging words through subgroup memory, for targets without native shuffles.
+        bool emulate_subgroup_shuffles;
         bool simt_to_explicit_simd;
         bool int64;
         bool decay_ptrs;
+        /// Spills uniform values to a stack in subgroup memory, where they take up room once per subgroup instead of once per invocation.
+        /// The subgroup shares that stack, so it is only used when no branch, call or join in the program can split the subgroup up.
+        bool uniform_stack;
+        /// Emulated physical memory is backed by arrays of words of this size, for each address space.
+        /// Data aligned to a whole word is accessed one word at a time, narrower data is read out of (and written back into) the word holding it,
+        /// which is only safe when no other invocation can write to that word at the same time.
+        struct {
+            IntSizes private_memory;
+            IntSizes subgroup_memory;
+            IntSizes shared_memory;
+        } emulated_word_size;
+        /// Places emulated memory in a global buffer allocated by the runtime, instead of arrays in the address space itself.
+        /// The buffer is interleaved by invocation (or by subgroup), such that neighbouring lanes accessing the same address touch consecutive words.
+        struct {
+            bool private_memory;
+            bool subgroup_memory;
+        } swizzled_global_memory;
     } lower;
 
     struct {
@@ -284,6 +307,45 @@ struct CompilerConfig_ {
             bool after_every_pass;
             bool delete_unused_instructions;
         } cleanup;
+        /// Call sites get inlined when the callee's size, minus the bonuses that apply, is under the threshold.
+        /// Sizes are counted in instructions, after the callee's own call sites were inlined.
+        struct {
+            uint32_t max_callee_size;
+            uint32_t max_caller_size;
+            uint32_t constant_argument_bonus;
+            uint32_t loop_depth_bonus;
+            /// calls that go through the tailcall dispatcher are much more expensive than leaf calls
+            uint32_t tail_call_bonus;
+            /// inlining is repeated until nothing changes, or for at most this many rounds
+            uint32_t max_rounds;
+        } inlining;
+        /// Structured loops that provably exit within max_trip_count iterations are fully unrolled if that takes at most max_size instructions,
+        /// otherwise they are unrolled by the largest factor that fits.
+        struct {
+            uint32_t max_trip_count;
+            uint32_t max_size;
+        } unrolling;
+        /// Callees of at most max_callee_size instructions get cloned for call sites passing them constants or uniform values,
+        /// up to max_clones clones for the whole module.
+        struct {
+            uint32_t max_clones;
+            uint32_t max_callee_size;
+        } specialization;
+        /// The top-level dispatcher checks for the likely_fns most frequently dispatched functions before falling back to a Match over the rest,
+        /// and with fallthrough, a function whose tail calls all go to the same function runs that one straight after if it's up next.
+        /// Frequencies are read from the profile file if there is one (a function name and a count per line), otherwise they're estimated from the call graph.
+        struct {
+            uint32_t likely_fns;
+            bool fallthrough;
+            String profile;
+        } dispatcher;
+        /// Matches are lowered to a binary tree of Ifs, save for clusters of at least min_cases keys that fill at least min_density_percent
+        /// of their range: these stay Matches, which the backends emit as native switches.
+        struct {
+            bool jump_tables;
+            uint32_t min_cases;
+            uint32_t min_density_percent;
+        } switch_lowering;
     } optimisations;
 
     struct {
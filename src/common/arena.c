@@ -40,19 +40,34 @@ void destroy_arena(Arena* arena) {
     free(arena);
 }
 
+static void reserve_block_slot(Arena* arena) {
+    assert(arena->nblocks <= arena->maxblocks);
+    // we need more storage for the block pointers themselves !
+    if (arena->nblocks == arena->maxblocks) {
+        arena->maxblocks *= 2;
+        arena->blocks = realloc(arena->blocks, arena->maxblocks * sizeof(void*));
+    }
+}
+
 void* arena_alloc(Arena* arena, size_t size) {
     size = round_up(size, (size_t) sizeof(max_align_t));
     if (size == 0)
         return NULL;
+    // oversized allocations get a dedicated block, slotted in before the current one so we keep bumping that one
+    if (size > alloc_size) {
+        reserve_block_slot(arena);
+        void* allocated = calloc(1, size);
+        if (arena->nblocks > 0) {
+            arena->blocks[arena->nblocks] = arena->blocks[arena->nblocks - 1];
+            arena->blocks[arena->nblocks - 1] = allocated;
+        } else
+            arena->blocks[0] = allocated;
+        arena->nblocks++;
+        return allocated;
+    }
     // arena is full
     if (size > arena->available) {
-        assert(arena->nblocks <= arena->maxblocks);
-        // we need more storage for the block pointers themselves !
-        if (arena->nblocks == arena->maxblocks) {
-            arena->maxblocks *= 2;
-            arena->blocks = realloc(arena->blocks, arena->maxblocks);
-        }
-
+        reserve_block_slot(arena);
         arena->blocks[arena->nblocks++] = malloc(alloc_size);
         arena->available = alloc_size;
     }
@@ -212,6 +212,61 @@ char* strip_path(const char* path) {
     return new;
 }
 
+uint16_t fp32_to_fp16_bits(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    uint32_t biased_exponent = (x >> 23) & 0xFF;
+    uint32_t mantissa = x & 0x7FFFFF;
+    // infinities and NaNs
+    if (biased_exponent == 0xFF)
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    int32_t exponent = (int32_t) biased_exponent - 127 + 15;
+    if (exponent >= 0x1F)
+        return sign | 0x7C00;
+    uint32_t shift = 13;
+    uint32_t half = 0;
+    if (exponent <= 0) {
+        // too small to be normal: shift the implicit one into the mantissa
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+    } else
+        half = exponent << 10;
+    half |= mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    // a carry out of the mantissa correctly bumps the exponent
+    if (remainder > halfway || (remainder == halfway && (half & 1)))
+        half++;
+    return sign | half;
+}
+
+float fp16_bits_to_fp32(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t x;
+    if (exponent == 0x1F)
+        x = sign | 0x7F800000 | (mantissa << 13);
+    else if (exponent == 0 && mantissa == 0)
+        x = sign;
+    else if (exponent == 0) {
+        // denormals are normal numbers in single precision
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        x = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    } else
+        x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
 void error_die() {
     abort();
 }
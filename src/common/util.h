@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 size_t apply_escape_codes(const char* src, size_t og_len, char* dst);
 
@@ -17,4 +18,8 @@ bool string_ends_with(const char* string, const char* suffix);
 
 char* strip_path(const char*);
 
+/// Converts to and from the bits of an IEEE half-precision float, rounding to the nearest even value.
+uint16_t fp32_to_fp16_bits(float);
+float fp16_bits_to_fp32(uint16_t);
+
 #endif
@@ -116,12 +116,28 @@ void cli_parse_compiler_config_args(CompilerConfig* config, int* pargc, char** a
             if (em == EmNone)
                 error("Unknown execution model: %s", argv[i]);
             config->specialization.execution_model = em;
+        } else if (strcmp(argv[i], "--dispatcher-profile") == 0) {
+            argv[i] = NULL;
+            i++;
+            if (i == argc)
+                error("Missing dispatcher profile file name");
+            config->optimisations.dispatcher.profile = argv[i];
         } else if (strcmp(argv[i], "--simt2d") == 0) {
             config->lower.simt_to_explicit_simd = true;
         } else if (strcmp(argv[i], "--print-internal") == 0) {
             config->logging.skip_internal = false;
         } else if (strcmp(argv[i], "--print-generated") == 0) {
             config->logging.skip_generated = false;
+        } else if (strcmp(argv[i], "--uniform-stack") == 0) {
+            config->lower.uniform_stack = true;
+        } else if (strcmp(argv[i], "--swizzle-private-memory") == 0) {
+            config->lower.swizzled_global_memory.private_memory = true;
+        } else if (strcmp(argv[i], "--swizzle-subgroup-memory") == 0) {
+            config->lower.swizzled_global_memory.subgroup_memory = true;
+        } else if (strcmp(argv[i], "--emulate-subgroup-shuffles") == 0) {
+            config->lower.emulate_subgroup_shuffles = true;
+        } else if (strcmp(argv[i], "--lower-int64") == 0) {
+            config->lower.int64 = true;
         } else if (strcmp(argv[i], "--no-physical-global-ptrs") == 0) {
             config->hacks.no_physical_global_ptrs = true;
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
@@ -144,6 +160,12 @@ void cli_parse_compiler_config_args(CompilerConfig* config, int* pargc, char** a
 #undef EM
         error_print("  --subgroup-size N                         Sets the subgroup size the program will be specialized for.\n");
         error_print("  --lift-join-points                        Forcefully lambda-lifts all join points. Can help with reconvergence issues.\n");
+        error_print("  --uniform-stack                           Spills uniform values once per subgroup, in programs where control flow never diverges.\n");
+        error_print("  --swizzle-private-memory                  Places emulated private memory in a global buffer, interleaved by invocation.\n");
+        error_print("  --swizzle-subgroup-memory                 Places emulated subgroup memory in a global buffer, interleaved by subgroup.\n");
+        error_print("  --emulate-subgroup-shuffles               Exchanges values through subgroup memory instead of using native shuffles.\n");
+        error_print("  --lower-int64                             Emulates 64-bit integers with pairs of 32-bit ones, for devices without Int64.\n");
+        error_print("  --dispatcher-profile <file>               Orders the top-level dispatcher using call counts, one '<function> <count>' per line.\n");
     }
 
     cli_pack_remaining_args(pargc, argv);
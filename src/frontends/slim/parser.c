@@ -774,7 +774,7 @@ static const Node* accept_terminator(ctxparams, Node* fn) {
             expect(accept_token(ctx, rpar_tok));
 
             return br_switch(arena, (Switch) {
-                .switch_value = first(values),
+                .switch_value = inspectee,
                 .case_values = values,
                 .case_jumps = cases,
                 .default_jump = default_jump,
@@ -51,6 +51,28 @@ static void bind_program_resources(VkrCommand* cmd, VkrSpecProgram* prog) {
     vkCmdBindDescriptorSets(cmd->cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, prog->layout, 0, bind_sets_count, bind_sets, 0, NULL);
 }
 
+/// Swizzled memory has room for every invocation of the dispatch, so it might need to grow
+static bool prepare_swizzled_memory(VkrSpecProgram* prog, int dimx, int dimy, int dimz) {
+    for (size_t i = 0; i < prog->resources.num_resources; i++) {
+        ProgramResourceInfo* resource = prog->resources.resources[i];
+        if (!resource->size_per_workgroup)
+            continue;
+
+        size_t size = resource->size_per_workgroup * dimx * dimy * dimz;
+        if (resource->buffer && resource->buffer->size >= size)
+            continue;
+        if (resource->buffer) {
+            // earlier dispatches might still be using the old buffer
+            CHECK_VK(vkDeviceWaitIdle(prog->device->device), return false);
+            destroy_buffer((Buffer*) resource->buffer);
+        }
+        resource->buffer = vkr_allocate_buffer_device(prog->device, size);
+        if (!resource->buffer)
+            return false;
+    }
+    return true;
+}
+
 static Command make_command_base() {
     return (Command) {
             .wait_for_completion = (bool(*)(Command*)) vkr_wait_completion,
@@ -61,6 +83,8 @@ VkrCommand* vkr_launch_kernel(VkrDevice* device, Program* program, String entry_
     assert(program && device);
 
     VkrSpecProgram* prog = get_specialized_program(program, entry_point, device);
+    if (!prepare_swizzled_memory(prog, dimx, dimy, dimz))
+        return NULL;
 
     debug_print("Dispatching kernel on %s\n", device->caps.properties.base.properties.deviceName);
 
@@ -215,6 +215,9 @@ struct ProgramResourceInfo_ {
     VkrBuffer* buffer;
 
     char* default_data;
+
+    /// Swizzled emulated memory is (re)allocated at dispatch time, as its size scales with the number of workgroups
+    size_t size_per_workgroup;
 };
 
 typedef struct {
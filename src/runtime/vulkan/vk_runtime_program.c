@@ -145,6 +145,26 @@ VkDescriptorType as_to_descriptor_type(AddressSpace as) {
     }
 }
 
+/// How many slots of swizzled memory a workgroup needs: one per invocation for private memory, one per subgroup for subgroup memory
+static size_t get_swizzled_slots_per_workgroup(VkrSpecProgram* program, AddressSpace as) {
+    const Node* entry_point = get_declaration(program->specialized_module, program->key.entry_point);
+    assert(entry_point);
+    Nodes wg_size = get_annotation_values(lookup_annotation(entry_point, "WorkgroupSize"));
+    assert(wg_size.count == 3);
+    size_t invocations = 1;
+    for (size_t i = 0; i < 3; i++)
+        invocations *= get_int_literal_value(*resolve_to_int_literal(wg_size.nodes[i]), false);
+
+    // the driver may pick any subgroup size in the supported range, we need enough room for the worst case
+    size_t max_subgroup_size = program->device->caps.subgroup_size.max;
+    size_t min_subgroup_size = program->device->caps.subgroup_size.min;
+    switch (as) {
+        case AsPrivatePhysical: return (invocations + max_subgroup_size - 1) / max_subgroup_size * max_subgroup_size;
+        case AsSubgroupPhysical: return (invocations + min_subgroup_size - 1) / min_subgroup_size;
+        default: error("Unexpected swizzled address space");
+    }
+}
+
 static bool extract_resources_layout(VkrSpecProgram* program, VkDescriptorSetLayout layouts[]) {
     VkDescriptorSetLayoutCreateInfo layout_create_infos[MAX_DESCRIPTOR_SETS] = { 0 };
     Growy* bindings_lists[MAX_DESCRIPTOR_SETS] = { 0 };
@@ -203,6 +223,42 @@ static bool extract_resources_layout(VkrSpecProgram* program, VkDescriptorSetLay
             else
                 res_info->staging = calloc(1, res_info->size);
 
+            VkDescriptorSetLayoutBinding vk_binding = {
+                .binding = binding,
+                .descriptorType = as_to_descriptor_type(as),
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_ALL,
+                .pImmutableSamplers = NULL,
+            };
+            register_required_descriptors(program, &vk_binding);
+            add_binding(layout_create_infos, bindings_lists, set, vk_binding);
+        } else if (lookup_annotation(decl, "SwizzledMemory")) {
+            AddressSpace as = decl->payload.global_variable.address_space;
+            assert(as == AsShaderStorageBufferObject);
+
+            int set = get_int_literal_value(*resolve_to_int_literal(get_annotation_value(lookup_annotation(decl, "DescriptorSet"))), false);
+            int binding = get_int_literal_value(*resolve_to_int_literal(get_annotation_value(lookup_annotation(decl, "DescriptorBinding"))), false);
+
+            Nodes swizzling = get_annotation_values(lookup_annotation(decl, "SwizzledMemory"));
+            assert(swizzling.count == 2);
+            AddressSpace emulated_as = get_int_literal_value(*resolve_to_int_literal(swizzling.nodes[0]), false);
+            const IntLiteral* slot_size = resolve_to_int_literal(swizzling.nodes[1]);
+            if (!slot_size) {
+                error_print("the size of swizzled memory for %s is not known at compile time\n", get_address_space_name(emulated_as));
+                return false;
+            }
+
+            ProgramResourceInfo* res_info = arena_alloc(program->arena, sizeof(ProgramResourceInfo));
+            *res_info = (ProgramResourceInfo) {
+                .is_bound = true,
+                .as = as,
+                .set = set,
+                .binding = binding,
+                .size_per_workgroup = get_int_literal_value(*slot_size, false) * get_swizzled_slots_per_workgroup(program, emulated_as),
+            };
+            growy_append_object(resources, res_info);
+            program->resources.num_resources++;
+
             VkDescriptorSetLayoutBinding vk_binding = {
                 .binding = binding,
                 .descriptorType = as_to_descriptor_type(as),
@@ -309,8 +365,22 @@ static CompilerConfig get_compiler_config_for_device(VkrDevice* device, const Co
     if (!device->caps.features.subgroup_extended_types.shaderSubgroupExtendedTypes)
         config.lower.emulate_subgroup_ops_extended_types = true;
 
+    VkSubgroupFeatureFlags shuffles = VK_SUBGROUP_FEATURE_SHUFFLE_BIT | VK_SUBGROUP_FEATURE_SHUFFLE_RELATIVE_BIT;
+    if ((device->caps.properties.subgroup.supportedOperations & shuffles) != shuffles)
+        config.lower.emulate_subgroup_shuffles = true;
+
     config.lower.int64 = !device->caps.features.base.features.shaderInt64;
 
+    // emulated memory is made of narrow words by default, which the device might not be able to do arithmetic on
+    IntSizes narrowest_int = IntTy8;
+    if (!device->caps.features.float_16_int8.shaderInt8)
+        narrowest_int = device->caps.features.base.features.shaderInt16 ? IntTy16 : IntTy32;
+    IntSizes* word_sizes[] = { &config.lower.emulated_word_size.private_memory, &config.lower.emulated_word_size.subgroup_memory, &config.lower.emulated_word_size.shared_memory };
+    for (size_t i = 0; i < sizeof(word_sizes) / sizeof(word_sizes[0]); i++) {
+        if (*word_sizes[i] < narrowest_int)
+            *word_sizes[i] = narrowest_int;
+    }
+
     if (device->caps.implementation.is_moltenvk) {
         warn_print("Hack: MoltenVK says they supported subgroup extended types, but it's a lie. 64-bit types are unaccounted for !\n");
         config.lower.emulate_subgroup_ops_extended_types = true;
@@ -384,6 +454,10 @@ static bool prepare_resources(VkrSpecProgram* program) {
     for (size_t i = 0; i < program->resources.num_resources; i++) {
         ProgramResourceInfo* resource = program->resources.resources[i];
 
+        // allocated when dispatching, see prepare_swizzled_memory
+        if (resource->size_per_workgroup)
+            continue;
+
         if (resource->host_backed_allocation) {
             assert(vkr_can_import_host_memory(program->device));
             resource->host_ptr = alloc_aligned(resource->size, program->device->caps.properties.external_memory_host.minImportedHostPointerAlignment);
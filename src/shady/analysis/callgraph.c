@@ -41,9 +41,6 @@ static const Node* ignore_immediate_fn_addr(const Node* node) {
 static void visit_callsite(CGVisitor* visitor, const Node* callee, const Node* instr) {
     assert(callee->tag == Function_TAG);
     CGNode* target = analyze_fn(visitor->graph, callee);
-    // Immediate recursion
-    if (target == visitor->root)
-        visitor->root->is_recursive = true;
     CGEdge edge = {
         .src_fn = visitor->root,
         .dst_fn = target,
@@ -64,12 +61,15 @@ static void search_for_callsites(CGVisitor* visitor, const Node* node) {
         case BasicBlock_TAG:
         case Case_TAG: {
             const Node* old_abs = visitor->abs;
+            visitor->abs = node;
             visit_node_operands(&visitor->visitor, IGNORE_ABSTRACTIONS_MASK, node);
             visitor->abs = old_abs;
             break;
         }
         case FnAddr_TAG: {
             CGNode* callee_node = analyze_fn(visitor->graph, node->payload.fn_addr.fn);
+            append_list(CGNode*, visitor->root->captures, callee_node);
+            callee_node->captures_count++;
             callee_node->is_address_captured = true;
             break;
         }
@@ -97,24 +97,14 @@ static void search_for_callsites(CGVisitor* visitor, const Node* node) {
     }
 }
 
-static CGNode* analyze_fn(CallGraph* graph, const Node* fn) {
-    assert(fn && fn->tag == Function_TAG);
-    CGNode** found = find_value_dict(const Node*, CGNode*, graph->fn2cgn, fn);
-    if (found)
-        return *found;
-    CGNode* new = calloc(1, sizeof(CGNode));
-    new->fn = fn;
-    new->callees = new_set(CGEdge, (HashFn) hash_cgedge, (CmpFn) compare_cgedge);
-    new->callers = new_set(CGEdge, (HashFn) hash_cgedge, (CmpFn) compare_cgedge);
-    new->tarjan.index = -1;
-    insert_dict_and_get_key(const Node*, CGNode*, graph->fn2cgn, fn, new);
-
+static void scan_fn(CallGraph* graph, CGNode* node) {
+    const Node* fn = node->fn;
     CGVisitor v = {
         .visitor = {
             .visit_node_fn = (VisitNodeFn) search_for_callsites
         },
         .graph = graph,
-        .root = new,
+        .root = node,
         .abs = fn,
     };
 
@@ -122,7 +112,42 @@ static CGNode* analyze_fn(CallGraph* graph, const Node* fn) {
         search_for_callsites(&v, fn->payload.fun.body);
         visit_function_rpo(&v.visitor, fn);
     }
+    graph->sccs_dirty = true;
+}
 
+/// Removes everything this function contributed to the graph: its outgoing edges and the addresses it captured
+static void forget_fn_body(CGNode* node) {
+    size_t i = 0;
+    CGEdge e;
+    while (dict_iter(node->callees, &i, &e, NULL)) {
+        bool removed = remove_dict(CGEdge, e.dst_fn->callers, e);
+        assert(removed);
+    }
+    clear_dict(node->callees);
+
+    for (size_t j = 0; j < entries_count_list(node->captures); j++) {
+        CGNode* captured = read_list(CGNode*, node->captures)[j];
+        assert(captured->captures_count > 0);
+        captured->captures_count--;
+        captured->is_address_captured = captured->captures_count > 0;
+    }
+    clear_list(node->captures);
+}
+
+static CGNode* analyze_fn(CallGraph* graph, const Node* fn) {
+    assert(fn && fn->tag == Function_TAG);
+    CGNode** found = find_value_dict(const Node*, CGNode*, graph->fn2cgn, fn);
+    if (found)
+        return *found;
+    CGNode* new = calloc(1, sizeof(CGNode));
+    new->fn = fn;
+    new->callees = new_set(CGEdge, (HashFn) hash_cgedge, (CmpFn) compare_cgedge);
+    new->callers = new_set(CGEdge, (HashFn) hash_cgedge, (CmpFn) compare_cgedge);
+    new->captures = new_list(CGNode*);
+    new->tarjan.index = -1;
+    insert_dict_and_get_key(const Node*, CGNode*, graph->fn2cgn, fn, new);
+
+    scan_fn(graph, new);
     return new;
 }
 
@@ -140,7 +165,7 @@ static CGNode* analyze_fn(CallGraph* graph, const Node* fn) {
 static int min(int a, int b) { return a < b ? a : b; }
 
 // https://en.wikipedia.org/wiki/Tarjan%27s_strongly_connected_components_algorithm
-static void strongconnect(CGNode* v, int* index, struct List* stack) {
+static void strongconnect(CGNode* v, int* index, struct List* stack, struct List* bottom_up, size_t* scc_index) {
     debugv_print("strongconnect(%s) \n", v->fn->payload.fun.name);
 
     v->tarjan.index = *index;
@@ -156,9 +181,12 @@ static void strongconnect(CGNode* v, int* index, struct List* stack) {
         debugv_print(" has %d successors\n", entries_count_dict(v->callees));
         while (dict_iter(v->callees, &iter, &e, NULL)) {
             debugv_print("  %s\n", e.dst_fn->fn->payload.fun.name);
+            // Immediate recursion
+            if (e.dst_fn == v)
+                v->is_recursive = true;
             if (e.dst_fn->tarjan.index == -1) {
                 // Successor w has not yet been visited; recurse on it
-                strongconnect(e.dst_fn, index, stack);
+                strongconnect(e.dst_fn, index, stack, bottom_up, scc_index);
                 v->tarjan.lowlink = min(v->tarjan.lowlink, e.dst_fn->tarjan.lowlink);
             } else if (e.dst_fn->tarjan.on_stack) {
                 // Successor w is in stack S and hence in the current SCC
@@ -171,6 +199,7 @@ static void strongconnect(CGNode* v, int* index, struct List* stack) {
     }
 
     // If v is a root node, pop the stack and generate an SCC
+    // SCCs come out in reverse topological order, which is exactly the bottom-up order we want to cache
     if (v->tarjan.lowlink == v->tarjan.index) {
         LARRAY(CGNode*, scc, entries_count_list(stack));
         size_t scc_size = 0;
@@ -180,9 +209,12 @@ static void strongconnect(CGNode* v, int* index, struct List* stack) {
             do {
                 w = pop_last_list(CGNode*, stack);
                 w->tarjan.on_stack = false;
+                w->scc = *scc_index;
                 scc[scc_size++] = w;
+                append_list(CGNode*, bottom_up, w);
             } while (v != w);
         }
+        (*scc_index)++;
 
         if (scc_size > 1) {
             for (size_t i = 0; i < scc_size; i++) {
@@ -194,24 +226,40 @@ static void strongconnect(CGNode* v, int* index, struct List* stack) {
     }
 }
 
-static void tarjan(struct Dict* verts) {
+static void tarjan(CallGraph* graph) {
     int index = 0;
+    size_t scc_index = 0;
     struct List* stack = new_list(CGNode*);
 
     size_t iter = 0;
     CGNode* n;
-    while (dict_iter(verts, &iter, NULL, &n)) {
+    while (dict_iter(graph->fn2cgn, &iter, NULL, &n)) {
+        n->tarjan.index = -1;
+        n->tarjan.on_stack = false;
+        n->is_recursive = false;
+    }
+    clear_list(graph->bottom_up);
+
+    iter = 0;
+    while (dict_iter(graph->fn2cgn, &iter, NULL, &n)) {
         if (n->tarjan.index == -1)
-            strongconnect(n, &index, stack);
+            strongconnect(n, &index, stack, graph->bottom_up, &scc_index);
     }
 
     destroy_list(stack);
+    graph->sccs_dirty = false;
+}
+
+static void refresh_sccs(CallGraph* graph) {
+    if (graph->sccs_dirty)
+        tarjan(graph);
 }
 
 CallGraph* new_callgraph(Module* mod) {
     CallGraph* graph = calloc(sizeof(CallGraph), 1);
     *graph = (CallGraph) {
-        .fn2cgn = new_dict(const Node*, CGNode*, (HashFn) hash_node, (CmpFn) compare_node)
+        .fn2cgn = new_dict(const Node*, CGNode*, (HashFn) hash_node, (CmpFn) compare_node),
+        .bottom_up = new_list(CGNode*),
     };
 
     Nodes decls = get_module_declarations(mod);
@@ -223,11 +271,52 @@ CallGraph* new_callgraph(Module* mod) {
 
     debugv_print("CallGraph: done with CFG build, contains %d nodes\n", entries_count_dict(graph->fn2cgn));
 
-    tarjan(graph->fn2cgn);
+    tarjan(graph);
 
     return graph;
 }
 
+CGNode* callgraph_lookup(CallGraph* graph, const Node* fn) {
+    refresh_sccs(graph);
+    CGNode** found = find_value_dict(const Node*, CGNode*, graph->fn2cgn, fn);
+    assert(found && "function is not part of the callgraph");
+    return *found;
+}
+
+CGNode* callgraph_update_fn(CallGraph* graph, const Node* fn) {
+    assert(fn && fn->tag == Function_TAG);
+    CGNode** found = find_value_dict(const Node*, CGNode*, graph->fn2cgn, fn);
+    if (!found)
+        return analyze_fn(graph, fn);
+
+    CGNode* node = *found;
+    forget_fn_body(node);
+    scan_fn(graph, node);
+    return node;
+}
+
+void callgraph_remove_fn(CallGraph* graph, const Node* fn) {
+    CGNode** found = find_value_dict(const Node*, CGNode*, graph->fn2cgn, fn);
+    if (!found)
+        return;
+    CGNode* node = *found;
+    forget_fn_body(node);
+    if (entries_count_dict(node->callers) > 0 || node->captures_count > 0)
+        error("Can't remove %s from the callgraph, it is still in use", get_abstraction_name(fn));
+
+    remove_dict(const Node*, graph->fn2cgn, fn);
+    destroy_dict(node->callers);
+    destroy_dict(node->callees);
+    destroy_list(node->captures);
+    free(node);
+    graph->sccs_dirty = true;
+}
+
+struct List* callgraph_bottom_up_order(CallGraph* graph) {
+    refresh_sccs(graph);
+    return graph->bottom_up;
+}
+
 void destroy_callgraph(CallGraph* graph) {
     size_t i = 0;
     CGNode* node;
@@ -235,8 +324,10 @@ void destroy_callgraph(CallGraph* graph) {
         debugv_print("Freeing CG node: %s\n", node->fn->payload.fun.name);
         destroy_dict(node->callers);
         destroy_dict(node->callees);
+        destroy_list(node->captures);
         free(node);
     }
     destroy_dict(graph->fn2cgn);
+    destroy_list(graph->bottom_up);
     free(graph);
 }
@@ -16,21 +16,45 @@ struct CGNode_ {
     const Node* fn;
     struct Dict* callers;
     struct Dict* callees;
+    /// @ref List of @ref CGNode* whose address this function captures, one entry per FnAddr
+    struct List* captures;
     struct {
         int index, lowlink;
         bool on_stack;
     } tarjan;
+    /// Index of the strongly connected component this belongs to, components are numbered bottom-up
+    size_t scc;
 
     bool is_recursive;
     /// set to true if the address of this is captured by a FnAddr node that is not immediately consumed by a call
     bool is_address_captured;
+    /// number of FnAddr nodes capturing this, across all the functions in the graph
+    size_t captures_count;
 };
 
 typedef struct Callgraph_ {
     struct Dict* fn2cgn;
+    /// @ref List of @ref CGNode*, callees come before their callers (save for recursion), see @ref callgraph_bottom_up_order
+    struct List* bottom_up;
+    /// set when functions were updated since the SCCs were last computed
+    bool sccs_dirty;
 } CallGraph;
 
 CallGraph* new_callgraph(Module*);
 void destroy_callgraph(CallGraph*);
 
+/// Looks up the node for a function, making sure the recursion info is up to date
+CGNode* callgraph_lookup(CallGraph*, const Node* fn);
+
+/// Rescans the body of a function that was added or modified since the graph was built.
+/// Only the edges out of that function are recomputed, the SCCs are refreshed lazily on the next query.
+CGNode* callgraph_update_fn(CallGraph*, const Node* fn);
+/// Forgets about a function that has no remaining callers
+void callgraph_remove_fn(CallGraph*, const Node* fn);
+
+/// All the functions in the graph, ordered such that callees are visited before their callers
+/// Members of the same recursive cycle are adjacent, in no particular order.
+/// The returned list is owned by the graph and is invalidated by updates.
+struct List* callgraph_bottom_up_order(CallGraph*);
+
 #endif
@@ -64,8 +64,8 @@ static void visit_domtree(Context* ctx, CFNode* cfnode, int depth) {
     if (body)
         visit_op(&ctx->visitor, NcTerminator, "body", body);
 
-    for (size_t i = 0; i < entries_count_list(cfnode->dominates); i++) {
-        CFNode* child = read_list(CFNode*, cfnode->dominates)[i];
+    for (size_t i = 0; i < cfnode->dominates.count; i++) {
+        CFNode* child = cfnode->dominates.nodes[i];
         visit_domtree(ctx, child, depth + (is_named ? 1 : 0));
     }
 
@@ -50,9 +50,9 @@ LTNode* new_lf_node(int type, LTNode* parent, int depth, struct List* cf_nodes)
 
 static bool is_leaf(LoopTreeBuilder* ltb, const CFNode* n, size_t num) {
     if (num == 1) {
-        struct List* succ_edges = n->succ_edges;
-        for (size_t i = 0; i < entries_count_list(succ_edges); i++) {
-            CFEdge e = read_list(CFEdge, succ_edges)[i];
+        CFEdges succ_edges = n->succ_edges;
+        for (size_t i = 0; i < succ_edges.count; i++) {
+            CFEdge e = succ_edges.edges[i];
             CFNode* succ = e.dst;
             if (!is_head(ltb, succ) && n == succ)
                 return false;
@@ -78,8 +78,8 @@ static int visit(LoopTreeBuilder* ltb, const CFNode* n, int counter) {
 static int walk_scc(LoopTreeBuilder* ltb, const CFNode* cur, LTNode* parent, int depth, int scc_counter) {
     scc_counter = visit(ltb, cur, scc_counter);
 
-    for (size_t succi = 0; succi < entries_count_list(cur->succ_edges); succi++) {
-        CFEdge succe = read_list(CFEdge, cur->succ_edges)[succi];
+    for (size_t succi = 0; succi < cur->succ_edges.count; succi++) {
+        CFEdge succe = cur->succ_edges.edges[succi];
         CFNode* succ = succe.dst;
         if (is_head(ltb, succ))
             continue; // this is a backedge
@@ -110,9 +110,9 @@ static int walk_scc(LoopTreeBuilder* ltb, const CFNode* cur, LTNode* parent, int
             if (ltb->s->entry == n) {
                 append_list(const CFNode*, heads, n); // entries are axiomatically heads
             } else {
-                for (size_t j = 0; j < entries_count_list(n->pred_edges); j++) {
-                    assert(n == read_list(CFEdge, n->pred_edges)[j].dst);
-                    const CFNode* pred = read_list(CFEdge, n->pred_edges)[j].src;
+                for (size_t j = 0; j < n->pred_edges.count; j++) {
+                    assert(n == n->pred_edges.edges[j].dst);
+                    const CFNode* pred = n->pred_edges.edges[j].src;
                     // all backedges are also inducing heads
                     // but do not yet mark them globally as head -- we are still running through the SCC
                     if (!in_scc(ltb, pred)) {
@@ -29,13 +29,23 @@ struct List* build_scopes(Module* mod) {
 KeyHash hash_node(const Node**);
 bool compare_node(const Node**, const Node**);
 
+/// Edges are first collected as index pairs, and laid out into per-node ranges once the scope is complete
+typedef struct {
+    CFEdgeType type;
+    size_t src, dst;
+} BuildEdge;
+
 typedef struct {
-    Arena* arena;
     const Node* entry;
     LoopTree* lt;
+    /// @ref Dict from const @ref Node* to size_t indices into @ref contents
     struct Dict* nodes;
+    /// @ref List of size_t
     struct List* queue;
+    /// @ref List of const @ref Node*
     struct List* contents;
+    /// @ref List of @ref BuildEdge
+    struct List* edges;
 
     struct Dict* join_point_values;
 } ScopeBuildContext;
@@ -50,26 +60,16 @@ CFNode* scope_lookup(Scope* scope, const Node* block) {
     return NULL;
 }
 
-static CFNode* get_or_enqueue(ScopeBuildContext* ctx, const Node* abs) {
+static size_t get_or_enqueue(ScopeBuildContext* ctx, const Node* abs) {
     assert(is_abstraction(abs));
     assert(!is_function(abs) || abs == ctx->entry);
-    CFNode** found = find_value_dict(const Node*, CFNode*, ctx->nodes, abs);
+    size_t* found = find_value_dict(const Node*, size_t, ctx->nodes, abs);
     if (found) return *found;
 
-    CFNode* new = arena_alloc(ctx->arena, sizeof(CFNode));
-    *new = (CFNode) {
-        .node = abs,
-        .succ_edges = new_list(CFEdge),
-        .pred_edges = new_list(CFEdge),
-        .rpo_index = SIZE_MAX,
-        .idom = NULL,
-        .dominates = NULL,
-        .structurally_dominates = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
-    };
-    assert(abs && new->node);
-    insert_dict(const Node*, CFNode*, ctx->nodes, abs, new);
-    append_list(Node*, ctx->queue, new);
-    append_list(Node*, ctx->contents, new);
+    size_t new = entries_count_list(ctx->contents);
+    insert_dict(const Node*, size_t, ctx->nodes, abs, new);
+    append_list(size_t, ctx->queue, new);
+    append_list(const Node*, ctx->contents, abs);
     return new;
 }
 
@@ -104,20 +104,12 @@ static void add_edge(ScopeBuildContext* ctx, const Node* src, const Node* dst, C
     if (ctx->lt && dst == ctx->entry)
         return;
 
-    CFNode* src_node = get_or_enqueue(ctx, src);
-    CFNode* dst_node = get_or_enqueue(ctx, dst);
-    CFEdge edge = {
+    BuildEdge edge = {
         .type = type,
-        .src = src_node,
-        .dst = dst_node,
+        .src = get_or_enqueue(ctx, src),
+        .dst = get_or_enqueue(ctx, dst),
     };
-    append_list(CFEdge, src_node->succ_edges, edge);
-    append_list(CFEdge, dst_node->pred_edges, edge);
-}
-
-static void add_structural_dominance_edge(ScopeBuildContext* ctx, CFNode* parent, const Node* dst, CFEdgeType type) {
-    add_edge(ctx, parent->node, dst, type);
-    insert_set_get_result(const Node*, parent->structurally_dominates, dst);
+    append_list(BuildEdge, ctx->edges, edge);
 }
 
 static void add_jump_edge(ScopeBuildContext* ctx, const Node* src, const Node* j) {
@@ -126,43 +118,42 @@ static void add_jump_edge(ScopeBuildContext* ctx, const Node* src, const Node* j
     add_edge(ctx, src, target, JumpEdge);
 }
 
-static void process_instruction(ScopeBuildContext* ctx, CFNode* parent, const Node* instruction, const Node* let_tail) {
+static void process_instruction(ScopeBuildContext* ctx, const Node* parent, const Node* instruction, const Node* let_tail) {
     switch (is_instruction(instruction)) {
         case NotAnInstruction: error("Grammar problem");
         case Instruction_Call_TAG:
         case Instruction_PrimOp_TAG:
         case Instruction_Comment_TAG:
-            add_structural_dominance_edge(ctx, parent, let_tail, LetTailEdge);
+            add_edge(ctx, parent, let_tail, LetTailEdge);
             return;
         case Instruction_Block_TAG:
-            add_structural_dominance_edge(ctx, parent, instruction->payload.block.inside, StructuredEnterBodyEdge);
-            add_structural_dominance_edge(ctx, parent, let_tail, LetTailEdge);
+            add_edge(ctx, parent, instruction->payload.block.inside, StructuredEnterBodyEdge);
+            add_edge(ctx, parent, let_tail, LetTailEdge);
             return;
         case Instruction_If_TAG:
-            add_structural_dominance_edge(ctx, parent, instruction->payload.if_instr.if_true, StructuredEnterBodyEdge);
+            add_edge(ctx, parent, instruction->payload.if_instr.if_true, StructuredEnterBodyEdge);
             if(instruction->payload.if_instr.if_false)
-                add_structural_dominance_edge(ctx, parent, instruction->payload.if_instr.if_false, StructuredEnterBodyEdge);
+                add_edge(ctx, parent, instruction->payload.if_instr.if_false, StructuredEnterBodyEdge);
             break;
         case Instruction_Match_TAG:
             for (size_t i = 0; i < instruction->payload.match_instr.cases.count; i++)
-                add_structural_dominance_edge(ctx, parent, instruction->payload.match_instr.cases.nodes[i], StructuredEnterBodyEdge);
-            add_structural_dominance_edge(ctx, parent, instruction->payload.match_instr.default_case, StructuredEnterBodyEdge);
+                add_edge(ctx, parent, instruction->payload.match_instr.cases.nodes[i], StructuredEnterBodyEdge);
+            add_edge(ctx, parent, instruction->payload.match_instr.default_case, StructuredEnterBodyEdge);
             break;
         case Instruction_Loop_TAG:
-            add_structural_dominance_edge(ctx, parent, instruction->payload.loop_instr.body, StructuredEnterBodyEdge);
+            add_edge(ctx, parent, instruction->payload.loop_instr.body, StructuredEnterBodyEdge);
             break;
         case Instruction_Control_TAG:
-            add_structural_dominance_edge(ctx, parent, instruction->payload.control.inside, StructuredEnterBodyEdge);
+            add_edge(ctx, parent, instruction->payload.control.inside, StructuredEnterBodyEdge);
             const Node* param = first(get_abstraction_params(instruction->payload.control.inside));
-            CFNode* let_tail_cfnode = get_or_enqueue(ctx, let_tail);
-            insert_dict(const Node*, CFNode*, ctx->join_point_values, param, let_tail_cfnode);
+            size_t let_tail_index = get_or_enqueue(ctx, let_tail);
+            insert_dict(const Node*, size_t, ctx->join_point_values, param, let_tail_index);
             break;
     }
-    add_structural_dominance_edge(ctx, parent, let_tail, StructuredPseudoExitEdge);
+    add_edge(ctx, parent, let_tail, StructuredPseudoExitEdge);
 }
 
-static void process_cf_node(ScopeBuildContext* ctx, CFNode* node) {
-    const Node* const abs = node->node;
+static void process_cf_node(ScopeBuildContext* ctx, const Node* abs) {
     assert(is_abstraction(abs));
     assert(!is_function(abs) || abs == ctx->entry);
     const Node* terminator = get_abstraction_body(abs);
@@ -172,7 +163,7 @@ static void process_cf_node(ScopeBuildContext* ctx, CFNode* node) {
         case LetMut_TAG:
         case Let_TAG: {
             const Node* target = get_let_tail(terminator);
-            process_instruction(ctx, node, get_let_instruction(terminator), target);
+            process_instruction(ctx, abs, get_let_instruction(terminator), target);
             break;
         }
         case Jump_TAG: {
@@ -191,9 +182,9 @@ static void process_cf_node(ScopeBuildContext* ctx, CFNode* node) {
             break;
         }
         case Join_TAG: {
-            CFNode** dst = find_value_dict(const Node*, CFNode*, ctx->join_point_values, terminator->payload.join.join_point);
+            size_t* dst = find_value_dict(const Node*, size_t, ctx->join_point_values, terminator->payload.join.join_point);
             if (dst)
-                add_edge(ctx, node->node, (*dst)->node, StructuredLeaveBodyEdge);
+                add_edge(ctx, abs, read_list(const Node*, ctx->contents)[*dst], StructuredLeaveBodyEdge);
             break;
         }
         case Yield_TAG:
@@ -208,84 +199,119 @@ static void process_cf_node(ScopeBuildContext* ctx, CFNode* node) {
     }
 }
 
+/// Lays out the collected edges into contiguous successor and predecessor ranges for each node (CSR style)
+static void layout_edges(Scope* scope, struct List* edges) {
+    size_t edges_count = entries_count_list(edges);
+    BuildEdge* build_edges = read_list(BuildEdge, edges);
+
+    for (size_t i = 0; i < edges_count; i++) {
+        scope->contents[build_edges[i].src].succ_edges.count++;
+        scope->contents[build_edges[i].dst].pred_edges.count++;
+    }
+
+    CFEdge* succ_edges = arena_alloc(scope->arena, sizeof(CFEdge) * edges_count);
+    CFEdge* pred_edges = arena_alloc(scope->arena, sizeof(CFEdge) * edges_count);
+    size_t succ_offset = 0, pred_offset = 0;
+    for (size_t i = 0; i < scope->size; i++) {
+        CFNode* n = &scope->contents[i];
+        n->succ_edges.edges = succ_edges + succ_offset;
+        n->pred_edges.edges = pred_edges + pred_offset;
+        succ_offset += n->succ_edges.count;
+        pred_offset += n->pred_edges.count;
+        // recounted below as we fill the ranges
+        n->succ_edges.count = 0;
+        n->pred_edges.count = 0;
+    }
+
+    // edges keep their insertion order within each range
+    for (size_t i = 0; i < edges_count; i++) {
+        CFNode* src = &scope->contents[build_edges[i].src];
+        CFNode* dst = &scope->contents[build_edges[i].dst];
+        CFEdge edge = {
+            .type = build_edges[i].type,
+            .src = src,
+            .dst = dst,
+        };
+        src->succ_edges.edges[src->succ_edges.count++] = edge;
+        dst->pred_edges.edges[dst->pred_edges.count++] = edge;
+    }
+}
+
+static void swap_edges(CFEdges edges) {
+    for (size_t i = 0; i < edges.count; i++) {
+        CFEdge* edge = &edges.edges[i];
+        CFNode* tmp = edge->dst;
+        edge->dst = edge->src;
+        edge->src = tmp;
+    }
+}
+
 /**
  * Invert all edges in this scope. Used to compute a post dominance tree.
  */
 static void flip_scope(Scope* scope) {
     scope->entry = NULL;
 
+    size_t exits_count = 0;
     for (size_t i = 0; i < scope->size; i++) {
-        CFNode * cur = read_list(CFNode*, scope->contents)[i];
+        CFNode* cur = &scope->contents[i];
 
-        struct List* tmp = cur->succ_edges;
+        CFEdges tmp = cur->succ_edges;
         cur->succ_edges = cur->pred_edges;
         cur->pred_edges = tmp;
 
-        for (size_t j = 0; j < entries_count_list(cur->succ_edges); j++) {
-            CFEdge* edge = &read_list(CFEdge, cur->succ_edges)[j];
-
-            CFNode* tmp = edge->dst;
-            edge->dst = edge->src;
-            edge->src = tmp;
-        }
-
-        for (size_t j = 0; j < entries_count_list(cur->pred_edges); j++) {
-            CFEdge* edge = &read_list(CFEdge, cur->pred_edges)[j];
+        swap_edges(cur->succ_edges);
+        swap_edges(cur->pred_edges);
 
-            CFNode* tmp = edge->dst;
-            edge->dst = edge->src;
-            edge->src = tmp;
-        }
-
-        if (entries_count_list(cur->pred_edges) == 0) {
-            if (scope->entry != NULL) {
-                if (scope->entry->node) {
-                    CFNode* new_entry = arena_alloc(scope->arena, sizeof(CFNode));
-                    *new_entry = (CFNode) {
-                        .node = NULL,
-                        .succ_edges = new_list(CFEdge),
-                        .pred_edges = new_list(CFEdge),
-                        .rpo_index = SIZE_MAX,
-                        .idom = NULL,
-                        .dominates = NULL,
-                    };
-
-                    CFEdge prev_entry_edge = {
-                        .type = JumpEdge,
-                        .src = new_entry,
-                        .dst = scope->entry
-                    };
-                    append_list(CFEdge, new_entry->succ_edges, prev_entry_edge);
-                    append_list(CFEdge, scope->entry->pred_edges, prev_entry_edge);
-                    scope->entry = new_entry;
-                }
+        if (cur->pred_edges.count == 0)
+            exits_count++;
+    }
 
-                CFEdge new_edge = {
-                    .type = JumpEdge,
-                    .src = scope->entry,
-                    .dst = cur
-                };
-                append_list(CFEdge, scope->entry->succ_edges, new_edge);
-                append_list(CFEdge, cur->pred_edges, new_edge);
-            } else {
-                scope->entry = cur;
-            }
+    assert(exits_count > 0);
+    if (exits_count == 1) {
+        for (size_t i = 0; i < scope->size; i++) {
+            if (scope->contents[i].pred_edges.count == 0)
+                scope->entry = &scope->contents[i];
         }
+        return;
     }
 
-    if (!scope->entry->node) {
-        scope->size += 1;
-        append_list(Node*, scope->contents, scope->entry);
+    // multiple exits: add a virtual entry node (there is room for it at the end of contents) that jumps to all of them
+    CFNode* new_entry = &scope->contents[scope->size];
+    *new_entry = (CFNode) {
+        .node = NULL,
+        .succ_edges = {
+            .count = 0,
+            .edges = arena_alloc(scope->arena, sizeof(CFEdge) * exits_count),
+        },
+        .rpo_index = SIZE_MAX,
+        .idom = NULL,
+    };
+    for (size_t i = 0; i < scope->size; i++) {
+        CFNode* cur = &scope->contents[i];
+        if (cur->pred_edges.count > 0)
+            continue;
+        CFEdge new_edge = {
+            .type = JumpEdge,
+            .src = new_entry,
+            .dst = cur
+        };
+        new_entry->succ_edges.edges[new_entry->succ_edges.count++] = new_edge;
+        cur->pred_edges.edges = arena_alloc(scope->arena, sizeof(CFEdge));
+        cur->pred_edges.edges[0] = new_edge;
+        cur->pred_edges.count = 1;
     }
+    scope->entry = new_entry;
+    scope->size += 1;
 }
 
 static void validate_scope(Scope* scope) {
     for (size_t i = 0; i < scope->size; i++) {
-        CFNode* node = read_list(CFNode*, scope->contents)[i];
+        CFNode* node = &scope->contents[i];
         if (is_case(node->node)) {
             size_t structured_body_uses = 0;
-            for (size_t j = 0; j < entries_count_list(node->pred_edges); j++) {
-                CFEdge edge = read_list(CFEdge, node->pred_edges)[j];
+            for (size_t j = 0; j < node->pred_edges.count; j++) {
+                CFEdge edge = node->pred_edges.edges[j];
                 switch (edge.type) {
                     case JumpEdge:
                         error_print("Error: cases cannot be jumped to directly.");
@@ -315,36 +341,53 @@ Scope* new_scope_impl(const Node* entry, LoopTree* lt, bool flipped) {
     Arena* arena = new_arena();
 
     ScopeBuildContext context = {
-        .arena = arena,
         .entry = entry,
         .lt = lt,
-        .nodes = new_dict(const Node*, CFNode*, (HashFn) hash_node, (CmpFn) compare_node),
-        .join_point_values = new_dict(const Node*, CFNode*, (HashFn) hash_node, (CmpFn) compare_node),
-        .queue = new_list(CFNode*),
-        .contents = new_list(CFNode*),
+        .nodes = new_dict(const Node*, size_t, (HashFn) hash_node, (CmpFn) compare_node),
+        .join_point_values = new_dict(const Node*, size_t, (HashFn) hash_node, (CmpFn) compare_node),
+        .queue = new_list(size_t),
+        .contents = new_list(const Node*),
+        .edges = new_list(BuildEdge),
     };
 
-    CFNode* entry_node = get_or_enqueue(&context, entry);
+    size_t entry_index = get_or_enqueue(&context, entry);
 
     while (entries_count_list(context.queue) > 0) {
-        CFNode* this = pop_last_list(CFNode*, context.queue);
-        process_cf_node(&context, this);
+        size_t this = pop_last_list(size_t, context.queue);
+        process_cf_node(&context, read_list(const Node*, context.contents)[this]);
     }
 
     destroy_list(context.queue);
     destroy_dict(context.join_point_values);
 
+    size_t size = entries_count_list(context.contents);
     Scope* scope = calloc(sizeof(Scope), 1);
     *scope = (Scope) {
         .arena = arena,
-        .entry = entry_node,
-        .size = entries_count_list(context.contents),
+        .size = size,
         .flipped = flipped,
-        .contents = context.contents,
-        .map = context.nodes,
+        // one extra slot for the virtual entry a flipped scope might need
+        .contents = arena_alloc(arena, sizeof(CFNode) * (size + 1)),
+        .map = new_dict(const Node*, CFNode*, (HashFn) hash_node, (CmpFn) compare_node),
         .rpo = NULL
     };
 
+    for (size_t i = 0; i < size; i++) {
+        CFNode* n = &scope->contents[i];
+        *n = (CFNode) {
+            .node = read_list(const Node*, context.contents)[i],
+            .rpo_index = SIZE_MAX,
+            .idom = NULL,
+        };
+        insert_dict(const Node*, CFNode*, scope->map, n->node, n);
+    }
+    scope->entry = &scope->contents[entry_index];
+    layout_edges(scope, context.edges);
+
+    destroy_list(context.edges);
+    destroy_list(context.contents);
+    destroy_dict(context.nodes);
+
     validate_scope(scope);
 
     if (flipped)
@@ -357,35 +400,16 @@ Scope* new_scope_impl(const Node* entry, LoopTree* lt, bool flipped) {
 }
 
 void destroy_scope(Scope* scope) {
-    bool entry_destroyed = false;
-    for (size_t i = 0; i < scope->size; i++) {
-        CFNode* node = read_list(CFNode*, scope->contents)[i];
-        entry_destroyed |= node == scope->entry;
-        destroy_list(node->pred_edges);
-        destroy_list(node->succ_edges);
-        if (node->dominates)
-            destroy_list(node->dominates);
-        if (node->structurally_dominates)
-            destroy_dict(node->structurally_dominates);
-    }
-    if (!entry_destroyed) {
-        destroy_list(scope->entry->pred_edges);
-        destroy_list(scope->entry->succ_edges);
-        if (scope->entry->dominates)
-            destroy_list(scope->entry->dominates);
-    }
     destroy_dict(scope->map);
     destroy_arena(scope->arena);
-    free(scope->rpo);
-    destroy_list(scope->contents);
     free(scope);
 }
 
 static size_t post_order_visit(Scope* scope, CFNode* n, size_t i) {
     n->rpo_index = -2;
 
-    for (size_t j = 0; j < entries_count_list(n->succ_edges); j++) {
-        CFEdge edge = read_list(CFEdge, n->succ_edges)[j];
+    for (size_t j = 0; j < n->succ_edges.count; j++) {
+        CFEdge edge = n->succ_edges.edges[j];
         if (edge.dst->rpo_index == SIZE_MAX)
             i = post_order_visit(scope, edge.dst, i);
     }
@@ -396,7 +420,7 @@ static size_t post_order_visit(Scope* scope, CFNode* n, size_t i) {
 }
 
 void compute_rpo(Scope* scope) {
-    scope->rpo = malloc(sizeof(const CFNode*) * scope->size);
+    scope->rpo = arena_alloc(scope->arena, sizeof(const CFNode*) * scope->size);
     size_t index = post_order_visit(scope,  scope->entry, scope->size);
     assert(index == 0);
 
@@ -418,11 +442,11 @@ CFNode* least_common_ancestor(CFNode* i, CFNode* j) {
 
 void compute_domtree(Scope* scope) {
     for (size_t i = 0; i < scope->size; i++) {
-        CFNode* n = read_list(CFNode*, scope->contents)[i];
+        CFNode* n = &scope->contents[i];
         if (n == scope->entry)
             continue;
-        for (size_t j = 0; j < entries_count_list(n->pred_edges); j++) {
-            CFEdge e = read_list(CFEdge, n->pred_edges)[j];
+        for (size_t j = 0; j < n->pred_edges.count; j++) {
+            CFEdge e = n->pred_edges.edges[j];
             CFNode* p = e.src;
             if (p->rpo_index < n->rpo_index) {
                 n->idom = p;
@@ -437,12 +461,12 @@ void compute_domtree(Scope* scope) {
     while (todo) {
         todo = false;
         for (size_t i = 0; i < scope->size; i++) {
-            CFNode* n = read_list(CFNode*, scope->contents)[i];
+            CFNode* n = &scope->contents[i];
             if (n == scope->entry)
                 continue;
             CFNode* new_idom = NULL;
-            for (size_t j = 0; j < entries_count_list(n->pred_edges); j++) {
-                CFEdge e = read_list(CFEdge, n->pred_edges)[j];
+            for (size_t j = 0; j < n->pred_edges.count; j++) {
+                CFEdge e = n->pred_edges.edges[j];
                 CFNode* p = e.src;
                 new_idom = new_idom ? least_common_ancestor(new_idom, p) : p;
             }
@@ -454,15 +478,25 @@ void compute_domtree(Scope* scope) {
         }
     }
 
+    // the dominator tree is laid out like the edges: count the children, carve out ranges, then fill them
     for (size_t i = 0; i < scope->size; i++) {
-        CFNode* n = read_list(CFNode*, scope->contents)[i];
-        n->dominates = new_list(CFNode*);
+        CFNode* n = &scope->contents[i];
+        if (n != scope->entry)
+            n->idom->dominates.count++;
     }
+    CFNode** dominated = arena_alloc(scope->arena, sizeof(CFNode*) * scope->size);
+    size_t offset = 0;
     for (size_t i = 0; i < scope->size; i++) {
-        CFNode* n = read_list(CFNode*, scope->contents)[i];
+        CFNode* n = &scope->contents[i];
+        n->dominates.nodes = dominated + offset;
+        offset += n->dominates.count;
+        n->dominates.count = 0;
+    }
+    for (size_t i = 0; i < scope->size; i++) {
+        CFNode* n = &scope->contents[i];
         if (n == scope->entry)
             continue;
-        append_list(CFNode*, n->idom->dominates, n);
+        n->idom->dominates.nodes[n->idom->dominates.count++] = n;
     }
 }
 
@@ -471,12 +505,12 @@ void compute_domtree(Scope* scope) {
  * @param target: List to extend. @ref List of @ref CFNode*
  */
 static void get_undominated_children(const CFNode* node, struct List* target) {
-    for (size_t i = 0; i < entries_count_list(node->succ_edges); i++) {
-        CFEdge edge = read_list(CFEdge, node->succ_edges)[i];
+    for (size_t i = 0; i < node->succ_edges.count; i++) {
+        CFEdge edge = node->succ_edges.edges[i];
 
         bool contained = false;
-        for (size_t j = 0; j < entries_count_list(node->dominates); j++) {
-            CFNode* dominated = read_list(CFNode*, node->dominates)[j];
+        for (size_t j = 0; j < node->dominates.count; j++) {
+            CFNode* dominated = node->dominates.nodes[j];
             if (edge.dst == dominated) {
                 contained = true;
                 break;
@@ -492,21 +526,53 @@ struct List* scope_get_dom_frontier(Scope* scope, const CFNode* node) {
     struct List* dom_frontier = new_list(CFNode*);
 
     get_undominated_children(node, dom_frontier);
-    for (size_t i = 0; i < entries_count_list(node->dominates); i++) {
-        CFNode* dom = read_list(CFNode*, node->dominates)[i];
+    for (size_t i = 0; i < node->dominates.count; i++) {
+        CFNode* dom = node->dominates.nodes[i];
         get_undominated_children(dom, dom_frontier);
     }
 
     return dom_frontier;
 }
 
+bool cfnode_binds_instruction(const CFNode* node) {
+    // every let lives in its own CF node, since their tails are cases
+    const Node* body = get_abstraction_body(node->node);
+    if (!body || (body->tag != Let_TAG && body->tag != LetMut_TAG))
+        return false;
+    return get_let_instruction(body)->tag != Comment_TAG;
+}
+
+size_t scope_count_instructions(const Scope* scope) {
+    size_t count = 0;
+    for (size_t i = 0; i < scope->size; i++) {
+        if (cfnode_binds_instruction(&scope->contents[i]))
+            count++;
+    }
+    return count;
+}
+
 static int extra_uniqueness = 0;
 
+bool cfnode_structurally_dominates(const CFNode* parent, const CFNode* child) {
+    // in flipped scopes, the edges from the parent are found among its predecessors instead
+    for (size_t i = 0; i < parent->succ_edges.count; i++) {
+        CFEdge edge = parent->succ_edges.edges[i];
+        if (edge.dst == child && is_structural_edge(edge.type) && edge.type != StructuredLeaveBodyEdge)
+            return true;
+    }
+    for (size_t i = 0; i < parent->pred_edges.count; i++) {
+        CFEdge edge = parent->pred_edges.edges[i];
+        if (edge.src == child && is_structural_edge(edge.type) && edge.type != StructuredLeaveBodyEdge)
+            return true;
+    }
+    return false;
+}
+
 static CFNode* get_let_pred(const CFNode* n) {
-    if (entries_count_list(n->pred_edges) == 1) {
-        CFEdge pred = read_list(CFEdge, n->pred_edges)[0];
+    if (n->pred_edges.count == 1) {
+        CFEdge pred = n->pred_edges.edges[0];
         assert(pred.dst == n);
-        if (pred.type == LetTailEdge && entries_count_list(pred.src->succ_edges) == 1) {
+        if (pred.type == LetTailEdge && pred.src->succ_edges.count == 1) {
             assert(is_case(n->node));
             return pred.src;
         }
@@ -539,10 +605,10 @@ static void dump_cf_node(FILE* output, const CFNode* n) {
         else
             label = format_string_arena(bb->arena->arena, "%slet ... = %s (...)\n", label, node_tags[instr->tag]);
 
-        if (entries_count_list(let_chain_end->succ_edges) != 1 || read_list(CFEdge, let_chain_end->succ_edges)[0].type != LetTailEdge)
+        if (let_chain_end->succ_edges.count != 1 || let_chain_end->succ_edges.edges[0].type != LetTailEdge)
             break;
 
-        let_chain_end = read_list(CFEdge, let_chain_end->succ_edges)[0].dst;
+        let_chain_end = let_chain_end->succ_edges.edges[0].dst;
         const Node* abs = body->payload.let.tail;
         assert(let_chain_end->node == abs);
         assert(is_case(abs));
@@ -557,9 +623,9 @@ static void dump_cf_node(FILE* output, const CFNode* n) {
 
     fprintf(output, "bb_%zu [label=\"%s\", color=\"%s\", shape=box];\n", (size_t) n, label, color);
 
-    for (size_t i = 0; i < entries_count_list(n->dominates); i++) {
-        CFNode* d = read_list(CFNode*, n->dominates)[i];
-        if (!find_key_dict(const Node*, n->structurally_dominates, d->node))
+    for (size_t i = 0; i < n->dominates.count; i++) {
+        CFNode* d = n->dominates.nodes[i];
+        if (!cfnode_structurally_dominates(n, d))
             dump_cf_node(output, d);
     }
 }
@@ -570,12 +636,12 @@ static void dump_cfg_scope(FILE* output, Scope* scope) {
     const Node* entry = scope->entry->node;
     fprintf(output, "subgraph cluster_%s {\n", get_abstraction_name(entry));
     fprintf(output, "label = \"%s\";\n", get_abstraction_name(entry));
-    for (size_t i = 0; i < entries_count_list(scope->contents); i++) {
-        const CFNode* n = read_list(const CFNode*, scope->contents)[i];
+    for (size_t i = 0; i < scope->size; i++) {
+        const CFNode* n = &scope->contents[i];
         dump_cf_node(output, n);
     }
-    for (size_t i = 0; i < entries_count_list(scope->contents); i++) {
-        const CFNode* bb_node = read_list(const CFNode*, scope->contents)[i];
+    for (size_t i = 0; i < scope->size; i++) {
+        const CFNode* bb_node = &scope->contents[i];
         const CFNode* src_node = bb_node;
         while (true) {
             const CFNode* let_parent = get_let_pred(src_node);
@@ -585,8 +651,8 @@ static void dump_cfg_scope(FILE* output, Scope* scope) {
                 break;
         }
 
-        for (size_t j = 0; j < entries_count_list(bb_node->succ_edges); j++) {
-            CFEdge edge = read_list(CFEdge, bb_node->succ_edges)[j];
+        for (size_t j = 0; j < bb_node->succ_edges.count; j++) {
+            CFEdge edge = bb_node->succ_edges.edges[j];
             const CFNode* target_node = edge.dst;
 
             if (edge.type == LetTailEdge && get_let_pred(target_node) == bb_node)
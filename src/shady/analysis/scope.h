@@ -22,20 +22,26 @@ typedef struct {
     CFNode* dst;
 } CFEdge;
 
+/// A range of edges, stored contiguously in the scope's arena
+typedef struct {
+    size_t count;
+    CFEdge* edges;
+} CFEdges;
+
+/// A range of nodes, stored contiguously in the scope's arena
+typedef struct {
+    size_t count;
+    CFNode** nodes;
+} CFNodes;
+
 struct CFNode_ {
     const Node* node;
 
-    /** @brief Edges where this node is the source
-     *
-     * @ref List of @ref CFEdge
-     */
-    struct List* succ_edges;
+    /// Edges where this node is the source
+    CFEdges succ_edges;
 
-    /** @brief Edges where this node is the destination
-     *
-     * @ref List of @ref CFEdge
-     */
-    struct List* pred_edges;
+    /// Edges where this node is the destination
+    CFEdges pred_edges;
 
     // set by compute_rpo
     size_t rpo_index;
@@ -43,24 +49,19 @@ struct CFNode_ {
     // set by compute_domtree
     CFNode* idom;
 
-    /** @brief All Nodes directly dominated by this CFNode.
-     *
-     * @ref List of @ref CFNode*
-     */
-    struct List* dominates;
-    struct Dict* structurally_dominates;
+    /// All Nodes directly dominated by this CFNode.
+    CFNodes dominates;
 };
 
 typedef struct Arena_ Arena;
 typedef struct Scope_ {
+    /// Backs the nodes, edges and dominator tree, in flat arrays
     Arena* arena;
     size_t size;
     bool flipped;
 
-    /**
-     * @ref List of @ref CFNode*
-     */
-    struct List* contents;
+    /// The nodes of this scope, in discovery order
+    CFNode* contents;
 
     /**
      * @ref Dict from const @ref Node* to @ref CFNode*
@@ -105,8 +106,18 @@ void compute_domtree(Scope*);
 
 CFNode* least_common_ancestor(CFNode* i, CFNode* j);
 
+/// Whether @p child is a case used by @p parent as a structured body or let tail.
+/// Those are dominated by construction, unlike the other children in the dominator tree.
+bool cfnode_structurally_dominates(const CFNode* parent, const CFNode* child);
+
 void destroy_scope(Scope*);
 
+/// Whether the body of @p node is a let binding an actual instruction, as opposed to a comment.
+bool cfnode_binds_instruction(const CFNode* node);
+/// Counts the instructions bound by lets in @p scope, ignoring comments.
+/// This is what the optimisation budgets measure code size in.
+size_t scope_count_instructions(const Scope*);
+
 /**
  * @returns @ref List of @ref CFNode*
  */
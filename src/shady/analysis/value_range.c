@@ -0,0 +1,236 @@
+#include "value_range.h"
+
+#include "log.h"
+#include "dict.h"
+#include "portability.h"
+
+#include "../type.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+struct ValueRangeAnalysis_ {
+    struct Dict* map;
+};
+
+ValueRangeAnalysis* new_value_range_analysis() {
+    ValueRangeAnalysis* vra = calloc(1, sizeof(ValueRangeAnalysis));
+    *vra = (ValueRangeAnalysis) {
+        .map = new_dict(const Node*, ValueRange, (HashFn) hash_node, (CmpFn) compare_node),
+    };
+    return vra;
+}
+
+void destroy_value_range_analysis(ValueRangeAnalysis* vra) {
+    destroy_dict(vra->map);
+    free(vra);
+}
+
+static const ValueRange unbounded = { .bounded = false };
+
+static ValueRange range(int64_t min, int64_t max) {
+    assert(min <= max);
+    return (ValueRange) { .bounded = true, .min = min, .max = max };
+}
+
+static ValueRange get_int_size_range(IntSizes width, bool is_signed) {
+    if (width == IntTy64)
+        return is_signed ? range(INT64_MIN, INT64_MAX) : unbounded;
+    int bits = int_size_in_bytes(width) * 8;
+    if (is_signed)
+        return range(-(INT64_C(1) << (bits - 1)), (INT64_C(1) << (bits - 1)) - 1);
+    return range(0, (INT64_C(1) << bits) - 1);
+}
+
+ValueRange get_int_type_range(const Type* t) {
+    if (t->tag != Int_TAG)
+        return unbounded;
+    return get_int_size_range(t->payload.int_type.width, t->payload.int_type.is_signed);
+}
+
+bool value_range_fits(ValueRange r, IntSizes width, bool is_signed) {
+    if (!r.bounded)
+        return false;
+    ValueRange t = get_int_size_range(width, is_signed);
+    // u64 is the only type we can't represent the range of, but it fits anything non-negative we can
+    if (!t.bounded)
+        return r.min >= 0;
+    return r.min >= t.min && r.max <= t.max;
+}
+
+static bool fits_type(ValueRange r, const Type* t) {
+    assert(t->tag == Int_TAG);
+    return value_range_fits(r, t->payload.int_type.width, t->payload.int_type.is_signed);
+}
+
+static bool is_non_negative(ValueRange r) {
+    return r.bounded && r.min >= 0;
+}
+
+static ValueRange join_ranges(ValueRange a, ValueRange b) {
+    if (!a.bounded || !b.bounded)
+        return unbounded;
+    return range(a.min < b.min ? a.min : b.min, a.max > b.max ? a.max : b.max);
+}
+
+/// Smallest all-ones mask that covers v
+static int64_t covering_mask(int64_t v) {
+    assert(v >= 0);
+    int64_t mask = 0;
+    while (mask < v)
+        mask = (mask << 1) | 1;
+    return mask;
+}
+
+static ValueRange eval_prim_op(ValueRangeAnalysis* vra, const Node* instr) {
+    const PrimOp* prim_op = &instr->payload.prim_op;
+    Nodes ops = prim_op->operands;
+    ValueRange r[3] = { unbounded, unbounded, unbounded };
+    for (size_t i = 0; i < ops.count && i < 3; i++) {
+        const Type* t = get_unqualified_type(ops.nodes[i]->type);
+        if (t->tag == Int_TAG)
+            r[i] = get_value_range(vra, ops.nodes[i]);
+    }
+
+    switch (prim_op->op) {
+        case quote_op: return ops.count == 1 ? r[0] : unbounded;
+        case add_op: {
+            int64_t min, max;
+            if (!r[0].bounded || !r[1].bounded || __builtin_add_overflow(r[0].min, r[1].min, &min) || __builtin_add_overflow(r[0].max, r[1].max, &max))
+                return unbounded;
+            return range(min, max);
+        }
+        case sub_op: {
+            int64_t min, max;
+            if (!r[0].bounded || !r[1].bounded || __builtin_sub_overflow(r[0].min, r[1].max, &min) || __builtin_sub_overflow(r[0].max, r[1].min, &max))
+                return unbounded;
+            return range(min, max);
+        }
+        case mul_op: {
+            if (!r[0].bounded || !r[1].bounded)
+                return unbounded;
+            int64_t products[4];
+            if (__builtin_mul_overflow(r[0].min, r[1].min, &products[0]) || __builtin_mul_overflow(r[0].min, r[1].max, &products[1])
+             || __builtin_mul_overflow(r[0].max, r[1].min, &products[2]) || __builtin_mul_overflow(r[0].max, r[1].max, &products[3]))
+                return unbounded;
+            ValueRange result = range(products[0], products[0]);
+            for (size_t i = 1; i < 4; i++)
+                result = join_ranges(result, range(products[i], products[i]));
+            return result;
+        }
+        case div_op: {
+            if (!is_non_negative(r[0]) || !r[1].bounded || r[1].min <= 0)
+                return unbounded;
+            return range(r[0].min / r[1].max, r[0].max / r[1].min);
+        }
+        case mod_op: {
+            if (!is_non_negative(r[0]) || !r[1].bounded || r[1].min <= 0)
+                return unbounded;
+            return range(0, r[0].max < r[1].max - 1 ? r[0].max : r[1].max - 1);
+        }
+        case and_op: {
+            // and-ing with a non-negative value can't set any bit above it
+            if (is_non_negative(r[0]) && is_non_negative(r[1]))
+                return range(0, r[0].max < r[1].max ? r[0].max : r[1].max);
+            if (is_non_negative(r[0]))
+                return range(0, r[0].max);
+            if (is_non_negative(r[1]))
+                return range(0, r[1].max);
+            return unbounded;
+        }
+        case or_op:
+        case xor_op: {
+            if (!is_non_negative(r[0]) || !is_non_negative(r[1]))
+                return unbounded;
+            return range(0, covering_mask(r[0].max > r[1].max ? r[0].max : r[1].max));
+        }
+        case rshift_logical_op:
+        case rshift_arithm_op: {
+            if (!is_non_negative(r[0]) || !r[1].bounded || r[1].min < 0 || r[1].max > 63)
+                return unbounded;
+            return range(r[0].min >> r[1].max, r[0].max >> r[1].min);
+        }
+        case lshift_op: {
+            if (!is_non_negative(r[0]) || !r[1].bounded || r[1].min < 0 || r[1].max > 62)
+                return unbounded;
+            if (r[0].max > (INT64_MAX >> r[1].max))
+                return unbounded;
+            return range(r[0].min << r[1].min, r[0].max << r[1].max);
+        }
+        case min_op: {
+            if (!r[0].bounded || !r[1].bounded)
+                return unbounded;
+            return range(r[0].min < r[1].min ? r[0].min : r[1].min, r[0].max < r[1].max ? r[0].max : r[1].max);
+        }
+        case max_op: {
+            if (!r[0].bounded || !r[1].bounded)
+                return unbounded;
+            return range(r[0].min > r[1].min ? r[0].min : r[1].min, r[0].max > r[1].max ? r[0].max : r[1].max);
+        }
+        case select_op: return join_ranges(r[1], r[2]);
+        // conversions preserve the value if it fits the destination, otherwise we fall back to the destination type
+        case convert_op:
+        case reinterpret_op: return r[0];
+        // array sizes are 32-bit, so sizes and offsets of types are too
+        case size_of_op:
+        case align_of_op:
+        case offset_of_op: return range(0, UINT32_MAX);
+        default: return unbounded;
+    }
+}
+
+static ValueRange eval_literal(IntLiteral lit) {
+    int64_t value = get_int_literal_value(lit, lit.is_signed);
+    if (lit.width == IntTy64 && !lit.is_signed && value < 0)
+        return unbounded;
+    return range(value, value);
+}
+
+static ValueRange eval_value(ValueRangeAnalysis* vra, const Node* node) {
+    switch (node->tag) {
+        case IntLiteral_TAG: return eval_literal(node->payload.int_literal);
+        case Variable_TAG: {
+            const Node* def = get_var_def(node->payload.var);
+            if (def && def->tag == PrimOp_TAG)
+                return get_value_range(vra, def);
+            return unbounded;
+        }
+        case RefDecl_TAG: {
+            const IntLiteral* lit = resolve_to_int_literal(node);
+            if (lit)
+                return eval_literal(*lit);
+            return unbounded;
+        }
+        case PrimOp_TAG: return eval_prim_op(vra, node);
+        default: return unbounded;
+    }
+}
+
+ValueRange get_value_range(ValueRangeAnalysis* vra, const Node* node) {
+    ValueRange* found = find_value_dict(const Node*, ValueRange, vra->map, node);
+    if (found)
+        return *found;
+
+    ValueRange result = unbounded;
+    const Type* t = NULL;
+    if (node->type) {
+        t = node->type;
+        if (node->tag == PrimOp_TAG) {
+            Nodes yield_types = unwrap_multiple_yield_types(node->arena, t);
+            t = yield_types.count == 1 ? first(yield_types) : NULL;
+        }
+    }
+
+    if (t && (t = get_unqualified_type(t))->tag == Int_TAG) {
+        result = eval_value(vra, node);
+        // if we can't prove the result fits, we assume the value could have wrapped around
+        if (!result.bounded || !fits_type(result, t))
+            result = get_int_type_range(t);
+    }
+
+    insert_dict(const Node*, ValueRange, vra->map, node, result);
+    return result;
+}
@@ -0,0 +1,26 @@
+#ifndef SHADY_VALUE_RANGE
+#define SHADY_VALUE_RANGE
+
+#include "shady/ir.h"
+
+/// Inclusive bounds on the mathematical value of an integer.
+/// Values that may not be representable as an int64_t (large unsigned 64-bit values) are simply not bounded.
+typedef struct {
+    bool bounded;
+    int64_t min, max;
+} ValueRange;
+
+typedef struct ValueRangeAnalysis_ ValueRangeAnalysis;
+
+ValueRangeAnalysis* new_value_range_analysis();
+void destroy_value_range_analysis(ValueRangeAnalysis*);
+
+/// Returns the range of values a (scalar, integer) value or instruction can take, in terms of its definition.
+/// Results are memoised, the nodes are expected to belong to an arena that outlives the analysis.
+ValueRange get_value_range(ValueRangeAnalysis*, const Node*);
+
+/// The full range of values an (unqualified) integer type can hold
+ValueRange get_int_type_range(const Type*);
+bool value_range_fits(ValueRange, IntSizes width, bool is_signed);
+
+#endif
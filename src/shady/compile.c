@@ -23,6 +23,15 @@ CompilerConfig default_compiler_config() {
             .minor = 4
         },
 
+        .lower = {
+            .emulated_word_size = {
+                .private_memory = IntTy32,
+                // other invocations can write the neighbouring bytes
+                .subgroup_memory = IntTy8,
+                .shared_memory = IntTy8,
+            },
+        },
+
         .logging = {
             // most of the time, we are not interested in seeing generated & internal code in the debug output
             .skip_internal = true,
@@ -33,7 +42,33 @@ CompilerConfig default_compiler_config() {
             .cleanup = {
                 .after_every_pass = true,
                 .delete_unused_instructions = true,
-            }
+            },
+            .inlining = {
+                .max_callee_size = 16,
+                .max_caller_size = 1024,
+                .constant_argument_bonus = 4,
+                .loop_depth_bonus = 8,
+                .tail_call_bonus = 16,
+                .max_rounds = 4,
+            },
+            .unrolling = {
+                .max_trip_count = 32,
+                .max_size = 256,
+            },
+            .specialization = {
+                .max_clones = 16,
+                .max_callee_size = 128,
+            },
+            .dispatcher = {
+                .likely_fns = 1,
+                .fallthrough = true,
+                .profile = NULL,
+            },
+            .switch_lowering = {
+                .jump_tables = true,
+                .min_cases = 4,
+                .min_density_percent = 40,
+            },
         },
 
         .specialization = {
@@ -81,24 +116,28 @@ CompilationResult run_compiler_passes(CompilerConfig* config, Module** pmod) {
 
     RUN_PASS(normalize_builtins);
     RUN_PASS(infer_program)
+    RUN_PASS(opt_unroll) // loops are still structured, with their state in parameters
 
     RUN_PASS(lcssa)
     RUN_PASS(reconvergence_heuristics)
 
     RUN_PASS(lower_cf_instrs)
     RUN_PASS(opt_mem2reg) // run because control-flow is now normalized
+    RUN_PASS(opt_gvn)
     RUN_PASS(setup_stack_frames)
     if (!config->hacks.force_join_point_lifting)
         RUN_PASS(mark_leaf_functions)
 
     RUN_PASS(lower_callf)
     RUN_PASS(opt_inline)
+    RUN_PASS(opt_specialize)
 
     RUN_PASS(lift_indirect_targets)
     RUN_PASS(opt_mem2reg) // run because we can now weaken non-leaking allocas
 
     if (config->specialization.execution_model != EmNone)
         RUN_PASS(specialize_execution_model)
+    RUN_PASS(opt_sccp)
 
     RUN_PASS(opt_stack)
 
@@ -106,6 +145,8 @@ CompilationResult run_compiler_passes(CompilerConfig* config, Module** pmod) {
     RUN_PASS(lower_switch_btree)
     RUN_PASS(opt_restructurize)
     RUN_PASS(opt_mem2reg)
+    RUN_PASS(opt_gvn)
+    RUN_PASS(opt_licm)
 
     RUN_PASS(lower_mask)
     RUN_PASS(lower_memcpy)
@@ -113,23 +154,31 @@ CompilationResult run_compiler_passes(CompilerConfig* config, Module** pmod) {
 
     RUN_PASS(lower_alloca)
     RUN_PASS(lower_stack)
-    RUN_PASS(lower_lea)
     RUN_PASS(lower_generic_globals)
+    RUN_PASS(opt_resolve_generic_ptrs) // needs to see the leas and the generic globals as conversions
+    RUN_PASS(lower_lea)
     RUN_PASS(lower_generic_ptrs)
     RUN_PASS(lower_physical_ptrs)
     RUN_PASS(lower_subgroup_vars)
     RUN_PASS(lower_memory_layout)
+    RUN_PASS(opt_gvn) // the memory lowering passes generate a lot of redundant address arithmetic
+    RUN_PASS(opt_licm)
+    RUN_PASS(opt_store_forwarding)
 
     if (config->lower.decay_ptrs)
         RUN_PASS(lower_decay_ptrs)
 
+    if (config->lower.int64)
+        RUN_PASS(opt_narrow_int64)
     RUN_PASS(lower_int)
 
     if (config->lower.simt_to_explicit_simd)
         RUN_PASS(simt2d)
 
-    if (config->specialization.entry_point)
+    if (config->specialization.entry_point) {
         RUN_PASS(specialize_entry_point)
+        RUN_PASS(opt_sccp) // the workgroup size is now known
+    }
     RUN_PASS(lower_fill)
 
     return CompilationNoError;
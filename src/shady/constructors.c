@@ -3,6 +3,7 @@
 #include "log.h"
 #include "fold.h"
 #include "portability.h"
+#include "util.h"
 
 #include "dict.h"
 #include "visit.h"
@@ -398,7 +399,7 @@ const Type* fp64_type(IrArena* arena) { return float_type(arena, (Float) { .widt
 
 const Node* fp_literal_helper(IrArena* a, FloatSizes size, double value) {
     switch (size) {
-        case FloatTy16: assert(false); break;
+        case FloatTy16: return float_literal(a, (FloatLiteral) { .width = size, .value = fp32_to_fp16_bits((float) value) });
         case FloatTy32: {
             float f = value;
             uint64_t bits = 0;
@@ -155,9 +155,9 @@ CTerm emit_value(Emitter* emitter, Printer* block_printer, const Node* value) {
         case Value_Variable_TAG: error("variables need to be emitted beforehand");
         case Value_IntLiteral_TAG: {
             if (value->payload.int_literal.is_signed)
-                emitted = format_string_arena(emitter->arena->arena, "%" PRIi64, value->payload.int_literal.value);
+                emitted = format_string_arena(emitter->arena->arena, "%" PRIi64, get_int_literal_value(value->payload.int_literal, true));
             else
-                emitted = format_string_arena(emitter->arena->arena, "%" PRIu64, value->payload.int_literal.value);
+                emitted = format_string_arena(emitter->arena->arena, "%" PRIu64, get_int_literal_value(value->payload.int_literal, false));
 
             bool is_long = value->payload.int_literal.width == IntTy64;
             bool is_signed = value->payload.int_literal.is_signed;
@@ -173,8 +173,15 @@ CTerm emit_value(Emitter* emitter, Printer* block_printer, const Node* value) {
         case Value_FloatLiteral_TAG: {
             uint64_t v = value->payload.float_literal.value;
             switch (value->payload.float_literal.width) {
-                case FloatTy16:
-                    assert(false);
+                case FloatTy16: {
+                    double d = get_float_literal_value(value->payload.float_literal);
+                    switch (emitter->config.dialect) {
+                        case ISPC: emitted = format_string_arena(emitter->arena->arena, "((float16) %.5g)", d); break;
+                        case C: emitted = format_string_arena(emitter->arena->arena, "((_Float16) %.5g)", d); break;
+                        case GLSL: emitted = format_string_arena(emitter->arena->arena, "float16_t(%.5g)", d); *emitter->need_explicit_arithmetic_types = true; break;
+                    }
+                    break;
+                }
                 case FloatTy32: {
                     float f;
                     memcpy(&f, &v, sizeof(uint32_t));
@@ -700,6 +707,7 @@ void emit_c(CompilerConfig compiler_config, CEmitterConfig config, Module* mod,
     Growy* fn_decls_g = new_growy();
     Growy* fn_defs_g = new_growy();
 
+    bool need_explicit_arithmetic_types = false;
     Emitter emitter = {
         .config = config,
         .arena = arena,
@@ -708,6 +716,7 @@ void emit_c(CompilerConfig compiler_config, CEmitterConfig config, Module* mod,
         .fn_defs = open_growy_as_printer(fn_defs_g),
         .emitted_terms = new_dict(Node*, CTerm, (HashFn) hash_node, (CmpFn) compare_node),
         .emitted_types = new_dict(Node*, String, (HashFn) hash_node, (CmpFn) compare_node),
+        .need_explicit_arithmetic_types = &need_explicit_arithmetic_types,
     };
 
     Nodes decls = get_module_declarations(mod);
@@ -739,6 +748,8 @@ void emit_c(CompilerConfig compiler_config, CEmitterConfig config, Module* mod,
             break;
         case GLSL:
             print(finalp, "#extension GL_ARB_gpu_shader_int64: require\n");
+            if (need_explicit_arithmetic_types)
+                print(finalp, "#extension GL_EXT_shader_explicit_arithmetic_types: require\n");
             print(finalp, "#define ubyte uint\n");
             print(finalp, "#define uchar uint\n");
             print(finalp, "#define ulong uint\n");
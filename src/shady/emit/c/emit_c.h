@@ -41,6 +41,10 @@ typedef struct {
 
     struct Dict* emitted_terms;
     struct Dict* emitted_types;
+
+    /// Set when an 8/16-bit integer or a half float gets printed, GLSL needs an extension for those.
+    /// Shared with the sub-emitters of structured constructs, like the dicts above.
+    bool* need_explicit_arithmetic_types;
 } Emitter;
 
 void register_emitted(Emitter*, const Node*, CTerm);
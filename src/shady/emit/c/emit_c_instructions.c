@@ -419,7 +419,8 @@ static void emit_primop(Emitter* emitter, Printer* p, const Node* node, Instruct
                     if (dst_type->tag == Float_TAG) {
                         assert(src_type->tag == Int_TAG);
                         switch (dst_type->payload.float_type.width) {
-                            case FloatTy16: break;
+                            case FloatTy16: n = src_type->payload.int_type.is_signed ? "int16BitsToFloat16" : "uint16BitsToFloat16";
+                                break;
                             case FloatTy32: n = src_type->payload.int_type.is_signed ? "intBitsToFloat" : "uintBitsToFloat";
                                 break;
                             case FloatTy64: break;
@@ -432,7 +433,8 @@ static void emit_primop(Emitter* emitter, Printer* p, const Node* node, Instruct
                         }
                         assert(src_type->tag == Float_TAG);
                         switch (src_type->payload.float_type.width) {
-                            case FloatTy16: break;
+                            case FloatTy16: n = dst_type->payload.int_type.is_signed ? "float16BitsToInt16" : "float16BitsToUint16";
+                                break;
                             case FloatTy32: n = dst_type->payload.int_type.is_signed ? "floatBitsToInt" : "floatBitsToUint";
                                 break;
                             case FloatTy64: break;
@@ -544,10 +546,18 @@ static void emit_primop(Emitter* emitter, Printer* p, const Node* node, Instruct
         case get_stack_base_op:
         case push_stack_op:
         case pop_stack_op:
+        case push_stack_uniform_op:
+        case pop_stack_uniform_op:
         case get_stack_pointer_op:
         case set_stack_pointer_op: error("Stack operations need to be lowered.");
         case default_join_point_op:
         case create_joint_point_op: error("lowered in lower_tailcalls.c");
+        case subgroup_barrier_op: {
+            // ISPC gangs run in lockstep and C only has the one thread
+            if (emitter->config.dialect == GLSL)
+                print(p, "\nsubgroupBarrier();");
+            return;
+        }
         case subgroup_elect_first_op: {
             switch (emitter->config.dialect) {
                 case ISPC: term = term_from_cvalue(format_string_arena(emitter->arena->arena, "(programIndex == count_trailing_zeros(lanemask()))")); break;
@@ -565,6 +575,25 @@ static void emit_primop(Emitter* emitter, Printer* p, const Node* node, Instruct
             }
             break;
         }
+        case subgroup_shuffle_op:
+        case subgroup_shuffle_xor_op:
+        case subgroup_shuffle_up_op:
+        case subgroup_shuffle_down_op: {
+            CValue value = to_cvalue(emitter, emit_value(emitter, p, prim_op->operands.nodes[0]));
+            CValue lane = to_cvalue(emitter, emit_value(emitter, p, prim_op->operands.nodes[1]));
+            switch (prim_op->op) {
+                case subgroup_shuffle_xor_op:  lane = format_string_arena(emitter->arena->arena, "(programIndex ^ %s)", lane); break;
+                case subgroup_shuffle_up_op:   lane = format_string_arena(emitter->arena->arena, "(programIndex - %s)", lane); break;
+                case subgroup_shuffle_down_op: lane = format_string_arena(emitter->arena->arena, "(programIndex + %s)", lane); break;
+                default: break;
+            }
+            switch (emitter->config.dialect) {
+                case ISPC: term = term_from_cvalue(format_string_arena(emitter->arena->arena, "shuffle(%s, (int32) %s)", value, lane)); break;
+                case C:
+                case GLSL: error("TODO")
+            }
+            break;
+        }
         case empty_mask_op:
         case mask_is_thread_active_op: error("lower_me");
         case debug_printf_op: {
@@ -675,6 +704,45 @@ static void emit_if(Emitter* emitter, Printer* p, const Node* if_instr, Instruct
     }
 }
 
+/// Whether the abstraction breaks out of the loop it's in, rather than out of one nested in it
+static bool breaks_out_of_enclosing_loop(const Node* abs) {
+    const Node* body = get_abstraction_body(abs);
+    while (body && body->tag == Let_TAG) {
+        const Node* instruction = get_let_instruction(body);
+        switch (instruction->tag) {
+            case If_TAG: {
+                if (breaks_out_of_enclosing_loop(instruction->payload.if_instr.if_true))
+                    return true;
+                if (instruction->payload.if_instr.if_false && breaks_out_of_enclosing_loop(instruction->payload.if_instr.if_false))
+                    return true;
+                break;
+            }
+            case Match_TAG: {
+                Nodes cases = instruction->payload.match_instr.cases;
+                for (size_t i = 0; i < cases.count; i++)
+                    if (breaks_out_of_enclosing_loop(cases.nodes[i]))
+                        return true;
+                if (instruction->payload.match_instr.default_case && breaks_out_of_enclosing_loop(instruction->payload.match_instr.default_case))
+                    return true;
+                break;
+            }
+            case Control_TAG: {
+                if (breaks_out_of_enclosing_loop(instruction->payload.control.inside))
+                    return true;
+                break;
+            }
+            case Block_TAG: {
+                if (breaks_out_of_enclosing_loop(instruction->payload.block.inside))
+                    return true;
+                break;
+            }
+            default: break;
+        }
+        body = get_abstraction_body(get_let_tail(body));
+    }
+    return body && body->tag == MergeBreak_TAG;
+}
+
 static void emit_match(Emitter* emitter, Printer* p, const Node* match_instr, InstructionOutputs outputs) {
     assert(match_instr->tag == Match_TAG);
     const Match* match = &match_instr->payload.match_instr;
@@ -690,6 +758,15 @@ static void emit_match(Emitter* emitter, Printer* p, const Node* match_instr, In
     //
     // We could do GOTO for C, but at the cost of arguably even more noise in the output, and two different codepaths.
     // I don't think it's quite worth it, just like it's not worth doing some data-flow based solution either.
+    //
+    // That said, when none of the cases break out of a loop, the switch works just fine, and those are the ones
+    // lower_switch_btree leaves in for being dense. ISPC always gets the if-chain.
+
+    bool use_switch = emitter->config.dialect != ISPC;
+    for (size_t i = 0; i < match->cases.count && use_switch; i++)
+        use_switch &= !breaks_out_of_enclosing_loop(match->cases.nodes[i]);
+    if (match->default_case)
+        use_switch &= !breaks_out_of_enclosing_loop(match->default_case);
 
     CValue inspectee = to_cvalue(emitter, emit_value(emitter, p, match->inspect));
     bool first = true;
@@ -697,19 +774,34 @@ static void emit_match(Emitter* emitter, Printer* p, const Node* match_instr, In
     for (size_t i = 0; i < match->cases.count; i++) {
         literals[i] = to_cvalue(emitter, emit_value(emitter, p, match->literals.nodes[i]));
     }
-    for (size_t i = 0; i < match->cases.count; i++) {
-        String case_body = emit_lambda_body(&sub_emiter, get_abstraction_body(match->cases.nodes[i]), NULL);
-        print(p, "\n");
-        if (!first)
-            print(p, "else ");
-        print(p, "if (%s == %s) { %s}", inspectee, literals[i], case_body);
-        free_tmp_str(case_body);
-        first = false;
-    }
-    if (match->default_case) {
-        String default_case_body = emit_lambda_body(&sub_emiter, get_abstraction_body(match->default_case), NULL);
-        print(p, "\nelse { %s}", default_case_body);
-        free_tmp_str(default_case_body);
+    if (use_switch) {
+        print(p, "\nswitch (%s) {", inspectee);
+        for (size_t i = 0; i < match->cases.count; i++) {
+            String case_body = emit_lambda_body(&sub_emiter, get_abstraction_body(match->cases.nodes[i]), NULL);
+            print(p, "\ncase %s: { %sbreak; }", literals[i], case_body);
+            free_tmp_str(case_body);
+        }
+        if (match->default_case) {
+            String default_case_body = emit_lambda_body(&sub_emiter, get_abstraction_body(match->default_case), NULL);
+            print(p, "\ndefault: { %sbreak; }", default_case_body);
+            free_tmp_str(default_case_body);
+        }
+        print(p, "\n}");
+    } else {
+        for (size_t i = 0; i < match->cases.count; i++) {
+            String case_body = emit_lambda_body(&sub_emiter, get_abstraction_body(match->cases.nodes[i]), NULL);
+            print(p, "\n");
+            if (!first)
+                print(p, "else ");
+            print(p, "if (%s == %s) { %s}", inspectee, literals[i], case_body);
+            free_tmp_str(case_body);
+            first = false;
+        }
+        if (match->default_case) {
+            String default_case_body = emit_lambda_body(&sub_emiter, get_abstraction_body(match->default_case), NULL);
+            print(p, "\nelse { %s}", default_case_body);
+            free_tmp_str(default_case_body);
+        }
     }
 
     assert(outputs.count == ephis.count);
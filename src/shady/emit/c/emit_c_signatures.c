@@ -159,12 +159,9 @@ String emit_type(Emitter* emitter, const Type* type, const char* center) {
                 }
                 case GLSL:
                     switch (type->payload.int_type.width) {
-                        case IntTy8:  warn_print("vanilla GLSL does not support 8-bit integers\n");
-                            emitted = "ubyte";
-                            break;
-                        case IntTy16: warn_print("vanilla GLSL does not support 16-bit integers\n");
-                            emitted = "ushort";
-                            break;
+                        // GL_EXT_shader_explicit_arithmetic_types
+                        case IntTy8:  emitted = "uint8_t";  *emitter->need_explicit_arithmetic_types = true; break;
+                        case IntTy16: emitted = "uint16_t"; *emitter->need_explicit_arithmetic_types = true; break;
                         case IntTy32: emitted = "uint";   break;
                         case IntTy64: warn_print("vanilla GLSL does not support 64-bit integers\n");
                             emitted = "uint64_t";
@@ -177,7 +174,11 @@ String emit_type(Emitter* emitter, const Type* type, const char* center) {
         case Float_TAG:
             switch (type->payload.float_type.width) {
                 case FloatTy16:
-                    assert(false);
+                    switch (emitter->config.dialect) {
+                        case ISPC: emitted = "float16"; break;
+                        case C: emitted = "_Float16"; break;
+                        case GLSL: emitted = "float16_t"; *emitter->need_explicit_arithmetic_types = true; break;
+                    }
                     break;
                 case FloatTy32:
                     emitted = "float";
@@ -50,7 +50,8 @@ SpvId emit_value(Emitter* emitter, BBBuilder bb_builder, const Node* node) {
                 uint32_t arr[] = { node->payload.int_literal.value & 0xFFFFFFFF, node->payload.int_literal.value >> 32 };
                 spvb_constant(emitter->file_builder, new, ty, 2, arr);
             } else {
-                uint32_t arr[] = { node->payload.int_literal.value };
+                // narrower constants have to be sign-extended to the whole word when they are signed
+                uint32_t arr[] = { (uint32_t) get_int_literal_value(node->payload.int_literal, node->payload.int_literal.is_signed) };
                 spvb_constant(emitter->file_builder, new, ty, 1, arr);
             }
             break;
@@ -301,7 +302,7 @@ static void emit_function(Emitter* emitter, const Node* node) {
         Scope* scope = new_scope(node);
         // reserve a bunch of identifiers for the basic blocks in the scope
         for (size_t i = 0; i < scope->size; i++) {
-            CFNode* cfnode = read_list(CFNode*, scope->contents)[i];
+            CFNode* cfnode = &scope->contents[i];
             assert(cfnode);
             const Node* bb = cfnode->node;
             if (is_case(bb))
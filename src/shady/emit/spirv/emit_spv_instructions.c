@@ -250,6 +250,28 @@ static void emit_primop(Emitter* emitter, FnBuilder fn_builder, BBBuilder bb_bui
             spvb_capability(emitter->file_builder, SpvCapabilityGroupNonUniformBallot);
             return;
         }
+        case subgroup_shuffle_op:
+        case subgroup_shuffle_xor_op:
+        case subgroup_shuffle_up_op:
+        case subgroup_shuffle_down_op: {
+            SpvId scope_subgroup = emit_value(emitter, bb_builder, int32_literal(emitter->arena, SpvScopeSubgroup));
+            SpvId operands[] = { scope_subgroup, emit_value(emitter, bb_builder, args.nodes[0]), emit_value(emitter, bb_builder, args.nodes[1]) };
+            SpvOp opcode;
+            switch (the_op.op) {
+                case subgroup_shuffle_op:      opcode = SpvOpGroupNonUniformShuffle; break;
+                case subgroup_shuffle_xor_op:  opcode = SpvOpGroupNonUniformShuffleXor; break;
+                case subgroup_shuffle_up_op:   opcode = SpvOpGroupNonUniformShuffleUp; break;
+                case subgroup_shuffle_down_op: opcode = SpvOpGroupNonUniformShuffleDown; break;
+                default: SHADY_UNREACHABLE;
+            }
+            assert(results_count == 1);
+            results[0] = spvb_op(bb_builder, opcode, emit_type(emitter, get_unqualified_type(first(args)->type)), 3, operands);
+            if (the_op.op == subgroup_shuffle_up_op || the_op.op == subgroup_shuffle_down_op)
+                spvb_capability(emitter->file_builder, SpvCapabilityGroupNonUniformShuffleRelative);
+            else
+                spvb_capability(emitter->file_builder, SpvCapabilityGroupNonUniformShuffle);
+            return;
+        }
         case subgroup_reduce_sum_op: {
             SpvId scope_subgroup = emit_value(emitter, bb_builder, int32_literal(emitter->arena, SpvScopeSubgroup));
             assert(results_count == 1);
@@ -257,6 +279,14 @@ static void emit_primop(Emitter* emitter, FnBuilder fn_builder, BBBuilder bb_bui
             spvb_capability(emitter->file_builder, SpvCapabilityGroupNonUniformArithmetic);
             return;
         }
+        case subgroup_barrier_op: {
+            assert(results_count == 0);
+            SpvId scope_subgroup = emit_value(emitter, bb_builder, int32_literal(emitter->arena, SpvScopeSubgroup));
+            // subgroup variables end up in workgroup memory, see lower_subgroup_vars
+            SpvId semantics = emit_value(emitter, bb_builder, int32_literal(emitter->arena, SpvMemorySemanticsAcquireReleaseMask | SpvMemorySemanticsWorkgroupMemoryMask));
+            spvb_control_barrier(bb_builder, scope_subgroup, scope_subgroup, semantics);
+            return;
+        }
         case subgroup_elect_first_op: {
             SpvId result_t = emit_type(emitter, bool_type(emitter->arena));
             SpvId scope_subgroup = emit_value(emitter, bb_builder, int32_literal(emitter->arena, SpvScopeSubgroup));
@@ -43,6 +43,70 @@ SpvStorageClass emit_addr_space(Emitter* emitter, AddressSpace address_space) {
     }
 }
 
+static void find_narrow_types(const Type* type, bool* has_8bit, bool* has_16bit) {
+    switch (type->tag) {
+        case Int_TAG:
+            *has_8bit |= type->payload.int_type.width == IntTy8;
+            *has_16bit |= type->payload.int_type.width == IntTy16;
+            break;
+        case Float_TAG:
+            *has_16bit |= type->payload.float_type.width == FloatTy16;
+            break;
+        case PackType_TAG: find_narrow_types(type->payload.pack_type.element_type, has_8bit, has_16bit); break;
+        case ArrType_TAG: find_narrow_types(type->payload.arr_type.element_type, has_8bit, has_16bit); break;
+        case RecordType_TAG: {
+            Nodes members = type->payload.record_type.members;
+            for (size_t i = 0; i < members.count; i++)
+                find_narrow_types(members.nodes[i], has_8bit, has_16bit);
+            break;
+        }
+        case TypeDeclRef_TAG: find_narrow_types(type->payload.type_decl_ref.decl->payload.nom_type.body, has_8bit, has_16bit); break;
+        // pointers don't put their pointee in this storage class
+        default: break;
+    }
+}
+
+/// 8 and 16-bit types need their own capabilities to live in interface storage classes
+static void emit_narrow_storage_capabilities(Emitter* emitter, SpvStorageClass storage_class, const Type* pointee) {
+    bool has_8bit = false, has_16bit = false;
+    find_narrow_types(pointee, &has_8bit, &has_16bit);
+    SpvCapability cap8 = 0, cap16 = 0;
+    switch (storage_class) {
+        case SpvStorageClassStorageBuffer:
+        case SpvStorageClassPhysicalStorageBuffer:
+            cap8 = SpvCapabilityStorageBuffer8BitAccess;
+            cap16 = SpvCapabilityStorageBuffer16BitAccess;
+            break;
+        case SpvStorageClassUniform:
+            cap8 = SpvCapabilityUniformAndStorageBuffer8BitAccess;
+            cap16 = SpvCapabilityUniformAndStorageBuffer16BitAccess;
+            break;
+        case SpvStorageClassPushConstant:
+            cap8 = SpvCapabilityStoragePushConstant8;
+            cap16 = SpvCapabilityStoragePushConstant16;
+            break;
+        case SpvStorageClassInput:
+        case SpvStorageClassOutput:
+            if (has_8bit)
+                error("8-bit types can't be used in shader inputs or outputs");
+            cap16 = SpvCapabilityStorageInputOutput16;
+            break;
+        default: return;
+    }
+    uint8_t major = emitter->configuration->target_spirv_version.major;
+    uint8_t minor = emitter->configuration->target_spirv_version.minor;
+    if (has_8bit) {
+        spvb_capability(emitter->file_builder, cap8);
+        if (major == 1 && minor < 5)
+            spvb_extension(emitter->file_builder, "SPV_KHR_8bit_storage");
+    }
+    if (has_16bit) {
+        spvb_capability(emitter->file_builder, cap16);
+        if (major == 1 && minor < 3)
+            spvb_extension(emitter->file_builder, "SPV_KHR_16bit_storage");
+    }
+}
+
 static const Node* rewrite_normalize(Rewriter* rewriter, const Node* node) {
     const Node* found = search_processed(rewriter, node);
     if (found) return found;
@@ -146,6 +210,7 @@ SpvId emit_type(Emitter* emitter, const Type* type) {
         } case PtrType_TAG: {
             SpvId pointee = emit_type(emitter, type->payload.ptr_type.pointed_type);
             SpvStorageClass sc = emit_addr_space(emitter, type->payload.ptr_type.address_space);
+            emit_narrow_storage_capabilities(emitter, sc, type->payload.ptr_type.pointed_type);
             new = spvb_ptr_type(emitter->file_builder, sc, pointee);
             //if (is_physical_as(type->payload.ptr_type.address_space) && type->payload.ptr_type.pointed_type->tag == ArrType_TAG) {
             //    TypeMemLayout elem_mem_layout = get_mem_layout(emitter->arena, type->payload.ptr_type.pointed_type);
@@ -780,6 +780,13 @@ void spvb_store(SpvbBasicBlockBuilder* bb_builder, SpvId value, SpvId pointer, s
         literal_int(operands[i]);
 }
 
+void spvb_control_barrier(SpvbBasicBlockBuilder* bb_builder, SpvId execution_scope, SpvId memory_scope, SpvId semantics) {
+    op(SpvOpControlBarrier, 4);
+    ref_id(execution_scope);
+    ref_id(memory_scope);
+    ref_id(semantics);
+}
+
 SpvId spvb_op(SpvbBasicBlockBuilder* bb_builder, SpvOp op, SpvId result_type, size_t operands_count, SpvId operands[]) {
     op(op, 3 + operands_count);
     SpvId id = spvb_fresh_id(bb_builder->fn_builder->file_builder);
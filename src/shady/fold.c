@@ -27,6 +27,72 @@ static bool is_one(const Node* node) {
     return false;
 }
 
+static uint64_t int_width_mask(IntSizes width) {
+    return width == IntTy64 ? UINT64_MAX : ~(UINT64_MAX << (int_size_in_bytes(width) * 8));
+}
+
+static bool is_all_ones(const Node* node) {
+    const IntLiteral* lit = resolve_to_int_literal(node);
+    if (lit && (uint64_t) get_int_literal_value(*lit, false) == int_width_mask(lit->width))
+        return true;
+    return false;
+}
+
+/// Finds k such that @p node is the literal 2^k, with k > 0
+static bool is_power_of_two(const Node* node, uint64_t* log2) {
+    const IntLiteral* lit = resolve_to_int_literal(node);
+    if (!lit)
+        return false;
+    uint64_t value = get_int_literal_value(*lit, false);
+    if (value < 2 || (value & (value - 1)) != 0)
+        return false;
+    *log2 = __builtin_ctzll(value);
+    return true;
+}
+
+static bool is_int_value(const Node* node) {
+    return node->type && get_unqualified_type(node->type)->tag == Int_TAG;
+}
+
+/// Integers and booleans compare equal to themselves, unlike floats (NaN)
+static bool has_exact_equality(const Node* node) {
+    if (!node->type)
+        return false;
+    const Type* t = get_unqualified_type(node->type);
+    return t->tag == Int_TAG || t->tag == Bool_TAG;
+}
+
+/// Like the constructors do, narrow literals keep the bits above their width cleared
+static const Node* int_literal_truncated(IrArena* arena, bool is_signed, IntSizes width, uint64_t value) {
+    return int_literal(arena, (IntLiteral) { .is_signed = is_signed, .width = width, .value = value & int_width_mask(width) });
+}
+
+/// A literal of the same integer type as @p like, which is either a typed value or an integer literal
+static const Node* int_literal_like(IrArena* arena, const Node* like, uint64_t value) {
+    const IntLiteral* lit = resolve_to_int_literal(like);
+    if (lit)
+        return int_literal_truncated(arena, lit->is_signed, lit->width, value);
+    const Type* t = get_unqualified_type(like->type);
+    assert(t->tag == Int_TAG);
+    return int_literal_truncated(arena, t->payload.int_type.is_signed, t->payload.int_type.width, value);
+}
+
+static const Node* binary_op(IrArena* arena, Op op, const Node* a, const Node* b) {
+    return prim_op(arena, (PrimOp) { .op = op, .operands = mk_nodes(arena, a, b), .type_arguments = empty(arena) });
+}
+
+static const Node* bool_literal(IrArena* arena, bool value) {
+    return value ? true_lit(arena) : false_lit(arena);
+}
+
+static bool resolve_to_bool_literal(const Node* node, bool* value) {
+    switch (node->tag) {
+        case True_TAG: *value = true; return true;
+        case False_TAG: *value = false; return true;
+        default: return false;
+    }
+}
+
 static const Node* fold_let(IrArena* arena, const Node* node) {
     assert(node->tag == Let_TAG);
     const Node* instruction = node->payload.let.instruction;
@@ -139,32 +205,129 @@ static const Node* fold_prim_op(IrArena* arena, const Node* node) {
     }
 
 #define UN_OP(primop, op) case primop##_op: \
-if (all_int_literals)        return quote_single(arena, int_literal(arena, (IntLiteral) { .is_signed = is_signed, .width = int_width, .value = op int_literals[0]->value})); \
+if (all_int_literals)        return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, op int_literals[0]->value)); \
 else if (all_float_literals) return quote_single(arena, fp_literal_helper(arena, float_width, op get_float_literal_value(*float_literals[0]))); \
 else break;
 
 #define BIN_OP(primop, op) case primop##_op: \
-if (all_int_literals)        return quote_single(arena, int_literal(arena, (IntLiteral) { .is_signed = is_signed, .width = int_width, .value = int_literals[0]->value op int_literals[1]->value })); \
+if (all_int_literals)        return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, int_literals[0]->value op int_literals[1]->value)); \
 else if (all_float_literals) return quote_single(arena, fp_literal_helper(arena, float_width, get_float_literal_value(*float_literals[0]) op get_float_literal_value(*float_literals[1]))); \
+break;
+
+#define INT_BIN_OP(primop, op) case primop##_op: \
+if (all_int_literals)        return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, int_literals[0]->value op int_literals[1]->value)); \
+break;
+
+// literals might hold bits above their width, so we compare the values as seen through their type
+#define CMP_OP(primop, op) case primop##_op: \
+if (all_int_literals && is_signed) return quote_single(arena, bool_literal(arena, get_int_literal_value(*int_literals[0], true) op get_int_literal_value(*int_literals[1], true))); \
+else if (all_int_literals)         return quote_single(arena, bool_literal(arena, (uint64_t) get_int_literal_value(*int_literals[0], false) op (uint64_t) get_int_literal_value(*int_literals[1], false))); \
+else if (all_float_literals)       return quote_single(arena, bool_literal(arena, get_float_literal_value(*float_literals[0]) op get_float_literal_value(*float_literals[1]))); \
+break;
+
+#define FLOAT_UN_FN(primop, fn) case primop##_op: \
+if (all_float_literals) return quote_single(arena, fp_literal_helper(arena, float_width, fn(get_float_literal_value(*float_literals[0])))); \
 break;
 
     if (all_int_literals || all_float_literals) {
         switch (payload.op) {
             UN_OP(neg, -)
+            FLOAT_UN_FN(sqrt, sqrt)
+            FLOAT_UN_FN(floor, floor)
+            FLOAT_UN_FN(ceil, ceil)
+            FLOAT_UN_FN(round, round)
+            FLOAT_UN_FN(sin, sin)
+            FLOAT_UN_FN(cos, cos)
+            FLOAT_UN_FN(exp, exp)
+            case not_op:
+                if (all_int_literals)
+                    return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, ~int_literals[0]->value));
+                break;
+            case inv_sqrt_op:
+                if (all_float_literals)
+                    return quote_single(arena, fp_literal_helper(arena, float_width, 1.0 / sqrt(get_float_literal_value(*float_literals[0]))));
+                break;
+            case fract_op:
+                if (all_float_literals) {
+                    double value = get_float_literal_value(*float_literals[0]);
+                    return quote_single(arena, fp_literal_helper(arena, float_width, value - floor(value)));
+                }
+                break;
+            case pow_op:
+                if (all_float_literals)
+                    return quote_single(arena, fp_literal_helper(arena, float_width, pow(get_float_literal_value(*float_literals[0]), get_float_literal_value(*float_literals[1]))));
+                break;
+            case abs_op:
+            case sign_op: {
+                if (all_int_literals && is_signed) {
+                    int64_t value = get_int_literal_value(*int_literals[0], true);
+                    // negating through uint64_t, the minimum value is its own absolute value once truncated
+                    uint64_t result = payload.op == abs_op ? (value < 0 ? 0 - (uint64_t) value : (uint64_t) value) : (uint64_t) ((value > 0) - (value < 0));
+                    return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, result));
+                } else if (all_int_literals) {
+                    uint64_t value = get_int_literal_value(*int_literals[0], false);
+                    uint64_t result = payload.op == abs_op ? value : value != 0;
+                    return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, result));
+                }
+                double value = get_float_literal_value(*float_literals[0]);
+                double result = payload.op == abs_op ? fabs(value) : (double) ((value > 0) - (value < 0));
+                return quote_single(arena, fp_literal_helper(arena, float_width, result));
+            }
+            case min_op:
+            case max_op: {
+                bool pick_first;
+                if (all_int_literals && is_signed)
+                    pick_first = get_int_literal_value(*int_literals[0], true) < get_int_literal_value(*int_literals[1], true);
+                else if (all_int_literals)
+                    pick_first = (uint64_t) get_int_literal_value(*int_literals[0], false) < (uint64_t) get_int_literal_value(*int_literals[1], false);
+                else
+                    pick_first = get_float_literal_value(*float_literals[0]) < get_float_literal_value(*float_literals[1]);
+                if (payload.op == max_op)
+                    pick_first = !pick_first;
+                return quote_single(arena, payload.operands.nodes[pick_first ? 0 : 1]);
+            }
             BIN_OP(add, +)
             BIN_OP(sub, -)
             BIN_OP(mul, *)
-            BIN_OP(div, /)
+            INT_BIN_OP(and, &)
+            INT_BIN_OP(or, |)
+            INT_BIN_OP(xor, ^)
+            CMP_OP(gt, >)
+            CMP_OP(gte, >=)
+            CMP_OP(lt, <)
+            CMP_OP(lte, <=)
+            CMP_OP(eq, ==)
+            CMP_OP(neq, !=)
+            case div_op:
             case mod_op:
-                if (all_int_literals)
-                    return quote_single(arena, int_literal(arena, (IntLiteral) { .is_signed = is_signed, .width = int_width, .value = int_literals[0]->value % int_literals[1]->value }));
+                // leave it to the runtime to deal with division by zero
+                if (all_int_literals && get_int_literal_value(*int_literals[1], false) == 0)
+                    break;
+                if (payload.op == div_op) {
+                    // the minimum value divided by -1 overflows (and traps on the host), it wraps around to itself like a negation
+                    if (all_int_literals && is_signed && get_int_literal_value(*int_literals[1], true) == -1)
+                        return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, 0 - (uint64_t) get_int_literal_value(*int_literals[0], true)));
+                    if (all_int_literals && is_signed)
+                        return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, get_int_literal_value(*int_literals[0], true) / get_int_literal_value(*int_literals[1], true)));
+                    else if (all_int_literals)
+                        return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, (uint64_t) get_int_literal_value(*int_literals[0], false) / (uint64_t) get_int_literal_value(*int_literals[1], false)));
+                    else
+                        return quote_single(arena, fp_literal_helper(arena, float_width, get_float_literal_value(*float_literals[0]) / get_float_literal_value(*float_literals[1])));
+                }
+                // same overflow as for div, but anything modulo -1 is zero anyways
+                if (all_int_literals && is_signed && get_int_literal_value(*int_literals[1], true) == -1)
+                    return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, 0));
+                if (all_int_literals && is_signed)
+                    return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, get_int_literal_value(*int_literals[0], true) % get_int_literal_value(*int_literals[1], true)));
+                else if (all_int_literals)
+                    return quote_single(arena, int_literal_truncated(arena, is_signed, int_width, (uint64_t) get_int_literal_value(*int_literals[0], false) % (uint64_t) get_int_literal_value(*int_literals[1], false)));
                 else
                     return quote_single(arena, fp_literal_helper(arena, float_width, fmod(get_float_literal_value(*float_literals[0]), get_float_literal_value(*float_literals[1]))));
             case reinterpret_op: {
                 const Type* dst_t = first(payload.type_arguments);
                 uint64_t raw_value = int_literals[0] ? int_literals[0]->value : float_literals[0]->value;
                 if (dst_t->tag == Int_TAG) {
-                    return quote_single(arena, int_literal(arena, (IntLiteral) { .is_signed = dst_t->payload.int_type.is_signed, .width = dst_t->payload.int_type.width, .value = raw_value }));
+                    return quote_single(arena, int_literal_truncated(arena, dst_t->payload.int_type.is_signed, dst_t->payload.int_type.width, raw_value));
                 } else if (dst_t->tag == Float_TAG) {
                     return quote_single(arena, float_literal(arena, (FloatLiteral) { .width = dst_t->payload.float_type.width, .value = raw_value }));
                 }
@@ -181,29 +344,82 @@ break;
                     if (all_int_literals) {
                         uint64_t old_value = get_int_literal_value(*int_literals[0], int_literals[0]->is_signed);
                         uint64_t value = old_value & bitmask;
-                        return quote_single(arena, int_literal(arena, (IntLiteral) {.is_signed = dst_t->payload.int_type.is_signed, .width = dst_t->payload.int_type.width, .value = value}));
+                        return quote_single(arena, int_literal_truncated(arena, dst_t->payload.int_type.is_signed, dst_t->payload.int_type.width, value));
                     } else if (all_float_literals) {
                         double old_value = get_float_literal_value(*float_literals[0]);
                         int64_t value = old_value;
-                        return quote_single(arena, int_literal(arena, (IntLiteral) {.is_signed = dst_t->payload.int_type.is_signed, .width = dst_t->payload.int_type.width, .value = value}));
+                        return quote_single(arena, int_literal_truncated(arena, dst_t->payload.int_type.is_signed, dst_t->payload.int_type.width, value));
                     }
                 } else if (dst_t->tag == Float_TAG) {
                     if (all_int_literals) {
-                        uint64_t old_value = get_int_literal_value(*int_literals[0], int_literals[0]->is_signed);
-                        double value = old_value;
+                        int64_t old_value = get_int_literal_value(*int_literals[0], int_literals[0]->is_signed);
+                        double value = int_literals[0]->is_signed ? (double) old_value : (double) (uint64_t) old_value;
                         return quote_single(arena, fp_literal_helper(arena, dst_t->payload.float_type.width, value));
                     } else if (all_float_literals) {
                         double old_value = get_float_literal_value(*float_literals[0]);
-                        return quote_single(arena, float_literal(arena, (FloatLiteral) { .width = dst_t->payload.float_type.width, .value = old_value }));
+                        return quote_single(arena, fp_literal_helper(arena, dst_t->payload.float_type.width, old_value));
                     }
                 }
                 break;
             }
+            case lshift_op:
+            case rshift_logical_op:
+            case rshift_arithm_op: {
+                if (!all_int_literals)
+                    break;
+                uint64_t shift = get_int_literal_value(*int_literals[1], false);
+                // shifting by the width of the type or more is undefined
+                if (shift >= int_size_in_bytes(int_literals[0]->width) * 8)
+                    break;
+                IntLiteral result = *int_literals[0];
+                if (payload.op == lshift_op)
+                    result.value = (uint64_t) get_int_literal_value(*int_literals[0], false) << shift;
+                else if (payload.op == rshift_logical_op)
+                    result.value = (uint64_t) get_int_literal_value(*int_literals[0], false) >> shift;
+                else
+                    result.value = get_int_literal_value(*int_literals[0], true) >> shift;
+                return quote_single(arena, int_literal_truncated(arena, result.is_signed, result.width, result.value));
+            }
             default: break;
         }
     }
 
+    bool bool_literals[2];
+    if (payload.operands.count > 0 && payload.operands.count <= 2) {
+        bool all_bool_literals = true;
+        for (size_t i = 0; i < payload.operands.count; i++)
+            all_bool_literals &= resolve_to_bool_literal(payload.operands.nodes[i], &bool_literals[i]);
+        if (all_bool_literals) {
+            switch (payload.op) {
+                case not_op: return quote_single(arena, bool_literal(arena, !bool_literals[0]));
+                case and_op: return quote_single(arena, bool_literal(arena, bool_literals[0] && bool_literals[1]));
+                case or_op: return quote_single(arena, bool_literal(arena, bool_literals[0] || bool_literals[1]));
+                case xor_op:
+                case neq_op: return quote_single(arena, bool_literal(arena, bool_literals[0] != bool_literals[1]));
+                case eq_op: return quote_single(arena, bool_literal(arena, bool_literals[0] == bool_literals[1]));
+                default: break;
+            }
+        }
+    }
+
     switch (payload.op) {
+        case select_op: {
+            const Node* condition_value = first(payload.operands);
+            bool condition;
+            if (resolve_to_bool_literal(condition_value, &condition))
+                return quote_single(arena, payload.operands.nodes[condition ? 1 : 2]);
+            if (payload.operands.nodes[1] == payload.operands.nodes[2])
+                return quote_single(arena, payload.operands.nodes[1]);
+            // select(c, true, false) is just c, and the other way around it's its negation
+            bool if_true, if_false;
+            if (resolve_to_bool_literal(payload.operands.nodes[1], &if_true) && resolve_to_bool_literal(payload.operands.nodes[2], &if_false)) {
+                assert(if_true != if_false);
+                if (if_true)
+                    return quote_single(arena, condition_value);
+                return prim_op(arena, (PrimOp) { .op = not_op, .operands = singleton(condition_value), .type_arguments = empty(arena) });
+            }
+            break;
+        }
         case add_op: {
             // If either operand is zero, destroy the add
             for (size_t i = 0; i < 2; i++)
@@ -218,6 +434,8 @@ break;
             // if first operand is zero, invert the second one
             if (is_zero(payload.operands.nodes[0]))
                 return prim_op(arena, (PrimOp) { .op = neg_op, .operands = singleton(payload.operands.nodes[1]), .type_arguments = empty(arena) });
+            if (payload.operands.nodes[0] == payload.operands.nodes[1] && is_int_value(payload.operands.nodes[0]))
+                return quote_single(arena, int_literal_like(arena, payload.operands.nodes[0], 0));
             break;
         }
         case mul_op: {
@@ -229,15 +447,105 @@ break;
                 if (is_one(payload.operands.nodes[i]))
                     return quote_single(arena, payload.operands.nodes[1 - i]);
 
+            // multiplying by 2^k is the same as shifting by k, signed or not
+            uint64_t log2;
+            for (size_t i = 0; i < 2; i++)
+                if (is_power_of_two(payload.operands.nodes[i], &log2) && is_int_value(payload.operands.nodes[1 - i]))
+                    return binary_op(arena, lshift_op, payload.operands.nodes[1 - i], int_literal_like(arena, payload.operands.nodes[i], log2));
+
             break;
         }
         case div_op: {
             // If second operand is one, return the first one
             if (is_one(payload.operands.nodes[1]))
                 return quote_single(arena, payload.operands.nodes[0]);
+            // signed division rounds towards zero, which a shift does not do for negative numbers
+            uint64_t log2;
+            const IntLiteral* divisor = resolve_to_int_literal(payload.operands.nodes[1]);
+            if (divisor && !divisor->is_signed && is_power_of_two(payload.operands.nodes[1], &log2))
+                return binary_op(arena, rshift_logical_op, payload.operands.nodes[0], int_literal_like(arena, payload.operands.nodes[1], log2));
+            break;
+        }
+        case mod_op: {
+            if (is_one(payload.operands.nodes[1]))
+                return quote_single(arena, int_literal_like(arena, payload.operands.nodes[1], 0));
+            uint64_t log2;
+            const IntLiteral* divisor = resolve_to_int_literal(payload.operands.nodes[1]);
+            if (divisor && !divisor->is_signed && is_power_of_two(payload.operands.nodes[1], &log2))
+                return binary_op(arena, and_op, payload.operands.nodes[0], int_literal_like(arena, payload.operands.nodes[1], (1ull << log2) - 1));
             break;
         }
-        case subgroup_broadcast_first_op: {
+        case and_op:
+        case or_op: {
+            if (payload.operands.nodes[0] == payload.operands.nodes[1])
+                return quote_single(arena, payload.operands.nodes[0]);
+            // x & 0 = 0, x & ~0 = x, x | 0 = x and x | ~0 = ~0, the same goes for booleans
+            for (size_t i = 0; i < 2; i++) {
+                const Node* operand = payload.operands.nodes[i];
+                bool bool_value;
+                bool absorbs = payload.op == and_op ? is_zero(operand) : is_all_ones(operand);
+                bool neutral = payload.op == and_op ? is_all_ones(operand) : is_zero(operand);
+                if (resolve_to_bool_literal(operand, &bool_value)) {
+                    absorbs = payload.op == and_op ? !bool_value : bool_value;
+                    neutral = !absorbs;
+                }
+                if (absorbs)
+                    return quote_single(arena, operand);
+                if (neutral)
+                    return quote_single(arena, payload.operands.nodes[1 - i]);
+            }
+            break;
+        }
+        case xor_op: {
+            for (size_t i = 0; i < 2; i++) {
+                bool bool_value;
+                if (is_zero(payload.operands.nodes[i]) || (resolve_to_bool_literal(payload.operands.nodes[i], &bool_value) && !bool_value))
+                    return quote_single(arena, payload.operands.nodes[1 - i]);
+            }
+            if (payload.operands.nodes[0] == payload.operands.nodes[1]) {
+                if (is_int_value(payload.operands.nodes[0]))
+                    return quote_single(arena, int_literal_like(arena, payload.operands.nodes[0], 0));
+                if (has_exact_equality(payload.operands.nodes[0]))
+                    return quote_single(arena, false_lit(arena));
+            }
+            break;
+        }
+        case lshift_op:
+        case rshift_logical_op:
+        case rshift_arithm_op: {
+            if (is_zero(payload.operands.nodes[1]) || is_zero(payload.operands.nodes[0]))
+                return quote_single(arena, payload.operands.nodes[0]);
+            break;
+        }
+        case min_op:
+        case max_op: {
+            if (payload.operands.nodes[0] == payload.operands.nodes[1])
+                return quote_single(arena, payload.operands.nodes[0]);
+            break;
+        }
+        case eq_op:
+        case gte_op:
+        case lte_op:
+        case neq_op:
+        case gt_op:
+        case lt_op: {
+            if (payload.operands.nodes[0] == payload.operands.nodes[1] && has_exact_equality(payload.operands.nodes[0])) {
+                bool reflexive = payload.op == eq_op || payload.op == gte_op || payload.op == lte_op;
+                return quote_single(arena, bool_literal(arena, reflexive));
+            }
+            break;
+        }
+        case lea_op: {
+            // a zero offset without indices is the base pointer itself
+            if (payload.operands.count == 2 && is_zero(payload.operands.nodes[1]))
+                return quote_single(arena, first(payload.operands));
+            break;
+        }
+        case subgroup_broadcast_first_op:
+        case subgroup_shuffle_op:
+        case subgroup_shuffle_xor_op:
+        case subgroup_shuffle_up_op:
+        case subgroup_shuffle_down_op: {
             const Node* value = first(payload.operands);
             if (is_qualified_type_uniform(value->type))
                 return quote_single(arena, value);
@@ -258,6 +566,25 @@ break;
             if (payload.type_arguments.nodes[0] == get_unqualified_type(payload.operands.nodes[0]->type))
                 return quote_single(arena, payload.operands.nodes[0]);
             break;
+        case extract_op: {
+            // look through composites built right there, splitting up aggregates generates a lot of those
+            const Node* composite = first(payload.operands);
+            const IntLiteral* index = resolve_to_int_literal(payload.operands.nodes[1]);
+            const Node* element = NULL;
+            if (composite->tag == Composite_TAG && index) {
+                Nodes contents = composite->payload.composite.contents;
+                uint64_t i = get_int_literal_value(*index, false);
+                if (i < contents.count)
+                    element = contents.nodes[i];
+            } else if (composite->tag == Fill_TAG)
+                element = composite->payload.fill.value;
+            if (!element)
+                break;
+            if (payload.operands.count == 2)
+                return quote_single(arena, element);
+            Nodes operands = concat_nodes(arena, singleton(element), nodes(arena, payload.operands.count - 2, &payload.operands.nodes[2]));
+            return prim_op(arena, (PrimOp) { .op = extract_op, .operands = operands, .type_arguments = empty(arena) });
+        }
         default: break;
     }
     return node;
@@ -51,6 +51,12 @@ void destroy_ir_arena(IrArena* arena) {
     destroy_dict(arena->string_set);
     destroy_dict(arena->nodes_set);
     destroy_dict(arena->node_set);
+    if (arena->mem_layouts)
+        destroy_dict(arena->mem_layouts);
+    if (arena->record_layouts)
+        destroy_dict(arena->record_layouts);
+    if (arena->subtypes)
+        destroy_dict(arena->subtypes);
     destroy_arena(arena->arena);
     free(arena);
 }
@@ -20,6 +20,11 @@ typedef struct IrArena_ {
 
     struct Dict* nodes_set;
     struct Dict* strings_set;
+
+    /// Memoised type queries, keyed on the interned types of this arena. Created on first use.
+    struct Dict* mem_layouts;
+    struct Dict* record_layouts;
+    struct Dict* subtypes;
 } IrArena_;
 
 struct Module_ {
@@ -30,6 +35,7 @@ struct Module_ {
 };
 
 void register_decl_module(Module*, Node*);
+void remove_decl_module(Module*, const Node*);
 void destroy_module(Module* m);
 
 struct BodyBuilder_ {
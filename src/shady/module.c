@@ -36,6 +36,18 @@ void register_decl_module(Module* m, Node* node) {
     append_list(Node*, m->decls, node);
 }
 
+void remove_decl_module(Module* m, const Node* node) {
+    assert(!m->sealed);
+    size_t count = entries_count_list(m->decls);
+    for (size_t i = 0; i < count; i++) {
+        if (read_list(const Node*, m->decls)[i] == node) {
+            delete_list_impl(m->decls, i);
+            return;
+        }
+    }
+    assert(false && "not a declaration of this module");
+}
+
 const Node* get_declaration(const Module* m, String name) {
     Nodes existing_decls = get_module_declarations(m);
     for (size_t i = 0; i < existing_decls.count; i++) {
@@ -2,6 +2,7 @@
 #include "log.h"
 #include "ir_private.h"
 #include "portability.h"
+#include "util.h"
 
 #include "dict.h"
 
@@ -64,9 +65,7 @@ double get_float_literal_value(FloatLiteral literal) {
     double r;
     switch (literal.width) {
         case FloatTy16:
-            error_print("TODO: fp16 literals");
-            error_die();
-            SHADY_UNREACHABLE;
+            r = (double) fp16_bits_to_fp32(literal.value & 0xFFFF);
             break;
         case FloatTy32: {
             float f;
@@ -198,6 +197,16 @@ const FloatLiteral* resolve_to_float_literal(const Node* node) {
     return NULL;
 }
 
+bool is_literal(const Node* node) {
+    switch (node->tag) {
+        case IntLiteral_TAG:
+        case FloatLiteral_TAG:
+        case True_TAG:
+        case False_TAG: return true;
+        default: return false;
+    }
+}
+
 static bool is_zero(const Node* node) {
     const IntLiteral* lit = resolve_to_int_literal(node);
     if (lit && get_int_literal_value(*lit, false) == 0)
@@ -127,10 +127,14 @@ static const Node* desugar_let_mut(Context* ctx, const Node* node) {
     const Node* old_lam = node->payload.let.tail;
     assert(old_lam && is_case(old_lam));
 
+    // plain values get the type of the variables they initialise, so that literals come out with the right width
+    Nodes old_params = old_lam->payload.case_.params;
+    if (is_value(ninstruction) && old_params.count == 1)
+        ninstruction = constrained(a, (ConstrainedValue) { .type = rewrite_node(&ctx->rewriter, old_params.nodes[0]->payload.var.type), .value = ninstruction });
+
     BodyBuilder* bb = begin_body(a);
 
-    Nodes initial_values = bind_instruction_outputs_count(bb, ninstruction, old_lam->payload.case_.params.count, NULL, false);
-    Nodes old_params = old_lam->payload.case_.params;
+    Nodes initial_values = bind_instruction_outputs_count(bb, ninstruction, old_params.count, NULL, false);
     for (size_t i = 0; i < old_params.count; i++) {
         const Node* oparam = old_params.nodes[i];
         const Type* type_annotation = oparam->payload.var.type;
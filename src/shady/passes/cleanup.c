@@ -117,6 +117,7 @@ Module* cleanup(SHADY_UNUSED const CompilerConfig* config, Module* const src) {
     do {
         debug_print("Cleanup round %d\n", r);
         todo = false;
+        todo |= opt_sroa(config, &m);
         todo |= opt_demote_alloca(config, &m);
         todo |= simplify(config, &m);
         r++;
@@ -2,6 +2,7 @@
 
 #include "log.h"
 #include "portability.h"
+#include "util.h"
 
 #include "../type.h"
 #include "../rewrite.h"
@@ -206,7 +207,8 @@ static const Node* _infer_value(Context* ctx, const Node* node, const Type* expe
                 uint64_t v;
                 switch (expected_type->payload.float_type.width) {
                     case FloatTy16:
-                        error("TODO: implement fp16 parsing");
+                        v = fp32_to_fp16_bits(strtof(node->payload.untyped_number.plaintext, NULL));
+                        break;
                     case FloatTy32:
                         assert(sizeof(float) == sizeof(uint32_t));
                         float f = strtof(node->payload.untyped_number.plaintext, NULL);
@@ -405,6 +407,15 @@ static const Node* _infer_primop(Context* ctx, const Node* node, const Type* exp
             new_operands[0] = infer(ctx, old_operands.nodes[0], qualified_type_helper(element_type, false));
             goto rebuild;
         }
+        case push_stack_uniform_op: {
+            assert(old_operands.count == 1);
+            assert(type_args.count == 1);
+            const Type* element_type = type_args.nodes[0];
+            assert(is_data_type(element_type));
+            new_operands[0] = infer(ctx, old_operands.nodes[0], qualified_type_helper(element_type, true));
+            goto rebuild;
+        }
+        case pop_stack_uniform_op:
         case pop_stack_op: {
             assert(old_operands.count == 0);
             assert(type_args.count == 1);
@@ -524,11 +535,19 @@ static const Node* _infer_primop(Context* ctx, const Node* node, const Type* exp
         case empty_mask_op:
         case subgroup_active_mask_op:
         case subgroup_elect_first_op:
+        case subgroup_barrier_op:
             input_types = nodes(a, 0, NULL);
             break;
         case subgroup_broadcast_first_op:
             new_operands[0] = infer(ctx, old_operands.nodes[0], NULL);
             goto rebuild;
+        case subgroup_shuffle_op:
+        case subgroup_shuffle_xor_op:
+        case subgroup_shuffle_up_op:
+        case subgroup_shuffle_down_op:
+            new_operands[0] = infer(ctx, old_operands.nodes[0], NULL);
+            new_operands[1] = infer(ctx, old_operands.nodes[1], qualified_type_helper(uint32_type(a), false));
+            goto rebuild;
         case subgroup_ballot_op:
             input_types = singleton(qualified_type_helper(bool_type(a), false));
             break;
@@ -545,8 +564,23 @@ static const Node* _infer_primop(Context* ctx, const Node* node, const Type* exp
             goto rebuild;
         }
         default: {
+            // untyped numbers take the type of the other operands, so they don't force narrow or wide arithmetic to 32 bits
+            // this only makes sense for ops working on operands of the same type, and not for things like composite indices
+            bool homogeneous = get_primop_class(op) & (OcArithmetic | OcLogic | OcCompare | OcShift | OcMath);
+            const Type* number_type = NULL;
+            for (size_t i = 0; i < old_operands.count; i++) {
+                if (!old_operands.nodes[i] || old_operands.nodes[i]->tag == UntypedNumber_TAG)
+                    continue;
+                new_operands[i] = infer(ctx, old_operands.nodes[i], NULL);
+                const Type* operand_type = get_unqualified_type(new_operands[i]->type);
+                if (homogeneous && !number_type && (operand_type->tag == Int_TAG || operand_type->tag == Float_TAG))
+                    number_type = qualified_type_helper(operand_type, false);
+            }
             for (size_t i = 0; i < old_operands.count; i++) {
-                new_operands[i] = old_operands.nodes[i] ? infer(ctx, old_operands.nodes[i], NULL) : NULL;
+                if (!old_operands.nodes[i])
+                    new_operands[i] = NULL;
+                else if (old_operands.nodes[i]->tag == UntypedNumber_TAG)
+                    new_operands[i] = infer(ctx, old_operands.nodes[i], number_type);
             }
             goto rebuild;
         }
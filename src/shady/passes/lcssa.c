@@ -93,9 +93,9 @@ const Node* process_abstraction_body(Context* ctx, const Node* old, const Node*
     const CFNode* n = scope_lookup(ctx->scope, old);
 
     size_t children_count = 0;
-    LARRAY(const Node*, old_children, entries_count_list(n->dominates));
-    for (size_t i = 0; i < entries_count_list(n->dominates); i++) {
-        CFNode* c = read_list(CFNode*, n->dominates)[i];
+    LARRAY(const Node*, old_children, n->dominates.count);
+    for (size_t i = 0; i < n->dominates.count; i++) {
+        CFNode* c = n->dominates.nodes[i];
         if (is_case(c->node))
             continue;
         old_children[children_count++] = c->node;
@@ -29,6 +29,8 @@ typedef struct Context_ {
 
     struct Dict* lifted;
     bool disable_lowering;
+    /// uniform values go to the uniform stack, only if the subgroup never splits up between spills and reloads
+    bool uniform_spills;
     const CompilerConfig* config;
 } Context;
 
@@ -37,7 +39,10 @@ static const Node* process_node(Context* ctx, const Node* node);
 typedef struct {
     const Node* old_cont;
     const Node* lifted_fn;
+    /// values pushed on the stack before jumping to the lifted continuation
     struct List* save_values;
+    /// values recomputed in the lifted continuation from the saved ones
+    struct List* remat_values;
 } LiftedCont;
 
 #pragma GCC diagnostic error "-Wswitch"
@@ -53,7 +58,7 @@ static const Node* add_spill_instrs(Context* ctx, BodyBuilder* builder, struct L
         deconstruct_qualified_type(&t);
         assert(t->tag != PtrType_TAG || is_physical_as(t->payload.ptr_type.address_space));
         const Node* save_instruction = prim_op(a, (PrimOp) {
-            .op = push_stack_op,
+            .op = ctx->uniform_spills && is_qualified_type_uniform(nvar->type) ? push_stack_uniform_op : push_stack_op,
             .type_arguments = singleton(get_unqualified_type(nvar->type)),
             .operands = singleton(nvar),
         });
@@ -65,6 +70,96 @@ static const Node* add_spill_instrs(Context* ctx, BodyBuilder* builder, struct L
     return sp;
 }
 
+/// How many instructions deep we're willing to go to recompute a value
+#define MAX_REMAT_DEPTH 4
+
+static bool is_read_only_global(const Node* ptr) {
+    if (ptr->tag != RefDecl_TAG)
+        return false;
+    const Node* decl = ptr->payload.ref_decl.decl;
+    if (decl->tag != GlobalVariable_TAG)
+        return false;
+    switch (decl->payload.global_variable.address_space) {
+        case AsInput:
+        case AsUInput: return lookup_annotation(decl, "Builtin") != NULL;
+        case AsPushConstant: return true;
+        default: return false;
+    }
+}
+
+/// Cheap instructions without side effects, that yield the same value wherever they run in the invocation
+static bool is_rematerialisable_instruction(const Node* instruction) {
+    if (instruction->tag != PrimOp_TAG)
+        return false;
+    PrimOp prim_op = instruction->payload.prim_op;
+    switch (prim_op.op) {
+        case add_op: case sub_op: case mul_op: case neg_op:
+        case not_op: case and_op: case or_op: case xor_op:
+        case gt_op: case gte_op: case lt_op: case lte_op: case eq_op: case neq_op:
+        case rshift_logical_op: case rshift_arithm_op: case lshift_op:
+        case min_op: case max_op:
+        case quote_op: case select_op: case convert_op: case reinterpret_op:
+        case extract_op: case lea_op:
+        case size_of_op: case align_of_op: case offset_of_op:
+            return true;
+        case load_op: return is_read_only_global(first(prim_op.operands));
+        default: return false;
+    }
+}
+
+/// A value can be recomputed if its definition is cheap, and only depends on other live values (which will be available
+/// in the lifted continuation) or on values that can themselves be recomputed. This never makes us save more values.
+static bool can_rematerialise(struct Dict* live, const Node* value, int depth) {
+    switch (value->tag) {
+        case Variable_TAG: break;
+        case IntLiteral_TAG:
+        case FloatLiteral_TAG:
+        case True_TAG:
+        case False_TAG:
+        case NullPtr_TAG:
+        case Undef_TAG:
+        case RefDecl_TAG:
+        case FnAddr_TAG: return true;
+        default: return false;
+    }
+
+    if (depth > 0 && find_key_dict(const Node*, live, value))
+        return true;
+    if (depth >= MAX_REMAT_DEPTH)
+        return false;
+
+    const Node* def = get_var_def(value->payload.var);
+    if (!def || !is_rematerialisable_instruction(def))
+        return false;
+    if (unwrap_multiple_yield_types(value->arena, def->type).count != 1)
+        return false;
+
+    Nodes operands = def->payload.prim_op.operands;
+    for (size_t i = 0; i < operands.count; i++) {
+        if (!can_rematerialise(live, operands.nodes[i], depth + 1))
+            return false;
+    }
+    return true;
+}
+
+static const Node* rematerialise(Context* ctx, BodyBuilder* bb, const Node* ovar) {
+    const Node* found = search_processed(&ctx->rewriter, ovar);
+    if (found)
+        return found;
+
+    assert(ovar->tag == Variable_TAG);
+    const Node* odef = get_var_def(ovar->payload.var);
+    Nodes ooperands = odef->payload.prim_op.operands;
+    for (size_t i = 0; i < ooperands.count; i++) {
+        if (ooperands.nodes[i]->tag == Variable_TAG)
+            rematerialise(ctx, bb, ooperands.nodes[i]);
+    }
+
+    const Node* value = first(bind_instruction_named(bb, rewrite_node(&ctx->rewriter, odef), &ovar->payload.var.name));
+    register_processed(&ctx->rewriter, ovar, value);
+    return value;
+}
+
 static LiftedCont* lambda_lift(Context* ctx, const Node* cont, String given_name) {
     assert(is_basic_block(cont) || is_case(cont));
     LiftedCont** found = find_value_dict(const Node*, LiftedCont*, ctx->lifted, cont);
@@ -79,10 +174,27 @@ static LiftedCont* lambda_lift(Context* ctx, const Node* cont, String given_name
 
     // Compute the live stuff we'll need
     Scope* scope = new_scope(cont);
-    struct List* recover_context = compute_free_variables(scope, cont);
-    size_t recover_context_size = entries_count_list(recover_context);
+    // since we're in SSA form, those are exactly the values live on entry to the continuation
+    struct List* free_variables = compute_free_variables(scope, cont);
     destroy_scope(scope);
 
+    // Split them between what we need to save, and what we can recompute from that
+    struct Dict* live = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node);
+    for (size_t i = 0; i < entries_count_list(free_variables); i++)
+        insert_set_get_result(const Node*, live, read_list(const Node*, free_variables)[i]);
+    struct List* recover_context = new_list(const Node*);
+    struct List* remat_values = new_list(const Node*);
+    for (size_t i = 0; i < entries_count_list(free_variables); i++) {
+        const Node* item = read_list(const Node*, free_variables)[i];
+        if (can_rematerialise(live, item, 0))
+            append_list(const Node*, remat_values, item);
+        else
+            append_list(const Node*, recover_context, item);
+    }
+    destroy_dict(live);
+    destroy_list(free_variables);
+    size_t recover_context_size = entries_count_list(recover_context);
+
     debugv_print("free (spilled) variables at '%s': ", name);
     for (size_t i = 0; i < recover_context_size; i++) {
         const Node* item = read_list(const Node*, recover_context)[i];
@@ -91,6 +203,14 @@ static LiftedCont* lambda_lift(Context* ctx, const Node* cont, String given_name
             debugv_print(", ");
     }
     debugv_print("\n");
+    debugv_print("rematerialised variables at '%s': ", name);
+    for (size_t i = 0; i < entries_count_list(remat_values); i++) {
+        const Node* item = read_list(const Node*, remat_values)[i];
+        debugv_print(get_value_name_safe(item));
+        if (i + 1 < entries_count_list(remat_values))
+            debugv_print(", ");
+    }
+    debugv_print("\n");
 
     // Create and register new parameters for the lifted continuation
     Nodes new_params = recreate_variables(&ctx->rewriter, oparams);
@@ -98,6 +218,7 @@ static LiftedCont* lambda_lift(Context* ctx, const Node* cont, String given_name
     LiftedCont* lifted_cont = calloc(sizeof(LiftedCont), 1);
     lifted_cont->old_cont = cont;
     lifted_cont->save_values = recover_context;
+    lifted_cont->remat_values = remat_values;
     insert_dict(const Node*, LiftedCont*, ctx->lifted, cont, lifted_cont);
 
     Context lifting_ctx = *ctx;
@@ -121,17 +242,22 @@ static LiftedCont* lambda_lift(Context* ctx, const Node* cont, String given_name
 
         const Type* value_type = rewrite_node(&ctx->rewriter, ovar->type);
 
+        bool uniform = is_qualified_type_uniform(ovar->type);
         const Node* recovered_value = first(bind_instruction_named(bb, prim_op(a, (PrimOp) {
-            .op = pop_stack_op,
+            .op = ctx->uniform_spills && uniform ? pop_stack_uniform_op : pop_stack_op,
             .type_arguments = singleton(get_unqualified_type(value_type))
         }), &ovar->payload.var.name));
 
-        if (is_qualified_type_uniform(ovar->type))
+        if (uniform && !ctx->uniform_spills)
             recovered_value = first(bind_instruction_named(bb, prim_op(a, (PrimOp) { .op = subgroup_broadcast_first_op, .operands = singleton(recovered_value) }), &ovar->payload.var.name));
 
         register_processed(&lifting_ctx.rewriter, ovar, recovered_value);
     }
 
+    // Recompute the rest
+    for (size_t i = 0; i < entries_count_list(remat_values); i++)
+        rematerialise(&lifting_ctx, bb, read_list(const Node*, remat_values)[i]);
+
     const Node* substituted = rewrite_node(&lifting_ctx.rewriter, obody);
     //destroy_dict(lifting_ctx.rewriter.processed);
     destroy_rewriter(&lifting_ctx.rewriter);
@@ -199,6 +325,69 @@ static const Node* process_node(Context* ctx, const Node* node) {
     }
 }
 
+static bool is_varying(const Node* value) {
+    return !is_qualified_type_uniform(value->type);
+}
+
+/// Join points bound by a control node are the same for all the invocations that entered it
+static bool is_control_join_point(const Node* jp) {
+    if (jp->tag != Variable_TAG)
+        return false;
+    const Node* abs = jp->payload.var.abs;
+    if (!abs || abs->tag != Case_TAG)
+        return false;
+    const Node* structured = abs->payload.case_.structured_construct;
+    return structured && structured->tag == Control_TAG;
+}
+
+/// Whether the invocations of a subgroup might go separate ways somewhere in this function
+static bool has_divergent_control_flow(const Node* fn) {
+    if (!fn->payload.fun.body)
+        return false;
+    bool divergent = false;
+    Scope* scope = new_scope(fn);
+    for (size_t i = 0; i < scope->size && !divergent; i++) {
+        const Node* body = get_abstraction_body(scope->contents[i].node);
+        switch (body->tag) {
+            case Let_TAG:
+            case LetMut_TAG: {
+                const Node* instruction = get_let_instruction(body);
+                switch (instruction->tag) {
+                    case If_TAG: divergent = is_varying(instruction->payload.if_instr.condition); break;
+                    case Match_TAG: divergent = is_varying(instruction->payload.match_instr.inspect); break;
+                    case Call_TAG: divergent = is_varying(instruction->payload.call.callee); break;
+                    default: break;
+                }
+                break;
+            }
+            case Branch_TAG: divergent = is_varying(body->payload.branch.branch_condition); break;
+            case Switch_TAG: divergent = is_varying(body->payload.br_switch.switch_value); break;
+            case TailCall_TAG: divergent = is_varying(body->payload.tail_call.target); break;
+            case Join_TAG: divergent = is_varying(body->payload.join.join_point) && !is_control_join_point(body->payload.join.join_point); break;
+            default: break;
+        }
+    }
+    destroy_scope(scope);
+    return divergent;
+}
+
+/// The spills and the matching reloads can be far apart, in different functions even, so rather than tracking where the subgroup splits up
+/// we only use the uniform stack for programs where it never does.
+/// The scheduler's own functions are left out, they reconverge before returning and only diverge further when given varying destinations.
+static bool is_control_flow_uniform(Module* mod) {
+    Nodes decls = get_module_declarations(mod);
+    for (size_t i = 0; i < decls.count; i++) {
+        const Node* decl = decls.nodes[i];
+        if (decl->tag != Function_TAG || lookup_annotation(decl, "Internal"))
+            continue;
+        if (has_divergent_control_flow(decl)) {
+            debugv_print("Not using the uniform stack, control flow diverges in %s\n", get_abstraction_name(decl));
+            return false;
+        }
+    }
+    return true;
+}
+
 Module* lift_indirect_targets(const CompilerConfig* config, Module* src) {
     ArenaConfig aconfig = get_arena_config(get_module_arena(src));
     // this will be safe now since we won't lift any more code after this pass
@@ -208,6 +397,7 @@ Module* lift_indirect_targets(const CompilerConfig* config, Module* src) {
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process_node),
         .lifted = new_dict(const Node*, LiftedCont*, (HashFn) hash_node, (CmpFn) compare_node),
+        .uniform_spills = config->lower.uniform_stack && is_control_flow_uniform(src),
         .config = config,
     };
 
@@ -217,6 +407,7 @@ Module* lift_indirect_targets(const CompilerConfig* config, Module* src) {
     LiftedCont* lifted_cont;
     while (dict_iter(ctx.lifted, &iter, NULL, &lifted_cont)) {
         destroy_list(lifted_cont->save_values);
+        destroy_list(lifted_cont->remat_values);
         free(lifted_cont);
     }
     destroy_dict(ctx.lifted);
@@ -11,14 +11,24 @@
 #include "../type.h"
 #include "../ir_private.h"
 #include "../transform/ir_gen_helpers.h"
+#include "../transform/memory_layout.h"
+#include "../analysis/callgraph.h"
 
 #include <assert.h>
 
+typedef struct {
+    /// Frame sizes in bytes, keyed by the old functions
+    struct Dict* frame_sizes;
+    /// Set when the stack holds more than the frames, so its depth can't be derived from them
+    bool has_push_pop;
+} StackUsage;
+
 typedef struct Context_ {
     Rewriter rewriter;
     bool disable_lowering;
 
     const CompilerConfig* config;
+    StackUsage* usage;
     struct Dict* prepared_offsets;
     const Node* entry_base_stack_ptr;
     const Node* entry_stack_offset;
@@ -28,6 +38,43 @@ typedef struct Context_ {
     const Type* stack_ptr_t;
 } Context;
 
+/// Positions are handed out by walking the function body, structured constructs come before the tail of their let
+typedef struct {
+    size_t start, end;
+} LoopRange;
+
+/// The positions where the address of an alloca may still be used
+typedef struct {
+    size_t start, end;
+    /// the address went somewhere we don't track, so the slot can't be shared
+    bool escapes;
+    /// index of the last loop that contains a use, but not the alloca itself: the next iteration might still use it
+    size_t loop;
+} Lifetime;
+
+typedef struct {
+    Visitor visitor;
+    Arena* arena;
+    size_t counter;
+    /// jumps between basic blocks don't follow the order of the walk
+    bool unstructured;
+    /// maps variables holding (derived) addresses of allocas to their @ref Lifetime*
+    struct Dict* tracked;
+    /// maps alloca instructions to their @ref Lifetime*
+    struct Dict* lifetimes;
+    /// alloca instructions in the order they're found in
+    struct List* allocas;
+    struct List* loops;
+    struct List* loop_stack;
+} LContext;
+
+typedef struct {
+    const Type* type;
+    AddressSpace as;
+    const Node* offset;
+    size_t end;
+} SharedSlot;
+
 typedef struct {
     Visitor visitor;
     Context* context;
@@ -36,6 +83,8 @@ typedef struct {
     size_t num_slots;
     struct List* members;
     struct Dict* prepared_offsets;
+    /// @ref List of @ref SharedSlot for allocas whose lifetimes we know
+    struct List* shared;
 } VContext;
 
 typedef struct {
@@ -45,37 +94,226 @@ typedef struct {
     AddressSpace as;
 } StackSlot;
 
-static void search_operand_for_alloca(VContext* vctx, const Node* node) {
+static bool get_alloca_address_space(const Node* node, AddressSpace* as) {
+    if (node->tag != PrimOp_TAG)
+        return false;
+    switch (node->payload.prim_op.op) {
+        case alloca_op: *as = AsPrivatePhysical; return true;
+        case alloca_subgroup_op: *as = AsSubgroupPhysical; return true;
+        default: return false;
+    }
+}
+
+static void mark_escaping(LContext* lctx, const Node* node) {
+    if (node->tag == Variable_TAG) {
+        Lifetime** found = find_value_dict(const Node*, Lifetime*, lctx->tracked, node);
+        if (found)
+            (*found)->escapes = true;
+        return;
+    }
+    visit_node_operands(&lctx->visitor, IGNORE_ABSTRACTIONS_MASK | NcType, node);
+}
+
+static Lifetime* use_address(LContext* lctx, const Node* ptr, size_t pos) {
+    Lifetime** found = find_value_dict(const Node*, Lifetime*, lctx->tracked, ptr);
+    if (!found)
+        return NULL;
+    Lifetime* lifetime = *found;
+    lifetime->end = pos;
+    size_t* loop_stack = read_list(size_t, lctx->loop_stack);
+    for (size_t i = 0; i < entries_count_list(lctx->loop_stack); i++) {
+        if (read_list(LoopRange, lctx->loops)[loop_stack[i]].start > lifetime->start) {
+            lifetime->loop = loop_stack[i];
+            break;
+        }
+    }
+    return lifetime;
+}
+
+static void walk_abstraction(LContext* lctx, const Node* abs);
+
+static void walk_prim_op(LContext* lctx, const Node* instruction, Nodes results, size_t pos) {
+    PrimOp payload = instruction->payload.prim_op;
+    AddressSpace as;
+    if (get_alloca_address_space(instruction, &as)) {
+        Lifetime* lifetime = arena_alloc(lctx->arena, sizeof(Lifetime));
+        *lifetime = (Lifetime) { .start = pos, .end = pos, .loop = SIZE_MAX };
+        insert_dict(const Node*, Lifetime*, lctx->lifetimes, instruction, lifetime);
+        const Node* ptr = first(results);
+        insert_dict(const Node*, Lifetime*, lctx->tracked, ptr, lifetime);
+        append_list(const Node*, lctx->allocas, instruction);
+        return;
+    }
+
+    bool derives_address;
+    switch (payload.op) {
+        case load_op:
+        case store_op: derives_address = false; break;
+        case lea_op: derives_address = true; break;
+        case reinterpret_op:
+        case convert_op: {
+            // casting to an integer loses track of it
+            if (first(payload.type_arguments)->tag != PtrType_TAG) {
+                mark_escaping(lctx, instruction);
+                return;
+            }
+            derives_address = true;
+            break;
+        }
+        default: mark_escaping(lctx, instruction); return;
+    }
+
+    Lifetime* lifetime = use_address(lctx, first(payload.operands), pos);
+    for (size_t i = 1; i < payload.operands.count; i++)
+        mark_escaping(lctx, payload.operands.nodes[i]);
+    if (lifetime && derives_address) {
+        const Node* derived = first(results);
+        insert_dict(const Node*, Lifetime*, lctx->tracked, derived, lifetime);
+    }
+}
+
+static void walk_instruction(LContext* lctx, const Node* instruction, Nodes results, size_t pos) {
+    switch (instruction->tag) {
+        case PrimOp_TAG: walk_prim_op(lctx, instruction, results, pos); break;
+        case If_TAG: {
+            mark_escaping(lctx, instruction->payload.if_instr.condition);
+            walk_abstraction(lctx, instruction->payload.if_instr.if_true);
+            if (instruction->payload.if_instr.if_false)
+                walk_abstraction(lctx, instruction->payload.if_instr.if_false);
+            break;
+        }
+        case Match_TAG: {
+            mark_escaping(lctx, instruction->payload.match_instr.inspect);
+            Nodes cases = instruction->payload.match_instr.cases;
+            for (size_t i = 0; i < cases.count; i++)
+                walk_abstraction(lctx, cases.nodes[i]);
+            walk_abstraction(lctx, instruction->payload.match_instr.default_case);
+            break;
+        }
+        case Loop_TAG: {
+            Nodes initial_args = instruction->payload.loop_instr.initial_args;
+            for (size_t i = 0; i < initial_args.count; i++)
+                mark_escaping(lctx, initial_args.nodes[i]);
+            size_t loop = entries_count_list(lctx->loops);
+            append_list(LoopRange, lctx->loops, ((LoopRange) { .start = lctx->counter }));
+            append_list(size_t, lctx->loop_stack, loop);
+            walk_abstraction(lctx, instruction->payload.loop_instr.body);
+            remove_last_list(size_t, lctx->loop_stack);
+            read_list(LoopRange, lctx->loops)[loop].end = lctx->counter;
+            break;
+        }
+        case Control_TAG: walk_abstraction(lctx, instruction->payload.control.inside); break;
+        case Block_TAG: walk_abstraction(lctx, instruction->payload.block.inside); break;
+        default: mark_escaping(lctx, instruction); break;
+    }
+}
+
+static void walk_abstraction(LContext* lctx, const Node* abs) {
+    const Node* terminator = get_abstraction_body(abs);
+    // follow let chains iteratively, they can get very long
+    while (terminator && terminator->tag == Let_TAG) {
+        const Node* tail = get_let_tail(terminator);
+        walk_instruction(lctx, get_let_instruction(terminator), get_abstraction_params(tail), lctx->counter++);
+        terminator = get_abstraction_body(tail);
+    }
+    if (!terminator)
+        return;
+    lctx->counter++;
+    switch (terminator->tag) {
+        case Jump_TAG:
+        case Branch_TAG:
+        case Switch_TAG: lctx->unstructured = true; break;
+        default: break;
+    }
+    mark_escaping(lctx, terminator);
+}
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+/// Works out where the address of each alloca in the function may be used, or returns false if we can't tell.
+static bool compute_lifetimes(LContext* lctx, const Node* fn) {
+    *lctx = (LContext) {
+        .visitor = {
+            .visit_node_fn = (VisitNodeFn) mark_escaping,
+        },
+        .arena = new_arena(),
+        .tracked = new_dict(const Node*, Lifetime*, (HashFn) hash_node, (CmpFn) compare_node),
+        .lifetimes = new_dict(const Node*, Lifetime*, (HashFn) hash_node, (CmpFn) compare_node),
+        .allocas = new_list(const Node*),
+        .loops = new_list(LoopRange),
+        .loop_stack = new_list(size_t),
+    };
+    walk_abstraction(lctx, fn);
+    for (size_t i = 0; i < entries_count_list(lctx->allocas); i++) {
+        Lifetime* lifetime = *find_value_dict(const Node*, Lifetime*, lctx->lifetimes, read_list(const Node*, lctx->allocas)[i]);
+        if (lifetime->loop != SIZE_MAX) {
+            size_t loop_end = read_list(LoopRange, lctx->loops)[lifetime->loop].end;
+            lifetime->end = lifetime->end > loop_end ? lifetime->end : loop_end;
+        }
+    }
+    return !lctx->unstructured;
+}
+
+static void destroy_lifetimes(LContext* lctx) {
+    destroy_dict(lctx->tracked);
+    destroy_dict(lctx->lifetimes);
+    destroy_list(lctx->allocas);
+    destroy_list(lctx->loops);
+    destroy_list(lctx->loop_stack);
+    destroy_arena(lctx->arena);
+}
+
+/// Gives the alloca a slot in the frame, sharing one with an alloca of the same type whose lifetime is over if we can.
+static void prepare_slot(VContext* vctx, const Node* alloca, const Lifetime* lifetime) {
     IrArena* a = vctx->context->rewriter.dst_arena;
     AddressSpace as;
+    bool is_alloca = get_alloca_address_space(alloca, &as);
+    assert(is_alloca);
+    const Type* element_type = rewrite_node(&vctx->context->rewriter, alloca->payload.prim_op.type_arguments.nodes[0]);
+    assert(is_data_type(element_type));
 
-    if (node->tag == PrimOp_TAG) {
-        switch (node->payload.prim_op.op) {
-            case alloca_op: as = AsPrivatePhysical; break;
-            case alloca_subgroup_op: as = AsSubgroupPhysical; break;
-            default: goto not_alloca;
+    const Node* slot_offset = NULL;
+    SharedSlot* shared = NULL;
+    if (lifetime && !lifetime->escapes) {
+        for (size_t i = 0; i < entries_count_list(vctx->shared); i++) {
+            SharedSlot* candidate = &read_list(SharedSlot, vctx->shared)[i];
+            if (candidate->type == element_type && candidate->as == as && candidate->end < lifetime->start) {
+                shared = candidate;
+                break;
+            }
         }
+    }
 
-        const Type* element_type = rewrite_node(&vctx->context->rewriter, node->payload.prim_op.type_arguments.nodes[0]);
-        assert(is_data_type(element_type));
-        const Node* slot_offset = gen_primop_e(vctx->bb, offset_of_op, singleton(type_decl_ref_helper(a, vctx->nom_t)), singleton(int32_literal(a, entries_count_list(vctx->members))));
+    if (shared) {
+        debugv_print("lower_alloca: stack slot %d reuses a previous slot\n", vctx->num_slots);
+        slot_offset = shared->offset;
+        shared->end = lifetime->end;
+    } else {
+        slot_offset = gen_primop_e(vctx->bb, offset_of_op, singleton(type_decl_ref_helper(a, vctx->nom_t)), singleton(int32_literal(a, entries_count_list(vctx->members))));
         append_list(const Type*, vctx->members, element_type);
+        if (lifetime && !lifetime->escapes)
+            append_list(SharedSlot, vctx->shared, ((SharedSlot) { .type = element_type, .as = as, .offset = slot_offset, .end = lifetime->end }));
+    }
 
-        StackSlot slot = { vctx->num_slots, slot_offset, element_type, as };
-        insert_dict(const Node*, StackSlot, vctx->prepared_offsets, node, slot);
+    StackSlot slot = { vctx->num_slots, slot_offset, element_type, as };
+    insert_dict(const Node*, StackSlot, vctx->prepared_offsets, alloca, slot);
 
-        vctx->num_slots++;
+    vctx->num_slots++;
+}
 
+static void search_operand_for_alloca(VContext* vctx, const Node* node) {
+    AddressSpace as;
+    if (get_alloca_address_space(node, &as)) {
+        // the ones we know the lifetime of were already given a slot
+        if (!find_value_dict(const Node*, StackSlot, vctx->prepared_offsets, node))
+            prepare_slot(vctx, node, NULL);
         return;
     }
 
-    not_alloca:
     visit_node_operands(&vctx->visitor, IGNORE_ABSTRACTIONS_MASK, node);
 }
 
-KeyHash hash_node(Node**);
-bool compare_node(Node**, Node**);
-
 static const Node* process(Context* ctx, const Node* node) {
     const Node* found = search_processed(&ctx->rewriter, node);
     if (found) return found;
@@ -105,20 +343,35 @@ static const Node* process(Context* ctx, const Node* node) {
                     .num_slots = 0,
                     .members = new_list(const Node*),
                     .prepared_offsets = ctx2.prepared_offsets,
+                    .shared = new_list(SharedSlot),
                 };
                 if (node->payload.fun.body) {
+                    // allocas whose addresses are never used at the same time can share a slot
+                    LContext lctx;
+                    if (compute_lifetimes(&lctx, node)) {
+                        for (size_t i = 0; i < entries_count_list(lctx.allocas); i++) {
+                            const Node* alloca = read_list(const Node*, lctx.allocas)[i];
+                            prepare_slot(&vctx, alloca, *find_value_dict(const Node*, Lifetime*, lctx.lifetimes, alloca));
+                        }
+                    }
+                    destroy_lifetimes(&lctx);
                     search_operand_for_alloca(&vctx, node->payload.fun.body);
                     visit_function_rpo(&vctx.visitor, node);
                 }
                 vctx.nom_t->payload.nom_type.body = record_type(a, (RecordType) {
-                    .members = nodes(a, vctx.num_slots, read_list(const Node*, vctx.members)),
+                    .members = nodes(a, entries_count_list(vctx.members), read_list(const Node*, vctx.members)),
                     .names = strings(a, 0, NULL),
                     .special = 0
                 });
                 destroy_list(vctx.members);
+                destroy_list(vctx.shared);
+                size_t frame_size = get_mem_layout(a, type_decl_ref_helper(a, vctx.nom_t)).size_in_bytes;
+                // frames start where the previous one ended, this keeps them aligned to the words backing the stack
+                size_t word_size = int_size_in_bytes(get_emulated_word_size(ctx->config, a, AsPrivatePhysical));
+                frame_size = (frame_size + word_size - 1) / word_size * word_size;
+                insert_dict(const Node*, size_t, ctx->usage->frame_sizes, node, frame_size);
                 ctx2.num_slots = vctx.num_slots;
-                ctx2.frame_size = gen_primop_e(bb, size_of_op, singleton(type_decl_ref_helper(a, vctx.nom_t)), empty(a));
-                ctx2.frame_size = convert_int_extend_according_to_src_t(bb, ctx->stack_ptr_t, ctx2.frame_size);
+                ctx2.frame_size = int_literal(a, (IntLiteral) { .width = ctx->stack_ptr_t->payload.int_type.width, .is_signed = ctx->stack_ptr_t->payload.int_type.is_signed, .value = frame_size });
             }
             if (node->payload.fun.body)
                 fun->payload.fun.body = finish_body(bb, rewrite_node(&ctx2.rewriter, node->payload.fun.body));
@@ -129,6 +382,13 @@ static const Node* process(Context* ctx, const Node* node) {
             return fun;
         }
         case PrimOp_TAG: {
+            switch (node->payload.prim_op.op) {
+                case push_stack_op:
+                case pop_stack_op:
+                case push_stack_uniform_op:
+                case pop_stack_uniform_op: ctx->usage->has_push_pop = true; break;
+                default: break;
+            }
             if (!ctx->disable_lowering && node->payload.prim_op.op == alloca_op) {
                 StackSlot* found_slot = find_value_dict(const Node*, StackSlot, ctx->prepared_offsets, node);
                 if (!found_slot) {
@@ -167,16 +427,71 @@ static const Node* process(Context* ctx, const Node* node) {
     return recreate_node_identity(&ctx->rewriter, node);
 }
 
+/// When the stack only ever holds the frames of the functions being called, and none of them are recursive,
+/// the deepest it can get is the largest sum of frame sizes along a path in the call graph.
+static bool compute_max_stack_depth(StackUsage* usage, Module* src, size_t* depth) {
+    if (usage->has_push_pop)
+        return false;
+    CallGraph* graph = new_callgraph(src);
+    struct Dict* depths = new_dict(const Node*, size_t, (HashFn) hash_node, (CmpFn) compare_node);
+    struct List* order = callgraph_bottom_up_order(graph);
+    bool bounded = true;
+    *depth = 0;
+    for (size_t i = 0; i < entries_count_list(order) && bounded; i++) {
+        CGNode* fn_node = read_list(CGNode*, order)[i];
+        if (fn_node->is_recursive || fn_node->is_address_captured) {
+            bounded = false;
+            break;
+        }
+        size_t callees_depth = 0;
+        size_t iter = 0;
+        CGEdge e;
+        while (dict_iter(fn_node->callees, &iter, &e, NULL)) {
+            // tail calls go through the dispatcher, which keeps the caller's frame around
+            if (e.instr->tag != Call_TAG) {
+                bounded = false;
+                break;
+            }
+            size_t callee_depth = *find_value_dict(const Node*, size_t, depths, e.dst_fn->fn);
+            callees_depth = callee_depth > callees_depth ? callee_depth : callees_depth;
+        }
+        size_t* frame_size = find_value_dict(const Node*, size_t, usage->frame_sizes, fn_node->fn);
+        size_t fn_depth = (frame_size ? *frame_size : 0) + callees_depth;
+        insert_dict(const Node*, size_t, depths, fn_node->fn, fn_depth);
+        *depth = fn_depth > *depth ? fn_depth : *depth;
+    }
+    destroy_dict(depths);
+    destroy_callgraph(graph);
+    return bounded;
+}
+
 Module* lower_alloca(SHADY_UNUSED const CompilerConfig* config, Module* src) {
     ArenaConfig aconfig = get_arena_config(get_module_arena(src));
     IrArena* a = new_ir_arena(aconfig);
     Module* dst = new_module(a, get_module_name(src));
+    StackUsage usage = {
+        .frame_sizes = new_dict(const Node*, size_t, (HashFn) hash_node, (CmpFn) compare_node),
+    };
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
         .config = config,
+        .usage = &usage,
         .stack_ptr_t = int_type(a, (Int) { .is_signed = false, .width = IntTy32 }),
     };
     rewrite_module(&ctx.rewriter);
     destroy_rewriter(&ctx.rewriter);
+
+    // lower_stack sizes the stack according to this, the default is the configured per-thread stack size
+    size_t depth;
+    Node* stack_size = (Node*) get_declaration(dst, "STACK_SIZE");
+    if (stack_size && compute_max_stack_depth(&usage, src, &depth)) {
+        // keep the stack non-empty and aligned for the widest types we might put in it
+        depth = (depth + 7) & ~(size_t) 7;
+        if (depth == 0)
+            depth = 8;
+        debugv_print("lower_alloca: the stack is at most %zu bytes deep\n", depth);
+        stack_size->payload.constant.instruction = quote_helper(a, singleton(uint32_literal(a, depth)));
+    }
+    destroy_dict(usage.frame_sizes);
     return dst;
 }
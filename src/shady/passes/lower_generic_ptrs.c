@@ -214,8 +214,15 @@ static const Node* process(Context* ctx, const Node* old) {
                                     generic_ptr = gen_primop_e(bb, or_op, empty(a), mk_nodes(a, generic_ptr, shifted_tag));
                         return yield_values_and_wrap_in_block(bb, singleton(generic_ptr));
                     } else if (old_src_t->tag == PtrType_TAG && old_src_t->payload.ptr_type.address_space == AsGeneric) {
-                        // cast _from_ generic
-                        error("TODO");
+                        // cast _from_ generic: the address space is known statically, so we only need to drop the tag
+                        AddressSpace dst_as = old_dst_t->payload.ptr_type.address_space;
+                        size_t tag = get_tag_for_addr_space(dst_as);
+                        BodyBuilder* bb = begin_body(a);
+                        String x = format_string_arena(a->arena, "Generated generic ptr convert dst %d tag %d", dst_as, tag);
+                        gen_comment(bb, x);
+                        const Node* src_ptr = rewrite_node(&ctx->rewriter, old_src);
+                        const Node* full_ptr = recover_full_pointer(ctx, bb, tag, src_ptr, rewrite_node(&ctx->rewriter, old_dst_t->payload.ptr_type.pointed_type));
+                        return yield_values_and_wrap_in_block(bb, singleton(full_ptr));
                     }
                     break;
                 }
@@ -49,8 +49,8 @@ static const Node* process(Context* ctx, const Node* node) {
         case IntLiteral_TAG:
             if (node->payload.int_literal.width == IntTy64 && ctx->config->lower.int64) {
                 uint64_t raw = node->payload.int_literal.value;
-                const Node* lower = uint32_literal(a, (uint32_t) raw);
-                const Node* upper = uint32_literal(a, (uint32_t) (raw >> 32));
+                const Node* lower = int32_literal(a, (int32_t) (uint32_t) raw);
+                const Node* upper = int32_literal(a, (int32_t) (uint32_t) (raw >> 32));
                 return tuple_helper(a, mk_nodes(a, lower, upper));
             }
             break;
@@ -65,13 +65,47 @@ static const Node* process(Context* ctx, const Node* node) {
                     // TODO: convert into and then out of unsigned
                     BodyBuilder* bb = begin_body(a);
                     extract_low_hi_halves_list(bb, new_nodes, lows, his);
-                    Nodes low_and_carry = bind_instruction(bb, prim_op(a, (PrimOp) { .op = add_carry_op, .operands = nodes(a, 2, lows)}));
-                    const Node* lo = first(low_and_carry);
+                    // add_carry yields a {result, carry} record
+                    const Node* low_and_carry = first(bind_instruction(bb, prim_op(a, (PrimOp) { .op = add_carry_op, .operands = nodes(a, 2, lows)})));
+                    const Node* lo = gen_extract(bb, low_and_carry, singleton(int32_literal(a, 0)));
+                    const Node* carry = gen_extract(bb, low_and_carry, singleton(int32_literal(a, 1)));
                     // compute the high side, without forgetting the carry bit
                     const Node* hi = first(bind_instruction(bb, prim_op(a, (PrimOp) { .op = add_op, .operands = nodes(a, 2, his)})));
-                                hi = first(bind_instruction(bb, prim_op(a, (PrimOp) { .op = add_op, .operands = mk_nodes(a, hi, low_and_carry.nodes[1])})));
+                                hi = first(bind_instruction(bb, prim_op(a, (PrimOp) { .op = add_op, .operands = mk_nodes(a, hi, carry)})));
                     return yield_values_and_wrap_in_block(bb, singleton(tuple_helper(a, mk_nodes(a, lo, hi))));
                 } break;
+                case convert_op: {
+                    const Type* src_t = get_unqualified_type(first(old_nodes)->type);
+                    const Type* dst_t = first(node->payload.prim_op.type_arguments);
+                    if (src_t->tag != Int_TAG || dst_t->tag != Int_TAG)
+                        break;
+                    bool wide_src = should_convert(ctx, first(old_nodes)->type);
+                    bool wide_dst = dst_t->payload.int_type.width == IntTy64 && ctx->config->lower.int64;
+                    const Node* src = rewrite_node(&ctx->rewriter, first(old_nodes));
+                    if (wide_src && wide_dst) {
+                        // signedness is not part of the emulated representation
+                        return quote_helper(a, singleton(src));
+                    } else if (wide_dst) {
+                        // the low half is the source extended to 32 bits, the high half is either zero or the sign bit
+                        BodyBuilder* bb = begin_body(a);
+                        const Node* lo = convert_int_extend_according_to_src_t(bb, int32_type(a), src);
+                        const Node* hi = int32_literal(a, 0);
+                        if (src_t->payload.int_type.is_signed)
+                            hi = gen_primop_e(bb, rshift_arithm_op, empty(a), mk_nodes(a, lo, int32_literal(a, 31)));
+                        return yield_values_and_wrap_in_block(bb, singleton(tuple_helper(a, mk_nodes(a, lo, hi))));
+                    } else if (wide_src) {
+                        // truncating only needs the low half
+                        BodyBuilder* bb = begin_body(a);
+                        const Node* lo = first(bind_instruction(bb, prim_op(a, (PrimOp) { .op = extract_op, .operands = mk_nodes(a, src, int32_literal(a, 0))})));
+                        const Type* ndst_t = rewrite_node(&ctx->rewriter, dst_t);
+                        if (dst_t->payload.int_type.width == IntTy32)
+                            lo = gen_reinterpret_cast(bb, ndst_t, lo);
+                        else
+                            lo = convert_int_extend_according_to_dst_t(bb, ndst_t, lo);
+                        return yield_values_and_wrap_in_block(bb, singleton(lo));
+                    }
+                    break;
+                }
                 default: break;
             }
             break;
@@ -11,67 +11,146 @@
 
 #include <assert.h>
 
+/// Constant-size copies that take at most this many wide accesses are unrolled completely
+#define MAX_UNROLLED_ACCESSES 16
+
 typedef struct {
     Rewriter rewriter;
     const CompilerConfig* config;
 } Context;
 
+/// The alignment we can assume for the pointer, going by what it points to
+static size_t get_known_alignment(IrArena* a, const Node* old_ptr) {
+    const Type* pointee = get_pointer_type_element(get_unqualified_type(old_ptr->type));
+    if (pointee->tag == ArrType_TAG && !pointee->payload.arr_type.size)
+        pointee = pointee->payload.arr_type.element_type;
+    if (!is_data_type(pointee))
+        return 1;
+    return get_mem_layout(a, pointee).alignment_in_bytes;
+}
+
+/// Picks the widest integer type both pointers are aligned for, no narrower than a word
+static IntSizes get_access_width(Context* ctx, size_t alignment) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    IntSizes width = a->config.memory.word_size;
+    // 64-bit accesses are no good if they get emulated afterwards
+    IntSizes widest = ctx->config->lower.int64 ? IntTy32 : IntTy64;
+    for (IntSizes w = width + 1; w <= widest; w++) {
+        if (alignment % int_size_in_bytes(w) == 0)
+            width = w;
+    }
+    return width;
+}
+
+static const Node* cast_to_array_ptr(BodyBuilder* bb, const Node* ptr, const Type* element_type) {
+    IrArena* a = ptr->arena;
+    const Type* ptr_t = get_unqualified_type(ptr->type);
+    assert(ptr_t->tag == PtrType_TAG);
+    return gen_reinterpret_cast(bb, ptr_type(a, (PtrType) {
+        .address_space = ptr_t->payload.ptr_type.address_space,
+        .pointed_type = arr_type(a, (ArrType) { .element_type = element_type, .size = NULL }),
+    }), ptr);
+}
+
+/// Repeats a byte across all the bytes of a wider integer
+static const Node* splat_byte(BodyBuilder* bb, const Node* value, IntSizes width) {
+    IrArena* a = value->arena;
+    const Type* wide_t = int_type(a, (Int) { .width = width, .is_signed = false });
+    const Node* wide = gen_conversion(bb, wide_t, gen_reinterpret_cast(bb, uint8_type(a), value));
+    uint64_t pattern = 0;
+    for (size_t i = 0; i < int_size_in_bytes(width); i++)
+        pattern = (pattern << 8) | 1;
+    return gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, wide, int_literal(a, (IntLiteral) { .width = width, .is_signed = false, .value = pattern })));
+}
+
+/// Copies element i of src to dst, or stores value in it when there is no src
+static void gen_copy_element(BodyBuilder* bb, const Node* dst, const Node* src, const Node* value, const Node* i) {
+    IrArena* a = dst->arena;
+    if (src)
+        value = gen_load(bb, gen_lea(bb, src, i, singleton(uint32_literal(a, 0))));
+    gen_store(bb, gen_lea(bb, dst, i, singleton(uint32_literal(a, 0))), value);
+}
+
+/// Copies the elements from start to end, the loop does nothing if there aren't any
+static void gen_copy_loop(BodyBuilder* bb, const Node* dst, const Node* src, const Node* value, const Node* start, const Node* end, String name) {
+    IrArena* a = dst->arena;
+    const Node* index = var(a, qualified_type_helper(uint32_type(a), false), name);
+    BodyBuilder* loop_bb = begin_body(a);
+    BodyBuilder* copy_bb = begin_body(a);
+    gen_copy_element(copy_bb, dst, src, value, index);
+    const Node* next_index = gen_primop_e(copy_bb, add_op, empty(a), mk_nodes(a, index, uint32_literal(a, 1)));
+    bind_instruction(loop_bb, if_instr(a, (If) {
+        .condition = gen_primop_e(loop_bb, lt_op, empty(a), mk_nodes(a, index, end)),
+        .yield_types = empty(a),
+        .if_true = case_(a, empty(a), finish_body(copy_bb, merge_continue(a, (MergeContinue) {.args = singleton(next_index)}))),
+        .if_false = case_(a, empty(a), merge_break(a, (MergeBreak) {.args = empty(a)}))
+    }));
+
+    bind_instruction(bb, loop_instr(a, (Loop) {
+        .yield_types = empty(a),
+        .body = case_(a, singleton(index), finish_body(loop_bb, unreachable(a))),
+        .initial_args = singleton(start)
+    }));
+}
+
+/// Moves as much as possible using accesses of the given width, and the rest one word at a time.
+/// src is NULL for memset, value is then already splatted to the right width.
+static void gen_wide_copy(Context* ctx, BodyBuilder* bb, const Node* dst, const Node* src, const Node* value, const Node* word_value, IntSizes width, const Node* num) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    const Type* word_type = int_type(a, (Int) { .is_signed = false, .width = a->config.memory.word_size });
+    const Type* wide_type = int_type(a, (Int) { .is_signed = false, .width = width });
+    size_t wide_bytes = int_size_in_bytes(width);
+    size_t words_per_access = wide_bytes / int_size_in_bytes(a->config.memory.word_size);
+
+    const Node* wide_dst = cast_to_array_ptr(bb, dst, wide_type);
+    const Node* wide_src = src ? cast_to_array_ptr(bb, src, wide_type) : NULL;
+    const Node* word_dst = cast_to_array_ptr(bb, dst, word_type);
+    const Node* word_src = src ? cast_to_array_ptr(bb, src, word_type) : NULL;
+
+    const IntLiteral* constant_num = resolve_to_int_literal(num);
+    if (constant_num) {
+        uint64_t num_bytes = get_int_literal_value(*constant_num, false);
+        uint64_t accesses = num_bytes / wide_bytes;
+        uint64_t tail_words = bytes_to_words_static(a, num_bytes % wide_bytes);
+        if (accesses + tail_words <= MAX_UNROLLED_ACCESSES) {
+            for (uint64_t i = 0; i < accesses; i++)
+                gen_copy_element(bb, wide_dst, wide_src, value, uint32_literal(a, i));
+            for (uint64_t i = 0; i < tail_words; i++)
+                gen_copy_element(bb, word_dst, word_src, word_value, uint32_literal(a, accesses * words_per_access + i));
+            return;
+        }
+    }
+
+    num = gen_conversion(bb, uint32_type(a), num);
+    const Node* accesses = gen_primop_e(bb, div_op, empty(a), mk_nodes(a, num, uint32_literal(a, wide_bytes)));
+    gen_copy_loop(bb, wide_dst, wide_src, value, uint32_literal(a, 0), accesses, "memcpy_i");
+    if (words_per_access > 1) {
+        const Node* tail_start = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, accesses, uint32_literal(a, words_per_access)));
+        gen_copy_loop(bb, word_dst, word_src, word_value, tail_start, bytes_to_words(bb, num), "memcpy_tail_i");
+    }
+}
+
 static const Node* process(Context* ctx, const Node* old) {
     const Node* found = search_processed(&ctx->rewriter, old);
     if (found) return found;
 
     IrArena* a = ctx->rewriter.dst_arena;
-    Module* m = ctx->rewriter.dst_module;
 
     switch (old->tag) {
         case PrimOp_TAG: {
             switch (old->payload.prim_op.op) {
                 case memcpy_op: {
-                    const Type* word_type = int_type(a, (Int) { .is_signed = false, .width = a->config.memory.word_size });
-
                     BodyBuilder* bb = begin_body(a);
                     Nodes old_ops = old->payload.prim_op.operands;
 
-                    const Node* dst_addr = rewrite_node(&ctx->rewriter, old_ops.nodes[0]);
-                    const Type* dst_addr_type = dst_addr->type;
-                    deconstruct_qualified_type(&dst_addr_type);
-                    assert(dst_addr_type->tag == PtrType_TAG);
-                    dst_addr_type = ptr_type(a, (PtrType) {
-                        .address_space = dst_addr_type->payload.ptr_type.address_space,
-                        .pointed_type = arr_type(a, (ArrType) { .element_type = word_type, .size = NULL }),
-                    });
-                    dst_addr = gen_reinterpret_cast(bb, dst_addr_type, dst_addr);
+                    size_t alignment = get_known_alignment(ctx->rewriter.src_arena, old_ops.nodes[0]);
+                    size_t src_alignment = get_known_alignment(ctx->rewriter.src_arena, old_ops.nodes[1]);
+                    alignment = alignment < src_alignment ? alignment : src_alignment;
 
+                    const Node* dst_addr = rewrite_node(&ctx->rewriter, old_ops.nodes[0]);
                     const Node* src_addr = rewrite_node(&ctx->rewriter, old_ops.nodes[1]);
-                    const Type* src_addr_type = src_addr->type;
-                    deconstruct_qualified_type(&src_addr_type);
-                    assert(src_addr_type->tag == PtrType_TAG);
-                    src_addr_type = ptr_type(a, (PtrType) {
-                            .address_space = src_addr_type->payload.ptr_type.address_space,
-                            .pointed_type = arr_type(a, (ArrType) { .element_type = word_type, .size = NULL }),
-                    });
-                    src_addr = gen_reinterpret_cast(bb, src_addr_type, src_addr);
-
                     const Node* num = rewrite_node(&ctx->rewriter, old_ops.nodes[2]);
-                    const Node* num_in_bytes = gen_conversion(bb, uint32_type(a), bytes_to_words(bb, num));
-
-                    const Node* index = var(a, qualified_type_helper(uint32_type(a), false), "memcpy_i");
-                    BodyBuilder* loop_bb = begin_body(a);
-                    const Node* loaded_word = gen_load(loop_bb, gen_lea(loop_bb, src_addr, index, singleton(uint32_literal(a, 0))));
-                    gen_store(loop_bb, gen_lea(loop_bb, dst_addr, index, singleton(uint32_literal(a, 0))), loaded_word);
-                    const Node* next_index = gen_primop_e(loop_bb, add_op, empty(a), mk_nodes(a, index, uint32_literal(a, 1)));
-                    bind_instruction(loop_bb, if_instr(a, (If) {
-                        .condition = gen_primop_e(loop_bb, lt_op, empty(a), mk_nodes(a, next_index, num_in_bytes)),
-                        .yield_types = empty(a),
-                        .if_true = case_(a, empty(a), merge_continue(a, (MergeContinue) {.args = singleton(next_index)})),
-                        .if_false = case_(a, empty(a), merge_break(a, (MergeBreak) {.args = empty(a)}))
-                    }));
-
-                    bind_instruction(bb, loop_instr(a, (Loop) {
-                        .yield_types = empty(a),
-                        .body = case_(a, singleton(index), finish_body(loop_bb, unreachable(a))),
-                        .initial_args = singleton(uint32_literal(a, 0))
-                    }));
+                    gen_wide_copy(ctx, bb, dst_addr, src_addr, NULL, NULL, get_access_width(ctx, alignment), num);
                     return yield_values_and_wrap_in_block(bb, empty(a));
                 }
                 case memset_op: {
@@ -80,39 +159,24 @@ static const Node* process(Context* ctx, const Node* old) {
                     const Type* src_type = src_value->type;
                     deconstruct_qualified_type(&src_type);
                     assert(src_type->tag == Int_TAG);
-                    const Type* word_type = src_type;// int_type(a, (Int) { .is_signed = false, .width = a->config.memory.word_size });
 
                     BodyBuilder* bb = begin_body(a);
 
                     const Node* dst_addr = rewrite_node(&ctx->rewriter, old_ops.nodes[0]);
-                    const Type* dst_addr_type = dst_addr->type;
-                    deconstruct_qualified_type(&dst_addr_type);
-                    assert(dst_addr_type->tag == PtrType_TAG);
-                    dst_addr_type = ptr_type(a, (PtrType) {
-                        .address_space = dst_addr_type->payload.ptr_type.address_space,
-                        .pointed_type = arr_type(a, (ArrType) { .element_type = word_type, .size = NULL }),
-                    });
-                    dst_addr = gen_reinterpret_cast(bb, dst_addr_type, dst_addr);
-
                     const Node* num = rewrite_node(&ctx->rewriter, old_ops.nodes[2]);
-                    const Node* num_in_bytes = gen_conversion(bb, uint32_type(a), bytes_to_words(bb, num));
-
-                    const Node* index = var(a, qualified_type_helper(uint32_type(a), false), "memset_i");
-                    BodyBuilder* loop_bb = begin_body(a);
-                    gen_store(loop_bb, gen_lea(loop_bb, dst_addr, index, singleton(uint32_literal(a, 0))), src_value);
-                    const Node* next_index = gen_primop_e(loop_bb, add_op, empty(a), mk_nodes(a, index, uint32_literal(a, 1)));
-                    bind_instruction(loop_bb, if_instr(a, (If) {
-                        .condition = gen_primop_e(loop_bb, lt_op, empty(a), mk_nodes(a, next_index, num_in_bytes)),
-                        .yield_types = empty(a),
-                        .if_true = case_(a, empty(a), merge_continue(a, (MergeContinue) {.args = singleton(next_index)})),
-                        .if_false = case_(a, empty(a), merge_break(a, (MergeBreak) {.args = empty(a)}))
-                    }));
-
-                    bind_instruction(bb, loop_instr(a, (Loop) {
-                        .yield_types = empty(a),
-                        .body = case_(a, singleton(index), finish_body(loop_bb, unreachable(a))),
-                        .initial_args = singleton(uint32_literal(a, 0))
-                    }));
+
+                    // A byte can be repeated to fill wider accesses, other values are stored as they are
+                    if (src_type->payload.int_type.width == IntTy8 && a->config.memory.word_size == IntTy8) {
+                        IntSizes width = get_access_width(ctx, get_known_alignment(ctx->rewriter.src_arena, old_ops.nodes[0]));
+                        const Node* word_value = gen_reinterpret_cast(bb, uint8_type(a), src_value);
+                        const Node* wide_value = width == IntTy8 ? word_value : splat_byte(bb, src_value, width);
+                        gen_wide_copy(ctx, bb, dst_addr, NULL, wide_value, word_value, width, num);
+                        return yield_values_and_wrap_in_block(bb, empty(a));
+                    }
+
+                    dst_addr = cast_to_array_ptr(bb, dst_addr, src_type);
+                    const Node* num_in_words = gen_conversion(bb, uint32_type(a), bytes_to_words(bb, num));
+                    gen_copy_loop(bb, dst_addr, NULL, src_value, uint32_literal(a, 0), num_in_words, "memset_i");
                     return yield_values_and_wrap_in_block(bb, empty(a));
                 }
                 default: break;
@@ -125,13 +189,14 @@ static const Node* process(Context* ctx, const Node* old) {
     return recreate_node_identity(&ctx->rewriter, old);
 }
 
-Module* lower_memcpy(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+Module* lower_memcpy(const CompilerConfig* config, Module* src) {
     ArenaConfig aconfig = get_arena_config(get_module_arena(src));
     IrArena* a = new_ir_arena(aconfig);
     Module* dst = new_module(a, get_module_name(src));
 
     Context ctx = {
-            .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process)
+            .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+            .config = config,
     };
     rewrite_module(&ctx.rewriter);
     destroy_rewriter(&ctx.rewriter);
@@ -2,6 +2,7 @@
 
 #include "../transform/ir_gen_helpers.h"
 #include "../transform/memory_layout.h"
+#include "../analysis/value_range.h"
 
 #include "../ir_private.h"
 #include "../rewrite.h"
@@ -22,6 +23,10 @@ typedef struct Context_ {
     const CompilerConfig* config;
 
     Nodes collected[NumAddressSpaces];
+    /// Type used for offset arithmetic into the emulated arrays, narrower than pointers when the array is small enough
+    const Type* offset_type[NumAddressSpaces];
+    /// Width of the words in the arrays backing each emulated address space
+    IntSizes word_size[NumAddressSpaces];
 
     struct Dict*   serialisation_uniform[NumAddressSpaces];
     struct Dict* deserialisation_uniform[NumAddressSpaces];
@@ -32,6 +37,9 @@ typedef struct Context_ {
     const Node* fake_private_memory;
     const Node* fake_subgroup_memory;
     const Node* fake_shared_memory;
+
+    /// First binding in descriptor set 0 that neither the module nor spirv_lift_globals_ssbo uses, for the swizzled buffers
+    int next_free_binding;
 } Context;
 
 static void store_init_data(Context* ctx, AddressSpace as, Nodes collected, BodyBuilder* bb);
@@ -39,7 +47,7 @@ static void store_init_data(Context* ctx, AddressSpace as, Nodes collected, Body
 // TODO: make this configuration-dependant
 static bool is_as_emulated(SHADY_UNUSED Context* ctx, AddressSpace as) {
     switch (as) {
-        case AsPrivatePhysical:  return true; // TODO have a config option to do this with swizzled global memory
+        case AsPrivatePhysical:  return true;
         case AsSubgroupPhysical: return true;
         case AsSharedPhysical:   return true;
         case AsGlobalPhysical:  return false; // TODO have a config option to do this with SSBOs
@@ -47,6 +55,15 @@ static bool is_as_emulated(SHADY_UNUSED Context* ctx, AddressSpace as) {
     }
 }
 
+/// Swizzled address spaces live in a global buffer allocated by the runtime, see swizzled_global_memory in CompilerConfig
+static bool is_as_swizzled(Context* ctx, AddressSpace as) {
+    switch (as) {
+        case AsPrivatePhysical:  return ctx->config->lower.swizzled_global_memory.private_memory;
+        case AsSubgroupPhysical: return ctx->config->lower.swizzled_global_memory.subgroup_memory;
+        default: return false;
+    }
+}
+
 static const Node** get_emulated_as_word_array(Context* ctx, AddressSpace as) {
     switch (as) {
         case AsPrivatePhysical:  return &ctx->fake_private_memory;
@@ -56,55 +73,157 @@ static const Node** get_emulated_as_word_array(Context* ctx, AddressSpace as) {
     }
 }
 
-static const Node* gen_deserialisation(Context* ctx, BodyBuilder* bb, const Type* element_type, const Node* arr, const Node* base_offset) {
+static const Node* offset_literal(const Node* offset, uint64_t value) {
+    const Type* offset_t = get_unqualified_type(offset->type);
+    return int_literal(offset->arena, (IntLiteral) { .width = offset_t->payload.int_type.width, .is_signed = false, .value = value });
+}
+
+/// Adds a (pointer-sized) value to an offset, in the offset's type
+static const Node* gen_add_to_offset(BodyBuilder* bb, const Node* offset, const Node* value) {
+    const Type* offset_t = get_unqualified_type(offset->type);
+    if (get_unqualified_type(value->type) != offset_t)
+        value = gen_conversion(bb, offset_t, value);
+    return gen_primop_e(bb, add_op, empty(bb->arena), mk_nodes(bb->arena, offset, value));
+}
+
+static const Node* gen_field_offset(BodyBuilder* bb, const Type* record_t, size_t i, const Node* base_offset) {
+    const Node* field_offset = gen_primop_e(bb, offset_of_op, singleton(record_t), singleton(size_t_literal(bb->arena, i)));
+    return gen_add_to_offset(bb, base_offset, field_offset);
+}
+
+static const Type* get_emulated_word_type(Context* ctx, AddressSpace as) {
+    return int_type(ctx->rewriter.dst_arena, (Int) { .width = ctx->word_size[as], .is_signed = false });
+}
+
+/// Swizzled memory is split in slots: one per invocation for private memory, one per subgroup for subgroup memory.
+/// Sets slots_count to how many slots the whole dispatch uses, and returns the slot of the current invocation.
+/// This uses builtins rather than SUBGROUP_SIZE and friends, since those only get their real values once the entry point is known.
+static const Node* gen_swizzled_slot(Context* ctx, BodyBuilder* bb, AddressSpace as, const Node** slots_count) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    Module* m = ctx->rewriter.dst_module;
+    const Node* workgroup_id = gen_builtin_load(m, bb, BuiltinWorkgroupId);
+    const Node* num_workgroups = gen_builtin_load(m, bb, BuiltinNumWorkgroups);
+    const Node* id[3];
+    const Node* num[3];
+    for (int i = 0; i < 3; i++) {
+        id[i] = gen_extract(bb, workgroup_id, singleton(int32_literal(a, i)));
+        num[i] = gen_extract(bb, num_workgroups, singleton(int32_literal(a, i)));
+    }
+    const Node* subgroups_per_wg = gen_builtin_load(m, bb, BuiltinNumSubgroups);
+
+    // workgroups are linearized x-major
+    const Node* slot = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, num[1], id[2]));
+                slot = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, id[1], slot));
+                slot = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, num[0], slot));
+                slot = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, id[0], slot));
+                slot = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, slot, subgroups_per_wg));
+                slot = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, slot, gen_builtin_load(m, bb, BuiltinSubgroupId)));
+    const Node* count = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, num[0], num[1]));
+                count = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, count, num[2]));
+                count = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, count, subgroups_per_wg));
+
+    if (as == AsPrivatePhysical) {
+        const Node* subgroup_size = gen_builtin_load(m, bb, BuiltinSubgroupSize);
+        slot = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, slot, subgroup_size));
+        slot = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, slot, gen_builtin_load(m, bb, BuiltinSubgroupLocalInvocationId)));
+        count = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, count, subgroup_size));
+    }
+
+    *slots_count = count;
+    return slot;
+}
+
+/// Points to the word holding the byte at offset
+static const Node* gen_word_ptr(Context* ctx, BodyBuilder* bb, AddressSpace as, const Node* arr, const Node* offset) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    size_t word_size_in_bytes = int_size_in_bytes(ctx->word_size[as]);
+    const Node* index = offset;
+    if (word_size_in_bytes > 1)
+        index = gen_primop_e(bb, div_op, empty(a), mk_nodes(a, offset, offset_literal(offset, word_size_in_bytes)));
+    if (is_as_swizzled(ctx, as)) {
+        // word i of a slot lives at i * slots_count + slot, so the lanes of a subgroup accessing the same address touch consecutive words
+        const Type* index_t = get_unqualified_type(index->type);
+        const Node* slots_count;
+        const Node* slot = gen_swizzled_slot(ctx, bb, as, &slots_count);
+        index = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, index, gen_conversion(bb, index_t, slots_count)));
+        index = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, index, gen_conversion(bb, index_t, slot)));
+        return gen_primop_ce(bb, lea_op, 4, (const Node* []) { arr, size_t_literal(a, 0), int32_literal(a, 0), index });
+    }
+    return gen_primop_ce(bb, lea_op, 3, (const Node* []) { arr, size_t_literal(a, 0), index });
+}
+
+/// How many bits into its word the byte at offset is
+static const Node* gen_shift_in_word(Context* ctx, BodyBuilder* bb, AddressSpace as, const Node* offset) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    const Type* word_t = get_emulated_word_type(ctx, as);
+    size_t word_size_in_bytes = int_size_in_bytes(ctx->word_size[as]);
+    const Node* byte_in_word = gen_primop_e(bb, and_op, empty(a), mk_nodes(a, offset, offset_literal(offset, word_size_in_bytes - 1)));
+    byte_in_word = gen_conversion(bb, word_t, byte_in_word);
+    return gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, byte_in_word, int_literal(a, (IntLiteral) { .width = ctx->word_size[as], .is_signed = false, .value = 8 })));
+}
+
+/// Data aligned to less than a word is accessed inside the word holding it, anything else takes whole words
+static bool fits_in_word(Context* ctx, AddressSpace as, const Type* element_type) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    return get_mem_layout(a, element_type).alignment_in_bytes < int_size_in_bytes(ctx->word_size[as]);
+}
+
+static const Node* gen_deserialisation(Context* ctx, BodyBuilder* bb, AddressSpace as, const Type* element_type, const Node* arr, const Node* base_offset) {
     IrArena* a = ctx->rewriter.dst_arena;
     const CompilerConfig* config = ctx->config;
-    const Node* zero = size_t_literal(a, 0);
     switch (element_type->tag) {
         case Bool_TAG: {
-            const Node* logical_ptr = gen_primop_ce(bb, lea_op, 3, (const Node* []) { arr, zero, base_offset });
-            const Node* value = gen_load(bb, logical_ptr);
+            // booleans take up as much memory as the smallest integers
+            const Type* int_t = int_type(a, (Int) { .width = a->config.memory.word_size, .is_signed = false });
+            const Node* value = gen_deserialisation(ctx, bb, as, int_t, arr, base_offset);
             return gen_primop_ce(bb, neq_op, 2, (const Node*[]) {value, int_literal(a, (IntLiteral) { .value = 0, .width = a->config.memory.word_size })});
         }
         case PtrType_TAG: switch (element_type->payload.ptr_type.address_space) {
             case AsGlobalPhysical: {
                 const Type* ptr_int_t = int_type(a, (Int) {.width = a->config.memory.ptr_size, .is_signed = false });
-                const Node* unsigned_int = gen_deserialisation(ctx, bb, ptr_int_t, arr, base_offset);
+                const Node* unsigned_int = gen_deserialisation(ctx, bb, as, ptr_int_t, arr, base_offset);
                 return gen_reinterpret_cast(bb, element_type, unsigned_int);
             }
             default: error("TODO")
         }
         case Int_TAG: ser_int: {
             assert(element_type->tag == Int_TAG);
-            const Node* acc = int_literal(a, (IntLiteral) { .width = element_type->payload.int_type.width, .is_signed = false, .value = 0 });
-            size_t length_in_bytes = int_size_in_bytes(element_type->payload.int_type.width);
-            size_t word_size_in_bytes = int_size_in_bytes(a->config.memory.word_size);
-            const Node* offset = base_offset;
-            const Node* shift = int_literal(a, (IntLiteral) { .width = element_type->payload.int_type.width, .is_signed = false, .value = 0 });
-            const Node* word_bitwidth = int_literal(a, (IntLiteral) { .width = element_type->payload.int_type.width, .is_signed = false, .value = word_size_in_bytes * 8 });
-            for (size_t byte = 0; byte < length_in_bytes; byte += word_size_in_bytes) {
-                const Node* word = gen_load(bb, gen_primop_ce(bb, lea_op, 3, (const Node* []) {arr, zero, offset}));
-                            word = gen_conversion(bb, int_type(a, (Int) { .width = element_type->payload.int_type.width, .is_signed = false }), word); // widen/truncate the word we just loaded
-                            word = first(gen_primop(bb, lshift_op, empty(a), mk_nodes(a, word, shift))); // shift it
-                acc = gen_primop_e(bb, or_op, empty(a), mk_nodes(a, acc, word));
-
-                offset = first(gen_primop(bb, add_op, empty(a), mk_nodes(a, offset, size_t_literal(a, 1))));
-                shift = first(gen_primop(bb, add_op, empty(a), mk_nodes(a, shift, word_bitwidth)));
+            IntSizes width = element_type->payload.int_type.width;
+            const Type* unsigned_t = int_type(a, (Int) { .width = width, .is_signed = false });
+            size_t length_in_bytes = int_size_in_bytes(width);
+            size_t word_size_in_bytes = int_size_in_bytes(ctx->word_size[as]);
+            const Node* acc = NULL;
+            if (fits_in_word(ctx, as, element_type)) {
+                const Node* word = gen_load(bb, gen_word_ptr(ctx, bb, as, arr, base_offset));
+                            word = gen_primop_e(bb, rshift_logical_op, empty(a), mk_nodes(a, word, gen_shift_in_word(ctx, bb, as, base_offset)));
+                acc = gen_conversion(bb, unsigned_t, word); // truncate to the bytes we're after
+            } else {
+                const Node* offset = base_offset;
+                for (size_t byte = 0; byte < length_in_bytes; byte += word_size_in_bytes) {
+                    const Node* word = gen_load(bb, gen_word_ptr(ctx, bb, as, arr, offset));
+                                word = gen_conversion(bb, unsigned_t, word); // widen/truncate the word we just loaded
+                    if (byte > 0) {
+                        word = gen_primop_e(bb, lshift_op, empty(a), mk_nodes(a, word, int_literal(a, (IntLiteral) { .width = width, .is_signed = false, .value = byte * 8 }))); // shift it
+                        acc = gen_primop_e(bb, or_op, empty(a), mk_nodes(a, acc, word));
+                    } else
+                        acc = word;
+
+                    offset = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, offset, offset_literal(base_offset, word_size_in_bytes)));
+                }
             }
             if (config->printf_trace.memory_accesses) {
-                AddressSpace as = get_unqualified_type(arr->type)->payload.ptr_type.address_space;
-                String template = format_string_interned(a, "loaded %s at %s:%s\n", element_type->payload.int_type.width == IntTy64 ? "%lu" : "%u", get_address_space_name(as), "%lx");
+                String template = format_string_interned(a, "loaded %s at %s:%s\n", width == IntTy64 ? "%lu" : "%u", get_address_space_name(as), get_unqualified_type(base_offset->type)->payload.int_type.width == IntTy64 ? "%lx" : "%x");
                 const Node* widened = acc;
-                if (element_type->payload.int_type.width < IntTy32)
+                if (width < IntTy32)
                     widened = gen_conversion(bb, uint32_type(a), acc);
                 bind_instruction(bb, prim_op(a, (PrimOp) { .op = debug_printf_op, .operands = mk_nodes(a, string_lit(a, (StringLiteral) { .string = template }), widened, base_offset) }));
             }
-            acc = gen_reinterpret_cast(bb, int_type(a, (Int) { .width = element_type->payload.int_type.width, .is_signed = element_type->payload.int_type.is_signed }), acc);\
+            acc = gen_reinterpret_cast(bb, int_type(a, (Int) { .width = width, .is_signed = element_type->payload.int_type.is_signed }), acc);\
             return acc;
         }
         case Float_TAG: {
             const Type* unsigned_int_t = int_type(a, (Int) {.width = float_to_int_width(element_type->payload.float_type.width), .is_signed = false });
-            const Node* unsigned_int = gen_deserialisation(ctx, bb, unsigned_int_t, arr, base_offset);
+            const Node* unsigned_int = gen_deserialisation(ctx, bb, as, unsigned_int_t, arr, base_offset);
             return gen_reinterpret_cast(bb, element_type, unsigned_int);
         }
         case TypeDeclRef_TAG:
@@ -115,10 +234,8 @@ static const Node* gen_deserialisation(Context* ctx, BodyBuilder* bb, const Type
             Nodes member_types = compound_type->payload.record_type.members;
             LARRAY(const Node*, loaded, member_types.count);
             for (size_t i = 0; i < member_types.count; i++) {
-                const Node* field_offset = gen_primop_e(bb, offset_of_op, singleton(element_type), singleton(size_t_literal(a, i)));
-                            field_offset = bytes_to_words(bb, field_offset);
-                const Node* adjusted_offset = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, base_offset, field_offset));
-                loaded[i] = gen_deserialisation(ctx, bb, member_types.nodes[i], arr, adjusted_offset);
+                const Node* adjusted_offset = gen_field_offset(bb, element_type, i, base_offset);
+                loaded[i] = gen_deserialisation(ctx, bb, as, member_types.nodes[i], arr, adjusted_offset);
             }
             return composite_helper(a, element_type, nodes(a, member_types.count, loaded));
         }
@@ -135,8 +252,8 @@ static const Node* gen_deserialisation(Context* ctx, BodyBuilder* bb, const Type
             LARRAY(const Node*, components, components_count);
             const Node* offset = base_offset;
             for (size_t i = 0; i < components_count; i++) {
-                components[i] = gen_deserialisation(ctx, bb, component_type, arr, offset);
-                offset = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, offset, gen_primop_e(bb, size_of_op, singleton(component_type), empty(a))));
+                components[i] = gen_deserialisation(ctx, bb, as, component_type, arr, offset);
+                offset = gen_add_to_offset(bb, offset, gen_primop_e(bb, size_of_op, singleton(component_type), empty(a)));
             }
             return composite_helper(a, element_type, nodes(a, components_count, components));
         }
@@ -144,62 +261,64 @@ static const Node* gen_deserialisation(Context* ctx, BodyBuilder* bb, const Type
     }
 }
 
-static void gen_serialisation(Context* ctx, BodyBuilder* bb, const Type* element_type, const Node* arr, const Node* base_offset, const Node* value) {
+static void gen_serialisation(Context* ctx, BodyBuilder* bb, AddressSpace as, const Type* element_type, const Node* arr, const Node* base_offset, const Node* value) {
     IrArena* a = ctx->rewriter.dst_arena;
     const CompilerConfig* config = ctx->config;
-    const Node* zero = size_t_literal(a, 0);
     switch (element_type->tag) {
         case Bool_TAG: {
-            const Node* logical_ptr = gen_primop_ce(bb, lea_op, 3, (const Node* []) { arr, zero, base_offset });
-            const Node* zero_b = int_literal(a, (IntLiteral) { .value = 1, .width = a->config.memory.word_size });
-            const Node* one_b =  int_literal(a, (IntLiteral) { .value = 0, .width = a->config.memory.word_size });
-            const Node* int_value = gen_primop_ce(bb, select_op, 3, (const Node*[]) { value, one_b, zero_b });
-            gen_store(bb, logical_ptr, int_value);
+            const Type* int_t = int_type(a, (Int) { .width = a->config.memory.word_size, .is_signed = false });
+            const Node* one = int_literal(a, (IntLiteral) { .value = 1, .width = a->config.memory.word_size });
+            const Node* zero = int_literal(a, (IntLiteral) { .value = 0, .width = a->config.memory.word_size });
+            const Node* int_value = gen_primop_ce(bb, select_op, 3, (const Node*[]) { value, one, zero });
+            gen_serialisation(ctx, bb, as, int_t, arr, base_offset, int_value);
             return;
         }
         case PtrType_TAG: switch (element_type->payload.ptr_type.address_space) {
             case AsGlobalPhysical: {
                 const Type* ptr_int_t = int_type(a, (Int) {.width = a->config.memory.ptr_size, .is_signed = false });
                 const Node* unsigned_value = gen_primop_e(bb, reinterpret_op, singleton(ptr_int_t), singleton(value));
-                return gen_serialisation(ctx, bb, ptr_int_t, arr, base_offset, unsigned_value);
+                return gen_serialisation(ctx, bb, as, ptr_int_t, arr, base_offset, unsigned_value);
             }
             default: error("TODO")
         }
         case Int_TAG: des_int: {
             assert(element_type->tag == Int_TAG);
+            IntSizes width = element_type->payload.int_type.width;
             // First bitcast to unsigned so we always get zero-extension and not sign-extension afterwards
-            const Type* element_t_unsigned = int_type(a, (Int) { .width = element_type->payload.int_type.width, .is_signed = false});
+            const Type* element_t_unsigned = int_type(a, (Int) { .width = width, .is_signed = false});
             value = convert_int_extend_according_to_src_t(bb, element_t_unsigned, value);
 
-            // const Node* acc = int_literal(a, (IntLiteral) { .width = element_type->payload.int_type.width, .is_signed = false, .value = 0 });
-            size_t length_in_bytes = int_size_in_bytes(element_type->payload.int_type.width);
-            size_t word_size_in_bytes = int_size_in_bytes(a->config.memory.word_size);
-            const Node* offset = base_offset;
-            const Node* shift = int_literal(a, (IntLiteral) { .width = element_type->payload.int_type.width, .is_signed = false, .value = 0 });
-            const Node* word_bitwidth = int_literal(a, (IntLiteral) { .width = element_type->payload.int_type.width, .is_signed = false, .value = word_size_in_bytes * 8 });
-            for (size_t byte = 0; byte < length_in_bytes; byte += word_size_in_bytes) {
-                bool is_last_word = byte + word_size_in_bytes >= length_in_bytes;
-                /*bool needs_patch = is_last_word && word_size_in_bytes < length_in_bytes;
-                const Node* original_word = NULL;
-                if (needs_patch) {
-                    original_word = gen_load(bb, gen_primop_ce(bb, lea_op, 3, (const Node* []) {arr, zero, offset}));
-                    error_print("TODO");
-                    error_die();
-                    // word = gen_conversion(bb, int_type(a, (Int) { .width = element_type->payload.int_type.width, .is_signed = false }), word); // widen/truncate the word we just loaded
-                }*/
-                const Node* word = value;
-                word = first(gen_primop(bb, rshift_logical_op, empty(a), mk_nodes(a, word, shift))); // shift it
-                word = gen_conversion(bb, int_type(a, (Int) { .width = a->config.memory.word_size, .is_signed = false }), word); // widen/truncate the word we want to store
-                gen_store(bb, gen_primop_ce(bb, lea_op, 3, (const Node* []) {arr, zero, offset}), word);
-
-                offset = first(gen_primop(bb, add_op, empty(a), mk_nodes(a, offset, size_t_literal(a, 1))));
-                shift = first(gen_primop(bb, add_op, empty(a), mk_nodes(a, shift, word_bitwidth)));
+            const Type* word_t = get_emulated_word_type(ctx, as);
+            size_t length_in_bytes = int_size_in_bytes(width);
+            size_t word_size_in_bytes = int_size_in_bytes(ctx->word_size[as]);
+            if (fits_in_word(ctx, as, element_type)) {
+                // read-modify-write the word holding the value
+                const Node* word_ptr = gen_word_ptr(ctx, bb, as, arr, base_offset);
+                const Node* shift = gen_shift_in_word(ctx, bb, as, base_offset);
+                const Node* mask = int_literal(a, (IntLiteral) { .width = ctx->word_size[as], .is_signed = false, .value = (UINT64_C(1) << (length_in_bytes * 8)) - 1 });
+                            mask = gen_primop_e(bb, lshift_op, empty(a), mk_nodes(a, mask, shift));
+                const Node* all_ones = int_literal(a, (IntLiteral) { .width = ctx->word_size[as], .is_signed = false, .value = UINT64_MAX >> (64 - word_size_in_bytes * 8) });
+                const Node* word = gen_load(bb, word_ptr);
+                            word = gen_primop_e(bb, and_op, empty(a), mk_nodes(a, word, gen_primop_e(bb, xor_op, empty(a), mk_nodes(a, mask, all_ones))));
+                const Node* shifted = gen_primop_e(bb, lshift_op, empty(a), mk_nodes(a, gen_conversion(bb, word_t, value), shift));
+                            word = gen_primop_e(bb, or_op, empty(a), mk_nodes(a, word, shifted));
+                gen_store(bb, word_ptr, word);
+            } else {
+                const Node* offset = base_offset;
+                for (size_t byte = 0; byte < length_in_bytes; byte += word_size_in_bytes) {
+                    const Node* word = value;
+                    if (byte > 0)
+                        word = gen_primop_e(bb, rshift_logical_op, empty(a), mk_nodes(a, word, int_literal(a, (IntLiteral) { .width = width, .is_signed = false, .value = byte * 8 }))); // shift it
+                    word = gen_conversion(bb, word_t, word); // widen/truncate the word we want to store
+                    gen_store(bb, gen_word_ptr(ctx, bb, as, arr, offset), word);
+
+                    offset = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, offset, offset_literal(base_offset, word_size_in_bytes)));
+                }
             }
             if (config->printf_trace.memory_accesses) {
-                AddressSpace as = get_unqualified_type(arr->type)->payload.ptr_type.address_space;
-                String template = format_string_interned(a, "stored %s at %s:%s\n", element_type->payload.int_type.width == IntTy64 ? "%lu" : "%u", get_address_space_name(as), "%lx");
+                String template = format_string_interned(a, "stored %s at %s:%s\n", width == IntTy64 ? "%lu" : "%u", get_address_space_name(as), get_unqualified_type(base_offset->type)->payload.int_type.width == IntTy64 ? "%lx" : "%x");
                 const Node* widened = value;
-                if (element_type->payload.int_type.width < IntTy32)
+                if (width < IntTy32)
                     widened = gen_conversion(bb, uint32_type(a), value);
                 bind_instruction(bb, prim_op(a, (PrimOp) { .op = debug_printf_op, .operands = mk_nodes(a, string_lit(a, (StringLiteral) { .string = template }), widened, base_offset) }));
             }
@@ -208,23 +327,21 @@ static void gen_serialisation(Context* ctx, BodyBuilder* bb, const Type* element
         case Float_TAG: {
             const Type* unsigned_int_t = int_type(a, (Int) {.width = float_to_int_width(element_type->payload.float_type.width), .is_signed = false });
             const Node* unsigned_value = gen_primop_e(bb, reinterpret_op, singleton(unsigned_int_t), singleton(value));
-            return gen_serialisation(ctx, bb, unsigned_int_t, arr, base_offset, unsigned_value);
+            return gen_serialisation(ctx, bb, as, unsigned_int_t, arr, base_offset, unsigned_value);
         }
         case RecordType_TAG: {
             Nodes member_types = element_type->payload.record_type.members;
             for (size_t i = 0; i < member_types.count; i++) {
                 const Node* extracted_value = first(bind_instruction(bb, prim_op(a, (PrimOp) { .op = extract_op, .operands = mk_nodes(a, value, int32_literal(a, i)), .type_arguments = empty(a) })));
-                const Node* field_offset = gen_primop_e(bb, offset_of_op, singleton(element_type), singleton(size_t_literal(a, i)));
-                            field_offset = bytes_to_words(bb, field_offset);
-                const Node* adjusted_offset = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, base_offset, field_offset));
-                gen_serialisation(ctx, bb, member_types.nodes[i], arr, adjusted_offset, extracted_value);
+                const Node* adjusted_offset = gen_field_offset(bb, element_type, i, base_offset);
+                gen_serialisation(ctx, bb, as, member_types.nodes[i], arr, adjusted_offset, extracted_value);
             }
             return;
         }
         case TypeDeclRef_TAG: {
             const Node* nom = element_type->payload.type_decl_ref.decl;
             assert(nom && nom->tag == NominalType_TAG);
-            gen_serialisation(ctx, bb, nom->payload.nom_type.body, arr, base_offset, value);
+            gen_serialisation(ctx, bb, as, nom->payload.nom_type.body, arr, base_offset, value);
             return;
         }
         case ArrType_TAG:
@@ -239,8 +356,8 @@ static void gen_serialisation(Context* ctx, BodyBuilder* bb, const Type* element
             const Type* component_type = get_fill_type_element_type(element_type);
             const Node* offset = base_offset;
             for (size_t i = 0; i < components_count; i++) {
-                gen_serialisation(ctx, bb, component_type, arr, offset, gen_extract(bb, value, singleton(int32_literal(a, i))));
-                offset = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, offset, gen_primop_e(bb, size_of_op, singleton(component_type), empty(a))));
+                gen_serialisation(ctx, bb, as, component_type, arr, offset, gen_extract(bb, value, singleton(int32_literal(a, i))));
+                offset = gen_add_to_offset(bb, offset, gen_primop_e(bb, size_of_op, singleton(component_type), empty(a)));
             }
             return;
         }
@@ -274,17 +391,21 @@ static const Node* gen_serdes_fn(Context* ctx, const Type* element_type, bool un
     Nodes return_ts = ser ? empty(a) : singleton(return_value_t);
 
     String name = format_string_arena(a->arena, "generated_%s_%s_%s_%s", ser ? "store" : "load", get_address_space_name(as), uniform_address ? "uniform" : "varying", name_type_safe(a, element_type));
-    Node* fun = function(ctx->rewriter.dst_module, params, name, singleton(annotation(a, (Annotation) { .name = "Generated" })), return_ts);
+    const Node* base = *get_emulated_as_word_array(ctx, as);
+    // lets opt_store_forwarding know what memory calls to this touch
+    Nodes annotations = mk_nodes(a, annotation(a, (Annotation) { .name = "Generated" }), annotation_value(a, (AnnotationValue) { .name = ser ? "EmulatedStore" : "EmulatedLoad", .value = base }));
+    Node* fun = function(ctx->rewriter.dst_module, params, name, annotations, return_ts);
     insert_dict(const Node*, Node*, cache, element_type, fun);
 
     BodyBuilder* bb = begin_body(a);
-    const Node* address = bytes_to_words(bb, address_param);
-    const Node* base = *get_emulated_as_word_array(ctx, as);
+    const Node* address = address_param;
+    if (ctx->offset_type[as] != emulated_ptr_type)
+        address = gen_conversion(bb, ctx->offset_type[as], address);
     if (ser) {
-        gen_serialisation(ctx, bb, element_type, base, address, value_param);
+        gen_serialisation(ctx, bb, as, element_type, base, address, value_param);
         fun->payload.fun.body = finish_body(bb, fn_ret(a, (Return) { .fn = fun, .args = empty(a) }));
     } else {
-        const Node* loaded_value = gen_deserialisation(ctx, bb, element_type, base, address);
+        const Node* loaded_value = gen_deserialisation(ctx, bb, as, element_type, base, address);
         assert(loaded_value);
         fun->payload.fun.body = finish_body(bb, fn_ret(a, (Return) { .fn = fun, .args = singleton(loaded_value) }));
     }
@@ -390,6 +511,7 @@ static Nodes collect_globals(Context* ctx, AddressSpace as) {
 }
 
 /// Collects all global variables in a specific AS, and creates a record type for them.
+/// Each of them starts on a new word, since they can hold data of any alignment (the stack does).
 static const Node* make_record_type(Context* ctx, AddressSpace as, Nodes collected) {
     IrArena* a = ctx->rewriter.dst_arena;
     Module* m = ctx->rewriter.dst_module;
@@ -397,15 +519,37 @@ static const Node* make_record_type(Context* ctx, AddressSpace as, Nodes collect
     String as_name = get_address_space_name(as);
     Node* global_struct_t = nominal_type(m, singleton(annotation(a, (Annotation) { .name = "Generated" })), format_string_arena(a->arena, "globals_physical_%s_t", as_name));
 
-    LARRAY(String, member_names, collected.count);
-    LARRAY(const Type*, member_tys, collected.count);
+    // room for padding in front of every global
+    LARRAY(String, member_names, collected.count * 2);
+    LARRAY(const Type*, member_tys, collected.count * 2);
+    size_t members_count = 0;
+
+    size_t word_size_in_bytes = int_size_in_bytes(ctx->word_size[as]);
+    size_t base_word_size_in_bytes = int_size_in_bytes(a->config.memory.word_size);
+    size_t offset_in_bytes = 0;
 
     for (size_t i = 0; i < collected.count; i++) {
         const Node* decl = collected.nodes[i];
         const Type* type = decl->payload.global_variable.type;
+        const Type* new_type = rewrite_node(&ctx->rewriter, type);
+        TypeMemLayout layout = get_mem_layout(a, new_type);
+
+        offset_in_bytes = (offset_in_bytes + layout.alignment_in_bytes - 1) / layout.alignment_in_bytes * layout.alignment_in_bytes;
+        size_t padding = (word_size_in_bytes - offset_in_bytes % word_size_in_bytes) % word_size_in_bytes;
+        if (padding > 0) {
+            member_tys[members_count] = arr_type(a, (ArrType) {
+                .element_type = int_type(a, (Int) { .width = a->config.memory.word_size, .is_signed = false }),
+                .size = size_t_literal(a, padding / base_word_size_in_bytes),
+            });
+            member_names[members_count] = format_string_arena(a->arena, "padding_%d", (int) i);
+            members_count++;
+            offset_in_bytes += padding;
+        }
+        offset_in_bytes += layout.size_in_bytes;
 
-        member_tys[i] = rewrite_node(&ctx->rewriter, type);
-        member_names[i] = decl->payload.global_variable.name;
+        size_t member_index = members_count++;
+        member_tys[member_index] = new_type;
+        member_names[member_index] = decl->payload.global_variable.name;
 
         // Turn the old global variable into a pointer (which are also now integers)
         const Type* emulated_ptr_type = int_type(a, (Int) { .width = a->config.memory.ptr_size, .is_signed = false });
@@ -415,7 +559,7 @@ static const Node* make_record_type(Context* ctx, AddressSpace as, Nodes collect
         // we need to compute the actual pointer by getting the offset and dividing it
         // after lower_memory_layout, optimisations will eliminate this and resolve to a value
         BodyBuilder* bb = begin_body(a);
-        const Node* offset = gen_primop_e(bb, offset_of_op, singleton(type_decl_ref(a, (TypeDeclRef) { .decl = global_struct_t })), singleton(size_t_literal(a,  i)));
+        const Node* offset = gen_primop_e(bb, offset_of_op, singleton(type_decl_ref(a, (TypeDeclRef) { .decl = global_struct_t })), singleton(size_t_literal(a, member_index)));
         // const Node* offset_in_words = bytes_to_words(bb, offset);
         new_address->payload.constant.instruction = yield_values_and_wrap_in_block(bb, singleton(offset));
 
@@ -423,8 +567,8 @@ static const Node* make_record_type(Context* ctx, AddressSpace as, Nodes collect
     }
 
     const Type* record_t = record_type(a, (RecordType) {
-        .members = nodes(a, collected.count, member_tys),
-        .names = strings(a, collected.count, member_names)
+        .members = nodes(a, members_count, member_tys),
+        .names = strings(a, members_count, member_names)
     });
 
     //return record_t;
@@ -446,16 +590,60 @@ static void store_init_data(Context* ctx, AddressSpace as, Nodes collected, Body
     }
 }
 
+/// Accesses outside of the emulated arrays are undefined, so offsets into them can be as narrow as the arrays are large
+static const Type* get_emulated_offset_type(Context* ctx, size_t size_in_bytes) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    ValueRange valid_addresses = { .bounded = true, .min = 0, .max = size_in_bytes };
+    if (a->config.memory.ptr_size > IntTy32 && value_range_fits(valid_addresses, IntTy32, false))
+        return uint32_type(a);
+    return int_type(a, (Int) { .width = a->config.memory.ptr_size, .is_signed = false });
+}
+
+/// Swizzled memory lives in a buffer made of a single array of words, whose size is only known by the runtime
+static const Type* make_swizzled_buffer_type(Context* ctx, AddressSpace as) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    return record_type(a, (RecordType) {
+        .members = singleton(arr_type(a, (ArrType) { .element_type = get_emulated_word_type(ctx, as), .size = NULL })),
+        .names = strings(a, 1, (String[]) { "words" }),
+        .special = DecorateBlock,
+    });
+}
+
+/// Binding 0 is taken by the lifted globals, the user's own buffers can be anywhere after it
+static int find_free_binding(Module* src) {
+    int free_binding = 1;
+    Nodes decls = get_module_declarations(src);
+    for (size_t i = 0; i < decls.count; i++) {
+        const Node* set = lookup_annotation(decls.nodes[i], "DescriptorSet");
+        const Node* binding = lookup_annotation(decls.nodes[i], "DescriptorBinding");
+        if (!set || !binding)
+            continue;
+        const IntLiteral* set_value = resolve_to_int_literal(get_annotation_value(set));
+        const IntLiteral* binding_value = resolve_to_int_literal(get_annotation_value(binding));
+        assert(set_value && binding_value);
+        if (get_int_literal_value(*set_value, false) != 0)
+            continue;
+        int used = get_int_literal_value(*binding_value, false);
+        if (used >= free_binding)
+            free_binding = used + 1;
+    }
+    return free_binding;
+}
+
 static void construct_emulated_memory_array(Context* ctx, AddressSpace as, AddressSpace logical_as) {
     IrArena* a = ctx->rewriter.dst_arena;
     Module* m = ctx->rewriter.dst_module;
     String as_name = get_address_space_name(as);
 
-    const Type* word_type = int_type(a, (Int) { .width = a->config.memory.word_size, .is_signed = false });
+    const Type* word_type = get_emulated_word_type(ctx, as);
     const Type* ptr_size_type = int_type(a, (Int) { .width = a->config.memory.ptr_size, .is_signed = false });
 
     ctx->collected[as] = collect_globals(ctx, as);
     if (ctx->collected[as].count == 0) {
+        if (is_as_swizzled(ctx, as)) {
+            *get_emulated_as_word_array(ctx, as) = undef(a, (Undef) { .type = ptr_type(a, (PtrType) { .address_space = AsShaderStorageBufferObject, .pointed_type = make_swizzled_buffer_type(ctx, as) }) });
+            return;
+        }
         const Type* words_array_type = arr_type(a, (ArrType) {
             .element_type = word_type,
             .size = NULL
@@ -465,17 +653,37 @@ static void construct_emulated_memory_array(Context* ctx, AddressSpace as, Addre
     }
 
     const Node* global_struct_t = make_record_type(ctx, as, ctx->collected[as]);
+    ctx->offset_type[as] = get_emulated_offset_type(ctx, get_mem_layout(a, type_decl_ref(a, (TypeDeclRef) { .decl = global_struct_t })).size_in_bytes);
 
     Nodes annotations = singleton(annotation(a, (Annotation) { .name = "Generated" }));
 
     // compute the size
     BodyBuilder* bb = begin_body(a);
     const Node* size_of = gen_primop_e(bb, size_of_op, singleton(type_decl_ref(a, (TypeDeclRef) { .decl = global_struct_t })), empty(a));
-    const Node* size_in_words = bytes_to_words(bb, size_of);
+    size_t word_size_in_bytes = int_size_in_bytes(ctx->word_size[as]);
+    const Node* size_in_words = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, size_of, size_t_literal(a, word_size_in_bytes - 1)));
+                size_in_words = gen_primop_e(bb, div_op, empty(a), mk_nodes(a, size_in_words, size_t_literal(a, word_size_in_bytes)));
 
     Node* constant_decl = constant(m, annotations, ptr_size_type, format_string_interned(a, "globals_physical_%s_size", as_name));
     constant_decl->payload.constant.instruction = yield_values_and_wrap_in_block(bb, singleton(size_in_words));
 
+    if (is_as_swizzled(ctx, as)) {
+        // the runtime multiplies this by how many slots the dispatch needs to size the buffer
+        bb = begin_body(a);
+        const Node* slot_size = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, ref_decl_helper(a, constant_decl), size_t_literal(a, word_size_in_bytes)));
+        Node* slot_size_decl = constant(m, annotations, ptr_size_type, format_string_interned(a, "globals_physical_%s_slot_size", as_name));
+        slot_size_decl->payload.constant.instruction = yield_values_and_wrap_in_block(bb, singleton(slot_size));
+
+        Nodes buffer_annotations = annotations;
+        buffer_annotations = append_nodes(a, buffer_annotations, annotation_value(a, (AnnotationValue) { .name = "DescriptorSet", .value = int32_literal(a, 0) }));
+        buffer_annotations = append_nodes(a, buffer_annotations, annotation_value(a, (AnnotationValue) { .name = "DescriptorBinding", .value = int32_literal(a, ctx->next_free_binding++) }));
+        buffer_annotations = append_nodes(a, buffer_annotations, annotation_values(a, (AnnotationValues) { .name = "SwizzledMemory", .values = mk_nodes(a, int32_literal(a, as), ref_decl_helper(a, slot_size_decl)) }));
+
+        Node* buffer = global_var(m, buffer_annotations, make_swizzled_buffer_type(ctx, as), format_string_arena(a->arena, "swizzled_word_memory_%s", as_name), AsShaderStorageBufferObject);
+        *get_emulated_as_word_array(ctx, as) = ref_decl_helper(a, buffer);
+        return;
+    }
+
     const Type* words_array_type = arr_type(a, (ArrType) {
         .element_type = word_type,
         .size = ref_decl_helper(a, constant_decl)
@@ -494,8 +702,14 @@ Module* lower_physical_ptrs(const CompilerConfig* config, Module* src) {
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process_node),
         .config = config,
+        .next_free_binding = find_free_binding(src),
     };
 
+    for (size_t i = 0; i < NumAddressSpaces; i++) {
+        ctx.offset_type[i] = int_type(a, (Int) { .width = a->config.memory.ptr_size, .is_signed = false });
+        ctx.word_size[i] = get_emulated_word_size(config, a, i);
+    }
+
     construct_emulated_memory_array(&ctx, AsPrivatePhysical, AsPrivateLogical);
     if (dst->arena->config.allow_subgroup_memory)
         construct_emulated_memory_array(&ctx, AsSubgroupPhysical, AsSubgroupLogical);
@@ -11,6 +11,7 @@
 #include "../ir_private.h"
 
 #include "../transform/ir_gen_helpers.h"
+#include "../transform/memory_layout.h"
 
 #include <assert.h>
 #include <string.h>
@@ -23,25 +24,34 @@ typedef struct Context_ {
 
     struct Dict* push;
     struct Dict* pop;
+    struct Dict* push_uniform;
+    struct Dict* pop_uniform;
 
     const Node* stack;
     const Node* stack_pointer;
+    /// Lives in subgroup memory, see uniform_stack in CompilerConfig
+    const Node* uniform_stack;
+    const Node* uniform_stack_pointer;
 } Context;
 
-static const Node* gen_fn(Context* ctx, const Type* element_type, bool push) {
-    struct Dict* cache = push ? ctx->push : ctx->pop;
+static const Node* gen_fn(Context* ctx, const Type* element_type, bool push, bool uniform) {
+    struct Dict* cache;
+    if (uniform)
+        cache = push ? ctx->push_uniform : ctx->pop_uniform;
+    else
+        cache = push ? ctx->push : ctx->pop;
 
     const Node** found = find_value_dict(const Node*, const Node*, cache, element_type);
     if (found)
         return *found;
 
     IrArena* a = ctx->rewriter.dst_arena;
-    const Type* qualified_t = qualified_type(a, (QualifiedType) { .is_uniform = false, .type = element_type });
+    const Type* qualified_t = qualified_type(a, (QualifiedType) { .is_uniform = uniform, .type = element_type });
 
     const Node* param = push ? var(a, qualified_t, "value") : NULL;
     Nodes params = push ? singleton(param) : empty(a);
     Nodes return_ts = push ? empty(a) : singleton(qualified_t);
-    String name = format_string_arena(a->arena, "generated_%s_%s", push ? "push" : "pop", name_type_safe(a, element_type));
+    String name = format_string_arena(a->arena, "generated_%s_%s%s", push ? "push" : "pop", uniform ? "uniform_" : "", name_type_safe(a, element_type));
     Node* fun = function(ctx->rewriter.dst_module, params, name, singleton(annotation(a, (Annotation) { .name = "Generated" })), return_ts);
     insert_dict(const Node*, Node*, cache, element_type, fun);
 
@@ -49,10 +59,17 @@ static const Node* gen_fn(Context* ctx, const Type* element_type, bool push) {
 
     const Node* element_size = gen_primop_e(bb, size_of_op, singleton(element_type), empty(a));
     element_size = gen_conversion(bb, uint32_type(a), element_size);
+    // keep the stack pointer aligned to the words backing the stack, so lower_physical_ptrs can access whole words
+    size_t word_size = int_size_in_bytes(get_emulated_word_size(ctx->config, a, uniform ? AsSubgroupPhysical : AsPrivatePhysical));
+    if (word_size > 1) {
+        element_size = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, element_size, uint32_literal(a, word_size - 1)));
+        element_size = gen_primop_e(bb, div_op, empty(a), mk_nodes(a, element_size, uint32_literal(a, word_size)));
+        element_size = gen_primop_e(bb, mul_op, empty(a), mk_nodes(a, element_size, uint32_literal(a, word_size)));
+    }
 
-    // TODO somehow annotate the uniform guys as uniform
-    const Node* stack_pointer = ctx->stack_pointer;
-    const Node* stack = ctx->stack;
+    const Node* stack_pointer = uniform ? ctx->uniform_stack_pointer : ctx->stack_pointer;
+    const Node* stack = uniform ? ctx->uniform_stack : ctx->stack;
+    assert(stack && stack_pointer);
 
     const Node* stack_size = gen_load(bb, stack_pointer);
 
@@ -125,13 +142,16 @@ static const Node* process_let(Context* ctx, const Node* node) {
                 return finish_body(bb, let(a, quote_helper(a, singleton(stack_base_ptr)), tail));
             }
             case push_stack_op:
-            case pop_stack_op: {
+            case pop_stack_op:
+            case push_stack_uniform_op:
+            case pop_stack_uniform_op: {
                 BodyBuilder* bb = begin_body(a);
                 const Type* element_type = rewrite_node(&ctx->rewriter, first(oprim_op->type_arguments));
 
-                bool push = oprim_op->op == push_stack_op;
+                bool push = oprim_op->op == push_stack_op || oprim_op->op == push_stack_uniform_op;
+                bool uniform = oprim_op->op == push_stack_uniform_op || oprim_op->op == pop_stack_uniform_op;
 
-                const Node* fn = gen_fn(ctx, element_type, push);
+                const Node* fn = gen_fn(ctx, element_type, push, uniform);
                 Nodes args = push ? singleton(rewrite_node(&ctx->rewriter, first(oprim_op->operands))) : empty(a);
                 Nodes results = bind_instruction(bb, call(a, (Call) { .callee = fn_addr_helper(a, fn), .args = args}));
 
@@ -163,6 +183,8 @@ static const Node* process_node(Context* ctx, const Node* old) {
         // is this an old forgotten workaround ?
         const Node* stack_pointer = ctx->stack_pointer;
         gen_store(bb, stack_pointer, uint32_literal(a, 0));
+        if (ctx->uniform_stack_pointer)
+            gen_store(bb, ctx->uniform_stack_pointer, uint32_literal(a, 0));
         new->payload.fun.body = finish_body(bb, rewrite_node(&ctx->rewriter, old->payload.fun.body));
         return new;
     }
@@ -181,10 +203,27 @@ Module* lower_stack(SHADY_UNUSED const CompilerConfig* config, Module* src) {
     IrArena* a = new_ir_arena(aconfig);
     Module* dst = new_module(a, get_module_name(src));
 
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process_node),
+
+        .config = config,
+
+        .push = new_dict(const Node*, Node*, (HashFn) hash_node, (CmpFn) compare_node),
+        .pop = new_dict(const Node*, Node*, (HashFn) hash_node, (CmpFn) compare_node),
+        .push_uniform = new_dict(const Node*, Node*, (HashFn) hash_node, (CmpFn) compare_node),
+        .pop_uniform = new_dict(const Node*, Node*, (HashFn) hash_node, (CmpFn) compare_node),
+    };
+
+    // lower_alloca shrinks this to the deepest the stack can get, when it can work that out
+    const Node* stack_size = uint32_literal(a, config->per_thread_stack_size);
+    const Node* stack_size_decl = get_declaration(src, "STACK_SIZE");
+    if (stack_size_decl)
+        stack_size = ref_decl_helper(a, rewrite_node(&ctx.rewriter, stack_size_decl));
+
     const Type* stack_base_element = uint8_type(a);
     const Type* stack_arr_type = arr_type(a, (ArrType) {
         .element_type = stack_base_element,
-        .size = uint32_literal(a, config->per_thread_stack_size),
+        .size = stack_size,
     });
     const Type* stack_counter_t = uint32_type(a);
 
@@ -197,22 +236,25 @@ Module* lower_stack(SHADY_UNUSED const CompilerConfig* config, Module* src) {
     Node* stack_ptr_decl = global_var(dst, annotations, stack_counter_t, "stack_ptr", AsPrivateLogical);
     stack_ptr_decl->payload.global_variable.init = uint32_literal(a, 0);
 
-    Context ctx = {
-        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process_node),
-
-        .config = config,
+    ctx.stack = ref_decl_helper(a, stack_decl);
+    ctx.stack_pointer = ref_decl_helper(a, stack_ptr_decl);
 
-        .push = new_dict(const Node*, Node*, (HashFn) hash_node, (CmpFn) compare_node),
-        .pop = new_dict(const Node*, Node*, (HashFn) hash_node, (CmpFn) compare_node),
+    // The uniform stack is shared by the subgroup, it is as big as the per-invocation one
+    if (config->lower.uniform_stack) {
+        Node* uniform_stack_decl = global_var(dst, annotations, stack_arr_type, "uniform_stack", AsSubgroupPhysical);
+        Node* uniform_stack_ptr_decl = global_var(dst, annotations, stack_counter_t, "uniform_stack_ptr", AsSubgroupLogical);
+        uniform_stack_ptr_decl->payload.global_variable.init = uint32_literal(a, 0);
 
-        .stack = ref_decl_helper(a, stack_decl),
-        .stack_pointer = ref_decl_helper(a, stack_ptr_decl),
-    };
+        ctx.uniform_stack = ref_decl_helper(a, uniform_stack_decl);
+        ctx.uniform_stack_pointer = ref_decl_helper(a, uniform_stack_ptr_decl);
+    }
 
     rewrite_module(&ctx.rewriter);
     destroy_rewriter(&ctx.rewriter);
 
     destroy_dict(ctx.push);
     destroy_dict(ctx.pop);
+    destroy_dict(ctx.push_uniform);
+    destroy_dict(ctx.pop_uniform);
     return dst;
 }
@@ -11,6 +11,7 @@
 typedef struct {
     Rewriter rewriter;
     const CompilerConfig* config;
+    Node* shuffle_exchange;
 } Context;
 
 static bool is_extended_type(SHADY_UNUSED IrArena* a, const Type* t, bool allow_vectors) {
@@ -26,6 +27,98 @@ static bool is_extended_type(SHADY_UNUSED IrArena* a, const Type* t, bool allow_
     }
 }
 
+static bool is_supported_natively(Context* ctx, const Type* element_type) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    if (element_type->tag == Int_TAG && element_type->payload.int_type.width == IntTy32)
+        return true;
+    return is_extended_type(a, element_type, true) && !ctx->config->lower.emulate_subgroup_ops_extended_types;
+}
+
+static bool is_shuffle(Op op) {
+    switch (op) {
+        case subgroup_shuffle_op:
+        case subgroup_shuffle_xor_op:
+        case subgroup_shuffle_up_op:
+        case subgroup_shuffle_down_op: return true;
+        default: return false;
+    }
+}
+
+/// Subgroup array the invocations exchange words through when shuffles are emulated.
+static const Node* get_shuffle_exchange(Context* ctx) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    if (!ctx->shuffle_exchange) {
+        const Type* arr_t = arr_type(a, (ArrType) { .element_type = int32_type(a), .size = uint32_literal(a, ctx->config->specialization.subgroup_size) });
+        ctx->shuffle_exchange = global_var(ctx->rewriter.dst_module, singleton(annotation(a, (Annotation) { .name = "Generated" })), arr_t, "subgroup_shuffle_exchange", AsSubgroupLogical);
+    }
+    return ref_decl_helper(a, ctx->shuffle_exchange);
+}
+
+/// Every invocation writes its word to its own slot, then reads the one of the lane it shuffles from.
+/// The subgroup might not run in lockstep, so barriers keep the slots from being read early or overwritten by the next shuffle.
+static const Node* gen_emulated_shuffle(Context* ctx, BodyBuilder* bb, Op op, const Node* word, const Node* operand) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    const Node* local_id = gen_builtin_load(ctx->rewriter.dst_module, bb, BuiltinSubgroupLocalInvocationId);
+    const Node* src_lane;
+    switch (op) {
+        case subgroup_shuffle_op:      src_lane = operand; break;
+        case subgroup_shuffle_xor_op:  src_lane = gen_primop_e(bb, xor_op, empty(a), mk_nodes(a, local_id, operand)); break;
+        case subgroup_shuffle_up_op:   src_lane = gen_primop_e(bb, sub_op, empty(a), mk_nodes(a, local_id, operand)); break;
+        case subgroup_shuffle_down_op: src_lane = gen_primop_e(bb, add_op, empty(a), mk_nodes(a, local_id, operand)); break;
+        default: SHADY_UNREACHABLE;
+    }
+    // out of range lanes give undefined results, we just need to stay within the array
+    src_lane = gen_primop_e(bb, mod_op, empty(a), mk_nodes(a, src_lane, uint32_literal(a, ctx->config->specialization.subgroup_size)));
+
+    const Type* word_type = get_unqualified_type(word->type);
+    if (word_type != int32_type(a))
+        word = gen_reinterpret_cast(bb, int32_type(a), word);
+    const Node* exchange = get_shuffle_exchange(ctx);
+    gen_store(bb, gen_lea(bb, exchange, int32_literal(a, 0), singleton(local_id)), word);
+    gen_primop(bb, subgroup_barrier_op, empty(a), empty(a));
+    const Node* result = gen_load(bb, gen_lea(bb, exchange, int32_literal(a, 0), singleton(src_lane)));
+    gen_primop(bb, subgroup_barrier_op, empty(a), empty(a));
+    if (word_type != int32_type(a))
+        result = gen_reinterpret_cast(bb, word_type, result);
+    return result;
+}
+
+static const Node* gen_subgroup_op(Context* ctx, BodyBuilder* bb, Op op, const Node* value, Nodes extra_operands) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    if (is_shuffle(op) && ctx->config->lower.emulate_subgroup_shuffles)
+        return gen_emulated_shuffle(ctx, bb, op, value, first(extra_operands));
+    return first(gen_primop(bb, op, empty(a), concat_nodes(a, singleton(value), extra_operands)));
+}
+
+/// Applies a subgroup op to a value the target can't handle directly, by going over it one 32-bit word at a time.
+static const Node* gen_subgroup_op_wordwise(Context* ctx, BodyBuilder* builder, Op op, const Node* varying_value, Nodes extra_operands) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    const Type* element_type = get_unqualified_type(varying_value->type);
+    TypeMemLayout layout = get_mem_layout(a, element_type);
+
+    const Type* local_arr_ty = arr_type(a, (ArrType) { .element_type = int32_type(a), .size = NULL });
+
+    const Node* varying_top_of_stack = gen_primop_e(builder, get_stack_base_op, empty(a), empty(a));
+    const Type* varying_raw_ptr_t = ptr_type(a, (PtrType) { .address_space = AsPrivatePhysical, .pointed_type = local_arr_ty });
+    const Node* varying_raw_ptr = gen_reinterpret_cast(builder, varying_raw_ptr_t, varying_top_of_stack);
+    const Type* varying_typed_ptr_t = ptr_type(a, (PtrType) { .address_space = AsPrivatePhysical, .pointed_type = element_type });
+    const Node* varying_typed_ptr = gen_reinterpret_cast(builder, varying_typed_ptr_t, varying_top_of_stack);
+
+    gen_store(builder, varying_typed_ptr, varying_value);
+    for (int32_t j = 0; j < bytes_to_words_static(a, layout.size_in_bytes); j++) {
+        const Node* varying_logical_addr = gen_lea(builder, varying_raw_ptr, int32_literal(a, 0), nodes(a, 1, (const Node* []) {int32_literal(a, j) }));
+        const Node* input = gen_load(builder, varying_logical_addr);
+
+        const Node* partial_result = gen_subgroup_op(ctx, builder, op, input, extra_operands);
+
+        if (ctx->config->printf_trace.subgroup_ops)
+            gen_primop(builder, debug_printf_op, empty(a), mk_nodes(a, string_lit(a, (StringLiteral) { .string = "partial_result %d"}), partial_result));
+
+        gen_store(builder, varying_logical_addr, partial_result);
+    }
+    return gen_load(builder, varying_typed_ptr);
+}
+
 static const Node* process_let(Context* ctx, const Node* old) {
     assert(old->tag == Let_TAG);
     IrArena* a = ctx->rewriter.dst_arena;
@@ -35,43 +128,27 @@ static const Node* process_let(Context* ctx, const Node* old) {
     if (old_instruction->tag == PrimOp_TAG) {
         PrimOp payload = old_instruction->payload.prim_op;
         switch (payload.op) {
-            case subgroup_broadcast_first_op: {
-                BodyBuilder* builder = begin_body(a);
+            case subgroup_broadcast_first_op:
+            case subgroup_shuffle_op:
+            case subgroup_shuffle_xor_op:
+            case subgroup_shuffle_up_op:
+            case subgroup_shuffle_down_op: {
                 const Node* varying_value = rewrite_node(&ctx->rewriter, payload.operands.nodes[0]);
                 const Type* element_type = get_unqualified_type(varying_value->type);
+                Nodes extra_operands = rewrite_nodes(&ctx->rewriter, nodes(a, payload.operands.count - 1, &payload.operands.nodes[1]));
+                bool emulate = is_shuffle(payload.op) && ctx->config->lower.emulate_subgroup_shuffles;
 
-                if (element_type->tag == Int_TAG && element_type->payload.int_type.width == IntTy32) {
-                    cancel_body(builder);
-                    break;
-                } else if (is_extended_type(a, element_type, true) && !ctx->config->lower.emulate_subgroup_ops_extended_types) {
-                    cancel_body(builder);
+                if (is_supported_natively(ctx, element_type) && !emulate)
                     break;
-                }
-
-                TypeMemLayout layout = get_mem_layout(a, element_type);
-
-                const Type* local_arr_ty = arr_type(a, (ArrType) { .element_type = int32_type(a), .size = NULL });
-
-                const Node* varying_top_of_stack = gen_primop_e(builder, get_stack_base_op, empty(a), empty(a));
-                const Type* varying_raw_ptr_t = ptr_type(a, (PtrType) { .address_space = AsPrivatePhysical, .pointed_type = local_arr_ty });
-                const Node* varying_raw_ptr = gen_reinterpret_cast(builder, varying_raw_ptr_t, varying_top_of_stack);
-                const Type* varying_typed_ptr_t = ptr_type(a, (PtrType) { .address_space = AsPrivatePhysical, .pointed_type = element_type });
-                const Node* varying_typed_ptr = gen_reinterpret_cast(builder, varying_typed_ptr_t, varying_top_of_stack);
 
-                gen_store(builder, varying_typed_ptr, varying_value);
-                for (int32_t j = 0; j < bytes_to_words_static(a, layout.size_in_bytes); j++) {
-                    const Node* varying_logical_addr = gen_lea(builder, varying_raw_ptr, int32_literal(a, 0), nodes(a, 1, (const Node* []) {int32_literal(a, j) }));
-                    const Node* input = gen_load(builder, varying_logical_addr);
-
-                    const Node* partial_result = gen_primop_ce(builder, subgroup_broadcast_first_op, 1, (const Node* []) { input });
-
-                    if (ctx->config->printf_trace.subgroup_ops)
-                        gen_primop(builder, debug_printf_op, empty(a), mk_nodes(a, string_lit(a, (StringLiteral) { .string = "partial_result %d"}), partial_result));
-
-                    gen_store(builder, varying_logical_addr, partial_result);
-                }
-                const Node* result = gen_load(builder, varying_typed_ptr);
-                result = first(gen_primop(builder, subgroup_assume_uniform_op, empty(a), singleton(result)));
+                BodyBuilder* builder = begin_body(a);
+                const Node* result;
+                if (element_type->tag == Int_TAG && element_type->payload.int_type.width == IntTy32)
+                    result = gen_subgroup_op(ctx, builder, payload.op, varying_value, extra_operands);
+                else
+                    result = gen_subgroup_op_wordwise(ctx, builder, payload.op, varying_value, extra_operands);
+                if (is_qualified_type_uniform(old_instruction->type))
+                    result = first(gen_primop(builder, subgroup_assume_uniform_op, empty(a), singleton(result)));
                 return finish_body(builder, let(a, quote_helper(a, singleton(result)), tail));
             }
             default: break;
@@ -20,6 +20,13 @@ static const Node* process(Context* ctx, NodeClass class, String op_name, const
 
     IrArena* a = ctx->rewriter.dst_arena;
 
+    // declarations don't belong to whatever body we might be in the middle of rewriting
+    if (class == NcDeclaration && ctx->b) {
+        Context c = *ctx;
+        c.b = NULL;
+        return process(&c, class, op_name, node);
+    }
+
     switch (node->tag) {
         case PtrType_TAG: {
             AddressSpace as = node->payload.ptr_type.address_space;
@@ -32,8 +39,10 @@ static const Node* process(Context* ctx, NodeClass class, String op_name, const
             const Node* odecl = node->payload.ref_decl.decl;
             if (odecl->tag != GlobalVariable_TAG || odecl->payload.global_variable.address_space != AsSubgroupLogical)
                 break;
-            assert(ctx->b);
             const Node* ndecl = rewrite_op(&ctx->rewriter, NcDeclaration, "decl", odecl);
+            // outside of a body (i.e. in annotations), this can only refer to the whole array
+            if (!ctx->b)
+                return ref_decl_helper(a, ndecl);
             const Node* index = gen_builtin_load(ctx->rewriter.dst_module, ctx->b, BuiltinSubgroupId);
             const Node* slice = gen_lea(ctx->b, ref_decl_helper(a, ndecl), int32_literal(a, 0), mk_nodes(a, index));
             return slice;
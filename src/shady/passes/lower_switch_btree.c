@@ -8,8 +8,11 @@
 #include "../rewrite.h"
 #include "../transform/ir_gen_helpers.h"
 
+#include <stdlib.h>
+
 typedef struct {
     Rewriter rewriter;
+    const CompilerConfig* config;
 
     const Node* inspectee;
     const Node* run_default_case;
@@ -21,7 +24,9 @@ typedef struct TreeNode_ TreeNode;
 struct TreeNode_ {
     TreeNode* children[2];
     int depth;
+    /// A node covers the keys from key to max_key, which are the same unless it's a dense cluster of cases
     uint64_t key;
+    uint64_t max_key;
     const Node* lam;
 };
 
@@ -94,9 +99,56 @@ static const Node* wrap_instr_in_lambda(const Node* instr) {
     return case_(a, empty(a), finish_body(bb, yield(a, (Yield) {.args = values})));
 }
 
+typedef struct {
+    uint64_t key;
+    const Node* literal;
+    const Node* lam;
+} SwitchCase;
+
+static int compare_switch_cases(const void* l, const void* r) {
+    const SwitchCase* a = l;
+    const SwitchCase* b = r;
+    return a->key < b->key ? -1 : a->key > b->key;
+}
+
+/// Returns how many cases, starting with the first one, are dense enough to stay a Match.
+/// We greedily take the longest run that still fills enough of its range of keys.
+static size_t find_dense_cluster(Context* ctx, const SwitchCase* cases, size_t count) {
+    if (!ctx->config->optimisations.switch_lowering.jump_tables)
+        return 1;
+    size_t best = 1;
+    uint64_t density = ctx->config->optimisations.switch_lowering.min_density_percent;
+    for (size_t i = 1; i < count; i++) {
+        uint64_t range = cases[i].key - cases[0].key;
+        // can't possibly be dense
+        if (range >= UINT32_MAX)
+            break;
+        if ((i + 1) * 100 >= density * (range + 1))
+            best = i + 1;
+    }
+    return best >= ctx->config->optimisations.switch_lowering.min_cases ? best : 1;
+}
+
+static const Node* generate_cluster_match(Context* ctx, const SwitchCase* cases, size_t count) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    LARRAY(const Node*, literals, count);
+    LARRAY(const Node*, lams, count);
+    for (size_t i = 0; i < count; i++) {
+        literals[i] = cases[i].literal;
+        lams[i] = cases[i].lam;
+    }
+    return wrap_instr_in_lambda(match_instr(a, (Match) {
+        .yield_types = ctx->yield_types,
+        .inspect = ctx->inspectee,
+        .literals = nodes(a, count, literals),
+        .cases = nodes(a, count, lams),
+        .default_case = generate_default_fallback_case(ctx),
+    }));
+}
+
 static const Node* generate_decision_tree(Context* ctx, TreeNode* n, uint64_t min, uint64_t max) {
     IrArena* a = ctx->rewriter.dst_arena;
-    assert(n->key >= min && n->key <= max);
+    assert(n->key >= min && n->max_key <= max);
     assert(n->lam);
 
     // instruction in case we match
@@ -107,6 +159,7 @@ static const Node* generate_decision_tree(Context* ctx, TreeNode* n, uint64_t mi
     assert(inspectee_t->tag == Int_TAG);
 
     const Node* pivot = int_literal(a, (IntLiteral) { .width = inspectee_t->payload.int_type.width, .is_signed = inspectee_t->payload.int_type.is_signed, .value = n->key });
+    const Node* max_pivot = int_literal(a, (IntLiteral) { .width = inspectee_t->payload.int_type.width, .is_signed = inspectee_t->payload.int_type.is_signed, .value = n->max_key });
 
     if (min < n->key) {
         BodyBuilder* bb = begin_body(a);
@@ -120,12 +173,12 @@ static const Node* generate_decision_tree(Context* ctx, TreeNode* n, uint64_t mi
         body = case_(a, empty(a), finish_body(bb, yield(a, (Yield) {.args = values})));
     }
 
-    if (max > n->key) {
+    if (max > n->max_key) {
         BodyBuilder* bb = begin_body(a);
         const Node* instr = if_instr(a, (If) {
             .yield_types = ctx->yield_types,
-            .condition = gen_primop_e(bb, gt_op, empty(a), mk_nodes(a, ctx->inspectee, pivot)),
-            .if_true = n->children[1] ? generate_decision_tree(ctx, n->children[1], n->key + 1, max) : generate_default_fallback_case(ctx),
+            .condition = gen_primop_e(bb, gt_op, empty(a), mk_nodes(a, ctx->inspectee, max_pivot)),
+            .if_true = n->children[1] ? generate_decision_tree(ctx, n->children[1], n->max_key + 1, max) : generate_default_fallback_case(ctx),
             .if_false = body,
         });
         Nodes values = bind_instruction(bb, instr);
@@ -148,14 +201,21 @@ static const Node* process(Context* ctx, const Node* node) {
             // TODO or maybe do that in fold()
             assert(cases.count > 0);
 
-            Arena* arena = new_arena();
-            TreeNode* root = NULL;
-            for (size_t i = 0; i < literals.count; i++) {
-                TreeNode* t = arena_alloc(arena, sizeof(TreeNode));
-                t->key = get_int_literal_value(*resolve_to_int_literal(literals.nodes[i]), false);
-                t->lam = cases.nodes[i];
-                root = insert(root, t);
-            }
+            LARRAY(SwitchCase, sorted_cases, cases.count);
+            for (size_t i = 0; i < cases.count; i++)
+                sorted_cases[i] = (SwitchCase) { get_int_literal_value(*resolve_to_int_literal(literals.nodes[i]), false), literals.nodes[i], cases.nodes[i] };
+            qsort(sorted_cases, cases.count, sizeof(SwitchCase), compare_switch_cases);
+
+            // Dense enough switches are left alone, the backends turn them into native switch statements
+            size_t cluster_size = find_dense_cluster(ctx, sorted_cases, cases.count);
+            if (cluster_size > 1 && cluster_size == cases.count)
+                return match_instr(a, (Match) {
+                    .yield_types = yield_types,
+                    .inspect = rewrite_node(&ctx->rewriter, node->payload.match_instr.inspect),
+                    .literals = literals,
+                    .cases = cases,
+                    .default_case = rewrite_node(&ctx->rewriter, node->payload.match_instr.default_case),
+                });
 
             BodyBuilder* bb = begin_body(a);
             const Node* run_default_case = gen_primop_e(bb, alloca_logical_op, singleton(bool_type(a)), empty(a));
@@ -165,6 +225,20 @@ static const Node* process(Context* ctx, const Node* node) {
             ctx2.run_default_case = run_default_case;
             ctx2.yield_types = yield_types;
             ctx2.inspectee = rewrite_node(&ctx->rewriter, node->payload.match_instr.inspect);
+
+            // Sparse keys go in the tree on their own, dense clusters of them become a single node holding a smaller Match
+            Arena* arena = new_arena();
+            TreeNode* root = NULL;
+            for (size_t i = 0; i < cases.count;) {
+                cluster_size = find_dense_cluster(ctx, &sorted_cases[i], cases.count - i);
+                TreeNode* t = arena_alloc(arena, sizeof(TreeNode));
+                t->key = sorted_cases[i].key;
+                t->max_key = sorted_cases[i + cluster_size - 1].key;
+                t->lam = cluster_size == 1 ? sorted_cases[i].lam : generate_cluster_match(&ctx2, &sorted_cases[i], cluster_size);
+                root = insert(root, t);
+                i += cluster_size;
+            }
+
             Nodes matched_results = bind_instruction(bb, block(a, (Block) { .yield_types = add_qualifiers(a, ctx2.yield_types, false), .inside = generate_decision_tree(&ctx2, root, 0, UINT64_MAX) }));
 
             // Check if we need to run the default case
@@ -186,13 +260,14 @@ static const Node* process(Context* ctx, const Node* node) {
     return recreate_node_identity(&ctx->rewriter, node);
 }
 
-Module* lower_switch_btree(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+Module* lower_switch_btree(const CompilerConfig* config, Module* src) {
     ArenaConfig aconfig = get_arena_config(get_module_arena(src));
     IrArena* a = new_ir_arena(aconfig);
     Module* dst = new_module(a, get_module_name(src));
 
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .config = config,
     };
     rewrite_module(&ctx.rewriter);
     destroy_rewriter(&ctx.rewriter);
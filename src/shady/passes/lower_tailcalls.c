@@ -11,6 +11,7 @@
 #include "../analysis/scope.h"
 #include "../analysis/uses.h"
 #include "../analysis/leak.h"
+#include "../analysis/callgraph.h"
 #include "../transform/ir_gen_helpers.h"
 
 #include "list.h"
@@ -18,6 +19,8 @@
 
 #include <assert.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 typedef uint64_t FnPtr;
 
@@ -269,6 +272,123 @@ static const Node* process(Context* ctx, const Node* old) {
     return recreate_node_identity(&ctx->rewriter, old);
 }
 
+typedef struct {
+    const Node* fn;
+    uint64_t frequency;
+    /// position in the module, so ties are broken the same way every time
+    size_t index;
+} DispatchTarget;
+
+static int compare_dispatch_targets(const void* l, const void* r) {
+    const DispatchTarget* a = l;
+    const DispatchTarget* b = r;
+    if (a->frequency != b->frequency)
+        return a->frequency > b->frequency ? -1 : 1;
+    return a->index < b->index ? -1 : a->index > b->index;
+}
+
+/// Looks the function up in a profile listing one function name and call count per line.
+static bool lookup_profiled_frequency(const char* profile, String name, uint64_t* frequency) {
+    size_t name_len = strlen(name);
+    for (const char* line = profile; line && *line; line = strchr(line, '\n'), line = line ? line + 1 : NULL) {
+        if (strncmp(line, name, name_len) != 0 || (line[name_len] != ' ' && line[name_len] != '\t'))
+            continue;
+        *frequency = strtoull(line + name_len, NULL, 10);
+        return true;
+    }
+    return false;
+}
+
+/// Without a profile, every place that can send control to a function counts once, and functions in a cycle are assumed to run many times over.
+static uint64_t estimate_frequency(CallGraph* graph, const Node* fn) {
+    CGNode* node = callgraph_lookup(graph, fn);
+    uint64_t frequency = node->captures_count;
+    size_t iter = 0;
+    CGEdge e;
+    while (dict_iter(node->callers, &iter, &e, NULL)) {
+        if (e.instr->tag == TailCall_TAG)
+            frequency++;
+    }
+    if (node->is_recursive)
+        frequency *= 8;
+    return frequency;
+}
+
+/// Returns the only function this one tail calls, if there is exactly one and it goes through the dispatcher.
+static const Node* get_single_static_successor(CallGraph* graph, const Node* fn) {
+    CGNode* node = callgraph_lookup(graph, fn);
+    const Node* successor = NULL;
+    size_t iter = 0;
+    CGEdge e;
+    while (dict_iter(node->callees, &iter, &e, NULL)) {
+        if (e.instr->tag != TailCall_TAG)
+            continue;
+        if (successor && successor != e.dst_fn->fn)
+            return NULL;
+        successor = e.dst_fn->fn;
+    }
+    if (successor && lookup_annotation(successor, "Leaf"))
+        return NULL;
+    return successor;
+}
+
+typedef struct {
+    const Node* next_mask;
+    const Node* local_id;
+    const Node* should_run;
+    BodyBuilder* loop_body_builder;
+} DispatchState;
+
+static void gen_dispatch_call(Context* ctx, BodyBuilder* bb, const DispatchState* state, const Node* decl) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    const Node* fn_lit = lower_fn_addr(ctx, decl);
+
+    BodyBuilder* if_builder = begin_body(a);
+    if (ctx->config->printf_trace.god_function) {
+        const Node* sid = gen_builtin_load(ctx->rewriter.dst_module, state->loop_body_builder, BuiltinSubgroupId);
+        bind_instruction(if_builder, prim_op(a, (PrimOp) { .op = debug_printf_op, .operands = mk_nodes(a, string_lit(a, (StringLiteral) { .string = "trace: thread %d:%d will run fn %d with mask = %lx\n" }), sid, state->local_id, fn_lit, state->next_mask) }));
+    }
+    bind_instruction(if_builder, call(a, (Call) {
+        .callee = fn_addr_helper(a, find_processed(&ctx->rewriter, decl)),
+        .args = nodes(a, 0, NULL)
+    }));
+    const Node* if_true_lam = case_(a, empty(a), finish_body(if_builder, yield(a, (Yield) {.args = nodes(a, 0, NULL)})));
+    bind_instruction(bb, if_instr(a, (If) {
+        .condition = state->should_run,
+        .if_true = if_true_lam,
+        .if_false = NULL,
+        .yield_types = empty(a),
+    }));
+}
+
+/// Builds the body that runs a function, and its successor right after it if that's where it went, before continuing the top loop.
+static const Node* gen_dispatch_case(Context* ctx, CallGraph* graph, const DispatchState* state, const Node* decl, const Node* continue_terminator) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    BodyBuilder* case_builder = begin_body(a);
+    gen_dispatch_call(ctx, case_builder, state, decl);
+
+    const Node* successor = ctx->config->optimisations.dispatcher.fallthrough ? get_single_static_successor(graph, decl) : NULL;
+    if (successor) {
+        // saves a trip around the loop and through the Match, the successor runs with the updated mask as it would there
+        DispatchState successor_state = *state;
+        const Node* next_function = gen_load(case_builder, access_decl(&ctx->rewriter, "next_fn"));
+        successor_state.next_mask = first(bind_instruction(case_builder, call(a, (Call) { .callee = access_decl(&ctx->rewriter, "builtin_get_active_branch"), .args = empty(a) })));
+        successor_state.should_run = gen_primop_e(case_builder, mask_is_thread_active_op, empty(a), mk_nodes(a, successor_state.next_mask, state->local_id));
+        const Node* is_successor = gen_primop_e(case_builder, eq_op, empty(a), mk_nodes(a, next_function, gen_conversion(case_builder, uint32_type(a), lower_fn_addr(ctx, successor))));
+
+        BodyBuilder* successor_builder = begin_body(a);
+        gen_dispatch_call(ctx, successor_builder, &successor_state, successor);
+        bind_instruction(case_builder, if_instr(a, (If) {
+            .condition = is_successor,
+            .if_true = case_(a, empty(a), finish_body(successor_builder, yield(a, (Yield) { .args = empty(a) }))),
+            .if_false = NULL,
+            .yield_types = empty(a),
+        }));
+    }
+
+    return case_(a, nodes(a, 0, NULL), finish_body(case_builder, continue_terminator));
+}
+
 void generate_top_level_dispatch_fn(Context* ctx) {
     assert(ctx->config->dynamic_scheduling);
     assert(*ctx->top_dispatcher_fn);
@@ -282,6 +402,12 @@ void generate_top_level_dispatch_fn(Context* ctx) {
     const Node* next_mask = first(bind_instruction(loop_body_builder, call(a, (Call) { .callee = get_active_branch_fn, .args = empty(a) })));
     const Node* local_id = gen_builtin_load(ctx->rewriter.dst_module, loop_body_builder, BuiltinSubgroupLocalInvocationId);
     const Node* should_run = gen_primop_e(loop_body_builder, mask_is_thread_active_op, empty(a), mk_nodes(a, next_mask, local_id));
+    DispatchState state = {
+        .next_mask = next_mask,
+        .local_id = local_id,
+        .should_run = should_run,
+        .loop_body_builder = loop_body_builder,
+    };
 
     bool count_iterations = ctx->config->shader_diagnostics.max_top_iterations > 0;
     const Node* iterations_count_param = NULL;
@@ -317,9 +443,6 @@ void generate_top_level_dispatch_fn(Context* ctx) {
         bind_instruction(loop_body_builder, bail_if);
     }
 
-    struct List* literals = new_list(const Node*);
-    struct List* cases = new_list(const Node*);
-
     // Build 'zero' case (exits the program)
     BodyBuilder* zero_case_builder = begin_body(a);
     BodyBuilder* zero_if_case_builder = begin_body(a);
@@ -342,9 +465,17 @@ void generate_top_level_dispatch_fn(Context* ctx) {
 
     const Node* zero_case_lam = case_(a, nodes(a, 0, NULL), finish_body(zero_case_builder, continue_terminator));
     const Node* zero_lit = uint64_literal(a, 0);
-    append_list(const Node*, literals, zero_lit);
-    append_list(const Node*, cases, zero_case_lam);
 
+    // Order the functions by how often we expect to dispatch to them, the likeliest ones get checked for before the Match
+    CallGraph* graph = new_callgraph(ctx->rewriter.src_module);
+    char* profile = NULL;
+    if (ctx->config->optimisations.dispatcher.profile) {
+        size_t profile_size;
+        if (!read_file(ctx->config->optimisations.dispatcher.profile, &profile_size, &profile))
+            error("lower_tailcalls: failed to read the dispatcher profile '%s'", ctx->config->optimisations.dispatcher.profile);
+    }
+
+    struct List* targets = new_list(DispatchTarget);
     Nodes old_decls = get_module_declarations(ctx->rewriter.src_module);
     for (size_t i = 0; i < old_decls.count; i++) {
         const Node* decl = old_decls.nodes[i];
@@ -352,47 +483,70 @@ void generate_top_level_dispatch_fn(Context* ctx) {
             if (lookup_annotation(decl, "Leaf"))
                 continue;
 
-            const Node* fn_lit = lower_fn_addr(ctx, decl);
+            DispatchTarget target = { .fn = decl, .frequency = 0, .index = i };
+            if (!profile)
+                target.frequency = estimate_frequency(graph, decl);
+            else
+                lookup_profiled_frequency(profile, get_abstraction_name(decl), &target.frequency);
+            append_list(DispatchTarget, targets, target);
+        }
+    }
+    free(profile);
 
-            BodyBuilder* if_builder = begin_body(a);
-            if (ctx->config->printf_trace.god_function) {
-                const Node* sid = gen_builtin_load(ctx->rewriter.dst_module, loop_body_builder, BuiltinSubgroupId);
-                bind_instruction(if_builder, prim_op(a, (PrimOp) { .op = debug_printf_op, .operands = mk_nodes(a, string_lit(a, (StringLiteral) { .string = "trace: thread %d:%d will run fn %d with mask = %lx\n" }), sid, local_id, fn_lit, next_mask) }));
-            }
-            bind_instruction(if_builder, call(a, (Call) {
-                .callee = fn_addr_helper(a, find_processed(&ctx->rewriter, decl)),
-                .args = nodes(a, 0, NULL)
-            }));
-            const Node* if_true_lam = case_(a, empty(a), finish_body(if_builder, yield(a, (Yield) {.args = nodes(a, 0, NULL)})));
-            const Node* if_instruction = if_instr(a, (If) {
-                .condition = should_run,
-                .if_true = if_true_lam,
-                .if_false = NULL,
-                .yield_types = empty(a),
-            });
+    size_t targets_count = entries_count_list(targets);
+    DispatchTarget* sorted_targets = read_list(DispatchTarget, targets);
+    qsort(sorted_targets, targets_count, sizeof(DispatchTarget), compare_dispatch_targets);
 
-            BodyBuilder* case_builder = begin_body(a);
-            bind_instruction(case_builder, if_instruction);
-            const Node* case_lam = case_(a, nodes(a, 0, NULL), finish_body(case_builder, continue_terminator));
+    size_t likely_count = ctx->config->optimisations.dispatcher.likely_fns;
+    likely_count = likely_count < targets_count ? likely_count : targets_count;
 
-            append_list(const Node*, literals, fn_lit);
-            append_list(const Node*, cases, case_lam);
-        }
+    struct List* literals = new_list(const Node*);
+    struct List* cases = new_list(const Node*);
+    for (size_t i = likely_count; i < targets_count; i++) {
+        const Node* fn_lit = lower_fn_addr(ctx, sorted_targets[i].fn);
+        const Node* case_lam = gen_dispatch_case(ctx, graph, &state, sorted_targets[i].fn, continue_terminator);
+        append_list(const Node*, literals, fn_lit);
+        append_list(const Node*, cases, case_lam);
     }
+    // the program only exits once, no point in having that first
+    append_list(const Node*, literals, zero_lit);
+    append_list(const Node*, cases, zero_case_lam);
 
     const Node* default_case_lam = case_(a, nodes(a, 0, NULL), unreachable(a));
 
-    bind_instruction(loop_body_builder, match_instr(a, (Match) {
+    const Node* dispatch = match_instr(a, (Match) {
         .yield_types = nodes(a, 0, NULL),
         .inspect = next_function,
         .literals = nodes(a, entries_count_list(literals), read_list(const Node*, literals)),
         .cases = nodes(a, entries_count_list(cases), read_list(const Node*, cases)),
         .default_case = default_case_lam,
-    }));
+    });
 
     destroy_list(literals);
     destroy_list(cases);
 
+    // wrap the Match in checks for the likely functions, innermost first so the likeliest is checked first
+    if (likely_count > 0) {
+        LARRAY(const Node*, is_likely, likely_count);
+        for (size_t i = 0; i < likely_count; i++)
+            is_likely[i] = gen_primop_e(loop_body_builder, eq_op, empty(a), mk_nodes(a, next_function, gen_conversion(loop_body_builder, uint32_type(a), lower_fn_addr(ctx, sorted_targets[i].fn))));
+        for (size_t i = likely_count - 1; i < likely_count; i--) {
+            BodyBuilder* else_builder = begin_body(a);
+            bind_instruction(else_builder, dispatch);
+            dispatch = if_instr(a, (If) {
+                .condition = is_likely[i],
+                .if_true = gen_dispatch_case(ctx, graph, &state, sorted_targets[i].fn, continue_terminator),
+                .if_false = case_(a, empty(a), finish_body(else_builder, unreachable(a))),
+                .yield_types = empty(a),
+            });
+        }
+    }
+
+    bind_instruction(loop_body_builder, dispatch);
+
+    destroy_list(targets);
+    destroy_callgraph(graph);
+
     const Node* loop_inside_lam = case_(a, count_iterations ? singleton(iterations_count_param) : nodes(a, 0, NULL), finish_body(loop_body_builder, unreachable(a)));
 
     const Node* the_loop = loop_instr(a, (Loop) {
@@ -1,6 +1,7 @@
 #include "passes.h"
 
 #include "dict.h"
+#include "list.h"
 #include "portability.h"
 #include "log.h"
 
@@ -21,58 +22,33 @@ typedef struct {
     const UsesMap* scope_uses;
 } Context;
 
-typedef struct {
-    CGNode* node;
-    // Whether this is a leaf node according to the callgraph
-    bool is_leaf;
-    bool done;
-} FnInfo;
-
-static bool is_leaf_fn(Context* ctx, CGNode* fn_node) {
-    FnInfo* info = find_value_dict(const Node*, FnInfo, ctx->fns, fn_node->fn);
-    if (info) {
-        // if we encounter a function before 'done' is set, it must be part of a recursive chain
-        if (!info->done) {
-            info->is_leaf = false;
-            info->done = true;
-        }
-        return info->is_leaf;
-    }
-
-    FnInfo initial_info = {
-        .node = fn_node,
-        .done = false,
-    };
-    insert_dict(const Node*, FnInfo, ctx->fns, fn_node->fn, initial_info);
-    info = find_value_dict(const Node*, FnInfo, ctx->fns, fn_node->fn);
-    assert(info);
-
-    if (fn_node->is_address_captured || fn_node->is_recursive) {
-        info->is_leaf = false;
-        info->done = true;
-        debugv_print("Function %s can't be a leaf function because %s.\n", get_abstraction_name(fn_node->fn), fn_node->is_address_captured ? "its address is captured" : "it is recursive" );
-        return false;
-    }
-
-    size_t iter = 0;
-    CGEdge e;
-    while (dict_iter(fn_node->callees, &iter, &e, NULL)) {
-        if (!is_leaf_fn(ctx, e.dst_fn)) {
-            debugv_print("Function %s can't be a leaf function because its callee %s is not a leaf function.\n", get_abstraction_name(fn_node->fn), get_abstraction_name(e.dst_fn->fn));
-            info->is_leaf = false;
-            info->done = true;
+/// Leafness only depends on the callees, so we can settle it for every function in a single bottom-up walk
+static void compute_leaf_fns(Context* ctx) {
+    struct List* order = callgraph_bottom_up_order(ctx->graph);
+    for (size_t i = 0; i < entries_count_list(order); i++) {
+        CGNode* fn_node = read_list(CGNode*, order)[i];
+        bool is_leaf = true;
+
+        if (fn_node->is_address_captured || fn_node->is_recursive) {
+            debugv_print("Function %s can't be a leaf function because %s.\n", get_abstraction_name(fn_node->fn), fn_node->is_address_captured ? "its address is captured" : "it is recursive" );
+            is_leaf = false;
+        } else {
+            size_t iter = 0;
+            CGEdge e;
+            while (dict_iter(fn_node->callees, &iter, &e, NULL)) {
+                // callees come first in the bottom-up order
+                bool* callee_is_leaf = find_value_dict(const Node*, bool, ctx->fns, e.dst_fn->fn);
+                assert(callee_is_leaf);
+                if (!*callee_is_leaf) {
+                    debugv_print("Function %s can't be a leaf function because its callee %s is not a leaf function.\n", get_abstraction_name(fn_node->fn), get_abstraction_name(e.dst_fn->fn));
+                    is_leaf = false;
+                    break;
+                }
+            }
         }
-    }
-
-    // by analysing the callees, the dict might have been regrown so we must refetch this to update the ptr if needed
-    info = find_value_dict(const Node*, FnInfo, ctx->fns, fn_node->fn);
 
-    if (!info->done) {
-        info->is_leaf = true;
-        info->done = true;
+        insert_dict(const Node*, bool, ctx->fns, fn_node->fn, is_leaf);
     }
-
-    return info->is_leaf;
 }
 
 static const Node* process(Context* ctx, const Node* node) {
@@ -84,8 +60,7 @@ static const Node* process(Context* ctx, const Node* node) {
     switch (node->tag) {
         case Function_TAG: {
             Context fn_ctx = *ctx;
-            CGNode* fn_node = *find_value_dict(const Node*, CGNode*, ctx->graph->fn2cgn, node);
-            fn_ctx.is_leaf = is_leaf_fn(ctx, fn_node);
+            fn_ctx.is_leaf = *find_value_dict(const Node*, bool, ctx->fns, node);
             fn_ctx.scope = new_scope(node);
             fn_ctx.scope_uses = create_uses_map(node, (NcDeclaration | NcType));
             ctx = &fn_ctx;
@@ -153,9 +128,10 @@ Module* mark_leaf_functions(SHADY_UNUSED const CompilerConfig* config, Module* s
     Module* dst = new_module(a, get_module_name(src));
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
-        .fns = new_dict(const Node*, FnInfo, (HashFn) hash_node, (CmpFn) compare_node),
+        .fns = new_dict(const Node*, bool, (HashFn) hash_node, (CmpFn) compare_node),
         .graph = new_callgraph(src)
     };
+    compute_leaf_fns(&ctx);
     rewrite_module(&ctx.rewriter);
     destroy_dict(ctx.fns);
     destroy_callgraph(ctx.graph);
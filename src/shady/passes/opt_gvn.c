@@ -0,0 +1,379 @@
+#include "passes.h"
+
+#include "log.h"
+#include "portability.h"
+#include "dict.h"
+#include "list.h"
+
+#include "../rewrite.h"
+#include "../type.h"
+#include "../analysis/scope.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+/// An instruction that was already bound, its results are available wherever `where` dominates
+typedef struct {
+    const CFNode* where;
+    Nodes results;
+} AvailableValue;
+
+typedef struct {
+    Scope* scope;
+    /// Pre and post-order indices of the CFNodes in the dominator tree, indexed like scope->contents
+    size_t* dom_pre;
+    size_t* dom_post;
+    /// Maps rewritten instructions to a @ref List of @ref AvailableValue
+    struct Dict* available;
+    /// Maps the rewritten results of pure instructions to those instructions, the fold rules can't see through variables
+    struct Dict* definitions;
+} FnInfo;
+
+typedef struct {
+    Rewriter rewriter;
+    FnInfo* fn;
+    /// CFNode whose body we are currently rewriting
+    const CFNode* cfnode;
+} Context;
+
+typedef enum {
+    NotNumberable,
+    /// Yields the same value anywhere it's dominated by its definition
+    Pure,
+    /// Depends on which threads are active, only reusable along a let chain
+    Convergent,
+    /// Reads from mutable memory, only reusable along a let chain that doesn't write to memory
+    MemoryRead,
+} NumberingKind;
+
+/// Only the invocation itself can write to those, and only through the instructions we see
+static bool is_thread_private_address_space(AddressSpace as) {
+    switch (as) {
+        case AsFunctionLogical:
+        case AsPrivateLogical:
+        case AsPrivatePhysical: return true;
+        default: return false;
+    }
+}
+
+static NumberingKind classify_instruction(const Node* instruction) {
+    if (instruction->tag != PrimOp_TAG)
+        return NotNumberable;
+    PrimOp prim_op = instruction->payload.prim_op;
+    if (prim_op.op == quote_op)
+        return NotNumberable;
+    if (prim_op.op == load_op) {
+        const Type* ptr_t = get_unqualified_type(first(prim_op.operands)->type);
+        assert(ptr_t->tag == PtrType_TAG);
+        AddressSpace as = ptr_t->payload.ptr_type.address_space;
+        if (is_addr_space_read_only(as))
+            return Pure;
+        if (is_thread_private_address_space(as))
+            return MemoryRead;
+        return NotNumberable;
+    }
+    if (has_primop_got_side_effects(prim_op.op))
+        return NotNumberable;
+    OpClass class = get_primop_class(prim_op.op);
+    // the stack pointer moves around with push/pop, which don't have data dependencies on it
+    if (class & OcStack)
+        return NotNumberable;
+    if (class & OcSubgroup_intrinsic)
+        return Convergent;
+    return Pure;
+}
+
+static bool may_write_memory(const Node* instruction) {
+    if (instruction->tag != PrimOp_TAG)
+        return true;
+    Op op = instruction->payload.prim_op.op;
+    return op != load_op && has_primop_got_side_effects(op);
+}
+
+static size_t cfnode_index(const FnInfo* fn, const CFNode* n) {
+    return n - fn->scope->contents;
+}
+
+static bool dominates(const FnInfo* fn, const CFNode* a, const CFNode* b) {
+    size_t ai = cfnode_index(fn, a), bi = cfnode_index(fn, b);
+    if (fn->dom_pre[ai] == SIZE_MAX || fn->dom_pre[bi] == SIZE_MAX)
+        return false;
+    return fn->dom_pre[ai] <= fn->dom_pre[bi] && fn->dom_post[bi] <= fn->dom_post[ai];
+}
+
+/// Walks up a straight let chain from @p use to @p def, checking the instructions in between
+static bool is_reachable_along_let_chain(const CFNode* def, const CFNode* use, bool check_memory) {
+    for (const CFNode* n = use; n != def; n = n->idom) {
+        const CFNode* pred = n->idom;
+        if (!pred)
+            return false;
+        const Node* body = get_abstraction_body(pred->node);
+        if (body->tag != Let_TAG || get_let_tail(body) != n->node)
+            return false;
+        if (check_memory && may_write_memory(get_let_instruction(body)))
+            return false;
+    }
+    return true;
+}
+
+static const AvailableValue* find_available_value(Context* ctx, const Node* ninstruction, NumberingKind kind) {
+    struct List** found = find_value_dict(const Node*, struct List*, ctx->fn->available, ninstruction);
+    if (!found)
+        return NULL;
+    for (size_t i = 0; i < entries_count_list(*found); i++) {
+        const AvailableValue* value = &read_list(AvailableValue, *found)[i];
+        if (!dominates(ctx->fn, value->where, ctx->cfnode))
+            continue;
+        switch (kind) {
+            case Pure: return value;
+            case Convergent: if (is_reachable_along_let_chain(value->where, ctx->cfnode, false)) return value; break;
+            case MemoryRead: if (is_reachable_along_let_chain(value->where, ctx->cfnode, true)) return value; break;
+            case NotNumberable: SHADY_UNREACHABLE;
+        }
+    }
+    return NULL;
+}
+
+static void add_available_value(Context* ctx, const Node* ninstruction, AvailableValue value) {
+    struct List** found = find_value_dict(const Node*, struct List*, ctx->fn->available, ninstruction);
+    if (found) {
+        append_list(AvailableValue, *found, value);
+        return;
+    }
+    struct List* list = new_list(AvailableValue);
+    append_list(AvailableValue, list, value);
+    insert_dict(const Node*, struct List*, ctx->fn->available, ninstruction, list);
+}
+
+static const CFNode* find_cfnode(Context* ctx, const Node* abs) {
+    CFNode** found = find_value_dict(const Node*, CFNode*, ctx->fn->scope->map, abs);
+    return found ? *found : NULL;
+}
+
+/// Numbers the dominator tree in DFS order, so dominance queries are constant time
+static void number_dom_tree(FnInfo* fn) {
+    size_t size = fn->scope->size;
+    fn->dom_pre = malloc(sizeof(size_t) * size);
+    fn->dom_post = malloc(sizeof(size_t) * size);
+    for (size_t i = 0; i < size; i++)
+        fn->dom_pre[i] = fn->dom_post[i] = SIZE_MAX;
+
+    // the dominator tree of a long let chain is just as deep, so we don't recurse
+    size_t* next_child = malloc(sizeof(size_t) * size);
+    const CFNode** stack = malloc(sizeof(const CFNode*) * size);
+    size_t sp = 0, counter = 0;
+    stack[sp++] = fn->scope->entry;
+    next_child[cfnode_index(fn, fn->scope->entry)] = 0;
+    fn->dom_pre[cfnode_index(fn, fn->scope->entry)] = counter++;
+    while (sp > 0) {
+        const CFNode* n = stack[sp - 1];
+        size_t i = cfnode_index(fn, n);
+        if (next_child[i] < n->dominates.count) {
+            const CFNode* child = n->dominates.nodes[next_child[i]++];
+            size_t ci = cfnode_index(fn, child);
+            next_child[ci] = 0;
+            fn->dom_pre[ci] = counter++;
+            stack[sp++] = child;
+            continue;
+        }
+        fn->dom_post[i] = counter++;
+        sp--;
+    }
+    free(next_child);
+    free(stack);
+}
+
+static const Node* find_definition(Context* ctx, const Node* value, Op op) {
+    const Node** found = find_value_dict(const Node*, const Node*, ctx->fn->definitions, value);
+    if (!found || (*found)->payload.prim_op.op != op)
+        return NULL;
+    return *found;
+}
+
+static bool is_int_or_float(const Type* t) {
+    return t->tag == Int_TAG || t->tag == Float_TAG;
+}
+
+/// Collapses an instruction with the one that defined its first operand: lea chains, shift chains and casts that cancel out
+static const Node* simplify_chain(Context* ctx, const Node* instruction) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    if (instruction->tag != PrimOp_TAG || instruction->payload.prim_op.operands.count == 0)
+        return instruction;
+    PrimOp payload = instruction->payload.prim_op;
+    const Node* src = first(payload.operands);
+    switch (payload.op) {
+        case lea_op: {
+            const Node* def = find_definition(ctx, src, lea_op);
+            if (!def)
+                break;
+            Nodes inner = def->payload.prim_op.operands;
+            Nodes outer_indices = nodes(a, payload.operands.count - 2, &payload.operands.nodes[2]);
+            const IntLiteral* outer_offset = resolve_to_int_literal(payload.operands.nodes[1]);
+            // lea(lea(p, o, i...), 0, j...) = lea(p, o, i..., j...)
+            if (outer_offset && get_int_literal_value(*outer_offset, false) == 0)
+                return prim_op(a, (PrimOp) { .op = lea_op, .operands = concat_nodes(a, inner, outer_indices), .type_arguments = empty(a) });
+            // lea(lea(p, o1), o2, j...) = lea(p, o1 + o2, j...)
+            const IntLiteral* inner_offset = resolve_to_int_literal(inner.nodes[1]);
+            if (inner.count == 2 && inner_offset && outer_offset && inner.nodes[1]->type == payload.operands.nodes[1]->type) {
+                uint64_t offset = get_int_literal_value(*inner_offset, false) + get_int_literal_value(*outer_offset, false);
+                if (outer_offset->width != IntTy64)
+                    offset &= ~(UINT64_MAX << (int_size_in_bytes(outer_offset->width) * 8));
+                const Node* noffset = int_literal(a, (IntLiteral) { .width = outer_offset->width, .is_signed = outer_offset->is_signed, .value = offset });
+                return prim_op(a, (PrimOp) { .op = lea_op, .operands = concat_nodes(a, mk_nodes(a, first(inner), noffset), outer_indices), .type_arguments = empty(a) });
+            }
+            break;
+        }
+        case lshift_op:
+        case rshift_logical_op: {
+            const Node* def = find_definition(ctx, src, payload.op);
+            if (!def)
+                break;
+            const IntLiteral* inner_shift = resolve_to_int_literal(def->payload.prim_op.operands.nodes[1]);
+            const IntLiteral* outer_shift = resolve_to_int_literal(payload.operands.nodes[1]);
+            if (!inner_shift || !outer_shift)
+                break;
+            uint64_t shift = get_int_literal_value(*inner_shift, false) + get_int_literal_value(*outer_shift, false);
+            // past the width of the type the result is undefined, rather than zero
+            if (shift >= get_type_bitwidth(get_unqualified_type(src->type)))
+                break;
+            const Node* nshift = int_literal(a, (IntLiteral) { .width = outer_shift->width, .is_signed = outer_shift->is_signed, .value = shift });
+            return prim_op(a, (PrimOp) { .op = payload.op, .operands = mk_nodes(a, first(def->payload.prim_op.operands), nshift), .type_arguments = empty(a) });
+        }
+        case reinterpret_op:
+        case convert_op: {
+            const Node* def = find_definition(ctx, src, payload.op);
+            if (!def)
+                break;
+            const Node* original = first(def->payload.prim_op.operands);
+            const Type* original_t = get_unqualified_type(original->type);
+            const Type* intermediate_t = first(def->payload.prim_op.type_arguments);
+            const Type* dst_t = first(payload.type_arguments);
+            if (payload.op == reinterpret_op) {
+                // bit casts compose, and cancel out when they go back to where they started
+                if (dst_t == original_t)
+                    return quote_helper(a, singleton(original));
+                if (is_int_or_float(original_t) && is_int_or_float(dst_t))
+                    return prim_op(a, (PrimOp) { .op = reinterpret_op, .operands = singleton(original), .type_arguments = singleton(dst_t) });
+                break;
+            }
+            if (dst_t != original_t)
+                break;
+            // converting to a wider integer and back, or to another address space and back, gives the original value
+            bool lossless = false;
+            if (original_t->tag == Int_TAG && intermediate_t->tag == Int_TAG)
+                lossless = get_type_bitwidth(intermediate_t) >= get_type_bitwidth(original_t);
+            else if (original_t->tag == PtrType_TAG && intermediate_t->tag == PtrType_TAG)
+                lossless = true;
+            if (lossless)
+                return quote_helper(a, singleton(original));
+            break;
+        }
+        default: break;
+    }
+    return instruction;
+}
+
+static const Node* process_let(Context* ctx, const Node* node) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    const Node* old_tail = get_let_tail(node);
+    const Node* ninstruction = simplify_chain(ctx, rewrite_node(&ctx->rewriter, get_let_instruction(node)));
+    // folding might have turned it into something else
+    NumberingKind kind = classify_instruction(ninstruction);
+    const CFNode* tail_cfnode = find_cfnode(ctx, old_tail);
+    if (kind == NotNumberable || !tail_cfnode)
+        return let(a, ninstruction, rewrite_node(&ctx->rewriter, old_tail));
+
+    Context tail_ctx = *ctx;
+    tail_ctx.cfnode = tail_cfnode;
+    Nodes oparams = get_abstraction_params(old_tail);
+
+    const AvailableValue* available = find_available_value(ctx, ninstruction, kind);
+    if (available) {
+        debugv_print("opt_gvn: reusing an earlier %s\n", get_primop_name(ninstruction->payload.prim_op.op));
+        register_processed_list(&tail_ctx.rewriter, oparams, available->results);
+        return rewrite_node(&tail_ctx.rewriter, get_abstraction_body(old_tail));
+    }
+
+    Nodes nparams = recreate_variables(&ctx->rewriter, oparams);
+    register_processed_list(&ctx->rewriter, oparams, nparams);
+    add_available_value(ctx, ninstruction, (AvailableValue) { .where = tail_cfnode, .results = nparams });
+    if (kind == Pure && nparams.count == 1) {
+        const Node* result = first(nparams);
+        insert_dict(const Node*, const Node*, ctx->fn->definitions, result, ninstruction);
+    }
+    const Node* nbody = rewrite_node(&tail_ctx.rewriter, get_abstraction_body(old_tail));
+    return let(a, ninstruction, case_(a, nparams, nbody));
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found) return found;
+
+    switch (node->tag) {
+        case Function_TAG: {
+            Context fn_ctx = *ctx;
+            FnInfo fn = {
+                .available = new_dict(const Node*, struct List*, (HashFn) hash_node, (CmpFn) compare_node),
+                .definitions = new_dict(const Node*, const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+            };
+            fn.scope = new_scope(node);
+            number_dom_tree(&fn);
+            fn_ctx.fn = &fn;
+            fn_ctx.cfnode = fn.scope->entry;
+
+            Node* new = recreate_decl_header_identity(&fn_ctx.rewriter, node);
+            recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
+
+            size_t i = 0;
+            struct List* list;
+            while (dict_iter(fn.available, &i, NULL, &list))
+                destroy_list(list);
+            destroy_dict(fn.available);
+            destroy_dict(fn.definitions);
+            free(fn.dom_pre);
+            free(fn.dom_post);
+            destroy_scope(fn.scope);
+            return new;
+        }
+        case Constant_TAG:
+        case GlobalVariable_TAG:
+        case NominalType_TAG: {
+            Context decl_ctx = *ctx;
+            decl_ctx.fn = NULL;
+            decl_ctx.cfnode = NULL;
+            return recreate_node_identity(&decl_ctx.rewriter, node);
+        }
+        case BasicBlock_TAG:
+        case Case_TAG: {
+            if (!ctx->fn)
+                break;
+            Context abs_ctx = *ctx;
+            abs_ctx.cfnode = find_cfnode(ctx, node);
+            return recreate_node_identity(&abs_ctx.rewriter, node);
+        }
+        case Let_TAG: {
+            // only rewrite the instruction ourselves if it's something we can number, the rest might need the usual quote folding
+            if (!ctx->fn || !ctx->cfnode || classify_instruction(get_let_instruction(node)) == NotNumberable)
+                break;
+            return process_let(ctx, node);
+        }
+        default: break;
+    }
+
+    return recreate_node_identity(&ctx->rewriter, node);
+}
+
+Module* opt_gvn(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+    };
+    rewrite_module(&ctx.rewriter);
+    destroy_rewriter(&ctx.rewriter);
+    return dst;
+}
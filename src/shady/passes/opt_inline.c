@@ -11,15 +11,32 @@
 #include "../ir_private.h"
 
 #include "../analysis/callgraph.h"
+#include "../analysis/scope.h"
+#include "../analysis/looptree.h"
 
 typedef struct {
     const Node* host_fn;
     const Node* return_jp;
 } InlinedCall;
 
+/// Call instructions are hash-consed, so the same one might show up in different functions
+typedef struct {
+    const Node* src_fn;
+    const Node* instr;
+} CallSite;
+
 typedef struct {
     Rewriter rewriter;
+    const CompilerConfig* config;
     CallGraph* graph;
+    /// @ref Dict from @ref CallSite to bool
+    struct Dict* inline_decisions;
+    /// @ref Dict from const @ref Node* to size_t, the size of functions once inlining is done
+    struct Dict* fn_sizes;
+    /// @ref List of @ref CGNode* with call sites to inline this round, in bottom-up order
+    struct List* hosts;
+    /// functions that had callers to begin with, those we can remove once all the calls to them got inlined
+    struct Dict* called;
     const Node* old_fun;
     Node* fun;
     InlinedCall* inlined_call;
@@ -52,55 +69,139 @@ static bool is_call_safely_removable(const Node* fn) {
     return true;
 }
 
-typedef struct {
-    size_t num_calls;
-    size_t num_inlineable_calls;
-    bool can_be_inlined;
-    bool can_be_eliminated;
-} FnInliningCriteria;
+static KeyHash hash_call_site(CallSite* site) {
+    return hash_murmur(site, sizeof(CallSite));
+}
 
-static FnInliningCriteria get_inlining_heuristic(CGNode* fn_node) {
-    FnInliningCriteria crit = { 0 };
+static bool compare_call_site(CallSite* a, CallSite* b) {
+    return a->src_fn == b->src_fn && a->instr == b->instr;
+}
 
-    CGEdge e;
-    size_t i = 0;
-    while (dict_iter(fn_node->callers, &i, &e, NULL)) {
-        crit.num_calls++;
-        if (is_call_potentially_inlineable(e.src_fn->fn, e.dst_fn->fn))
-            crit.num_inlineable_calls++;
+static size_t get_loop_depth(LoopTree* lt, const Node* abs) {
+    size_t depth = 0;
+    LTNode* lt_node = looptree_lookup(lt, abs);
+    for (LTNode* n = lt_node->parent; n && n->parent; n = n->parent) {
+        if (n->type == LF_HEAD)
+            depth++;
     }
+    return depth;
+}
 
-    debugv_print("%s has %d callers\n", get_abstraction_name(fn_node->fn), crit.num_calls);
+static size_t count_constant_arguments(Nodes args) {
+    size_t count = 0;
+    for (size_t i = 0; i < args.count; i++) {
+        if (args.nodes[i]->tag != Variable_TAG)
+            count++;
+    }
+    return count;
+}
 
-    // a function can be inlined if it has exactly one inlineable call...
-    if (crit.num_inlineable_calls <= 1)
-        crit.can_be_inlined = true;
+static size_t get_fn_size(Context* ctx, const Node* fn) {
+    size_t* found = find_value_dict(const Node*, size_t, ctx->fn_sizes, fn);
+    assert(found);
+    return *found;
+}
 
+static size_t saturating_sub(size_t a, size_t b) {
+    return a > b ? a - b : 0;
+}
+
+/// Decides whether the call described by this edge is worth inlining, given how big the callee ended up
+static bool should_inline_call_site(Context* ctx, CGEdge e, LoopTree* lt, size_t num_inlineable_callers) {
+    const Node* src_fn = e.src_fn->fn;
+    const Node* dst_fn = e.dst_fn->fn;
+    if (!is_call_potentially_inlineable(src_fn, dst_fn))
+        return false;
     // avoid inlining recursive things for now
-    if (fn_node->is_address_captured || fn_node->is_recursive)
-        crit.can_be_inlined = false;
+    if (e.dst_fn->is_recursive || e.src_fn->scc == e.dst_fn->scc)
+        return false;
 
-    // it can be eliminated if it can be inlined, and all the calls are inlineable calls ...
-    if (crit.num_calls == crit.num_inlineable_calls && crit.can_be_inlined)
-        crit.can_be_eliminated = true;
+    // a function with a single call site can be moved where it's called from, that can only make things smaller
+    if (num_inlineable_callers == 1 && !e.dst_fn->is_address_captured && is_call_safely_removable(dst_fn))
+        return true;
 
-    // unless the address is captured, in which case it must remain available for the indirect calls.
-    if (fn_node->is_address_captured)
-        crit.can_be_eliminated = false;
+    size_t bonus = 0;
+    Nodes args = e.instr->tag == Call_TAG ? e.instr->payload.call.args : e.instr->payload.tail_call.args;
+    bonus += count_constant_arguments(args) * ctx->config->optimisations.inlining.constant_argument_bonus;
+    bonus += get_loop_depth(lt, e.abs) * ctx->config->optimisations.inlining.loop_depth_bonus;
+    if (e.instr->tag == TailCall_TAG)
+        bonus += ctx->config->optimisations.inlining.tail_call_bonus;
 
-    if (!is_call_safely_removable(fn_node->fn))
-        crit.can_be_eliminated = false;
+    size_t cost = saturating_sub(get_fn_size(ctx, dst_fn), bonus);
+    debugv_print("Cost of inlining %s into %s: %zu (bonus: %zu)\n", get_abstraction_name(dst_fn), get_abstraction_name(src_fn), cost, bonus);
+    return cost <= ctx->config->optimisations.inlining.max_callee_size;
+}
 
-    return crit;
+static size_t count_inlineable_callers(CGNode* fn_node) {
+    size_t count = 0;
+    CGEdge e;
+    size_t i = 0;
+    while (dict_iter(fn_node->callers, &i, &e, NULL)) {
+        if (is_call_potentially_inlineable(e.src_fn->fn, e.dst_fn->fn))
+            count++;
+    }
+    return count;
+}
+
+/// Walks the callgraph bottom-up, so we know how big each callee got after its own call sites were inlined
+static void compute_inlining_decisions(Context* ctx) {
+    clear_dict(ctx->inline_decisions);
+    clear_dict(ctx->fn_sizes);
+    clear_list(ctx->hosts);
+    struct List* order = callgraph_bottom_up_order(ctx->graph);
+    for (size_t i = 0; i < entries_count_list(order); i++) {
+        CGNode* fn_node = read_list(CGNode*, order)[i];
+        const Node* fn = fn_node->fn;
+        size_t size = 0;
+        bool is_host = false;
+        if (fn->payload.fun.body) {
+            Scope* scope = new_scope(fn);
+            LoopTree* lt = build_loop_tree(scope);
+            size = scope_count_instructions(scope);
+
+            size_t iter = 0;
+            CGEdge e;
+            while (dict_iter(fn_node->callees, &iter, &e, NULL)) {
+                // callees outside of our SCC were already visited, and only those can be inlined
+                bool inline_it = should_inline_call_site(ctx, e, lt, count_inlineable_callers(e.dst_fn));
+                if (inline_it) {
+                    size_t grown_size = size + get_fn_size(ctx, e.dst_fn->fn);
+                    if (grown_size > ctx->config->optimisations.inlining.max_caller_size) {
+                        debugv_print("Not inlining %s into %s, it would grow too big\n", get_abstraction_name(e.dst_fn->fn), get_abstraction_name(fn));
+                        inline_it = false;
+                    } else {
+                        size = grown_size;
+                    }
+                }
+                CallSite site = { .src_fn = fn, .instr = e.instr };
+                insert_dict(CallSite, bool, ctx->inline_decisions, site, inline_it);
+                is_host |= inline_it;
+            }
+
+            destroy_loop_tree(lt);
+            destroy_scope(scope);
+        }
+        insert_dict(const Node*, size_t, ctx->fn_sizes, fn, size);
+        if (is_host)
+            append_list(CGNode*, ctx->hosts, fn_node);
+    }
+}
+
+static bool should_inline(Context* ctx, const Node* instr) {
+    if (!ctx->graph)
+        return false;
+    CallSite site = { .src_fn = ctx->old_fun, .instr = instr };
+    bool* found = find_value_dict(CallSite, bool, ctx->inline_decisions, site);
+    return found && *found;
 }
 
 /// inlines the abstraction with supplied arguments
 static const Node* inline_call(Context* ctx, const Node* ocallee, Nodes nargs, const Node* return_to) {
     assert(is_abstraction(ocallee));
 
-    log_string(DEBUG, "Inlining '%s' inside '%s'\n", get_abstraction_name(ctx->fun), get_abstraction_name(ocallee));
+    log_string(DEBUG, "Inlining '%s' inside '%s'\n", get_abstraction_name(ocallee), get_abstraction_name(ctx->fun));
     Context inline_context = *ctx;
-    inline_context.rewriter.map = clone_dict(inline_context.rewriter.map);
+    inline_context.rewriter = create_children_rewriter(&ctx->rewriter);
 
     ctx = &inline_context;
     InlinedCall inlined_call = {
@@ -108,13 +209,15 @@ static const Node* inline_call(Context* ctx, const Node* ocallee, Nodes nargs, c
         .return_jp = return_to,
     };
     inline_context.inlined_call = &inlined_call;
+    // callees are processed first, whatever call sites are left in there stay as they are for this round
+    inline_context.old_fun = NULL;
 
     Nodes oparams = get_abstraction_params(ocallee);
     register_processed_list(&inline_context.rewriter, oparams, nargs);
 
     const Node* nbody = rewrite_node(&inline_context.rewriter, get_abstraction_body(ocallee));
 
-    destroy_dict(inline_context.rewriter.map);
+    destroy_rewriter(&inline_context.rewriter);
 
     assert(is_terminator(nbody));
     return nbody;
@@ -129,34 +232,9 @@ static const Node* process(Context* ctx, const Node* node) {
 
     IrArena* a = ctx->rewriter.dst_arena;
     Rewriter* r = &ctx->rewriter;
-    assert(a != node->arena);
     assert(node->arena == ctx->rewriter.src_arena);
 
     switch (node->tag) {
-        case Function_TAG: {
-            if (ctx->graph) {
-                CGNode* fn_node = *find_value_dict(const Node*, CGNode*, ctx->graph->fn2cgn, node);
-                if (get_inlining_heuristic(fn_node).can_be_eliminated) {
-                    debugv_print("Eliminating %s because it has exactly one caller\n", get_abstraction_name(fn_node->fn));
-                    return NULL;
-                }
-            }
-
-            Nodes annotations = rewrite_nodes(&ctx->rewriter, node->payload.fun.annotations);
-            Node* new = function(ctx->rewriter.dst_module, recreate_variables(&ctx->rewriter, node->payload.fun.params), node->payload.fun.name, annotations, rewrite_nodes(&ctx->rewriter, node->payload.fun.return_types));
-            register_processed(r, node, new);
-
-            Context fn_ctx = *ctx;
-            fn_ctx.rewriter.map = clone_dict(fn_ctx.rewriter.map);
-            fn_ctx.old_fun = node;
-            fn_ctx.fun = new;
-            fn_ctx.inlined_call = NULL;
-            for (size_t i = 0; i < new->payload.fun.params.count; i++)
-                register_processed(&fn_ctx.rewriter, node->payload.fun.params.nodes[i], new->payload.fun.params.nodes[i]);
-            recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
-            destroy_dict(fn_ctx.rewriter.map);
-            return new;
-        }
         case Call_TAG: {
             if (!ctx->graph)
                 break;
@@ -165,8 +243,7 @@ static const Node* process(Context* ctx, const Node* node) {
 
             ocallee = ignore_immediate_fn_addr(ocallee);
             if (ocallee->tag == Function_TAG) {
-                CGNode* fn_node = *find_value_dict(const Node*, CGNode*, ctx->graph->fn2cgn, ocallee);
-                if (get_inlining_heuristic(fn_node).can_be_inlined && is_call_potentially_inlineable(ctx->old_fun, ocallee)) {
+                if (should_inline(ctx, node)) {
                     debugv_print("Inlining call to %s\n", get_abstraction_name(ocallee));
                     Nodes nargs = rewrite_nodes(&ctx->rewriter, oargs);
 
@@ -210,8 +287,7 @@ static const Node* process(Context* ctx, const Node* node) {
             const Node* ocallee = node->payload.tail_call.target;
             ocallee = ignore_immediate_fn_addr(ocallee);
             if (ocallee->tag == Function_TAG) {
-                CGNode* fn_node = *find_value_dict(const Node*, CGNode*, ctx->graph->fn2cgn, ocallee);
-                if (get_inlining_heuristic(fn_node).can_be_inlined) {
+                if (should_inline(ctx, node)) {
                     debugv_print("Inlining tail call to %s\n", get_abstraction_name(ocallee));
                     Nodes nargs = rewrite_nodes(&ctx->rewriter, node->payload.tail_call.args);
                     return inline_call(ctx, ocallee, nargs, NULL);
@@ -231,18 +307,92 @@ static const Node* process(Context* ctx, const Node* node) {
 KeyHash hash_node(const Node**);
 bool compare_node(const Node**, const Node**);
 
-void opt_simplify_cf(SHADY_UNUSED const CompilerConfig* config, Module* src, Module* dst) {
+/// Rewrites the body of a function in place, inlining the call sites that were picked for it
+static void inline_into_fn(Context* ctx, Node* fn) {
+    Context fn_ctx = *ctx;
+    fn_ctx.rewriter = create_children_rewriter(&ctx->rewriter);
+    fn_ctx.old_fun = fn;
+    fn_ctx.fun = fn;
+    fn_ctx.inlined_call = NULL;
+    register_processed_list(&fn_ctx.rewriter, fn->payload.fun.params, fn->payload.fun.params);
+    fn->payload.fun.body = rewrite_node(&fn_ctx.rewriter, fn->payload.fun.body);
+    destroy_rewriter(&fn_ctx.rewriter);
+}
+
+/// Removes the functions that lost all their callers, which might in turn leave their own callees without any
+static void eliminate_uncalled_fns(Context* ctx, Module* mod) {
+    struct List* uncalled = new_list(const Node*);
+    while (true) {
+        size_t iter = 0;
+        CGNode* fn_node;
+        while (dict_iter(ctx->graph->fn2cgn, &iter, NULL, &fn_node)) {
+            if (fn_node->is_address_captured || entries_count_dict(fn_node->callers) > 0 || !is_call_safely_removable(fn_node->fn))
+                continue;
+            if (find_key_dict(const Node*, ctx->called, fn_node->fn))
+                append_list(const Node*, uncalled, fn_node->fn);
+        }
+        if (entries_count_list(uncalled) == 0)
+            break;
+        for (size_t i = 0; i < entries_count_list(uncalled); i++) {
+            const Node* fn = read_list(const Node*, uncalled)[i];
+            debugv_print("Eliminating %s because all the calls to it were inlined\n", get_abstraction_name(fn));
+            callgraph_remove_fn(ctx->graph, fn);
+            remove_dict(const Node*, ctx->called, fn);
+            remove_decl_module(mod, fn);
+        }
+        clear_list(uncalled);
+    }
+    destroy_list(uncalled);
+}
+
+void opt_simplify_cf(const CompilerConfig* config, Module* src, Module* dst) {
+    // we work on our own copy of the module, so functions keep their identity across rounds and the callgraph only needs updating where inlining happened
+    Rewriter importer = create_importer(src, dst);
+    rewrite_module(&importer);
+    destroy_rewriter(&importer);
+
     Context ctx = {
-        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
-        .graph = NULL,
+        .rewriter = create_rewriter(dst, dst, (RewriteNodeFn) process),
+        .config = config,
+        .graph = new_callgraph(dst),
+        .inline_decisions = new_dict(CallSite, bool, (HashFn) hash_call_site, (CmpFn) compare_call_site),
+        .fn_sizes = new_dict(const Node*, size_t, (HashFn) hash_node, (CmpFn) compare_node),
+        .hosts = new_list(CGNode*),
+        .called = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
         .fun = NULL,
         .inlined_call = NULL,
     };
-    ctx.graph = new_callgraph(src);
 
-    rewrite_module(&ctx.rewriter);
-    if (ctx.graph)
-        destroy_callgraph(ctx.graph);
+    Nodes decls = get_module_declarations(dst);
+    for (size_t i = 0; i < decls.count; i++)
+        register_processed(&ctx.rewriter, decls.nodes[i], decls.nodes[i]);
+
+    size_t iter = 0;
+    CGNode* fn_node;
+    while (dict_iter(ctx.graph->fn2cgn, &iter, NULL, &fn_node)) {
+        if (entries_count_dict(fn_node->callers) > 0)
+            insert_set_get_result(const Node*, ctx.called, fn_node->fn);
+    }
+
+    // inlining moves call sites into new callers, where they might be worth inlining too
+    for (size_t round = 0; round < config->optimisations.inlining.max_rounds; round++) {
+        compute_inlining_decisions(&ctx);
+        if (entries_count_list(ctx.hosts) == 0)
+            break;
+        debugv_print("Inlining round %zu: %zu functions to rewrite\n", round, entries_count_list(ctx.hosts));
+        for (size_t i = 0; i < entries_count_list(ctx.hosts); i++) {
+            CGNode* host = read_list(CGNode*, ctx.hosts)[i];
+            inline_into_fn(&ctx, (Node*) host->fn);
+            callgraph_update_fn(ctx.graph, host->fn);
+        }
+        eliminate_uncalled_fns(&ctx, dst);
+    }
+
+    destroy_callgraph(ctx.graph);
+    destroy_dict(ctx.inline_decisions);
+    destroy_dict(ctx.fn_sizes);
+    destroy_list(ctx.hosts);
+    destroy_dict(ctx.called);
 
     destroy_rewriter(&ctx.rewriter);
 }
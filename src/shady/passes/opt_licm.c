@@ -0,0 +1,230 @@
+#include "passes.h"
+
+#include "log.h"
+#include "portability.h"
+#include "dict.h"
+#include "list.h"
+
+#include "../rewrite.h"
+#include "../type.h"
+#include "../analysis/scope.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+typedef struct {
+    Scope* scope;
+    /// Old lets that were moved in front of a loop, their variables are already mapped to the hoisted results
+    struct Dict* hoisted;
+} FnInfo;
+
+typedef struct {
+    Rewriter rewriter;
+    FnInfo* fn;
+} Context;
+
+typedef enum {
+    NotHoistable,
+    /// Can be computed ahead of time even if the loop might not have reached it
+    Speculatable,
+    /// Might fault or trap, so it needs to be executed on every iteration to be hoisted
+    NeedsGuaranteedExecution,
+} HoistKind;
+
+static HoistKind classify_instruction(const Node* instruction) {
+    if (instruction->tag != PrimOp_TAG)
+        return NotHoistable;
+    PrimOp prim_op = instruction->payload.prim_op;
+    switch (prim_op.op) {
+        case quote_op: return NotHoistable;
+        // the base of the stack does not move, unlike the stack pointer
+        case get_stack_base_op: return Speculatable;
+        case div_op:
+        case mod_op: return NeedsGuaranteedExecution;
+        case load_op: {
+            const Type* ptr_t = get_unqualified_type(first(prim_op.operands)->type);
+            assert(ptr_t->tag == PtrType_TAG);
+            if (is_addr_space_read_only(ptr_t->payload.ptr_type.address_space))
+                return NeedsGuaranteedExecution;
+            return NotHoistable;
+        }
+        default: break;
+    }
+    if (has_primop_got_side_effects(prim_op.op))
+        return NotHoistable;
+    // threads leave the loop at different iterations, so the active mask is not invariant
+    if (get_primop_class(prim_op.op) & (OcStack | OcSubgroup_intrinsic))
+        return NotHoistable;
+    return Speculatable;
+}
+
+static bool is_invariant_value(struct Dict* defined_inside, const Node* value) {
+    switch (value->tag) {
+        case Variable_TAG: return !find_key_dict(const Node*, defined_inside, value);
+        case Composite_TAG: {
+            Nodes contents = value->payload.composite.contents;
+            for (size_t i = 0; i < contents.count; i++)
+                if (!is_invariant_value(defined_inside, contents.nodes[i]))
+                    return false;
+            return true;
+        }
+        case Fill_TAG: return is_invariant_value(defined_inside, value->payload.fill.value);
+        case ConstrainedValue_TAG: return is_invariant_value(defined_inside, value->payload.constrained.value);
+        default: return true;
+    }
+}
+
+static int compare_rpo_index(const void* a, const void* b) {
+    const CFNode* na = *(const CFNode**) a;
+    const CFNode* nb = *(const CFNode**) b;
+    return na->rpo_index < nb->rpo_index ? -1 : na->rpo_index > nb->rpo_index;
+}
+
+/// Collects the lets in the body of @p loop whose instructions don't depend on anything computed inside of it, in the order they need to be bound.
+/// The loop is made of everything the body dominates, which includes nested structured constructs.
+static struct List* find_loop_invariants(Context* ctx, const Node* loop) {
+    Scope* scope = ctx->fn->scope;
+    struct List* invariants = new_list(const Node*);
+    const Node* body = loop->payload.loop_instr.body;
+    CFNode** found = find_value_dict(const Node*, CFNode*, scope->map, body);
+    if (!found)
+        return invariants;
+
+    struct List* region = new_list(CFNode*);
+    append_list(CFNode*, region, *found);
+    for (size_t i = 0; i < entries_count_list(region); i++) {
+        CFNode* n = read_list(CFNode*, region)[i];
+        for (size_t j = 0; j < n->dominates.count; j++)
+            append_list(CFNode*, region, n->dominates.nodes[j]);
+    }
+    // definitions come before their uses in reverse post-order
+    qsort(read_list(CFNode*, region), entries_count_list(region), sizeof(CFNode*), compare_rpo_index);
+
+    struct Dict* defined_inside = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node);
+    for (size_t i = 0; i < entries_count_list(region); i++) {
+        Nodes params = get_abstraction_params(read_list(CFNode*, region)[i]->node);
+        for (size_t j = 0; j < params.count; j++)
+            insert_set_get_result(const Node*, defined_inside, params.nodes[j]);
+    }
+
+    // the body runs at least once, so its let chain is executed for sure until something might branch away
+    struct Dict* guaranteed = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node);
+    for (const Node* abs = body; abs;) {
+        insert_set_get_result(const Node*, guaranteed, abs);
+        const Node* terminator = get_abstraction_body(abs);
+        if (terminator->tag != Let_TAG || get_let_instruction(terminator)->tag != PrimOp_TAG)
+            break;
+        abs = get_let_tail(terminator);
+    }
+
+    for (size_t i = 0; i < entries_count_list(region); i++) {
+        const Node* abs = read_list(CFNode*, region)[i]->node;
+        const Node* let = get_abstraction_body(abs);
+        if (!let || let->tag != Let_TAG)
+            continue;
+        Nodes results = get_abstraction_params(get_let_tail(let));
+        bool hoist = find_key_dict(const Node*, ctx->fn->hoisted, let);
+        if (!hoist) {
+            const Node* instruction = get_let_instruction(let);
+            switch (classify_instruction(instruction)) {
+                case NotHoistable: continue;
+                case NeedsGuaranteedExecution: if (!find_key_dict(const Node*, guaranteed, abs)) continue; break;
+                case Speculatable: break;
+            }
+            Nodes operands = instruction->payload.prim_op.operands;
+            hoist = true;
+            for (size_t j = 0; j < operands.count; j++)
+                hoist &= is_invariant_value(defined_inside, operands.nodes[j]);
+            if (!hoist)
+                continue;
+            append_list(const Node*, invariants, let);
+        }
+        for (size_t j = 0; j < results.count; j++)
+            remove_dict(const Node*, defined_inside, results.nodes[j]);
+    }
+
+    destroy_dict(guaranteed);
+    destroy_dict(defined_inside);
+    destroy_list(region);
+    return invariants;
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found) return found;
+
+    IrArena* a = ctx->rewriter.dst_arena;
+
+    switch (node->tag) {
+        case Function_TAG: {
+            Context fn_ctx = *ctx;
+            FnInfo fn = {
+                .hoisted = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+            };
+            fn.scope = new_scope(node);
+            fn_ctx.fn = &fn;
+
+            Node* new = recreate_decl_header_identity(&fn_ctx.rewriter, node);
+            recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
+
+            destroy_dict(fn.hoisted);
+            destroy_scope(fn.scope);
+            return new;
+        }
+        case Constant_TAG:
+        case GlobalVariable_TAG:
+        case NominalType_TAG: {
+            Context decl_ctx = *ctx;
+            decl_ctx.fn = NULL;
+            return recreate_node_identity(&decl_ctx.rewriter, node);
+        }
+        case Let_TAG: {
+            if (!ctx->fn)
+                break;
+            const Node* old_tail = get_let_tail(node);
+            // the results have been registered when we bound this in front of the loop
+            if (find_key_dict(const Node*, ctx->fn->hoisted, node))
+                return rewrite_node(&ctx->rewriter, get_abstraction_body(old_tail));
+
+            const Node* old_instruction = get_let_instruction(node);
+            if (old_instruction->tag != Loop_TAG)
+                break;
+            struct List* invariants = find_loop_invariants(ctx, old_instruction);
+            size_t count = entries_count_list(invariants);
+            if (count == 0) {
+                destroy_list(invariants);
+                break;
+            }
+
+            BodyBuilder* bb = begin_body(a);
+            for (size_t i = 0; i < count; i++) {
+                const Node* let = read_list(const Node*, invariants)[i];
+                const Node* old_hoisted = get_let_instruction(let);
+                debugv_print("opt_licm: hoisting %s out of a loop\n", get_primop_name(old_hoisted->payload.prim_op.op));
+                Nodes results = bind_instruction(bb, rewrite_node(&ctx->rewriter, old_hoisted));
+                register_processed_list(&ctx->rewriter, get_abstraction_params(get_let_tail(let)), results);
+                insert_set_get_result(const Node*, ctx->fn->hoisted, let);
+            }
+            destroy_list(invariants);
+            return finish_body(bb, recreate_node_identity(&ctx->rewriter, node));
+        }
+        default: break;
+    }
+
+    return recreate_node_identity(&ctx->rewriter, node);
+}
+
+Module* opt_licm(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+    };
+    rewrite_module(&ctx.rewriter);
+    destroy_rewriter(&ctx.rewriter);
+    return dst;
+}
@@ -159,8 +159,8 @@ static KnowledgeBase* create_kb(Context* ctx, const Node* old) {
     // log_string(DEBUGVV, "Creating KB for ");
     // log_node(DEBUGVV, old);
     // log_string(DEBUGVV, "\n.");
-    if (entries_count_list(cf_node->pred_edges) == 1) {
-        CFEdge edge = read_list(CFEdge, cf_node->pred_edges)[0];
+    if (cf_node->pred_edges.count == 1) {
+        CFEdge edge = cf_node->pred_edges.edges[0];
         assert(edge.dst == cf_node);
         if (edge.type == LetTailEdge || edge.type == JumpEdge) {
             CFNode* dominator = edge.src;
@@ -479,8 +479,8 @@ static void handle_bb(Context* ctx, const Node* old) {
         PtrSourceKnowledge* source = NULL;
         PtrKnowledge uk = { 0 };
         // check if all the edges have a value for this!
-        for (size_t j = 0; j < entries_count_list(cfnode->pred_edges); j++) {
-            CFEdge edge = read_list(CFEdge, cfnode->pred_edges)[j];
+        for (size_t j = 0; j < cfnode->pred_edges.count; j++) {
+            CFEdge edge = cfnode->pred_edges.edges[j];
             if (edge.type == StructuredPseudoExitEdge)
                 continue; // these are not real edges...
             KnowledgeBase* kb_at_src = get_kb(ctx, edge.src->node);
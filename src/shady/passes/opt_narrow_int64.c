@@ -0,0 +1,171 @@
+#include "passes.h"
+
+#include "log.h"
+#include "portability.h"
+#include "dict.h"
+
+#include "../ir_private.h"
+#include "../type.h"
+#include "../rewrite.h"
+#include "../transform/ir_gen_helpers.h"
+#include "../analysis/value_range.h"
+
+#include <assert.h>
+
+typedef struct {
+    Rewriter rewriter;
+    const CompilerConfig* config;
+    ValueRangeAnalysis* ranges;
+    /// Maps old 64-bit variables to the narrow value they were computed from
+    struct Dict* narrowed;
+} Context;
+
+static bool is_int64(const Type* t) {
+    return t->tag == Int_TAG && t->payload.int_type.width == IntTy64;
+}
+
+static bool fits_narrow(Context* ctx, const Node* old, bool is_signed) {
+    return value_range_fits(get_value_range(ctx->ranges, old), IntTy32, is_signed);
+}
+
+static bool is_narrowable_op(Op op) {
+    switch (op) {
+        case add_op: case sub_op: case mul_op: case div_op: case mod_op:
+        case and_op: case or_op: case xor_op:
+        case rshift_logical_op: case rshift_arithm_op: case lshift_op:
+        case min_op: case max_op:
+        case gt_op: case gte_op: case lt_op: case lte_op: case eq_op: case neq_op:
+            return true;
+        default: return false;
+    }
+}
+
+/// Checks whether a 64-bit operation would compute the same result on 32-bit operands
+static bool can_narrow(Context* ctx, const Node* old_instruction, bool* is_signed) {
+    if (old_instruction->tag != PrimOp_TAG)
+        return false;
+    const PrimOp* prim_op = &old_instruction->payload.prim_op;
+    if (!is_narrowable_op(prim_op->op) || prim_op->operands.count != 2)
+        return false;
+
+    const Type* lhs_t = get_unqualified_type(first(prim_op->operands)->type);
+    if (!is_int64(lhs_t))
+        return false;
+    *is_signed = lhs_t->payload.int_type.is_signed;
+
+    for (size_t i = 0; i < prim_op->operands.count; i++) {
+        if (!fits_narrow(ctx, prim_op->operands.nodes[i], *is_signed))
+            return false;
+    }
+
+    switch (prim_op->op) {
+        case rshift_logical_op:
+        case rshift_arithm_op:
+        case lshift_op: {
+            // shifting by 32 or more is undefined on 32-bit integers
+            ValueRange shift = get_value_range(ctx->ranges, prim_op->operands.nodes[1]);
+            if (!shift.bounded || shift.min < 0 || shift.max > 31)
+                return false;
+            // an unsigned value past INT32_MAX would get sign-extended by the narrow arithmetic shift, but not by the wide one
+            if (prim_op->op == rshift_arithm_op && !fits_narrow(ctx, first(prim_op->operands), true))
+                return false;
+            break;
+        }
+        default: break;
+    }
+
+    // comparisons yield booleans, otherwise the result itself needs to be representable
+    const Type* result_t = get_unqualified_type(old_instruction->type);
+    if (result_t->tag == Bool_TAG)
+        return true;
+    return is_int64(result_t) && fits_narrow(ctx, old_instruction, *is_signed);
+}
+
+static const Node* narrow_operand(Context* ctx, BodyBuilder* bb, const Node* old, const Type* narrow_t) {
+    IrArena* a = ctx->rewriter.dst_arena;
+
+    const Node** found = find_value_dict(const Node*, const Node*, ctx->narrowed, old);
+    if (found) {
+        if (get_unqualified_type((*found)->type) == narrow_t)
+            return *found;
+        return gen_reinterpret_cast(bb, narrow_t, *found);
+    }
+
+    if (old->tag == IntLiteral_TAG)
+        return int_literal(a, (IntLiteral) { .width = IntTy32, .is_signed = narrow_t->payload.int_type.is_signed, .value = (uint32_t) old->payload.int_literal.value });
+
+    // peel off widening conversions, those are common when mixing 32-bit builtins into 64-bit arithmetic
+    const Node* def = old->tag == Variable_TAG ? get_var_def(old->payload.var) : NULL;
+    if (def && def->tag == PrimOp_TAG && def->payload.prim_op.op == convert_op) {
+        const Node* src = first(def->payload.prim_op.operands);
+        const Type* src_t = get_unqualified_type(src->type);
+        if (src_t->tag == Int_TAG && src_t->payload.int_type.width == IntTy32) {
+            const Node* nsrc = rewrite_node(&ctx->rewriter, src);
+            if (src_t->payload.int_type.is_signed == narrow_t->payload.int_type.is_signed)
+                return nsrc;
+            return gen_reinterpret_cast(bb, narrow_t, nsrc);
+        }
+    }
+
+    const Node* nold = rewrite_node(&ctx->rewriter, old);
+    if (get_unqualified_type(nold->type)->payload.int_type.is_signed != narrow_t->payload.int_type.is_signed)
+        return convert_int_extend_according_to_dst_t(bb, narrow_t, nold);
+    return gen_conversion(bb, narrow_t, nold);
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found) return found;
+
+    IrArena* a = ctx->rewriter.dst_arena;
+
+    switch (node->tag) {
+        case Let_TAG: {
+            const Node* old_instruction = get_let_instruction(node);
+            const Node* old_tail = get_let_tail(node);
+            bool is_signed;
+            if (!can_narrow(ctx, old_instruction, &is_signed))
+                break;
+
+            const PrimOp* old_prim_op = &old_instruction->payload.prim_op;
+            const Type* narrow_t = int_type(a, (Int) { .width = IntTy32, .is_signed = is_signed });
+            BodyBuilder* bb = begin_body(a);
+            LARRAY(const Node*, narrow_operands, old_prim_op->operands.count);
+            for (size_t i = 0; i < old_prim_op->operands.count; i++)
+                narrow_operands[i] = narrow_operand(ctx, bb, old_prim_op->operands.nodes[i], narrow_t);
+            const Node* result = gen_primop_e(bb, old_prim_op->op, empty(a), nodes(a, old_prim_op->operands.count, narrow_operands));
+
+            const Type* result_t = get_unqualified_type(old_instruction->type);
+            if (result_t->tag == Int_TAG) {
+                const Node* old_var = first(get_abstraction_params(old_tail));
+                insert_dict(const Node*, const Node*, ctx->narrowed, old_var, result);
+                result = gen_conversion(bb, rewrite_node(&ctx->rewriter, result_t), result);
+            }
+            debugv_print("opt_narrow_int64: narrowed %s\n", get_primop_name(old_prim_op->op));
+            return finish_body(bb, let(a, quote_helper(a, singleton(result)), rewrite_node(&ctx->rewriter, old_tail)));
+        }
+        default: break;
+    }
+
+    return recreate_node_identity(&ctx->rewriter, node);
+}
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+Module* opt_narrow_int64(const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .config = config,
+        .ranges = new_value_range_analysis(),
+        .narrowed = new_dict(const Node*, const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+    };
+    rewrite_module(&ctx.rewriter);
+    destroy_rewriter(&ctx.rewriter);
+    destroy_value_range_analysis(ctx.ranges);
+    destroy_dict(ctx.narrowed);
+    return dst;
+}
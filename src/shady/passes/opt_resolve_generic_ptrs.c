@@ -0,0 +1,584 @@
+#include "passes.h"
+
+#include "dict.h"
+#include "log.h"
+#include "portability.h"
+#include "util.h"
+
+#include "../rewrite.h"
+#include "../type.h"
+#include "../ir_private.h"
+#include "../transform/ir_gen_helpers.h"
+
+#include "../analysis/scope.h"
+#include "../analysis/uses.h"
+#include "../analysis/leak.h"
+
+#include <assert.h>
+
+KeyHash hash_node(const Node**);
+bool compare_node(const Node**, const Node**);
+
+/// The innermost structured constructs a case is nested in, that's where yields and merges go
+typedef struct {
+    const Node* construct;
+    const Node* loop;
+} Enclosing;
+
+typedef struct {
+    Scope* scope;
+    const UsesMap* uses;
+    /// Maps old generic pointer variables to the AddressSpace they point into, AsGeneric if that's ambiguous.
+    /// Variables that are absent from the lattice are not known to hold anything yet.
+    struct Dict* lattice;
+    /// Maps old cases to Enclosing
+    struct Dict* enclosing;
+    /// Maps the join points of static control constructs to the let binding them
+    struct Dict* join_points;
+    /// Logical allocas holding generic pointers that are only ever loaded from and stored to, their lattice value covers everything stored in them
+    struct Dict* slots;
+    /// Maps old generic pointers to a pointer with the same address in the destination arena, but in a concrete address space
+    struct Dict* resolved;
+    bool changed;
+} FnInfo;
+
+/// Clones are identified by the types of their parameters, where generic pointers got replaced by concrete ones
+typedef struct {
+    const Node* callee;
+    Nodes param_types;
+} CloneKey;
+
+typedef struct Context_ {
+    Rewriter rewriter;
+    /// clones are rewritten from the callee's body, next to (not inside of) the function we're in
+    Rewriter* root_rewriter;
+    const CompilerConfig* config;
+    /// @ref Dict from @ref CloneKey to @ref Node*
+    struct Dict* clones;
+    FnInfo* fn;
+    Node* fun;
+} Context;
+
+static KeyHash hash_clone_key(CloneKey* key) {
+    return hash_murmur(key, sizeof(CloneKey));
+}
+
+static bool compare_clone_key(CloneKey* a, CloneKey* b) {
+    return a->callee == b->callee && a->param_types.nodes == b->param_types.nodes;
+}
+
+static bool is_generic_ptr_value(const Node* value) {
+    return is_generic_ptr_type(get_unqualified_type(value->type));
+}
+
+static AddressSpace get_ptr_address_space(const Node* value) {
+    const Type* t = get_unqualified_type(value->type);
+    assert(t->tag == PtrType_TAG);
+    return t->payload.ptr_type.address_space;
+}
+
+/// Generic globals are lowered to constants converting a pointer to the actual global
+static const Node* get_converted_global(const Node* value) {
+    if (value->tag != RefDecl_TAG || value->payload.ref_decl.decl->tag != Constant_TAG)
+        return NULL;
+    const Node* instruction = value->payload.ref_decl.decl->payload.constant.instruction;
+    if (!instruction || instruction->tag != PrimOp_TAG || instruction->payload.prim_op.op != convert_op)
+        return NULL;
+    return first(instruction->payload.prim_op.operands);
+}
+
+/// @returns false if nothing is known about @p value yet
+static bool get_lattice_value(Context* ctx, const Node* value, AddressSpace* result) {
+    switch (value->tag) {
+        case Variable_TAG: {
+            AddressSpace* found = find_value_dict(const Node*, AddressSpace, ctx->fn->lattice, value);
+            if (found)
+                *result = *found;
+            return found;
+        }
+        // null doesn't point anywhere, so it's compatible with anything
+        case NullPtr_TAG: return false;
+        default: break;
+    }
+    const Node* global = get_converted_global(value);
+    *result = global ? get_ptr_address_space(global) : AsGeneric;
+    return true;
+}
+
+static void meet(Context* ctx, const Node* var, AddressSpace as) {
+    if (!is_generic_ptr_value(var) && !find_key_dict(const Node*, ctx->fn->slots, var))
+        return;
+    AddressSpace* found = find_value_dict(const Node*, AddressSpace, ctx->fn->lattice, var);
+    if (!found) {
+        insert_dict(const Node*, AddressSpace, ctx->fn->lattice, var, as);
+        ctx->fn->changed = true;
+        return;
+    }
+    if (*found == as || *found == AsGeneric)
+        return;
+    *found = AsGeneric;
+    ctx->fn->changed = true;
+}
+
+static void meet_list(Context* ctx, Nodes vars, Nodes values) {
+    assert(vars.count == values.count);
+    for (size_t i = 0; i < vars.count; i++) {
+        AddressSpace as;
+        if (get_lattice_value(ctx, values.nodes[i], &as))
+            meet(ctx, vars.nodes[i], as);
+    }
+}
+
+static void meet_list_ambiguous(Context* ctx, Nodes vars) {
+    for (size_t i = 0; i < vars.count; i++)
+        meet(ctx, vars.nodes[i], AsGeneric);
+}
+
+static void set_enclosing(Context* ctx, const Node* abs, Enclosing enclosing) {
+    if (!abs || find_value_dict(const Node*, Enclosing, ctx->fn->enclosing, abs))
+        return;
+    insert_dict(const Node*, Enclosing, ctx->fn->enclosing, abs, enclosing);
+    ctx->fn->changed = true;
+}
+
+/// Control flow lowering turns phis into logical allocas, as long as their address doesn't escape we can see all the values flowing through them
+static bool is_slot_private(const UsesMap* map, const Node* alloca_var) {
+    for (const Use* use = get_first_use(map, alloca_var); use; use = use->next_use) {
+        const Node* user = use->user;
+        if (user->tag == Case_TAG)
+            continue;
+        if (user->tag != PrimOp_TAG)
+            return false;
+        Nodes operands = user->payload.prim_op.operands;
+        switch (user->payload.prim_op.op) {
+            case load_op: continue;
+            case store_op: if (operands.nodes[1] != alloca_var) continue; return false;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+static void visit_jump(Context* ctx, const Node* jump) {
+    assert(jump->tag == Jump_TAG);
+    meet_list(ctx, get_abstraction_params(jump->payload.jump.target), jump->payload.jump.args);
+}
+
+static void visit_let(Context* ctx, const Node* let, Enclosing enclosing) {
+    const Node* instruction = get_let_instruction(let);
+    const Node* tail = get_let_tail(let);
+    Nodes results = get_abstraction_params(tail);
+    Enclosing inside = { .construct = let, .loop = enclosing.loop };
+    set_enclosing(ctx, tail, enclosing);
+    switch (instruction->tag) {
+        case PrimOp_TAG: {
+            PrimOp payload = instruction->payload.prim_op;
+            if (payload.op == convert_op && results.count == 1 && is_generic_ptr_value(first(results))) {
+                meet(ctx, first(results), get_ptr_address_space(first(payload.operands)));
+                return;
+            }
+            if (payload.op == lea_op && is_generic_ptr_value(first(payload.operands))) {
+                meet_list(ctx, results, singleton(first(payload.operands)));
+                return;
+            }
+            if (payload.op == alloca_logical_op && is_generic_ptr_type(first(payload.type_arguments)) && is_slot_private(ctx->fn->uses, first(results))) {
+                const Node* slot = first(results);
+                if (insert_set_get_result(const Node*, ctx->fn->slots, slot))
+                    ctx->fn->changed = true;
+                return;
+            }
+            const Node* ptr = payload.operands.count > 0 ? first(payload.operands) : NULL;
+            if (payload.op == load_op && find_key_dict(const Node*, ctx->fn->slots, ptr)) {
+                meet_list(ctx, results, singleton(ptr));
+                return;
+            }
+            if (payload.op == store_op && find_key_dict(const Node*, ctx->fn->slots, ptr)) {
+                meet_list(ctx, singleton(ptr), singleton(payload.operands.nodes[1]));
+                return;
+            }
+            meet_list_ambiguous(ctx, results);
+            return;
+        }
+        case If_TAG: {
+            set_enclosing(ctx, instruction->payload.if_instr.if_true, inside);
+            set_enclosing(ctx, instruction->payload.if_instr.if_false, inside);
+            return;
+        }
+        case Match_TAG: {
+            Match payload = instruction->payload.match_instr;
+            for (size_t i = 0; i < payload.cases.count; i++)
+                set_enclosing(ctx, payload.cases.nodes[i], inside);
+            set_enclosing(ctx, payload.default_case, inside);
+            return;
+        }
+        case Loop_TAG: {
+            Loop payload = instruction->payload.loop_instr;
+            meet_list(ctx, get_abstraction_params(payload.body), payload.initial_args);
+            set_enclosing(ctx, payload.body, (Enclosing) { .construct = let, .loop = let });
+            return;
+        }
+        case Block_TAG: {
+            set_enclosing(ctx, instruction->payload.block.inside, inside);
+            return;
+        }
+        case Control_TAG: {
+            const Node* inside_case = instruction->payload.control.inside;
+            set_enclosing(ctx, inside_case, inside);
+            // if the join point doesn't leak, the results can only come from the joins we see
+            if (is_control_static(ctx->fn->uses, instruction)) {
+                const Node* jp = first(get_abstraction_params(inside_case));
+                if (!find_value_dict(const Node*, const Node*, ctx->fn->join_points, jp))
+                    insert_dict(const Node*, const Node*, ctx->fn->join_points, jp, let);
+                return;
+            }
+            meet_list_ambiguous(ctx, results);
+            return;
+        }
+        default: meet_list_ambiguous(ctx, results); return;
+    }
+}
+
+/// Yields and breaks flow to the tail of the construct they're in
+static void yield_to(Context* ctx, const Node* construct, Nodes args) {
+    if (!construct)
+        return;
+    meet_list(ctx, get_abstraction_params(get_let_tail(construct)), args);
+}
+
+static void visit_abstraction(Context* ctx, const Node* abs) {
+    const Node* body = get_abstraction_body(abs);
+    if (!body)
+        return;
+    Enclosing enclosing = { 0 };
+    Enclosing* found = find_value_dict(const Node*, Enclosing, ctx->fn->enclosing, abs);
+    if (found)
+        enclosing = *found;
+
+    switch (body->tag) {
+        case Let_TAG: visit_let(ctx, body, enclosing); break;
+        case Jump_TAG: visit_jump(ctx, body); break;
+        case Branch_TAG: {
+            visit_jump(ctx, body->payload.branch.true_jump);
+            visit_jump(ctx, body->payload.branch.false_jump);
+            break;
+        }
+        case Switch_TAG: {
+            for (size_t i = 0; i < body->payload.br_switch.case_jumps.count; i++)
+                visit_jump(ctx, body->payload.br_switch.case_jumps.nodes[i]);
+            visit_jump(ctx, body->payload.br_switch.default_jump);
+            break;
+        }
+        case Yield_TAG: {
+            yield_to(ctx, enclosing.construct, body->payload.yield.args);
+            break;
+        }
+        case Join_TAG: {
+            const Node** control = find_value_dict(const Node*, const Node*, ctx->fn->join_points, body->payload.join.join_point);
+            if (control)
+                yield_to(ctx, *control, body->payload.join.args);
+            break;
+        }
+        case MergeBreak_TAG: {
+            yield_to(ctx, enclosing.loop, body->payload.merge_break.args);
+            break;
+        }
+        case MergeContinue_TAG: {
+            if (enclosing.loop)
+                meet_list(ctx, get_abstraction_params(get_let_instruction(enclosing.loop)->payload.loop_instr.body), body->payload.merge_continue.args);
+            break;
+        }
+        default: break;
+    }
+}
+
+/// @param param_spaces what the parameters of @p fn point into, they're all ambiguous if this is NULL
+static void analyse_function(Context* ctx, const Node* fn, const AddressSpace* param_spaces) {
+    FnInfo* info = ctx->fn;
+    Nodes params = get_abstraction_params(fn);
+    for (size_t i = 0; i < params.count; i++)
+        meet(ctx, params.nodes[i], param_spaces ? param_spaces[i] : AsGeneric);
+    do {
+        info->changed = false;
+        for (size_t i = 0; i < info->scope->size; i++)
+            visit_abstraction(ctx, info->scope->rpo[i]->node);
+    } while (info->changed);
+}
+
+static FnInfo create_fn_info(const Node* fn) {
+    FnInfo info = {
+        .uses = create_uses_map(fn, (NcDeclaration | NcType)),
+        .lattice = new_dict(const Node*, AddressSpace, (HashFn) hash_node, (CmpFn) compare_node),
+        .enclosing = new_dict(const Node*, Enclosing, (HashFn) hash_node, (CmpFn) compare_node),
+        .join_points = new_dict(const Node*, const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+        .slots = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+        .resolved = new_dict(const Node*, const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+    };
+    info.scope = new_scope(fn);
+    return info;
+}
+
+static void destroy_fn_info(FnInfo* info) {
+    destroy_dict(info->lattice);
+    destroy_dict(info->enclosing);
+    destroy_dict(info->join_points);
+    destroy_dict(info->slots);
+    destroy_dict(info->resolved);
+    destroy_uses_map(info->uses);
+    destroy_scope(info->scope);
+}
+
+/// @returns a pointer equivalent to @p old, but in a concrete address space, or NULL if we don't have one
+static const Node* get_resolved(Context* ctx, const Node* old) {
+    const Node** found = find_value_dict(const Node*, const Node*, ctx->fn->resolved, old);
+    if (found)
+        return *found;
+    const Node* global = get_converted_global(old);
+    if (global)
+        return rewrite_node(&ctx->rewriter, global);
+    return NULL;
+}
+
+static void set_resolved(Context* ctx, const Node* old, const Node* resolved) {
+    insert_dict(const Node*, const Node*, ctx->fn->resolved, old, resolved);
+}
+
+/// Parameters pointing into a known address space get converted back to it once, on entry
+static const Node* rewrite_body_resolving_params(Context* ctx, Nodes old_params, Nodes new_params, const Node* old_body) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    BodyBuilder* bb = begin_body(a);
+    for (size_t i = 0; i < old_params.count; i++) {
+        const Node* old_param = old_params.nodes[i];
+        AddressSpace as;
+        if (!is_generic_ptr_value(old_param) || get_resolved(ctx, old_param))
+            continue;
+        if (!get_lattice_value(ctx, old_param, &as) || as == AsGeneric)
+            continue;
+        const Type* generic_t = get_unqualified_type(new_params.nodes[i]->type);
+        const Type* resolved_t = ptr_type(a, (PtrType) { .pointed_type = generic_t->payload.ptr_type.pointed_type, .address_space = as });
+        set_resolved(ctx, old_param, gen_primop_e(bb, convert_op, singleton(resolved_t), singleton(new_params.nodes[i])));
+    }
+    return finish_body(bb, rewrite_node(&ctx->rewriter, old_body));
+}
+
+static Node* get_or_create_clone(Context* ctx, CloneKey key) {
+    Node** found = find_value_dict(CloneKey, Node*, ctx->clones, key);
+    if (found)
+        return *found;
+
+    IrArena* a = ctx->rewriter.dst_arena;
+    Rewriter* root = ctx->root_rewriter;
+    const Node* ocallee = key.callee;
+    Nodes oparams = get_abstraction_params(ocallee);
+
+    LARRAY(const Node*, nparams, oparams.count);
+    LARRAY(AddressSpace, param_spaces, oparams.count);
+    for (size_t i = 0; i < oparams.count; i++) {
+        nparams[i] = var(a, key.param_types.nodes[i], oparams.nodes[i]->payload.var.name);
+        const Type* t = get_unqualified_type(key.param_types.nodes[i]);
+        param_spaces[i] = t->tag == PtrType_TAG ? t->payload.ptr_type.address_space : AsGeneric;
+    }
+
+    Nodes annotations = rewrite_nodes(root, ocallee->payload.fun.annotations);
+    annotations = filter_out_annotation(a, annotations, "Exported");
+    annotations = filter_out_annotation(a, annotations, "EntryPoint");
+    String name = format_string_arena(a->arena, "%s_resolved_%zu", get_abstraction_name(ocallee), entries_count_dict(ctx->clones));
+    Node* clone = function(ctx->rewriter.dst_module, nodes(a, oparams.count, nparams), name, annotations, rewrite_nodes(root, ocallee->payload.fun.return_types));
+    insert_dict(CloneKey, Node*, ctx->clones, key, clone);
+    debugv_print("Resolving the generic pointer parameters of %s into %s\n", get_abstraction_name(ocallee), name);
+
+    Context clone_ctx = *ctx;
+    clone_ctx.rewriter = create_children_rewriter(root);
+    FnInfo fn = create_fn_info(ocallee);
+    clone_ctx.fn = &fn;
+    clone_ctx.fun = clone;
+    analyse_function(&clone_ctx, ocallee, param_spaces);
+
+    // the body might still need the parameters we made concrete as generic pointers
+    BodyBuilder* bb = begin_body(a);
+    for (size_t i = 0; i < oparams.count; i++) {
+        const Node* oparam = oparams.nodes[i];
+        if (!is_generic_ptr_value(oparam) || param_spaces[i] == AsGeneric) {
+            register_processed(&clone_ctx.rewriter, oparam, nparams[i]);
+            continue;
+        }
+        const Type* generic_t = rewrite_node(root, get_unqualified_type(oparam->type));
+        register_processed(&clone_ctx.rewriter, oparam, gen_primop_e(bb, convert_op, singleton(generic_t), singleton(nparams[i])));
+        set_resolved(&clone_ctx, oparam, nparams[i]);
+    }
+    clone->payload.fun.body = finish_body(bb, rewrite_node(&clone_ctx.rewriter, get_abstraction_body(ocallee)));
+
+    destroy_fn_info(&fn);
+    destroy_rewriter(&clone_ctx.rewriter);
+    return clone;
+}
+
+static bool is_callee_clonable(const Node* fn) {
+    if (fn->tag != Function_TAG || !fn->payload.fun.body)
+        return false;
+    if (lookup_annotation(fn, "Internal"))
+        return false;
+    return true;
+}
+
+/// Redirects calls passing generic pointers we could resolve to a clone taking concrete ones instead
+static const Node* process_call(Context* ctx, const Node* old) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    Call payload = old->payload.call;
+    if (payload.callee->tag != FnAddr_TAG || !is_callee_clonable(payload.callee->payload.fn_addr.fn))
+        return NULL;
+    const Node* ocallee = payload.callee->payload.fn_addr.fn;
+    Nodes oparams = get_abstraction_params(ocallee);
+    if (oparams.count != payload.args.count)
+        return NULL;
+
+    bool changed = false;
+    LARRAY(const Node*, param_types, oparams.count);
+    LARRAY(const Node*, nargs, oparams.count);
+    for (size_t i = 0; i < oparams.count; i++) {
+        const Node* oparam = oparams.nodes[i];
+        const Node* resolved = is_generic_ptr_value(oparam) ? get_resolved(ctx, payload.args.nodes[i]) : NULL;
+        if (resolved) {
+            param_types[i] = qualified_type_helper(get_unqualified_type(resolved->type), is_qualified_type_uniform(oparam->type));
+            nargs[i] = resolved;
+            changed = true;
+        } else {
+            param_types[i] = rewrite_node(&ctx->rewriter, oparam->type);
+            nargs[i] = rewrite_node(&ctx->rewriter, payload.args.nodes[i]);
+        }
+    }
+    if (!changed)
+        return NULL;
+
+    CloneKey key = { .callee = ocallee, .param_types = nodes(a, oparams.count, param_types) };
+    if (!find_value_dict(CloneKey, Node*, ctx->clones, key) && entries_count_dict(ctx->clones) >= ctx->config->optimisations.specialization.max_clones)
+        return NULL;
+    return call(a, (Call) {
+        .callee = fn_addr_helper(a, get_or_create_clone(ctx, key)),
+        .args = nodes(a, oparams.count, nargs),
+    });
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found) return found;
+
+    IrArena* a = ctx->rewriter.dst_arena;
+    Rewriter* r = &ctx->rewriter;
+
+    if (node->tag == Function_TAG && node->payload.fun.body) {
+        Rewriter* root = ctx->root_rewriter;
+        Node* new = function(ctx->rewriter.dst_module, recreate_variables(root, node->payload.fun.params), node->payload.fun.name, rewrite_nodes(root, node->payload.fun.annotations), rewrite_nodes(root, node->payload.fun.return_types));
+        register_processed(root, node, new);
+
+        Context fn_ctx = *ctx;
+        fn_ctx.rewriter = create_children_rewriter(root);
+        FnInfo fn = create_fn_info(node);
+        fn_ctx.fn = &fn;
+        fn_ctx.fun = new;
+        analyse_function(&fn_ctx, node, NULL);
+        register_processed_list(&fn_ctx.rewriter, node->payload.fun.params, new->payload.fun.params);
+        recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
+
+        destroy_fn_info(&fn);
+        destroy_rewriter(&fn_ctx.rewriter);
+        return new;
+    }
+
+    // declarations are shared between the functions and their clones
+    if (is_declaration(node))
+        return recreate_node_identity(ctx->root_rewriter, node);
+    if (!ctx->fn)
+        return recreate_node_identity(&ctx->rewriter, node);
+
+    switch (node->tag) {
+        case Case_TAG: {
+            Nodes old_params = get_abstraction_params(node);
+            Nodes new_params = recreate_variables(r, old_params);
+            register_processed_list(r, old_params, new_params);
+            return case_(a, new_params, rewrite_body_resolving_params(ctx, old_params, new_params, get_abstraction_body(node)));
+        }
+        case BasicBlock_TAG: {
+            Nodes old_params = get_abstraction_params(node);
+            Nodes new_params = recreate_variables(r, old_params);
+            register_processed_list(r, old_params, new_params);
+            Node* bb = basic_block(a, ctx->fun, new_params, get_abstraction_name(node));
+            register_processed(r, node, bb);
+            bb->payload.basic_block.body = rewrite_body_resolving_params(ctx, old_params, new_params, get_abstraction_body(node));
+            return bb;
+        }
+        case Let_TAG: {
+            const Node* instruction = get_let_instruction(node);
+            Nodes results = get_abstraction_params(get_let_tail(node));
+            if (instruction->tag != PrimOp_TAG || results.count != 1 || !is_generic_ptr_value(first(results)))
+                break;
+            PrimOp payload = instruction->payload.prim_op;
+            const Node* result = first(results);
+            if (payload.op == convert_op) {
+                set_resolved(ctx, result, rewrite_node(r, first(payload.operands)));
+                break;
+            }
+            const Node* resolved_base = payload.op == lea_op ? get_resolved(ctx, first(payload.operands)) : NULL;
+            if (!resolved_base)
+                break;
+            // the generic lea stays around for the other uses, it's dead code otherwise
+            BodyBuilder* bb = begin_body(a);
+            Nodes indices = nodes(a, payload.operands.count - 2, &payload.operands.nodes[2]);
+            set_resolved(ctx, result, gen_lea(bb, resolved_base, rewrite_node(r, payload.operands.nodes[1]), rewrite_nodes(r, indices)));
+            return finish_body(bb, recreate_node_identity(r, node));
+        }
+        case PrimOp_TAG: {
+            PrimOp payload = node->payload.prim_op;
+            switch (payload.op) {
+                case load_op: {
+                    const Node* resolved = get_resolved(ctx, first(payload.operands));
+                    if (!resolved)
+                        break;
+                    // loads through generic pointers are as uniform as the pointer, that's not true of every address space
+                    const Node* new = prim_op_helper(a, load_op, empty(a), singleton(resolved));
+                    if (is_qualified_type_uniform(node->type) && !is_qualified_type_uniform(new->type))
+                        break;
+                    return new;
+                }
+                case store_op: {
+                    const Node* resolved = get_resolved(ctx, first(payload.operands));
+                    if (!resolved)
+                        break;
+                    return prim_op_helper(a, store_op, empty(a), mk_nodes(a, resolved, rewrite_node(r, payload.operands.nodes[1])));
+                }
+                case convert_op: {
+                    const Node* resolved = get_resolved(ctx, first(payload.operands));
+                    if (!resolved || get_unqualified_type(resolved->type) != rewrite_node(r, first(payload.type_arguments)))
+                        break;
+                    return quote_helper(a, singleton(resolved));
+                }
+                default: break;
+            }
+            break;
+        }
+        case Call_TAG: {
+            const Node* new = process_call(ctx, node);
+            if (new)
+                return new;
+            break;
+        }
+        default: break;
+    }
+
+    return recreate_node_identity(&ctx->rewriter, node);
+}
+
+Module* opt_resolve_generic_ptrs(const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .config = config,
+        .clones = new_dict(CloneKey, Node*, (HashFn) hash_clone_key, (CmpFn) compare_clone_key),
+    };
+    ctx.root_rewriter = &ctx.rewriter;
+    rewrite_module(&ctx.rewriter);
+    destroy_dict(ctx.clones);
+    destroy_rewriter(&ctx.rewriter);
+    return dst;
+}
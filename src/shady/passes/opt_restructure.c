@@ -100,9 +100,8 @@ static const Node* handle_bb_callsite(Context* ctx, BodyBuilder* bb, const Node*
         DFSStackEntry dfs_entry = { .parent = ctx->dfs_stack, .old = dst, .containing_control = ctx->control_stack };
         ctx2.dfs_stack = &dfs_entry;
         
-        struct Dict* tmp_processed = clone_dict(ctx->rewriter.map);
-        append_list(struct Dict*, ctx->tmp_alloc_stack, tmp_processed);
-        ctx2.rewriter.map = tmp_processed;
+        ctx2.rewriter = create_children_rewriter(&ctx->rewriter);
+        append_list(struct Dict*, ctx->tmp_alloc_stack, ctx2.rewriter.map);
         for (size_t i = 0; i < oargs.count; i++) {
             nparams[i] = var(a, rewrite_node(&ctx->rewriter, oparams.nodes[i]->type), "arg");
             register_processed(&ctx2.rewriter, oparams.nodes[i], nparams[i]);
@@ -118,7 +117,7 @@ static const Node* handle_bb_callsite(Context* ctx, BodyBuilder* bb, const Node*
         const Node* structured = structure(&ctx2, dst, let(a, quote_helper(a, empty(a)), exit_ladder_trampoline));
         assert(is_terminator(structured));
         // forget we rewrote all that
-        destroy_dict(tmp_processed);
+        destroy_rewriter(&ctx2.rewriter);
         pop_list_impl(ctx->tmp_alloc_stack);
 
         if (dfs_entry.loop_header) {
@@ -361,7 +360,7 @@ static const Node* process(Context* ctx, const Node* node) {
         bool is_leaf = false;
         if (is_builtin || !node->payload.fun.body || lookup_annotation(node, "Structured") || setjmp(ctx2.bail)) {
             ctx2.lower = false;
-            ctx2.rewriter.map = ctx->rewriter.map;
+            ctx2.rewriter = ctx->rewriter;
             if (node->payload.fun.body)
                 new->payload.fun.body = rewrite_node(&ctx2.rewriter, node->payload.fun.body);
             // builtin functions are always considered leaf functions
@@ -373,9 +372,8 @@ static const Node* process(Context* ctx, const Node* node) {
             bind_instruction(bb, prim_op(a, (PrimOp) { .op = store_op, .operands = mk_nodes(a, ptr, int32_literal(a, 0)) }));
             ctx2.level_ptr = ptr;
             ctx2.fn = new;
-            struct Dict* tmp_processed = clone_dict(ctx->rewriter.map);
-            append_list(struct Dict*, ctx->tmp_alloc_stack, tmp_processed);
-            ctx2.rewriter.map = tmp_processed;
+            ctx2.rewriter = create_children_rewriter(&ctx->rewriter);
+            append_list(struct Dict*, ctx->tmp_alloc_stack, ctx2.rewriter.map);
             new->payload.fun.body = finish_body(bb, structure(&ctx2, node, unreachable(a)));
             is_leaf = true;
         }
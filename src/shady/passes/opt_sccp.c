@@ -0,0 +1,455 @@
+#include "passes.h"
+
+#include "log.h"
+#include "portability.h"
+#include "dict.h"
+
+#include "../rewrite.h"
+#include "../type.h"
+#include "../analysis/scope.h"
+#include "../analysis/uses.h"
+#include "../analysis/leak.h"
+
+#include <assert.h>
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+/// Variables that are absent from the lattice are not known to hold anything yet
+typedef struct {
+    enum { KnownConstant, Overdefined } kind;
+    /// A literal in the destination arena
+    const Node* value;
+} LatticeValue;
+
+/// The innermost structured constructs a case is nested in, that's where yields and merges go
+typedef struct {
+    const Node* construct;
+    const Node* loop;
+} Enclosing;
+
+typedef struct {
+    Scope* scope;
+    const UsesMap* uses;
+    /// Maps old variables to LatticeValue
+    struct Dict* lattice;
+    /// Set of the old abstractions that might run
+    struct Dict* executable;
+    /// Maps old cases to Enclosing
+    struct Dict* enclosing;
+    /// Maps the join points of static control constructs to the let binding them
+    struct Dict* join_points;
+    bool changed;
+} FnInfo;
+
+typedef struct {
+    Rewriter rewriter;
+    FnInfo* fn;
+} Context;
+
+static const LatticeValue overdefined = { .kind = Overdefined };
+
+/// @returns false if nothing is known about @p value yet
+static bool get_lattice_value(Context* ctx, const Node* value, LatticeValue* result) {
+    if (value->tag == Variable_TAG) {
+        LatticeValue* found = find_value_dict(const Node*, LatticeValue, ctx->fn->lattice, value);
+        if (found)
+            *result = *found;
+        return found;
+    }
+    if (is_literal(value)) {
+        *result = (LatticeValue) { .kind = KnownConstant, .value = rewrite_node(&ctx->rewriter, value) };
+        return true;
+    }
+    const IntLiteral* int_lit = resolve_to_int_literal(value);
+    if (int_lit) {
+        *result = (LatticeValue) { .kind = KnownConstant, .value = int_literal(ctx->rewriter.dst_arena, *int_lit) };
+        return true;
+    }
+    *result = overdefined;
+    return true;
+}
+
+static void meet(Context* ctx, const Node* var, LatticeValue value) {
+    LatticeValue* found = find_value_dict(const Node*, LatticeValue, ctx->fn->lattice, var);
+    if (!found) {
+        insert_dict(const Node*, LatticeValue, ctx->fn->lattice, var, value);
+        ctx->fn->changed = true;
+        return;
+    }
+    if (found->kind == Overdefined)
+        return;
+    if (value.kind == KnownConstant && value.value == found->value)
+        return;
+    *found = overdefined;
+    ctx->fn->changed = true;
+}
+
+static void meet_list(Context* ctx, Nodes vars, Nodes values) {
+    assert(vars.count == values.count);
+    for (size_t i = 0; i < vars.count; i++) {
+        LatticeValue value;
+        if (get_lattice_value(ctx, values.nodes[i], &value))
+            meet(ctx, vars.nodes[i], value);
+    }
+}
+
+static void meet_list_overdefined(Context* ctx, Nodes vars) {
+    for (size_t i = 0; i < vars.count; i++)
+        meet(ctx, vars.nodes[i], overdefined);
+}
+
+static void set_enclosing(Context* ctx, const Node* abs, Enclosing enclosing) {
+    if (!find_value_dict(const Node*, Enclosing, ctx->fn->enclosing, abs))
+        insert_dict(const Node*, Enclosing, ctx->fn->enclosing, abs, enclosing);
+}
+
+static void mark_executable(Context* ctx, const Node* abs, Enclosing enclosing) {
+    set_enclosing(ctx, abs, enclosing);
+    if (insert_set_get_result(const Node*, ctx->fn->executable, abs))
+        ctx->fn->changed = true;
+}
+
+static bool is_executable(Context* ctx, const Node* abs) {
+    return find_key_dict(const Node*, ctx->fn->executable, abs);
+}
+
+/// Abstractions we didn't see in the scope are left alone
+static bool is_dead(Context* ctx, const Node* abs) {
+    return find_value_dict(const Node*, CFNode*, ctx->fn->scope->map, abs) && !is_executable(ctx, abs);
+}
+
+static void visit_jump(Context* ctx, const Node* jump) {
+    assert(jump->tag == Jump_TAG);
+    const Node* target = jump->payload.jump.target;
+    meet_list(ctx, get_abstraction_params(target), jump->payload.jump.args);
+    mark_executable(ctx, target, (Enclosing) { 0 });
+}
+
+/// Figures out the values yielded by a primop, using the folding rules of the destination arena
+static void visit_prim_op(Context* ctx, const Node* instruction, Nodes results) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    PrimOp payload = instruction->payload.prim_op;
+    if (has_primop_got_side_effects(payload.op)) {
+        meet_list_overdefined(ctx, results);
+        return;
+    }
+    if (payload.op == quote_op) {
+        meet_list(ctx, results, payload.operands);
+        return;
+    }
+
+    LARRAY(const Node*, operands, payload.operands.count);
+    for (size_t i = 0; i < payload.operands.count; i++) {
+        LatticeValue value;
+        if (!get_lattice_value(ctx, payload.operands.nodes[i], &value))
+            return;
+        if (value.kind == Overdefined) {
+            meet_list_overdefined(ctx, results);
+            return;
+        }
+        operands[i] = value.value;
+    }
+
+    const Node* folded = prim_op(a, (PrimOp) {
+        .op = payload.op,
+        .type_arguments = rewrite_nodes(&ctx->rewriter, payload.type_arguments),
+        .operands = nodes(a, payload.operands.count, operands),
+    });
+    if (folded->tag == PrimOp_TAG && folded->payload.prim_op.op == quote_op && folded->payload.prim_op.operands.count == results.count) {
+        Nodes values = folded->payload.prim_op.operands;
+        for (size_t i = 0; i < results.count; i++)
+            meet(ctx, results.nodes[i], is_literal(values.nodes[i]) ? (LatticeValue) { .kind = KnownConstant, .value = values.nodes[i] } : overdefined);
+        return;
+    }
+    meet_list_overdefined(ctx, results);
+}
+
+static bool literal_matches(const Node* literal, const Node* value) {
+    const IntLiteral* a = resolve_to_int_literal(literal);
+    const IntLiteral* b = resolve_to_int_literal(value);
+    return a && b && get_int_literal_value(*a, false) == get_int_literal_value(*b, false);
+}
+
+static void visit_let(Context* ctx, const Node* let, Enclosing enclosing) {
+    const Node* instruction = get_let_instruction(let);
+    const Node* tail = get_let_tail(let);
+    Nodes results = get_abstraction_params(tail);
+    Enclosing inside = { .construct = let, .loop = enclosing.loop };
+    set_enclosing(ctx, tail, enclosing);
+    switch (instruction->tag) {
+        case PrimOp_TAG: visit_prim_op(ctx, instruction, results); break;
+        case If_TAG: {
+            If payload = instruction->payload.if_instr;
+            LatticeValue condition;
+            if (!get_lattice_value(ctx, payload.condition, &condition))
+                return;
+            bool true_live = condition.kind == Overdefined || condition.value->tag == True_TAG;
+            bool false_live = condition.kind == Overdefined || condition.value->tag == False_TAG;
+            if (true_live)
+                mark_executable(ctx, payload.if_true, inside);
+            if (false_live) {
+                if (payload.if_false)
+                    mark_executable(ctx, payload.if_false, inside);
+                else
+                    mark_executable(ctx, tail, enclosing);
+            }
+            // the tail only becomes executable once something yields to it
+            return;
+        }
+        case Match_TAG: {
+            Match payload = instruction->payload.match_instr;
+            LatticeValue inspectee;
+            if (!get_lattice_value(ctx, payload.inspect, &inspectee))
+                return;
+            bool matched = false;
+            for (size_t i = 0; i < payload.cases.count; i++) {
+                if (inspectee.kind == Overdefined || literal_matches(payload.literals.nodes[i], inspectee.value)) {
+                    mark_executable(ctx, payload.cases.nodes[i], inside);
+                    matched |= inspectee.kind == KnownConstant;
+                }
+            }
+            if (!matched)
+                mark_executable(ctx, payload.default_case, inside);
+            return;
+        }
+        case Loop_TAG: {
+            Loop payload = instruction->payload.loop_instr;
+            meet_list(ctx, get_abstraction_params(payload.body), payload.initial_args);
+            mark_executable(ctx, payload.body, (Enclosing) { .construct = let, .loop = let });
+            return;
+        }
+        case Block_TAG: {
+            mark_executable(ctx, instruction->payload.block.inside, inside);
+            return;
+        }
+        case Control_TAG: {
+            const Node* inside_case = instruction->payload.control.inside;
+            meet_list_overdefined(ctx, get_abstraction_params(inside_case));
+            mark_executable(ctx, inside_case, inside);
+            // if the join point doesn't leak, the results can only come from the joins we see
+            if (is_control_static(ctx->fn->uses, instruction)) {
+                const Node* jp = first(get_abstraction_params(inside_case));
+                if (!find_value_dict(const Node*, const Node*, ctx->fn->join_points, jp))
+                    insert_dict(const Node*, const Node*, ctx->fn->join_points, jp, let);
+                return;
+            }
+            meet_list_overdefined(ctx, results);
+            break;
+        }
+        default: meet_list_overdefined(ctx, results); break;
+    }
+    mark_executable(ctx, tail, enclosing);
+}
+
+/// Yields and breaks flow to the tail of the construct they're in
+static void yield_to(Context* ctx, const Node* construct, Nodes args) {
+    if (!construct)
+        return;
+    const Node* tail = get_let_tail(construct);
+    Enclosing* tail_enclosing = find_value_dict(const Node*, Enclosing, ctx->fn->enclosing, tail);
+    assert(tail_enclosing);
+    meet_list(ctx, get_abstraction_params(tail), args);
+    mark_executable(ctx, tail, *tail_enclosing);
+}
+
+static void visit_abstraction(Context* ctx, const Node* abs) {
+    const Node* body = get_abstraction_body(abs);
+    if (!body)
+        return;
+    Enclosing enclosing = { 0 };
+    Enclosing* found = find_value_dict(const Node*, Enclosing, ctx->fn->enclosing, abs);
+    if (found)
+        enclosing = *found;
+
+    switch (body->tag) {
+        case Let_TAG: visit_let(ctx, body, enclosing); break;
+        case Jump_TAG: visit_jump(ctx, body); break;
+        case Branch_TAG: {
+            LatticeValue condition;
+            if (!get_lattice_value(ctx, body->payload.branch.branch_condition, &condition))
+                break;
+            if (condition.kind == Overdefined || condition.value->tag == True_TAG)
+                visit_jump(ctx, body->payload.branch.true_jump);
+            if (condition.kind == Overdefined || condition.value->tag == False_TAG)
+                visit_jump(ctx, body->payload.branch.false_jump);
+            break;
+        }
+        case Switch_TAG: {
+            LatticeValue value;
+            if (!get_lattice_value(ctx, body->payload.br_switch.switch_value, &value))
+                break;
+            bool matched = false;
+            for (size_t i = 0; i < body->payload.br_switch.case_values.count; i++) {
+                if (value.kind == Overdefined || literal_matches(body->payload.br_switch.case_values.nodes[i], value.value)) {
+                    visit_jump(ctx, body->payload.br_switch.case_jumps.nodes[i]);
+                    matched |= value.kind == KnownConstant;
+                }
+            }
+            if (!matched)
+                visit_jump(ctx, body->payload.br_switch.default_jump);
+            break;
+        }
+        case Yield_TAG: {
+            yield_to(ctx, enclosing.construct, body->payload.yield.args);
+            break;
+        }
+        case Join_TAG: {
+            const Node** control = find_value_dict(const Node*, const Node*, ctx->fn->join_points, body->payload.join.join_point);
+            if (control)
+                yield_to(ctx, *control, body->payload.join.args);
+            break;
+        }
+        case MergeBreak_TAG: {
+            yield_to(ctx, enclosing.loop, body->payload.merge_break.args);
+            break;
+        }
+        case MergeContinue_TAG: {
+            if (enclosing.loop)
+                meet_list(ctx, get_abstraction_params(get_let_instruction(enclosing.loop)->payload.loop_instr.body), body->payload.merge_continue.args);
+            break;
+        }
+        default: break;
+    }
+}
+
+static void analyse_function(Context* ctx, const Node* fn) {
+    FnInfo* info = ctx->fn;
+    meet_list_overdefined(ctx, get_abstraction_params(fn));
+    mark_executable(ctx, fn, (Enclosing) { 0 });
+    // visiting in reverse post-order means we only need extra rounds for loops
+    do {
+        info->changed = false;
+        for (size_t i = 0; i < info->scope->size; i++) {
+            const Node* abs = info->scope->rpo[i]->node;
+            if (is_executable(ctx, abs))
+                visit_abstraction(ctx, abs);
+        }
+    } while (info->changed);
+}
+
+/// Variables that turned out to be constants are replaced, we still need to keep them around since they might be parameters
+static void register_params(Context* ctx, Nodes old_params, Nodes new_params) {
+    for (size_t i = 0; i < old_params.count; i++) {
+        LatticeValue* found = find_value_dict(const Node*, LatticeValue, ctx->fn->lattice, old_params.nodes[i]);
+        if (found && found->kind == KnownConstant)
+            register_processed(&ctx->rewriter, old_params.nodes[i], found->value);
+        else
+            register_processed(&ctx->rewriter, old_params.nodes[i], new_params.nodes[i]);
+    }
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found) return found;
+
+    IrArena* a = ctx->rewriter.dst_arena;
+
+    switch (node->tag) {
+        case Function_TAG: {
+            if (!node->payload.fun.body)
+                break;
+            Context fn_ctx = *ctx;
+            FnInfo fn = {
+                .lattice = new_dict(const Node*, LatticeValue, (HashFn) hash_node, (CmpFn) compare_node),
+                .executable = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+                .enclosing = new_dict(const Node*, Enclosing, (HashFn) hash_node, (CmpFn) compare_node),
+                .join_points = new_dict(const Node*, const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+            };
+            fn.scope = new_scope(node);
+            fn.uses = create_uses_map(node, (NcDeclaration | NcType));
+            fn_ctx.fn = &fn;
+            analyse_function(&fn_ctx, node);
+
+            Node* new = recreate_decl_header_identity(&fn_ctx.rewriter, node);
+            recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
+
+            destroy_dict(fn.lattice);
+            destroy_dict(fn.executable);
+            destroy_dict(fn.enclosing);
+            destroy_dict(fn.join_points);
+            destroy_uses_map(fn.uses);
+            destroy_scope(fn.scope);
+            return new;
+        }
+        case Constant_TAG:
+        case GlobalVariable_TAG:
+        case NominalType_TAG: {
+            Context decl_ctx = *ctx;
+            decl_ctx.fn = NULL;
+            return recreate_node_identity(&decl_ctx.rewriter, node);
+        }
+        default: break;
+    }
+
+    if (!ctx->fn)
+        return recreate_node_identity(&ctx->rewriter, node);
+
+    switch (node->tag) {
+        case Case_TAG: {
+            Nodes old_params = get_abstraction_params(node);
+            Nodes new_params = recreate_variables(&ctx->rewriter, old_params);
+            register_params(ctx, old_params, new_params);
+            if (is_dead(ctx, node))
+                return case_(a, new_params, unreachable(a));
+            return case_(a, new_params, rewrite_node(&ctx->rewriter, get_abstraction_body(node)));
+        }
+        case BasicBlock_TAG: {
+            Nodes old_params = get_abstraction_params(node);
+            Nodes new_params = recreate_variables(&ctx->rewriter, old_params);
+            register_params(ctx, old_params, new_params);
+            Node* bb = basic_block(a, (Node*) rewrite_node(&ctx->rewriter, node->payload.basic_block.fn), new_params, node->payload.basic_block.name);
+            register_processed(&ctx->rewriter, node, bb);
+            if (is_dead(ctx, node))
+                bb->payload.basic_block.body = unreachable(a);
+            else
+                bb->payload.basic_block.body = rewrite_node(&ctx->rewriter, get_abstraction_body(node));
+            return bb;
+        }
+        case If_TAG: {
+            If payload = node->payload.if_instr;
+            LatticeValue condition;
+            if (!get_lattice_value(ctx, payload.condition, &condition) || condition.kind != KnownConstant)
+                break;
+            Nodes yield_types = rewrite_nodes(&ctx->rewriter, payload.yield_types);
+            const Node* live = condition.value->tag == True_TAG ? payload.if_true : payload.if_false;
+            debugv_print("opt_sccp: folding away a branch of an if\n");
+            if (!live)
+                return quote_helper(a, empty(a));
+            return block(a, (Block) { .inside = rewrite_node(&ctx->rewriter, live), .yield_types = add_qualifiers(a, yield_types, false) });
+        }
+        case Branch_TAG: {
+            LatticeValue condition;
+            if (!get_lattice_value(ctx, node->payload.branch.branch_condition, &condition) || condition.kind != KnownConstant)
+                break;
+            debugv_print("opt_sccp: folding a branch\n");
+            return rewrite_node(&ctx->rewriter, condition.value->tag == True_TAG ? node->payload.branch.true_jump : node->payload.branch.false_jump);
+        }
+        case Switch_TAG: {
+            LatticeValue value;
+            if (!get_lattice_value(ctx, node->payload.br_switch.switch_value, &value) || value.kind != KnownConstant)
+                break;
+            debugv_print("opt_sccp: folding a switch\n");
+            for (size_t i = 0; i < node->payload.br_switch.case_values.count; i++) {
+                if (literal_matches(node->payload.br_switch.case_values.nodes[i], value.value))
+                    return rewrite_node(&ctx->rewriter, node->payload.br_switch.case_jumps.nodes[i]);
+            }
+            return rewrite_node(&ctx->rewriter, node->payload.br_switch.default_jump);
+        }
+        default: break;
+    }
+
+    return recreate_node_identity(&ctx->rewriter, node);
+}
+
+Module* opt_sccp(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+    };
+    rewrite_module(&ctx.rewriter);
+    destroy_rewriter(&ctx.rewriter);
+    return dst;
+}
@@ -0,0 +1,360 @@
+#include "passes.h"
+
+#include "dict.h"
+#include "list.h"
+#include "arena.h"
+#include "portability.h"
+#include "util.h"
+#include "log.h"
+
+#include "../rewrite.h"
+#include "../type.h"
+#include "../ir_private.h"
+
+#include "../analysis/callgraph.h"
+#include "../analysis/scope.h"
+
+#include <assert.h>
+
+/// What the parameters of a callee are bound to: either a constant argument, which removes the parameter,
+/// or the (possibly more uniform) type the parameter gets in the clone
+typedef struct {
+    const Node* callee;
+    Nodes bindings;
+} SpecializationKey;
+
+typedef struct {
+    SpecializationKey key;
+    size_t index;
+    /// created lazily, when the first call site using it gets rewritten
+    Node* clone;
+} Specialization;
+
+/// Call instructions are hash-consed, so the same one might show up in different functions
+typedef struct {
+    const Node* src_fn;
+    const Node* instr;
+} CallSite;
+
+typedef struct Context_ {
+    Rewriter rewriter;
+    /// clones are rewritten from the callee's body, next to (not inside of) the function we're in
+    Rewriter* root_rewriter;
+    const CompilerConfig* config;
+    CallGraph* graph;
+    Arena* arena;
+    /// @ref Dict from @ref SpecializationKey to @ref Specialization*
+    struct Dict* specializations;
+    /// @ref Dict from @ref CallSite to @ref Specialization*
+    struct Dict* decisions;
+    /// @ref Dict from const @ref Node* to size_t
+    struct Dict* fn_sizes;
+    /// functions we can remove entirely, because all the calls to them were redirected to clones
+    struct Dict* eliminated;
+    size_t clones_count;
+    const Node* old_fun;
+    Node* fun;
+} Context;
+
+static KeyHash hash_specialization_key(SpecializationKey* key) {
+    return hash_murmur(key, sizeof(SpecializationKey));
+}
+
+static bool compare_specialization_key(SpecializationKey* a, SpecializationKey* b) {
+    return a->callee == b->callee && a->bindings.nodes == b->bindings.nodes;
+}
+
+static KeyHash hash_call_site(CallSite* site) {
+    return hash_murmur(site, sizeof(CallSite));
+}
+
+static bool compare_call_site(CallSite* a, CallSite* b) {
+    return a->src_fn == b->src_fn && a->instr == b->instr;
+}
+
+static bool is_constant_argument(const Node* arg) {
+    switch (arg->tag) {
+        case IntLiteral_TAG:
+        case FloatLiteral_TAG:
+        case True_TAG:
+        case False_TAG: return true;
+        default: return false;
+    }
+}
+
+static bool is_call_specializable(const Node* src_fn, const Node* dst_fn) {
+    if (lookup_annotation(src_fn, "Internal") || lookup_annotation(dst_fn, "Internal"))
+        return false;
+    if (lookup_annotation(dst_fn, "NoInline"))
+        return false;
+    if (!dst_fn->payload.fun.body)
+        return false;
+    return true;
+}
+
+static bool is_fn_safely_removable(const Node* fn) {
+    if (lookup_annotation(fn, "Internal"))
+        return false;
+    if (lookup_annotation(fn, "EntryPoint"))
+        return false;
+    if (lookup_annotation(fn, "Exported"))
+        return false;
+    return true;
+}
+
+static size_t get_fn_size(Context* ctx, const Node* fn) {
+    size_t* found = find_value_dict(const Node*, size_t, ctx->fn_sizes, fn);
+    if (found)
+        return *found;
+    Scope* scope = new_scope(fn);
+    size_t size = scope_count_instructions(scope);
+    destroy_scope(scope);
+    insert_dict(const Node*, size_t, ctx->fn_sizes, fn, size);
+    return size;
+}
+
+/// Works out what a clone for this call site would look like, returns false if it would be no different from the callee.
+/// Uniformity is only exploited for regular calls: threads coming from different tail calls can be scheduled together.
+static bool compute_bindings(IrArena* a, const Node* callee, Nodes args, bool is_tail_call, Nodes* bindings) {
+    Nodes params = get_abstraction_params(callee);
+    if (params.count != args.count)
+        return false;
+    bool changed = false;
+    LARRAY(const Node*, arr, params.count);
+    for (size_t i = 0; i < params.count; i++) {
+        const Node* param = params.nodes[i];
+        const Node* arg = args.nodes[i];
+        arr[i] = param->type;
+        if (is_constant_argument(arg)) {
+            arr[i] = arg;
+            changed = true;
+        } else if (!is_tail_call && !is_qualified_type_uniform(param->type) && is_qualified_type_uniform(arg->type)) {
+            arr[i] = qualified_type_helper(get_unqualified_type(param->type), true);
+            changed = true;
+        }
+    }
+    *bindings = nodes(a, params.count, arr);
+    return changed;
+}
+
+static Specialization* decide_specialization(Context* ctx, CGEdge e) {
+    const Node* src_fn = e.src_fn->fn;
+    const Node* dst_fn = e.dst_fn->fn;
+    if (!is_call_specializable(src_fn, dst_fn))
+        return NULL;
+    // a clone of a function calling itself would still call the original
+    if (e.dst_fn->is_recursive || e.src_fn->scc == e.dst_fn->scc)
+        return NULL;
+
+    bool is_tail_call = e.instr->tag == TailCall_TAG;
+    Nodes args = is_tail_call ? e.instr->payload.tail_call.args : e.instr->payload.call.args;
+    SpecializationKey key = { .callee = dst_fn };
+    if (!compute_bindings(dst_fn->arena, dst_fn, args, is_tail_call, &key.bindings))
+        return NULL;
+
+    Specialization** found = find_value_dict(SpecializationKey, Specialization*, ctx->specializations, key);
+    if (found)
+        return *found;
+    if (ctx->clones_count >= ctx->config->optimisations.specialization.max_clones)
+        return NULL;
+    if (get_fn_size(ctx, dst_fn) > ctx->config->optimisations.specialization.max_callee_size)
+        return NULL;
+
+    Specialization* spec = arena_alloc(ctx->arena, sizeof(Specialization));
+    *spec = (Specialization) { .key = key, .index = ctx->clones_count++ };
+    insert_dict(SpecializationKey, Specialization*, ctx->specializations, key, spec);
+    return spec;
+}
+
+static void compute_specialization_decisions(Context* ctx) {
+    struct List* order = callgraph_bottom_up_order(ctx->graph);
+    for (size_t i = 0; i < entries_count_list(order); i++) {
+        CGNode* fn_node = read_list(CGNode*, order)[i];
+        size_t iter = 0;
+        CGEdge e;
+        while (dict_iter(fn_node->callees, &iter, &e, NULL)) {
+            Specialization* spec = decide_specialization(ctx, e);
+            if (!spec)
+                continue;
+            CallSite site = { .src_fn = fn_node->fn, .instr = e.instr };
+            insert_dict(CallSite, Specialization*, ctx->decisions, site, spec);
+        }
+    }
+
+    // the original can go away when every call to it got redirected, and nothing else can observe it
+    for (size_t i = 0; i < entries_count_list(order); i++) {
+        CGNode* fn_node = read_list(CGNode*, order)[i];
+        if (fn_node->is_address_captured || !is_fn_safely_removable(fn_node->fn) || entries_count_dict(fn_node->callers) == 0)
+            continue;
+        bool all_specialized = true;
+        size_t iter = 0;
+        CGEdge e;
+        while (dict_iter(fn_node->callers, &iter, &e, NULL)) {
+            CallSite site = { .src_fn = e.src_fn->fn, .instr = e.instr };
+            all_specialized &= find_value_dict(CallSite, Specialization*, ctx->decisions, site) != NULL;
+        }
+        if (all_specialized)
+            insert_set_get_result(const Node*, ctx->eliminated, fn_node->fn);
+    }
+}
+
+static Specialization* find_specialization(Context* ctx, const Node* instr) {
+    if (!ctx->old_fun)
+        return NULL;
+    CallSite site = { .src_fn = ctx->old_fun, .instr = instr };
+    Specialization** found = find_value_dict(CallSite, Specialization*, ctx->decisions, site);
+    return found ? *found : NULL;
+}
+
+static Node* get_or_create_clone(Context* ctx, Specialization* spec) {
+    if (spec->clone)
+        return spec->clone;
+
+    IrArena* a = ctx->rewriter.dst_arena;
+    Rewriter* root = ctx->root_rewriter;
+    const Node* ocallee = spec->key.callee;
+    Nodes oparams = get_abstraction_params(ocallee);
+    Nodes bindings = spec->key.bindings;
+
+    Context clone_ctx = *ctx;
+    clone_ctx.rewriter = create_children_rewriter(root);
+    struct List* nparams = new_list(const Node*);
+    for (size_t i = 0; i < oparams.count; i++) {
+        const Node* oparam = oparams.nodes[i];
+        if (is_type(bindings.nodes[i])) {
+            const Node* nparam = var(a, rewrite_node(root, bindings.nodes[i]), oparam->payload.var.name);
+            append_list(const Node*, nparams, nparam);
+            register_processed(&clone_ctx.rewriter, oparam, nparam);
+        } else {
+            register_processed(&clone_ctx.rewriter, oparam, rewrite_node(root, bindings.nodes[i]));
+        }
+    }
+
+    Nodes annotations = rewrite_nodes(root, ocallee->payload.fun.annotations);
+    annotations = filter_out_annotation(a, annotations, "Exported");
+    annotations = filter_out_annotation(a, annotations, "EntryPoint");
+    String name = format_string_arena(a->arena, "%s_specialized_%zu", get_abstraction_name(ocallee), spec->index);
+    Node* clone = function(ctx->rewriter.dst_module, nodes(a, entries_count_list(nparams), read_list(const Node*, nparams)), name, annotations, rewrite_nodes(root, ocallee->payload.fun.return_types));
+    destroy_list(nparams);
+    spec->clone = clone;
+    debugv_print("Specializing %s into %s\n", get_abstraction_name(ocallee), name);
+
+    clone_ctx.old_fun = ocallee;
+    clone_ctx.fun = clone;
+    clone->payload.fun.body = rewrite_node(&clone_ctx.rewriter, get_abstraction_body(ocallee));
+    destroy_rewriter(&clone_ctx.rewriter);
+    return clone;
+}
+
+static Nodes rewrite_remaining_args(Context* ctx, Specialization* spec, Nodes oargs) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    LARRAY(const Node*, nargs, oargs.count);
+    size_t count = 0;
+    for (size_t i = 0; i < oargs.count; i++) {
+        if (is_type(spec->key.bindings.nodes[i]))
+            nargs[count++] = rewrite_node(&ctx->rewriter, oargs.nodes[i]);
+    }
+    return nodes(a, count, nargs);
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    if (!node)
+        return NULL;
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found)
+        return found;
+
+    IrArena* a = ctx->rewriter.dst_arena;
+    Rewriter* r = &ctx->rewriter;
+
+    switch (node->tag) {
+        case Function_TAG: {
+            if (find_key_dict(const Node*, ctx->eliminated, node)) {
+                debugv_print("Eliminating %s because all the calls to it were specialized\n", get_abstraction_name(node));
+                return NULL;
+            }
+
+            Nodes annotations = rewrite_nodes(&ctx->rewriter, node->payload.fun.annotations);
+            Node* new = function(ctx->rewriter.dst_module, recreate_variables(&ctx->rewriter, node->payload.fun.params), node->payload.fun.name, annotations, rewrite_nodes(&ctx->rewriter, node->payload.fun.return_types));
+            register_processed(r, node, new);
+
+            Context fn_ctx = *ctx;
+            fn_ctx.rewriter = create_children_rewriter(&ctx->rewriter);
+            fn_ctx.old_fun = node;
+            fn_ctx.fun = new;
+            register_processed_list(&fn_ctx.rewriter, node->payload.fun.params, new->payload.fun.params);
+            recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
+            destroy_rewriter(&fn_ctx.rewriter);
+            return new;
+        }
+        case Call_TAG: {
+            Specialization* spec = find_specialization(ctx, node);
+            if (!spec)
+                break;
+            Node* clone = get_or_create_clone(ctx, spec);
+            return call(a, (Call) {
+                .callee = fn_addr_helper(a, clone),
+                .args = rewrite_remaining_args(ctx, spec, node->payload.call.args),
+            });
+        }
+        case TailCall_TAG: {
+            Specialization* spec = find_specialization(ctx, node);
+            if (!spec)
+                break;
+            Node* clone = get_or_create_clone(ctx, spec);
+            return tail_call(a, (TailCall) {
+                .target = fn_addr_helper(a, clone),
+                .args = rewrite_remaining_args(ctx, spec, node->payload.tail_call.args),
+            });
+        }
+        case BasicBlock_TAG: {
+            // the basic blocks of a clone belong to it, not to the function they were cloned from
+            if (!ctx->fun)
+                break;
+            Nodes nparams = recreate_variables(r, get_abstraction_params(node));
+            register_processed_list(r, get_abstraction_params(node), nparams);
+            Node* bb = basic_block(a, ctx->fun, nparams, get_abstraction_name(node));
+            register_processed(r, node, bb);
+            bb->payload.basic_block.body = rewrite_node(r, get_abstraction_body(node));
+            return bb;
+        }
+        default: break;
+    }
+
+    const Node* new = recreate_node_identity(&ctx->rewriter, node);
+    if (node->tag == Case_TAG)
+        register_processed(&ctx->rewriter, node, new);
+    return new;
+}
+
+KeyHash hash_node(const Node**);
+bool compare_node(const Node**, const Node**);
+
+Module* opt_specialize(const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .config = config,
+        .graph = new_callgraph(src),
+        .arena = new_arena(),
+        .specializations = new_dict(SpecializationKey, Specialization*, (HashFn) hash_specialization_key, (CmpFn) compare_specialization_key),
+        .decisions = new_dict(CallSite, Specialization*, (HashFn) hash_call_site, (CmpFn) compare_call_site),
+        .fn_sizes = new_dict(const Node*, size_t, (HashFn) hash_node, (CmpFn) compare_node),
+        .eliminated = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+    };
+    ctx.root_rewriter = &ctx.rewriter;
+    compute_specialization_decisions(&ctx);
+
+    rewrite_module(&ctx.rewriter);
+
+    destroy_callgraph(ctx.graph);
+    destroy_dict(ctx.specializations);
+    destroy_dict(ctx.decisions);
+    destroy_dict(ctx.fn_sizes);
+    destroy_dict(ctx.eliminated);
+    destroy_arena(ctx.arena);
+    destroy_rewriter(&ctx.rewriter);
+    return dst;
+}
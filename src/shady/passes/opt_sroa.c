@@ -0,0 +1,216 @@
+#include "passes.h"
+
+#include "log.h"
+#include "portability.h"
+#include "dict.h"
+
+#include "../rewrite.h"
+#include "../type.h"
+#include "../transform/ir_gen_helpers.h"
+#include "../analysis/uses.h"
+
+#include <assert.h>
+
+/// Splitting bigger aggregates turns every whole load or store into that many accesses
+#define MAX_SPLIT_WIDTH 64
+
+KeyHash hash_node(const Node**);
+bool compare_node(const Node**, const Node**);
+
+typedef struct {
+    Rewriter rewriter;
+    const UsesMap* uses;
+    /// Maps the old variables bound to split allocas to the @ref Nodes holding the allocas for each element
+    struct Dict* split;
+    bool todo;
+} Context;
+
+static size_t get_split_width(const Type* t) {
+    t = get_maybe_nominal_type_body(t);
+    switch (t->tag) {
+        case RecordType_TAG: {
+            if (t->payload.record_type.special != NotSpecial)
+                return 0;
+            return t->payload.record_type.members.count;
+        }
+        case ArrType_TAG: {
+            if (!t->payload.arr_type.size)
+                return 0;
+            const IntLiteral* size = resolve_to_int_literal(t->payload.arr_type.size);
+            return size ? get_int_literal_value(*size, false) : 0;
+        }
+        case PackType_TAG: return t->payload.pack_type.width;
+        default: return 0;
+    }
+}
+
+static const Type* get_split_element_type(const Type* t, size_t i) {
+    t = get_maybe_nominal_type_body(t);
+    switch (t->tag) {
+        case RecordType_TAG: return t->payload.record_type.members.nodes[i];
+        case ArrType_TAG: return t->payload.arr_type.element_type;
+        case PackType_TAG: return t->payload.pack_type.element_type;
+        default: SHADY_UNREACHABLE;
+    }
+}
+
+/// Returns the element a lea into a split alloca starts with, or -1 if it isn't a constant one in bounds.
+static int64_t get_split_lea_element(Nodes operands, size_t width) {
+    if (operands.count < 3)
+        return -1;
+    const IntLiteral* offset = resolve_to_int_literal(operands.nodes[1]);
+    const IntLiteral* index = resolve_to_int_literal(operands.nodes[2]);
+    if (!offset || get_int_literal_value(*offset, false) != 0 || !index)
+        return -1;
+    uint64_t i = get_int_literal_value(*index, false);
+    return i < width ? (int64_t) i : -1;
+}
+
+/// The alloca can be split if its address never escapes and it's only ever addressed as a whole or with a constant first index.
+static bool is_splittable(Context* ctx, const Node* ptr, size_t width) {
+    for (const Use* use = get_first_use(ctx->uses, ptr); use; use = use->next_use) {
+        if (is_abstraction(use->user) && use->operand_class == NcVariable)
+            continue;
+        if (use->user->tag != PrimOp_TAG)
+            return false;
+        PrimOp payload = use->user->payload.prim_op;
+        for (size_t i = 1; i < payload.operands.count; i++)
+            if (payload.operands.nodes[i] == ptr)
+                return false;
+        switch (payload.op) {
+            case load_op:
+            case store_op: continue;
+            case lea_op: {
+                if (get_split_lea_element(payload.operands, width) < 0)
+                    return false;
+                continue;
+            }
+            default: return false;
+        }
+    }
+    return true;
+}
+
+static const Node* process_let(Context* ctx, const Node* node) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    const Node* oinstruction = get_let_instruction(node);
+    if (oinstruction->tag != PrimOp_TAG)
+        return NULL;
+    PrimOp payload = oinstruction->payload.prim_op;
+    if (payload.op != alloca_op && payload.op != alloca_logical_op)
+        return NULL;
+
+    const Node* otail = get_let_tail(node);
+    const Node* ovar = first(get_abstraction_params(otail));
+    const Type* otype = first(payload.type_arguments);
+    size_t width = get_split_width(otype);
+    if (width == 0 || width > MAX_SPLIT_WIDTH || !is_splittable(ctx, ovar, width))
+        return NULL;
+
+    debugv_print("opt_sroa: splitting ");
+    log_node(DEBUGV, ovar);
+    debugv_print(" into %d allocas\n", width);
+    ctx->todo = true;
+
+    BodyBuilder* bb = begin_body(a);
+    LARRAY(const Node*, elements, width);
+    for (size_t i = 0; i < width; i++) {
+        const Type* element_type = rewrite_node(&ctx->rewriter, get_split_element_type(otype, i));
+        elements[i] = gen_primop_e(bb, payload.op, singleton(element_type), rewrite_nodes(&ctx->rewriter, payload.operands));
+    }
+    Nodes split = nodes(a, width, elements);
+    insert_dict(const Node*, Nodes, ctx->split, ovar, split);
+    return finish_body(bb, rewrite_node(&ctx->rewriter, get_abstraction_body(otail)));
+}
+
+static const Node* process_access(Context* ctx, const Node* node) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    PrimOp payload = node->payload.prim_op;
+    if (payload.op != load_op && payload.op != store_op && payload.op != lea_op)
+        return NULL;
+    const Node* optr = first(payload.operands);
+    Nodes* found = find_value_dict(const Node*, Nodes, ctx->split, optr);
+    if (!found)
+        return NULL;
+    Nodes split = *found;
+
+    const Type* otype = get_pointer_type_element(get_unqualified_type(optr->type));
+    BodyBuilder* bb = begin_body(a);
+    switch (payload.op) {
+        case lea_op: {
+            const Node* element = split.nodes[get_split_lea_element(payload.operands, split.count)];
+            if (payload.operands.count > 3) {
+                Nodes rest = rewrite_nodes(&ctx->rewriter, nodes(a, payload.operands.count - 3, &payload.operands.nodes[3]));
+                element = gen_lea(bb, element, int32_literal(a, 0), rest);
+            }
+            return yield_values_and_wrap_in_block(bb, singleton(element));
+        }
+        case load_op: {
+            LARRAY(const Node*, values, split.count);
+            for (size_t i = 0; i < split.count; i++)
+                values[i] = gen_load(bb, split.nodes[i]);
+            const Node* value = composite_helper(a, rewrite_node(&ctx->rewriter, otype), nodes(a, split.count, values));
+            return yield_values_and_wrap_in_block(bb, singleton(value));
+        }
+        case store_op: {
+            const Node* value = rewrite_node(&ctx->rewriter, payload.operands.nodes[1]);
+            for (size_t i = 0; i < split.count; i++)
+                gen_store(bb, split.nodes[i], gen_extract(bb, value, singleton(int32_literal(a, i))));
+            return yield_values_and_wrap_in_block(bb, empty(a));
+        }
+        default: SHADY_UNREACHABLE;
+    }
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found) return found;
+
+    switch (node->tag) {
+        case Function_TAG: {
+            Context fn_ctx = *ctx;
+            fn_ctx.uses = create_uses_map(node, (NcDeclaration | NcType));
+            Node* new = recreate_decl_header_identity(&fn_ctx.rewriter, node);
+            recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
+            destroy_uses_map(fn_ctx.uses);
+            ctx->todo |= fn_ctx.todo;
+            return new;
+        }
+        case Let_TAG: {
+            if (!ctx->uses)
+                break;
+            const Node* new = process_let(ctx, node);
+            if (new)
+                return new;
+            break;
+        }
+        case PrimOp_TAG: {
+            if (!ctx->uses)
+                break;
+            const Node* new = process_access(ctx, node);
+            if (new)
+                return new;
+            break;
+        }
+        default: break;
+    }
+
+    return recreate_node_identity(&ctx->rewriter, node);
+}
+
+bool opt_sroa(SHADY_UNUSED const CompilerConfig* config, Module** m) {
+    Module* src = *m;
+    IrArena* a = get_module_arena(src);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .split = new_dict(const Node*, Nodes, (HashFn) hash_node, (CmpFn) compare_node),
+        .todo = false,
+    };
+    ctx.rewriter.config.rebind_let = true;
+    rewrite_module(&ctx.rewriter);
+    destroy_rewriter(&ctx.rewriter);
+    destroy_dict(ctx.split);
+    *m = dst;
+    return ctx.todo;
+}
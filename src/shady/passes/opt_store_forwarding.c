@@ -0,0 +1,397 @@
+#include "passes.h"
+
+#include "log.h"
+#include "portability.h"
+#include "dict.h"
+#include "list.h"
+
+#include "../rewrite.h"
+#include "../type.h"
+#include "../analysis/scope.h"
+#include "../analysis/uses.h"
+#include "../transform/memory_layout.h"
+
+#include <assert.h>
+#include <string.h>
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+typedef enum {
+    /// Plain load or store on a logical pointer, offsets are counted in elements of the root
+    LogicalAccess,
+    /// Call to one of the functions lower_physical_ptrs generates, offsets are counted in bytes
+    EmulatedAccess,
+} AccessKind;
+
+/// Where an access goes: @p offset and @p size are only meaningful relative to the same root, kind and base
+typedef struct {
+    AccessKind kind;
+    /// Either a global variable or a local alloca, NULL if we don't know what the pointer points to
+    const Node* root;
+    AddressSpace as;
+    /// Accesses the root as a whole, rather than some element in it
+    bool whole;
+    /// Non-constant part of the offset, NULL if the offset is constant
+    const Node* base;
+    int64_t offset;
+    uint64_t size;
+} Address;
+
+typedef struct {
+    enum { NoAccess, Load, Store, Clobber } tag;
+    Address address;
+    const Type* type;
+    /// The stored value for stores
+    const Node* value;
+} Access;
+
+/// What we know about memory at some point of a let chain
+typedef struct {
+    Address address;
+    const Type* type;
+    /// Value currently held at that address
+    const Node* value;
+    /// Store that nothing read since, NULL otherwise
+    const Node* pending_store;
+} Entry;
+
+typedef struct {
+    Rewriter rewriter;
+    /// Uses in the function being analysed
+    const UsesMap* uses;
+    /// Old store lets that are overwritten before anything reads them
+    struct Dict* dead_stores;
+    /// Maps old load lets to the old value they'll read
+    struct Dict* forwarded;
+} Context;
+
+/// Only the invocation itself can see those, so nothing else can write to them behind our back
+static bool is_thread_private(AddressSpace as) {
+    switch (as) {
+        case AsFunctionLogical:
+        case AsPrivateLogical: return true;
+        default: return false;
+    }
+}
+
+static const Node* get_definition(const Node* value, Op op) {
+    if (value->tag != Variable_TAG)
+        return NULL;
+    const Node* def = get_var_def(value->payload.var);
+    if (!def || def->tag != PrimOp_TAG || def->payload.prim_op.op != op)
+        return NULL;
+    return def;
+}
+
+/// Splits an offset into a variable base and a constant
+static void decompose_offset(const Node* value, const Node** base, int64_t* offset) {
+    *offset = 0;
+    while (true) {
+        const IntLiteral* lit = resolve_to_int_literal(value);
+        if (lit) {
+            *offset += get_int_literal_value(*lit, true);
+            *base = NULL;
+            return;
+        }
+        const Node* def = get_definition(value, add_op);
+        if (def) {
+            Nodes operands = def->payload.prim_op.operands;
+            const IntLiteral* rhs = resolve_to_int_literal(operands.nodes[1]);
+            const IntLiteral* lhs = resolve_to_int_literal(operands.nodes[0]);
+            if (rhs || lhs) {
+                *offset += get_int_literal_value(rhs ? *rhs : *lhs, true);
+                value = rhs ? operands.nodes[0] : operands.nodes[1];
+                continue;
+            }
+        }
+        *base = value;
+        return;
+    }
+}
+
+static AddressSpace get_pointer_address_space(const Node* ptr) {
+    const Type* ptr_t = get_unqualified_type(ptr->type);
+    assert(ptr_t->tag == PtrType_TAG);
+    return ptr_t->payload.ptr_type.address_space;
+}
+
+static const Node* get_root(const Node* ptr) {
+    if (ptr->tag == RefDecl_TAG && ptr->payload.ref_decl.decl->tag == GlobalVariable_TAG)
+        return ptr->payload.ref_decl.decl;
+    if (get_definition(ptr, alloca_logical_op))
+        return ptr;
+    return NULL;
+}
+
+static Address get_logical_address(const Node* ptr) {
+    Address address = {
+        .kind = LogicalAccess,
+        .as = get_pointer_address_space(ptr),
+        .root = get_root(ptr),
+        .whole = true,
+        .size = 1,
+    };
+    if (address.root)
+        return address;
+    // the emulated memory is accessed with lea(words, 0, offset)
+    const Node* lea = get_definition(ptr, lea_op);
+    if (!lea || lea->payload.prim_op.operands.count != 3)
+        return address;
+    Nodes operands = lea->payload.prim_op.operands;
+    const IntLiteral* first_offset = resolve_to_int_literal(operands.nodes[1]);
+    address.root = get_root(operands.nodes[0]);
+    if (!address.root || !first_offset || get_int_literal_value(*first_offset, false) != 0) {
+        address.root = NULL;
+        return address;
+    }
+    address.whole = false;
+    decompose_offset(operands.nodes[2], &address.base, &address.offset);
+    return address;
+}
+
+static Access classify_call(Context* ctx, const Node* instruction) {
+    const Node* callee = instruction->payload.call.callee;
+    if (callee->tag != FnAddr_TAG)
+        return (Access) { .tag = Clobber };
+    const Node* fn = callee->payload.fn_addr.fn;
+    const Node* load = lookup_annotation(fn, "EmulatedLoad");
+    const Node* store = lookup_annotation(fn, "EmulatedStore");
+    if (!load && !store)
+        return (Access) { .tag = Clobber };
+
+    const Node* words = get_annotation_value(load ? load : store);
+    Nodes args = instruction->payload.call.args;
+    const Type* type = get_unqualified_type(load ? first(fn->payload.fun.return_types) : fn->payload.fun.params.nodes[1]->type);
+    Access access = {
+        .tag = load ? Load : Store,
+        .address = {
+            .kind = EmulatedAccess,
+            .root = get_root(words),
+            .as = get_pointer_address_space(words),
+            .size = get_mem_layout(ctx->rewriter.src_arena, type).size_in_bytes,
+        },
+        .type = type,
+        .value = store ? args.nodes[1] : NULL,
+    };
+    decompose_offset(first(args), &access.address.base, &access.address.offset);
+    return access;
+}
+
+static Access classify_instruction(Context* ctx, const Node* instruction) {
+    switch (instruction->tag) {
+        case Call_TAG: return classify_call(ctx, instruction);
+        case PrimOp_TAG: {
+            PrimOp payload = instruction->payload.prim_op;
+            switch (payload.op) {
+                case load_op:
+                case store_op: {
+                    const Node* ptr = first(payload.operands);
+                    const Type* ptr_t = get_unqualified_type(ptr->type);
+                    return (Access) {
+                        .tag = payload.op == load_op ? Load : Store,
+                        .address = get_logical_address(ptr),
+                        .type = ptr_t->payload.ptr_type.pointed_type,
+                        .value = payload.op == store_op ? payload.operands.nodes[1] : NULL,
+                    };
+                }
+                default: break;
+            }
+            if (has_primop_got_side_effects(payload.op))
+                return (Access) { .tag = Clobber };
+            return (Access) { .tag = NoAccess };
+        }
+        default: return (Access) { .tag = Clobber };
+    }
+}
+
+/// Calls can't see allocas that are only ever loaded from or stored to directly
+static bool is_escaping(Context* ctx, const Node* root) {
+    if (root->tag != Variable_TAG)
+        return true;
+    for (const Use* use = get_first_use(ctx->uses, root); use; use = use->next_use) {
+        const Node* user = use->user;
+        if (user->tag == Case_TAG)
+            continue;
+        if (user->tag != PrimOp_TAG)
+            return true;
+        Nodes operands = user->payload.prim_op.operands;
+        switch (user->payload.prim_op.op) {
+            case load_op: break;
+            case store_op: if (operands.nodes[1] == root) return true; break;
+            default: return true;
+        }
+    }
+    return false;
+}
+
+static bool may_alias(const Address* a, const Address* b) {
+    if (a->as != b->as)
+        return false;
+    if (!a->root || !b->root)
+        return true;
+    if (a->root != b->root)
+        return false;
+    if (a->kind != b->kind || a->whole || b->whole || a->base != b->base)
+        return true;
+    return a->offset < b->offset + (int64_t) b->size && b->offset < a->offset + (int64_t) a->size;
+}
+
+static bool same_address(const Address* a, const Address* b) {
+    return a->root && a->kind == b->kind && a->root == b->root && a->whole == b->whole && a->base == b->base && a->offset == b->offset && a->size == b->size;
+}
+
+static void forget_all(struct List* entries) {
+    while (entries_count_list(entries) > 0)
+        pop_list_impl(entries);
+}
+
+static void remove_entry(struct List* entries, size_t i) {
+    size_t last = entries_count_list(entries) - 1;
+    read_list(Entry, entries)[i] = read_list(Entry, entries)[last];
+    pop_list_impl(entries);
+}
+
+static bool is_followed_instruction(const Node* instruction) {
+    return instruction->tag == PrimOp_TAG || instruction->tag == Call_TAG;
+}
+
+/// Walks one let chain, tracking what its loads and stores do to thread-private memory.
+/// Structured constructs end the chain, their tail starts a new one.
+static void analyse_let_chain(Context* ctx, struct List* entries, const Node* abs) {
+    forget_all(entries);
+    for (const Node* body = get_abstraction_body(abs); body && body->tag == Let_TAG; body = get_abstraction_body(get_let_tail(body))) {
+        const Node* instruction = get_let_instruction(body);
+        if (!is_followed_instruction(instruction))
+            break;
+        Access access = classify_instruction(ctx, instruction);
+        if (access.tag == NoAccess)
+            continue;
+        if (access.tag == Clobber) {
+            for (size_t i = 0; i < entries_count_list(entries);) {
+                if (is_escaping(ctx, read_list(Entry, entries)[i].address.root))
+                    remove_entry(entries, i);
+                else
+                    i++;
+            }
+            continue;
+        }
+        if (!is_thread_private(access.address.as))
+            continue;
+
+        Entry* known = NULL;
+        for (size_t i = 0; i < entries_count_list(entries); i++) {
+            Entry* entry = &read_list(Entry, entries)[i];
+            if (same_address(&entry->address, &access.address) && entry->type == access.type)
+                known = entry;
+        }
+
+        if (access.tag == Load) {
+            Nodes results = get_abstraction_params(get_let_tail(body));
+            if (known && results.count == 1) {
+                // a uniform load can't be replaced by something varying
+                if (!is_qualified_type_uniform(first(results)->type) || is_qualified_type_uniform(known->value->type)) {
+                    insert_dict(const Node*, const Node*, ctx->forwarded, body, known->value);
+                    continue;
+                }
+            }
+            for (size_t i = 0; i < entries_count_list(entries); i++) {
+                Entry* entry = &read_list(Entry, entries)[i];
+                if (may_alias(&entry->address, &access.address))
+                    entry->pending_store = NULL;
+            }
+            if (!known && results.count == 1 && access.address.root) {
+                Entry entry = { .address = access.address, .type = access.type, .value = first(results) };
+                append_list(Entry, entries, entry);
+            }
+            continue;
+        }
+
+        assert(access.tag == Store);
+        for (size_t i = 0; i < entries_count_list(entries);) {
+            Entry* entry = &read_list(Entry, entries)[i];
+            if (!may_alias(&entry->address, &access.address)) {
+                i++;
+                continue;
+            }
+            if (entry->pending_store && same_address(&entry->address, &access.address))
+                insert_set_get_result(const Node*, ctx->dead_stores, entry->pending_store);
+            remove_entry(entries, i);
+        }
+        if (access.address.root) {
+            Entry entry = { .address = access.address, .type = access.type, .value = access.value, .pending_store = body };
+            append_list(Entry, entries, entry);
+        }
+    }
+}
+
+static void analyse_function(Context* ctx, const Node* fn) {
+    Scope* scope = new_scope(fn);
+    ctx->uses = create_uses_map(fn, (NcDeclaration | NcType));
+    // chains start wherever we didn't get to by simply following a let
+    struct Dict* followed = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node);
+    for (size_t i = 0; i < scope->size; i++) {
+        const Node* body = get_abstraction_body(scope->rpo[i]->node);
+        if (body && body->tag == Let_TAG && is_followed_instruction(get_let_instruction(body))) {
+            const Node* tail = get_let_tail(body);
+            insert_set_get_result(const Node*, followed, tail);
+        }
+    }
+    struct List* entries = new_list(Entry);
+    for (size_t i = 0; i < scope->size; i++) {
+        const Node* abs = scope->rpo[i]->node;
+        if (!find_key_dict(const Node*, followed, abs))
+            analyse_let_chain(ctx, entries, abs);
+    }
+    destroy_list(entries);
+    destroy_dict(followed);
+    destroy_uses_map(ctx->uses);
+    ctx->uses = NULL;
+    destroy_scope(scope);
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found) return found;
+
+    switch (node->tag) {
+        case Function_TAG: {
+            if (node->payload.fun.body)
+                analyse_function(ctx, node);
+            break;
+        }
+        case Let_TAG: {
+            const Node* old_tail = get_let_tail(node);
+            if (find_key_dict(const Node*, ctx->dead_stores, node)) {
+                debugv_print("opt_store_forwarding: removing a dead store\n");
+                return rewrite_node(&ctx->rewriter, get_abstraction_body(old_tail));
+            }
+            const Node** value = find_value_dict(const Node*, const Node*, ctx->forwarded, node);
+            if (value) {
+                debugv_print("opt_store_forwarding: forwarding a stored value to a load\n");
+                register_processed(&ctx->rewriter, first(get_abstraction_params(old_tail)), rewrite_node(&ctx->rewriter, *value));
+                return rewrite_node(&ctx->rewriter, get_abstraction_body(old_tail));
+            }
+            break;
+        }
+        default: break;
+    }
+
+    return recreate_node_identity(&ctx->rewriter, node);
+}
+
+Module* opt_store_forwarding(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .dead_stores = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+        .forwarded = new_dict(const Node*, const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+    };
+    rewrite_module(&ctx.rewriter);
+    destroy_rewriter(&ctx.rewriter);
+    destroy_dict(ctx.dead_stores);
+    destroy_dict(ctx.forwarded);
+    return dst;
+}
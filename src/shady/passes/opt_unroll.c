@@ -0,0 +1,322 @@
+#include "passes.h"
+
+#include "log.h"
+#include "portability.h"
+#include "dict.h"
+#include "list.h"
+
+#include "../rewrite.h"
+#include "../type.h"
+#include "../analysis/scope.h"
+
+#include <assert.h>
+
+/// How deep we look into the definition of an exit condition or an induction step
+#define MAX_EVALUATION_DEPTH 16
+
+typedef struct {
+    const Node* old_loop;
+    /// Where the copies look up what was defined before the loop
+    const Rewriter* outer;
+    /// Join point standing in for the loop when it's fully unrolled, NULL if the unrolled body is still a loop
+    const Node* break_point;
+    size_t copies_left;
+} UnrollState;
+
+typedef struct {
+    Rewriter rewriter;
+    const CompilerConfig* config;
+    Scope* scope;
+    UnrollState* unroll;
+} Context;
+
+typedef struct {
+    size_t copies;
+    bool full;
+} UnrollPlan;
+
+/// What we learned about a loop body by looking at its region
+typedef struct {
+    const CFNode* body_node;
+    /// Instructions in the region, which is what each copy costs
+    size_t size;
+    /// The single place the loop continues from
+    const CFNode* continue_node;
+    const Node* continue_args;
+} LoopShape;
+
+/// Computes @p value in the destination arena assuming the loop parameters hold @p env, NULL when that's not a literal
+static const Node* evaluate(Context* ctx, const Node* body, const Node** env, const Node* value, int depth) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    if (depth > MAX_EVALUATION_DEPTH)
+        return NULL;
+    if (is_literal(value))
+        return rewrite_node(&ctx->rewriter, value);
+    if (value->tag != Variable_TAG)
+        return NULL;
+    if (value->payload.var.abs == body)
+        return env[value->payload.var.pindex];
+
+    const Node* def = get_var_def(value->payload.var);
+    if (!def || def->tag != PrimOp_TAG || has_primop_got_side_effects(def->payload.prim_op.op))
+        return NULL;
+    PrimOp payload = def->payload.prim_op;
+    if (payload.op == quote_op)
+        return payload.operands.count == 1 ? evaluate(ctx, body, env, first(payload.operands), depth + 1) : NULL;
+    LARRAY(const Node*, operands, payload.operands.count);
+    for (size_t i = 0; i < payload.operands.count; i++) {
+        operands[i] = evaluate(ctx, body, env, payload.operands.nodes[i], depth + 1);
+        if (!operands[i])
+            return NULL;
+    }
+    const Node* folded = prim_op(a, (PrimOp) {
+        .op = payload.op,
+        .type_arguments = rewrite_nodes(&ctx->rewriter, payload.type_arguments),
+        .operands = nodes(a, payload.operands.count, operands),
+    });
+    if (folded->tag == PrimOp_TAG && folded->payload.prim_op.op == quote_op && folded->payload.prim_op.operands.count == 1 && is_literal(first(folded->payload.prim_op.operands)))
+        return first(folded->payload.prim_op.operands);
+    return NULL;
+}
+
+/// The loop is made of everything the body dominates, we only deal with innermost loops made of structured control flow
+static bool analyse_loop_shape(Context* ctx, const Node* loop, LoopShape* shape) {
+    const Node* body = loop->payload.loop_instr.body;
+    CFNode** found = find_value_dict(const Node*, CFNode*, ctx->scope->map, body);
+    if (!found)
+        return false;
+
+    *shape = (LoopShape) { .body_node = *found };
+    bool ok = true;
+    struct List* region = new_list(CFNode*);
+    append_list(CFNode*, region, *found);
+    for (size_t i = 0; i < entries_count_list(region) && ok; i++) {
+        CFNode* n = read_list(CFNode*, region)[i];
+        for (size_t j = 0; j < n->dominates.count; j++)
+            append_list(CFNode*, region, n->dominates.nodes[j]);
+
+        // basic blocks could be jumped to from anywhere, we can't just copy them
+        if (n->node->tag != Case_TAG) {
+            ok = false;
+            break;
+        }
+        if (cfnode_binds_instruction(n))
+            shape->size++;
+        const Node* terminator = get_abstraction_body(n->node);
+        switch (terminator->tag) {
+            case Let_TAG: {
+                if (get_let_instruction(terminator)->tag == Loop_TAG)
+                    ok = false;
+                break;
+            }
+            case MergeContinue_TAG: {
+                // every continue would get its own copy of the rest of the iterations
+                if (shape->continue_node)
+                    ok = false;
+                shape->continue_node = n;
+                shape->continue_args = terminator;
+                break;
+            }
+            default: break;
+        }
+    }
+    ok &= shape->continue_node != NULL;
+    destroy_list(region);
+    return ok;
+}
+
+/// Looks for an `if` that breaks out of the loop, and that needs to be passed every time the loop continues
+static bool find_exit_condition(const LoopShape* shape, const Node** condition, bool* exit_value) {
+    for (const CFNode* n = shape->continue_node; n != shape->body_node; n = n->idom) {
+        const Node* let = get_abstraction_body(n->idom->node);
+        if (let->tag != Let_TAG || get_let_tail(let) != n->node)
+            continue;
+        const Node* instruction = get_let_instruction(let);
+        if (instruction->tag != If_TAG)
+            continue;
+        If payload = instruction->payload.if_instr;
+        if (get_abstraction_body(payload.if_true)->tag == MergeBreak_TAG) {
+            *condition = payload.condition;
+            *exit_value = true;
+            return true;
+        }
+        if (payload.if_false && get_abstraction_body(payload.if_false)->tag == MergeBreak_TAG) {
+            *condition = payload.condition;
+            *exit_value = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Runs the loop on its literal initial arguments until it's known to exit, without going over the configured limit
+/// @returns the number of times the body runs, or 0 if we don't know
+static size_t compute_trip_count(Context* ctx, const Node* loop, const LoopShape* shape) {
+    const Node* condition;
+    bool exit_value;
+    if (!find_exit_condition(shape, &condition, &exit_value))
+        return 0;
+
+    const Node* body = loop->payload.loop_instr.body;
+    Nodes initial_args = loop->payload.loop_instr.initial_args;
+    Nodes continue_args = shape->continue_args->payload.merge_continue.args;
+    LARRAY(const Node*, env, initial_args.count);
+    LARRAY(const Node*, next, initial_args.count);
+    for (size_t i = 0; i < initial_args.count; i++)
+        env[i] = is_literal(initial_args.nodes[i]) ? rewrite_node(&ctx->rewriter, initial_args.nodes[i]) : NULL;
+
+    for (size_t iteration = 0; iteration < ctx->config->optimisations.unrolling.max_trip_count; iteration++) {
+        const Node* exits = evaluate(ctx, body, env, condition, 0);
+        if (!exits || (exits->tag != True_TAG && exits->tag != False_TAG))
+            return 0;
+        if ((exits->tag == True_TAG) == exit_value)
+            return iteration + 1;
+        for (size_t i = 0; i < continue_args.count; i++)
+            next[i] = evaluate(ctx, body, env, continue_args.nodes[i], 0);
+        for (size_t i = 0; i < continue_args.count; i++)
+            env[i] = next[i];
+    }
+    return 0;
+}
+
+static bool plan_unrolling(Context* ctx, const Node* loop, UnrollPlan* plan) {
+    LoopShape shape;
+    if (!analyse_loop_shape(ctx, loop, &shape))
+        return false;
+    size_t trip_count = compute_trip_count(ctx, loop, &shape);
+    if (trip_count == 0)
+        return false;
+
+    size_t max_size = ctx->config->optimisations.unrolling.max_size;
+    if (trip_count * shape.size <= max_size) {
+        *plan = (UnrollPlan) { .copies = trip_count, .full = true };
+        return true;
+    }
+    // the exit condition is kept in each copy, so the factor doesn't need to divide the trip count
+    size_t factor = max_size / shape.size;
+    if (factor < 2)
+        return false;
+    *plan = (UnrollPlan) { .copies = factor, .full = false };
+    return true;
+}
+
+static const Node* emit_copy(Context* ctx, UnrollState* state, Nodes args) {
+    const Node* old_body = state->old_loop->payload.loop_instr.body;
+    Context copy_ctx = *ctx;
+    copy_ctx.rewriter = create_children_rewriter(state->outer);
+    copy_ctx.unroll = state;
+    assert(state->copies_left > 0);
+    state->copies_left--;
+    register_processed_list(&copy_ctx.rewriter, get_abstraction_params(old_body), args);
+    const Node* body = rewrite_node(&copy_ctx.rewriter, get_abstraction_body(old_body));
+    destroy_rewriter(&copy_ctx.rewriter);
+    return body;
+}
+
+static const Node* unroll_loop(Context* ctx, const Node* old_let, UnrollPlan plan) {
+    IrArena* a = ctx->rewriter.dst_arena;
+    const Node* old_loop = get_let_instruction(old_let);
+    Loop payload = old_loop->payload.loop_instr;
+    Nodes yield_types = rewrite_nodes(&ctx->rewriter, payload.yield_types);
+    Nodes initial_args = rewrite_nodes(&ctx->rewriter, payload.initial_args);
+    UnrollState state = {
+        .old_loop = old_loop,
+        .outer = &ctx->rewriter,
+        .copies_left = plan.copies,
+    };
+
+    const Node* instruction;
+    if (plan.full) {
+        debugv_print("opt_unroll: fully unrolling a loop running %d times\n", (int) plan.copies);
+        const Type* jp_type = qualified_type(a, (QualifiedType) {
+            .type = join_point_type(a, (JoinPointType) { .yield_types = yield_types }),
+            .is_uniform = false,
+        });
+        state.break_point = var(a, jp_type, "unrolled_loop_break_point");
+        const Node* body = emit_copy(ctx, &state, initial_args);
+        instruction = control(a, (Control) {
+            .yield_types = yield_types,
+            .inside = case_(a, singleton(state.break_point), body),
+        });
+    } else {
+        debugv_print("opt_unroll: unrolling a loop %d times\n", (int) plan.copies);
+        Nodes params = recreate_variables(&ctx->rewriter, get_abstraction_params(payload.body));
+        const Node* body = emit_copy(ctx, &state, params);
+        instruction = loop_instr(a, (Loop) {
+            .yield_types = yield_types,
+            .body = case_(a, params, body),
+            .initial_args = initial_args,
+        });
+    }
+    return let(a, instruction, rewrite_node(&ctx->rewriter, get_let_tail(old_let)));
+}
+
+static const Node* process(Context* ctx, const Node* node) {
+    const Node* found = search_processed(&ctx->rewriter, node);
+    if (found) return found;
+
+    IrArena* a = ctx->rewriter.dst_arena;
+
+    switch (node->tag) {
+        case Function_TAG: {
+            Context fn_ctx = *ctx;
+            fn_ctx.scope = new_scope(node);
+            Node* new = recreate_decl_header_identity(&fn_ctx.rewriter, node);
+            recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
+            destroy_scope(fn_ctx.scope);
+            return new;
+        }
+        case Constant_TAG:
+        case GlobalVariable_TAG:
+        case NominalType_TAG: {
+            Context decl_ctx = *ctx;
+            decl_ctx.scope = NULL;
+            return recreate_node_identity(&decl_ctx.rewriter, node);
+        }
+        case Let_TAG: {
+            if (!ctx->scope || get_let_instruction(node)->tag != Loop_TAG)
+                break;
+            UnrollPlan plan;
+            if (!plan_unrolling(ctx, get_let_instruction(node), &plan))
+                break;
+            return unroll_loop(ctx, node, plan);
+        }
+        case MergeContinue_TAG: {
+            UnrollState* state = ctx->unroll;
+            if (!state)
+                break;
+            Nodes args = rewrite_nodes(&ctx->rewriter, node->payload.merge_continue.args);
+            if (state->copies_left > 0)
+                return emit_copy(ctx, state, args);
+            // we ran out of copies where the loop was known to exit
+            if (state->break_point)
+                return unreachable(a);
+            return merge_continue(a, (MergeContinue) { .args = args });
+        }
+        case MergeBreak_TAG: {
+            UnrollState* state = ctx->unroll;
+            if (!state || !state->break_point)
+                break;
+            return join(a, (Join) {
+                .join_point = state->break_point,
+                .args = rewrite_nodes(&ctx->rewriter, node->payload.merge_break.args),
+            });
+        }
+        default: break;
+    }
+
+    return recreate_node_identity(&ctx->rewriter, node);
+}
+
+Module* opt_unroll(const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Context ctx = {
+        .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .config = config,
+    };
+    rewrite_module(&ctx.rewriter);
+    destroy_rewriter(&ctx.rewriter);
+    return dst;
+}
@@ -65,6 +65,9 @@ RewritePass lower_alloca;
 RewritePass lower_stack;
 /// Eliminates lea_op on all physical address spaces
 RewritePass lower_lea;
+/// Works out which address space generic pointers actually point into, so only the ambiguous ones need the tag dispatch
+/// Clones functions for the call sites where this makes generic pointer parameters concrete
+RewritePass opt_resolve_generic_ptrs;
 /// Emulates generic pointers by replacing them with tagged integers and special load/store routines that look at those tags
 RewritePass lower_generic_ptrs;
 /// Emulates physical pointers to certain address spaces by using integer indices into global arrays
@@ -110,8 +113,24 @@ RewritePass eliminate_constants;
 RewritePass mark_leaf_functions;
 /// In addition, also inlines function calls according to heuristics
 RewritePass opt_inline;
+/// Clones callees for the call sites passing them constant or uniform arguments, within a budget
+RewritePass opt_specialize;
 RewritePass opt_mem2reg;
+/// Reuses the results of identical instructions that dominate each other, taking memory and convergence into account
+RewritePass opt_gvn;
+/// Moves loop-invariant instructions out of structured loops
+RewritePass opt_licm;
+/// Forwards values stored to thread-private memory to the loads reading them back, and removes stores overwritten before being read
+RewritePass opt_store_forwarding;
+/// Unrolls structured loops whose trip count is known, fully when they're small enough
+RewritePass opt_unroll;
+/// Propagates constants through parameters, yields and merges, and removes the code that can't be reached as a result
+RewritePass opt_sccp;
+/// Splits aggregate allocas that are only accessed with constant indices into one alloca per element
+OptPass opt_sroa;
 OptPass opt_demote_alloca;
+/// Uses value ranges to perform 64-bit arithmetic on 32-bit integers where the results are provably the same
+RewritePass opt_narrow_int64;
 
 /// Try to identify reconvergence points throughout the program for unstructured control flow programs
 RewritePass reconvergence_heuristics;
@@ -51,8 +51,8 @@ static void gather_exiting_nodes(LoopTree* lt, const CFNode* entry, const CFNode
         return;
     }
 
-    for (size_t i = 0; i < entries_count_list(block->dominates); i++) {
-        const CFNode* target = read_list(CFNode*, block->dominates)[i];
+    for (size_t i = 0; i < block->dominates.count; i++) {
+        const CFNode* target = block->dominates.nodes[i];
         gather_exiting_nodes(lt, entry, target, exiting_nodes);
     }
 }
@@ -337,8 +337,8 @@ static const Node* process_node(Context* ctx, const Node* node) {
             if (entries_count_list(current_loop->cf_nodes)) {
                 bool leaves_loop = false;
                 CFNode* current_node = scope_lookup(ctx->fwd_scope, ctx->current_abstraction);
-                for (size_t i = 0; i < entries_count_list(current_node->succ_edges); i++) {
-                    CFEdge edge = read_list(CFEdge, current_node->succ_edges)[i];
+                for (size_t i = 0; i < current_node->succ_edges.count; i++) {
+                    CFEdge edge = current_node->succ_edges.edges[i];
                     LTNode* lt_target = looptree_lookup(ctx->current_looptree, edge.dst->node);
 
                     if (lt_target->parent != current_loop) {
@@ -153,10 +153,10 @@ static void print_basic_block(PrinterCtx* ctx, const Node* bb) {
 
 static void print_dominated_bbs(PrinterCtx* ctx, const CFNode* dominator) {
     assert(dominator);
-    for (size_t i = 0; i < dominator->dominates->elements_count; i++) {
-        const CFNode* cfnode = read_list(const CFNode*, dominator->dominates)[i];
+    for (size_t i = 0; i < dominator->dominates.count; i++) {
+        const CFNode* cfnode = dominator->dominates.nodes[i];
         // ignore cases that make up basic structural dominance
-        if (find_key_dict(const Node*, dominator->structurally_dominates, cfnode->node))
+        if (cfnode_structurally_dominates(dominator, cfnode))
             continue;
         assert(is_basic_block(cfnode->node));
         print_basic_block(ctx, cfnode->node);
@@ -435,7 +435,7 @@ static void print_value(PrinterCtx* ctx, const Node* node) {
         case FloatLiteral_TAG:
             printf(BBLUE);
             switch (node->payload.float_literal.width) {
-                case FloatTy16: printf("%" PRIu16, (uint16_t) node->payload.float_literal.value); break;
+                case FloatTy16: printf("%.5g", get_float_literal_value(node->payload.float_literal)); break;
                 case FloatTy32: {
                     float f;
                     memcpy(&f, &node->payload.float_literal.value, sizeof(uint32_t));
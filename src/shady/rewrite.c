@@ -30,10 +30,19 @@ Rewriter create_rewriter(Module* src, Module* dst, RewriteNodeFn fn) {
     };
 }
 
+Rewriter create_children_rewriter(const Rewriter* parent) {
+    Rewriter r = *parent;
+    r.map = new_dict(const Node*, Node*, (HashFn) hash_node, (CmpFn) compare_node);
+    r.parent = parent;
+    return r;
+}
+
 void destroy_rewriter(Rewriter* r) {
     assert(r->map);
     destroy_dict(r->map);
-    destroy_dict(r->decls_map);
+    // the declarations map belongs to the root rewriter
+    if (!r->parent)
+        destroy_dict(r->decls_map);
 }
 
 Rewriter create_importer(Module* src, Module* dst) {
@@ -138,10 +147,18 @@ static Nodes rewrite_ops_helper(Rewriter* rewriter, NodeClass class, String op_n
 }
 
 const Node* search_processed(const Rewriter* ctx, const Node* old) {
-    struct Dict* map = is_declaration(old) ? ctx->decls_map : ctx->map;
-    assert(map && "this rewriter has no processed cache");
-    const Node** found = find_value_dict(const Node*, const Node*, map, old);
-    return found ? *found : NULL;
+    if (is_declaration(old)) {
+        assert(ctx->decls_map && "this rewriter has no processed cache");
+        const Node** found = find_value_dict(const Node*, const Node*, ctx->decls_map, old);
+        return found ? *found : NULL;
+    }
+    for (; ctx; ctx = ctx->parent) {
+        assert(ctx->map && "this rewriter has no processed cache");
+        const Node** found = find_value_dict(const Node*, const Node*, ctx->map, old);
+        if (found)
+            return *found;
+    }
+    return NULL;
 }
 
 const Node* find_processed(const Rewriter* ctx, const Node* old) {
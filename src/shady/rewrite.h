@@ -39,12 +39,18 @@ struct Rewriter_ {
     } config;
     struct Dict* map;
     struct Dict* decls_map;
+    /// Non-declaration lookups that miss in map fall back to this rewriter, see create_children_rewriter
+    const Rewriter* parent;
 };
 
 Rewriter create_rewriter(Module* src, Module* dst, RewriteNodeFn fn);
 Rewriter create_importer(Module* src, Module* dst);
 Module* rebuild_module(Module*);
 Rewriter create_substituter(Module* arena);
+/// Creates a rewriter that shares everything with the parent, but records its processed nodes in its own (initially empty) map.
+/// Lookups fall back to the parent, which makes scoped substitutions (inlining a body, trying out a region) cheap,
+/// but the parent must outlive the child and must not be used to register new nodes while the child is alive.
+Rewriter create_children_rewriter(const Rewriter* parent);
 void destroy_rewriter(Rewriter*);
 
 void rewrite_module(Rewriter*);
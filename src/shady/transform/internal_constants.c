@@ -4,7 +4,7 @@
 
 #include <string.h>
 
-void generate_dummy_constants(SHADY_UNUSED CompilerConfig* config, Module* mod) {
+void generate_dummy_constants(CompilerConfig* config, Module* mod) {
     IrArena* arena = get_module_arena(mod);
 #define X(name, T, placeholder) \
     Node* name##_var = constant(mod, nodes(arena, 0, NULL), T, #name); \
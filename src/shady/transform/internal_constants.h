@@ -6,6 +6,7 @@
 #define INTERNAL_CONSTANTS(X) \
 X(SUBGROUP_SIZE, int32_type(arena), uint32_literal(arena, 8)) \
 X(SUBGROUPS_PER_WG, int32_type(arena), uint32_literal(arena, 1)) \
+X(STACK_SIZE, int32_type(arena), uint32_literal(arena, config->per_thread_stack_size)) \
 
 void generate_dummy_constants(CompilerConfig* config, Module*);
 
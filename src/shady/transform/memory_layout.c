@@ -3,10 +3,12 @@
 
 #include "log.h"
 #include "portability.h"
+#include "dict.h"
 
 #include "../type.h"
 
 #include <assert.h>
+#include <string.h>
 
 inline static size_t round_up(size_t a, size_t b) {
     if (b == 0)
@@ -21,15 +23,39 @@ static int maxof(int a, int b) {
     return b;
 }
 
-TypeMemLayout get_record_layout(IrArena* a, const Node* record_type, FieldLayout* fields) {
-    assert(record_type->tag == RecordType_TAG);
+static KeyHash hash_type_ptr(const Type** t) {
+    return hash_murmur(t, sizeof(const Type*));
+}
+
+static bool compare_type_ptr(const Type** a, const Type** b) {
+    return *a == *b;
+}
+
+/// Layouts only depend on the arena's config, so we remember them for the types that live there
+static bool can_memoise_layout(IrArena* a, const Type* type) {
+    return type->arena == a;
+}
+
+typedef struct {
+    TypeMemLayout layout;
+    FieldLayout* fields;
+} RecordLayout;
+
+static TypeMemLayout compute_record_layout(IrArena* a, const Node* record_type, FieldLayout* fields) {
 
     size_t offset = 0;
     size_t max_align = 0;
 
     Nodes member_types = record_type->payload.record_type.members;
     for (size_t i = 0; i < member_types.count; i++) {
-        TypeMemLayout member_layout = get_mem_layout(a, member_types.nodes[i]);
+        const Type* member_type = member_types.nodes[i];
+        TypeMemLayout member_layout;
+        // blocks can end with an array of unknown size, which takes up no room as far as we're concerned
+        if (member_type->tag == ArrType_TAG && !member_type->payload.arr_type.size) {
+            TypeMemLayout element_layout = get_mem_layout(a, member_type->payload.arr_type.element_type);
+            member_layout = (TypeMemLayout) { .type = member_type, .size_in_bytes = 0, .alignment_in_bytes = element_layout.alignment_in_bytes };
+        } else
+            member_layout = get_mem_layout(a, member_type);
         offset = round_up(offset, member_layout.alignment_in_bytes);
         if (fields) {
             fields[i].mem_layout = member_layout;
@@ -47,6 +73,29 @@ TypeMemLayout get_record_layout(IrArena* a, const Node* record_type, FieldLayout
     };
 }
 
+TypeMemLayout get_record_layout(IrArena* a, const Node* record_type, FieldLayout* fields) {
+    assert(record_type->tag == RecordType_TAG);
+    if (!can_memoise_layout(a, record_type))
+        return compute_record_layout(a, record_type, fields);
+
+    if (!a->record_layouts)
+        a->record_layouts = new_dict(const Type*, RecordLayout, (HashFn) hash_type_ptr, (CmpFn) compare_type_ptr);
+    size_t members_count = record_type->payload.record_type.members.count;
+    RecordLayout* found = find_value_dict(const Type*, RecordLayout, a->record_layouts, record_type);
+    if (!found) {
+        RecordLayout new = {
+            .fields = arena_alloc(a->arena, sizeof(FieldLayout) * members_count),
+        };
+        new.layout = compute_record_layout(a, record_type, new.fields);
+        insert_dict(const Type*, RecordLayout, a->record_layouts, record_type, new);
+        found = find_value_dict(const Type*, RecordLayout, a->record_layouts, record_type);
+    }
+
+    if (fields)
+        memcpy(fields, found->fields, sizeof(FieldLayout) * members_count);
+    return found->layout;
+}
+
 size_t get_record_field_offset_in_bytes(IrArena* a, const Type* t, size_t i) {
     assert(t->tag == RecordType_TAG);
     Nodes member_types = t->payload.record_type.members;
@@ -56,7 +105,7 @@ size_t get_record_field_offset_in_bytes(IrArena* a, const Type* t, size_t i) {
     return fields[i].offset_in_bytes;
 }
 
-TypeMemLayout get_mem_layout(IrArena* a, const Type* type) {
+static TypeMemLayout compute_mem_layout(IrArena* a, const Type* type) {
     size_t base_word_size = int_size_in_bytes(a->config.memory.word_size);
     assert(is_type(type));
     switch (type->tag) {
@@ -111,6 +160,21 @@ TypeMemLayout get_mem_layout(IrArena* a, const Type* type) {
     }
 }
 
+TypeMemLayout get_mem_layout(IrArena* a, const Type* type) {
+    if (!can_memoise_layout(a, type))
+        return compute_mem_layout(a, type);
+
+    if (!a->mem_layouts)
+        a->mem_layouts = new_dict(const Type*, TypeMemLayout, (HashFn) hash_type_ptr, (CmpFn) compare_type_ptr);
+    TypeMemLayout* found = find_value_dict(const Type*, TypeMemLayout, a->mem_layouts, type);
+    if (found)
+        return *found;
+
+    TypeMemLayout layout = compute_mem_layout(a, type);
+    insert_dict(const Type*, TypeMemLayout, a->mem_layouts, type, layout);
+    return layout;
+}
+
 const Node* size_t_literal(IrArena* a, uint64_t value) {
     return int_literal(a, (IntLiteral) { .width = a->config.memory.ptr_size, .is_signed = false, .value = value });
 }
@@ -119,7 +183,10 @@ const Node* bytes_to_words(BodyBuilder* bb, const Node* bytes) {
     IrArena* a = bytes->arena;
     const Type* word_type = int_type(a, (Int) { .width = a->config.memory.word_size, .is_signed = false });
     size_t word_width = get_type_bitwidth(word_type);
-    const Node* bytes_per_word = size_t_literal(a, word_width / 8);
+    // follow the type of the operand, offsets into emulated memory are not necessarily pointer-sized
+    const Type* bytes_t = get_unqualified_type(bytes->type);
+    assert(bytes_t->tag == Int_TAG);
+    const Node* bytes_per_word = int_literal(a, (IntLiteral) { .width = bytes_t->payload.int_type.width, .is_signed = bytes_t->payload.int_type.is_signed, .value = word_width / 8 });
     return gen_primop_e(bb, div_op, empty(a), mk_nodes(a, bytes, bytes_per_word));
 }
 
@@ -128,6 +195,22 @@ uint64_t bytes_to_words_static(const IrArena* a, uint64_t bytes) {
     return bytes / word_width;
 }
 
+IntSizes get_emulated_word_size(const CompilerConfig* config, const IrArena* a, AddressSpace as) {
+    IntSizes width;
+    switch (as) {
+        case AsPrivatePhysical:  width = config->lower.emulated_word_size.private_memory; break;
+        case AsSubgroupPhysical: width = config->lower.emulated_word_size.subgroup_memory; break;
+        case AsSharedPhysical:   width = config->lower.emulated_word_size.shared_memory; break;
+        default: width = a->config.memory.word_size; break;
+    }
+    // 64-bit words would have to be emulated themselves
+    if (config->lower.int64 && width > IntTy32)
+        width = IntTy32;
+    if (width < a->config.memory.word_size)
+        width = a->config.memory.word_size;
+    return width;
+}
+
 IntSizes float_to_int_width(FloatSizes width) {
     switch (width) {
         case FloatTy16: return IntTy16;
@@ -22,6 +22,8 @@ size_t get_record_field_offset_in_bytes(IrArena*, const Type*, size_t);
 const Node* size_t_literal(IrArena* a, uint64_t value);
 const Node* bytes_to_words(BodyBuilder* bb, const Node* bytes);
 uint64_t bytes_to_words_static(const IrArena*, uint64_t bytes);
+/// The words backing an emulated address space, never narrower than the arena's word size
+IntSizes get_emulated_word_size(const CompilerConfig*, const IrArena*, AddressSpace);
 IntSizes float_to_int_width(FloatSizes width);
 
 #endif
@@ -22,10 +22,59 @@ static bool are_types_identical(size_t num_types, const Type* types[]) {
     return true;
 }
 
+typedef struct {
+    const Type* supertype;
+    const Type* type;
+} SubtypeQuery;
+
+static KeyHash hash_subtype_query(SubtypeQuery* q) {
+    return hash_murmur(q, sizeof(SubtypeQuery));
+}
+
+static bool compare_subtype_query(SubtypeQuery* a, SubtypeQuery* b) {
+    return a->supertype == b->supertype && a->type == b->type;
+}
+
+static bool is_subtype_impl(const Type* supertype, const Type* type);
+
+/// Whether it's worth remembering the answer, leaf types are cheaper to compare than to look up
+static bool should_memoise_subtype(const Type* t) {
+    switch (t->tag) {
+        case RecordType_TAG:
+        case JoinPointType_TAG:
+        case FnType_TAG:
+        case BBType_TAG:
+        case LamType_TAG:
+        case PtrType_TAG:
+        case ArrType_TAG:
+        case PackType_TAG: return true;
+        default: return false;
+    }
+}
+
 bool is_subtype(const Type* supertype, const Type* type) {
     assert(supertype && type);
+    // types are hash-consed, and subtyping is reflexive
+    if (supertype == type)
+        return true;
     if (supertype->tag != type->tag)
         return false;
+    if (supertype->arena != type->arena || !should_memoise_subtype(type))
+        return is_subtype_impl(supertype, type);
+
+    IrArena* a = type->arena;
+    if (!a->subtypes)
+        a->subtypes = new_dict(SubtypeQuery, bool, (HashFn) hash_subtype_query, (CmpFn) compare_subtype_query);
+    SubtypeQuery query = { .supertype = supertype, .type = type };
+    bool* found = find_value_dict(SubtypeQuery, bool, a->subtypes, query);
+    if (found)
+        return *found;
+    bool result = is_subtype_impl(supertype, type);
+    insert_dict(SubtypeQuery, bool, a->subtypes, query, result);
+    return result;
+}
+
+static bool is_subtype_impl(const Type* supertype, const Type* type) {
     switch (is_type(supertype)) {
         case NotAType: error("supplied not a type to is_subtype");
         case QualifiedType_TAG: {
@@ -180,6 +229,17 @@ bool is_addr_space_uniform(IrArena* arena, AddressSpace as) {
     }
 }
 
+bool is_addr_space_read_only(AddressSpace as) {
+    switch (as) {
+        case AsInput:
+        case AsUInput:
+        case AsPushConstant:
+        case AsUniform:
+        case AsUniformConstant: return true;
+        default: return false;
+    }
+}
+
 const Type* get_actual_mask_type(IrArena* arena) {
     switch (arena->config.specializations.subgroup_mask_representation) {
         case SubgroupMaskAbstract: return mask_type(arena);
@@ -368,6 +428,8 @@ const Type* check_type_record_type(IrArena* arena, RecordType type) {
         // member types are value types iff this is a return tuple
         if (type.special == MultipleReturn)
             assert(is_value_type(type.members.nodes[i]));
+        else if (type.special == DecorateBlock && i + 1 == type.members.count && type.members.nodes[i]->tag == ArrType_TAG && !type.members.nodes[i]->payload.arr_type.size)
+            assert(is_data_type(type.members.nodes[i]->payload.arr_type.element_type)); // blocks may end with a runtime-sized array
         else
             assert(is_data_type(type.members.nodes[i]));
     }
@@ -975,6 +1037,11 @@ const Type* check_type_prim_op(IrArena* arena, PrimOp prim_op) {
                 .type = get_actual_mask_type(arena)
             });
         }
+        case subgroup_barrier_op: {
+            assert(prim_op.type_arguments.count == 0);
+            assert(prim_op.operands.count == 0);
+            return empty_multiple_return_type(arena);
+        }
         case subgroup_elect_first_op: {
             assert(prim_op.type_arguments.count == 0);
             assert(prim_op.operands.count == 0);
@@ -983,6 +1050,25 @@ const Type* check_type_prim_op(IrArena* arena, PrimOp prim_op) {
                 .type = bool_type(arena)
             });
         }
+        case subgroup_shuffle_op:
+        case subgroup_shuffle_xor_op:
+        case subgroup_shuffle_up_op:
+        case subgroup_shuffle_down_op: {
+            assert(prim_op.type_arguments.count == 0);
+            assert(prim_op.operands.count == 2);
+            const Node* value = prim_op.operands.nodes[0];
+            const Node* lane = prim_op.operands.nodes[1];
+            const Type* lane_type = get_unqualified_type(lane->type);
+            assert(lane_type->tag == Int_TAG && !lane_type->payload.int_type.is_signed && lane_type->payload.int_type.width == IntTy32);
+            bool is_uniform = is_qualified_type_uniform(value->type);
+            // with a uniform lane id, every invocation reads from the same one
+            if (prim_op.op == subgroup_shuffle_op)
+                is_uniform |= is_qualified_type_uniform(lane->type);
+            return qualified_type(arena, (QualifiedType) {
+                .is_uniform = is_uniform,
+                .type = get_unqualified_type(value->type)
+            });
+        }
         case subgroup_assume_uniform_op:
         case subgroup_broadcast_first_op:
         case subgroup_reduce_sum_op: {
@@ -1044,6 +1130,25 @@ const Type* check_type_prim_op(IrArena* arena, PrimOp prim_op) {
             assert(is_data_type(element_type));
             return qualified_type(arena, (QualifiedType) { .is_uniform = false, .type = element_type});
         }
+        case push_stack_uniform_op: {
+            assert(prim_op.type_arguments.count == 1);
+            assert(prim_op.operands.count == 1);
+            const Type* element_type = first(prim_op.type_arguments);
+            assert(is_data_type(element_type));
+            const Type* qual_element_type = qualified_type(arena, (QualifiedType) {
+                .is_uniform = true,
+                .type = element_type
+            });
+            assert(is_subtype(qual_element_type, first(prim_op.operands)->type));
+            return empty_multiple_return_type(arena);
+        }
+        case pop_stack_uniform_op: {
+            assert(prim_op.operands.count == 0);
+            assert(prim_op.type_arguments.count == 1);
+            const Type* element_type = prim_op.type_arguments.nodes[0];
+            assert(is_data_type(element_type));
+            return qualified_type(arena, (QualifiedType) { .is_uniform = true, .type = element_type});
+        }
         // Debugging ops
         case debug_printf_op: {
             assert(prim_op.type_arguments.count == 0);
@@ -8,6 +8,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 static bool expect_memstuff = false;
 static bool found_memstuff = false;
@@ -31,7 +32,145 @@ static void search_for_memstuff(Visitor* v, const Node* n) {
     visit_node_operands(v, NcDeclaration, n);
 }
 
+static String expect_inlined = NULL;
+static String expect_not_inlined = NULL;
+static bool found_call_to_inlined = false;
+static bool found_call_to_not_inlined = false;
+
+static void search_for_calls(Visitor* v, const Node* n) {
+    const Node* callee = NULL;
+    if (n->tag == Call_TAG)
+        callee = n->payload.call.callee;
+    else if (n->tag == TailCall_TAG)
+        callee = n->payload.tail_call.target;
+    if (callee && callee->tag == FnAddr_TAG) {
+        String name = get_abstraction_name(callee->payload.fn_addr.fn);
+        if (expect_inlined && strcmp(name, expect_inlined) == 0)
+            found_call_to_inlined = true;
+        if (expect_not_inlined && strcmp(name, expect_not_inlined) == 0)
+            found_call_to_not_inlined = true;
+    }
+
+    visit_node_operands(v, NcDeclaration, n);
+}
+
+static void check_inlining(Module* mod) {
+    Visitor v = {.visit_node_fn = search_for_calls};
+    visit_module(&v, mod);
+    if (expect_inlined && found_call_to_inlined) {
+        error_print("Expected every call to %s to be inlined.\n", expect_inlined);
+        dump_module(mod);
+        exit(-1);
+    }
+    if (expect_not_inlined && !found_call_to_not_inlined) {
+        error_print("Expected some calls to %s to remain.\n", expect_not_inlined);
+        dump_module(mod);
+        exit(-1);
+    }
+    dump_module(mod);
+    exit(0);
+}
+
+/// A node kind (like if_instr), a primop (like load) or a declaration (or a reference to that function) that should show up between min and max times
+/// (only counting what sits inside structured loops if in_loops is set)
+typedef struct {
+    String name;
+    bool in_loops;
+    size_t min, max;
+    size_t found;
+} Expectation;
+
+#define MAX_EXPECTATIONS 16
+static String check_after = NULL;
+static Expectation expectations[MAX_EXPECTATIONS];
+static size_t expectations_count = 0;
+
+static void add_expectation(String name, bool in_loops, size_t min, size_t max) {
+    if (expectations_count == MAX_EXPECTATIONS)
+        error("Too many expectations");
+    expectations[expectations_count++] = (Expectation) { .name = name, .in_loops = in_loops, .min = min, .max = max };
+}
+
+static void count_name(String name, bool in_loops) {
+    for (size_t i = 0; i < expectations_count; i++) {
+        if (expectations[i].in_loops == in_loops && strcmp(expectations[i].name, name) == 0)
+            expectations[i].found++;
+    }
+}
+
+static String get_expectation_name(const Node* n) {
+    return n->tag == PrimOp_TAG ? get_primop_name(n->payload.prim_op.op) : node_tags[n->tag];
+}
+
+static void search_for_expected(Visitor* v, const Node* n) {
+    count_name(get_expectation_name(n), false);
+    if (n->tag == FnAddr_TAG)
+        count_name(get_abstraction_name(n->payload.fn_addr.fn), false);
+    visit_node_operands(v, IGNORE_ABSTRACTIONS_MASK | NcType, n);
+}
+
+static size_t loop_depth = 0;
+
+// walks the structured cases in nesting order instead, basic blocks are not looked into
+static void search_in_loops(Visitor* v, const Node* n) {
+    if (loop_depth > 0)
+        count_name(get_expectation_name(n), true);
+    if (n->tag == Loop_TAG) {
+        visit_nodes(v, n->payload.loop_instr.initial_args);
+        loop_depth++;
+        visit_node(v, n->payload.loop_instr.body);
+        loop_depth--;
+        return;
+    }
+    visit_node_operands(v, NcBasic_block | NcDeclaration | NcType, n);
+}
+
+static void check_expectations(Module* mod) {
+    Visitor v = {.visit_node_fn = search_for_expected};
+    Visitor loops_v = {.visit_node_fn = search_in_loops};
+    Nodes decls = get_module_declarations(mod);
+    for (size_t i = 0; i < decls.count; i++) {
+        const Node* decl = decls.nodes[i];
+        count_name(get_decl_name(decl), false);
+        if (decl->tag == Function_TAG && decl->payload.fun.body) {
+            search_for_expected(&v, decl->payload.fun.body);
+            visit_function_rpo(&v, decl);
+            search_in_loops(&loops_v, decl->payload.fun.body);
+        }
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < expectations_count; i++) {
+        Expectation e = expectations[i];
+        if (e.found < e.min || e.found > e.max) {
+            error_print("Expected %s to show up ", e.name);
+            if (e.min == e.max)
+                error_print("%zu times", e.min);
+            else if (e.max == SIZE_MAX)
+                error_print("at least %zu times", e.min);
+            else
+                error_print("between %zu and %zu times", e.min, e.max);
+            if (e.in_loops)
+                error_print(" inside loops");
+            error_print(" after %s, found it %zu times.\n", check_after, e.found);
+            ok = false;
+        }
+    }
+    dump_module(mod);
+    exit(ok ? 0 : -1);
+}
+
 static void after_pass(void* uptr, String pass_name, Module* mod) {
+    if (check_after) {
+        if (strcmp(pass_name, check_after) == 0)
+            check_expectations(mod);
+        return;
+    }
+    if (expect_inlined || expect_not_inlined) {
+        if (strcmp(pass_name, "opt_inline") == 0)
+            check_inlining(mod);
+        return;
+    }
     if (strcmp(pass_name, "opt_mem2reg") == 0) {
         Visitor v = {.visit_node_fn = search_for_memstuff};
         visit_module(&v, mod);
@@ -58,9 +197,63 @@ static void cli_parse_oracle_args(int* pargc, char** argv) {
             argv[i] = NULL;
             expect_memstuff = true;
             continue;
+        } else if (strcmp(argv[i], "--expect-inlined") == 0) {
+            argv[i] = NULL;
+            i++;
+            if (i == argc)
+                error("Missing function name for --expect-inlined");
+            expect_inlined = argv[i];
+            argv[i] = NULL;
+            continue;
+        } else if (strcmp(argv[i], "--expect-not-inlined") == 0) {
+            argv[i] = NULL;
+            i++;
+            if (i == argc)
+                error("Missing function name for --expect-not-inlined");
+            expect_not_inlined = argv[i];
+            argv[i] = NULL;
+            continue;
+        } else if (strcmp(argv[i], "--after") == 0) {
+            argv[i] = NULL;
+            i++;
+            if (i == argc)
+                error("Missing pass name for --after");
+            check_after = argv[i];
+            argv[i] = NULL;
+            continue;
+        } else if (strcmp(argv[i], "--expect") == 0 || strcmp(argv[i], "--expect-no") == 0) {
+            bool expect_none = strcmp(argv[i], "--expect-no") == 0;
+            argv[i] = NULL;
+            i++;
+            if (i == argc)
+                error("Missing name for --expect");
+            add_expectation(argv[i], false, expect_none ? 0 : 1, expect_none ? 0 : SIZE_MAX);
+            argv[i] = NULL;
+            continue;
+        } else if (strcmp(argv[i], "--expect-count") == 0) {
+            argv[i] = NULL;
+            i += 2;
+            if (i >= argc)
+                error("Missing name or count for --expect-count");
+            size_t count = strtoull(argv[i], NULL, 10);
+            add_expectation(argv[i - 1], false, count, count);
+            argv[i - 1] = NULL;
+            argv[i] = NULL;
+            continue;
+        } else if (strcmp(argv[i], "--expect-none-in-loops") == 0) {
+            argv[i] = NULL;
+            i++;
+            if (i == argc)
+                error("Missing name for --expect-none-in-loops");
+            add_expectation(argv[i], true, 0, 0);
+            argv[i] = NULL;
+            continue;
         }
     }
 
+    if (expectations_count > 0 && !check_after)
+        error("Expectations need a pass to check them after, see --after");
+
     cli_pack_remaining_args(pargc, argv);
 }
 
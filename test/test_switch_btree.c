@@ -0,0 +1,97 @@
+#include "shady/ir.h"
+#include "shady/driver.h"
+
+#include "log.h"
+#include "portability.h"
+
+#include "../src/shady/type.h"
+#include "../src/shady/visit.h"
+#include "../src/shady/passes/passes.h"
+
+#include <stdlib.h>
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+// Matches only exist at that stage in generated code (like the dispatcher), so we build one by hand
+static Module* build_match(IrArena* a, const uint64_t* keys, size_t count) {
+    Module* m = new_module(a, "switch_btree");
+    const Type* t = qualified_type_helper(int32_type(a), false);
+    const Node* x = var(a, t, "x");
+    Node* fn = function(m, singleton(x), "f", singleton(annotation(a, (Annotation) { .name = "Exported" })), singleton(t));
+
+    LARRAY(const Node*, literals, count);
+    LARRAY(const Node*, cases, count);
+    for (size_t i = 0; i < count; i++) {
+        literals[i] = int32_literal(a, keys[i]);
+        cases[i] = case_(a, empty(a), yield(a, (Yield) { .args = singleton(int32_literal(a, i)) }));
+    }
+
+    BodyBuilder* bb = begin_body(a);
+    Nodes results = bind_instruction(bb, match_instr(a, (Match) {
+        .yield_types = singleton(int32_type(a)),
+        .inspect = x,
+        .literals = nodes(a, count, literals),
+        .cases = nodes(a, count, cases),
+        .default_case = case_(a, empty(a), yield(a, (Yield) { .args = singleton(int32_literal(a, -1)) })),
+    }));
+    fn->payload.fun.body = finish_body(bb, fn_ret(a, (Return) { .fn = fn, .args = results }));
+    return m;
+}
+
+static size_t matches_count;
+static size_t ifs_count;
+
+static void count_selections(Visitor* v, const Node* n) {
+    if (n->tag == Match_TAG)
+        matches_count++;
+    if (n->tag == If_TAG)
+        ifs_count++;
+    visit_node_operands(v, NcDeclaration | NcType, n);
+}
+
+static void lower_and_count(IrArena* a, const uint64_t* keys, size_t count) {
+    CompilerConfig config = default_compiler_config();
+    Module* lowered = lower_switch_btree(&config, build_match(a, keys, count));
+    matches_count = 0;
+    ifs_count = 0;
+    Visitor v = { .visit_node_fn = count_selections };
+    visit_module(&v, lowered);
+    destroy_ir_arena(get_module_arena(lowered));
+}
+
+/// A dense set of keys stays a single Match, which the backends emit as a native switch
+static void test_dense(IrArena* a) {
+    uint64_t keys[] = { 3, 0, 1, 2, 5, 6 };
+    lower_and_count(a, keys, sizeof(keys) / sizeof(keys[0]));
+    CHECK(matches_count == 1, exit(-1));
+    CHECK(ifs_count == 0, exit(-1));
+}
+
+/// Keys spread too thin become a tree of comparisons
+static void test_sparse(IrArena* a) {
+    uint64_t keys[] = { 10, 500, 70000, 3, 90, 1000000 };
+    lower_and_count(a, keys, sizeof(keys) / sizeof(keys[0]));
+    CHECK(matches_count == 0, exit(-1));
+    CHECK(ifs_count > 0, exit(-1));
+}
+
+/// Dense clusters within sparse keys become smaller Matches at the leaves of the tree
+static void test_clustered(IrArena* a) {
+    uint64_t keys[] = { 0, 1, 2, 3, 4, 1000, 50000, 50001, 50002, 50003 };
+    lower_and_count(a, keys, sizeof(keys) / sizeof(keys[0]));
+    CHECK(matches_count == 2, exit(-1));
+    CHECK(ifs_count > 0, exit(-1));
+}
+
+int main(int argc, char** argv) {
+    cli_parse_common_args(&argc, argv);
+
+    ArenaConfig acfg = default_arena_config();
+    acfg.name_bound = true;
+    acfg.check_types = true;
+    IrArena* a = new_ir_arena(acfg);
+    test_dense(a);
+    test_sparse(a);
+    test_clustered(a);
+    destroy_ir_arena(a);
+}